@@ -7,6 +7,7 @@ uniform float frameno;
 uniform vec4 particleprops; /* ( lifetime divisor 0.05 is good, alpha, upward speed, ? ) */
 layout(location = 0) in vec4 position;
 layout(location = 1) in vec4 icolor;
+layout(location = 2) in float iframe; // The frame the dot was made on, modulo max_frameno.
 out vec4 vColor;
 out vec4 direction_forward;
 out vec4 worldspace_camera;
@@ -23,7 +24,7 @@ void main()
 	vec4 personpos = modelviewinverse * vec4( 0., 0., 0., 1. );
 	float distance_to_person = length( position.xyz - personpos.xyz );
 	
-	frameage = frameno - icolor.a; 
+	frameage = frameno - iframe; 
 	if( frameage < 0 ) frameage += max_frameno;
 	frameage /= distance_to_person + .1; // ** Ali **Far Objects Last Longer
 
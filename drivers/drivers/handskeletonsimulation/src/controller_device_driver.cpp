@@ -4,6 +4,11 @@
 #include "driverlog.h"
 #include "vrmath.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
 // Let's create some variables for strings used in getting settings.
 // This is the section where all of the settings we want are stored. A section name can be anything,
 // but if you want to store driver specific settings, it's best to namespace the section with the driver identifier
@@ -17,6 +22,27 @@ static const char *my_controller_left_settings_section = "driver_handskeletonsim
 // These are the keys we want to retrieve the values for in the settings
 static const char *my_controller_settings_key_model_number = "model_number";
 static const char *my_controller_settings_key_serial_number = "serial_number";
+static const char *my_controller_settings_key_network_input = "network_input";
+static const char *my_controller_settings_key_animation_clip = "animation_clip";
+static const char *my_controller_settings_key_animation_clip_weight = "animation_clip_weight";
+static const char *my_controller_settings_key_animation_clip_additive = "animation_clip_additive";
+
+// Size of the NetFramePayload_HandCurlSplay payload
+static const uint16_t k_unHandCurlSplayPayloadSize = 40;
+
+// How far each finger (thumb, index, middle, ring, pinky) can curl in the WithController range, where the hand is wrapped
+// around a controller's grip rather than making a fist. The thumb rests on the controller's face, so it curls less.
+static constexpr MyFingerCurls k_withControllerMaxCurls = { 0.5f, 0.75f, 0.75f, 0.75f, 0.75f };
+
+// How long the network input thread waits for a glove frame before updating the pose anyway
+static const int k_nInputSocketTimeoutMs = 5;
+
+// Where the hands sit relative to the hmd, folded at compile time rather than rebuilt on every pose.
+// Each hand is turned so its palm faces inwards, moved 0.15m to its side, up a little to be more in view and 0.5m forward
+// in front of the hmd so we can see it.
+static constexpr vr::HmdQuaternion_t k_qHandOffsetOrientation = HmdQuaternion_FromEulerAnglesConstexpr( DEG_TO_RAD( 90.0 ), DEG_TO_RAD( 90.0 ), 0.0 );
+static constexpr vr::HmdVector3_t k_vecLeftHandOffsetPosition = { -0.15f, 0.1f, -0.5f };
+static constexpr vr::HmdVector3_t k_vecRightHandOffsetPosition = { 0.15f, 0.1f, -0.5f };
 
 
 MyControllerDeviceDriver::MyControllerDeviceDriver( vr::ETrackedControllerRole role )
@@ -46,6 +72,16 @@ MyControllerDeviceDriver::MyControllerDeviceDriver( vr::ETrackedControllerRole r
 	// "<driver_name>:". You can search this in the top search bar to find the info that you've logged.
 	DriverLog( "My Controller Model Number: %s", my_controller_model_number_.c_str() );
 	DriverLog( "My Controller Serial Number: %s", my_controller_serial_number_.c_str() );
+
+	// Whether finger curls and splays come from a glove over the network, or from our own animation
+	use_network_input_ = vr::VRSettings()->GetBool( my_controller_main_settings_section, my_controller_settings_key_network_input );
+
+	// An optional hand clip to play over the finger input. At full weight in override mode it replaces it entirely.
+	char animation_clip[ 1024 ];
+	vr::VRSettings()->GetString( my_controller_main_settings_section, my_controller_settings_key_animation_clip, animation_clip, sizeof( animation_clip ) );
+	animation_clip_path_ = animation_clip;
+	animation_clip_weight_ = vr::VRSettings()->GetFloat( my_controller_main_settings_section, my_controller_settings_key_animation_clip_weight );
+	animation_clip_additive_ = vr::VRSettings()->GetBool( my_controller_main_settings_section, my_controller_settings_key_animation_clip_additive );
 }
 
 //-----------------------------------------------------------------------------
@@ -105,9 +141,36 @@ vr::EVRInitError MyControllerDeviceDriver::Activate( uint32_t unObjectId )
 	// initialise our hand tracking simulation class
 	my_hand_simulation_ = std::make_unique< MyHandSimulation >();
 
+	// Map the animation clip, if we have one. Without it we just show the finger input.
+	if ( !animation_clip_path_.empty() )
+	{
+		animation_clip_ = std::make_unique< HandClipFile >();
+		if ( animation_clip_->Open( animation_clip_path_.c_str() ) )
+		{
+			animation_tree_ = std::make_unique< HandBlendTree >( my_controller_role_ );
+			animation_tree_->AddClipLayer( &animation_clip_->GetClip(), animation_clip_additive_ ? HandBlendMode_Additive : HandBlendMode_Override, animation_clip_weight_, 0.0 );
+			animation_start_ = std::chrono::steady_clock::now();
+		}
+		else
+		{
+			animation_clip_.reset();
+		}
+	}
+
+	// If we can't listen for the glove, carry on with the animation so the hand still shows up
+	if ( use_network_input_ && !MyOpenInputSocket() )
+	{
+		DriverLog( "Falling back to simulated finger input" );
+		use_network_input_ = false;
+	}
+
 	// create a thread for updating our skeleton
 	is_active_ = true;
-	my_input_thread_ = std::thread( &MyControllerDeviceDriver::MyInputThread, this );
+	has_submitted_skeleton_ = false;
+	if ( use_network_input_ )
+		my_input_thread_ = std::thread( &MyControllerDeviceDriver::MyNetworkInputThread, this );
+	else
+		my_input_thread_ = std::thread( &MyControllerDeviceDriver::MyInputThread, this );
 
 	// We've activated everything successfully!
 	// Let's tell SteamVR that by saying we don't have any errors.
@@ -133,6 +196,15 @@ void MyControllerDeviceDriver::DebugRequest( const char *pchRequest, char *pchRe
 {
 	if ( unResponseBufferSize >= 1 )
 		pchResponseBuffer[ 0 ] = 0;
+
+	// "link_stats" returns the glove link counters when using network input
+	if ( strcmp( pchRequest, "link_stats" ) == 0 && unResponseBufferSize > 0 )
+	{
+		const NetLinkStats stats = link_tracker_.GetStats();
+		snprintf( pchResponseBuffer, unResponseBufferSize, "accepted=%llu lost=%llu late=%llu duplicate=%llu corrupt=%llu",
+			( unsigned long long )stats.frames_accepted, ( unsigned long long )stats.frames_lost, ( unsigned long long )stats.frames_late,
+			( unsigned long long )stats.frames_duplicate, ( unsigned long long )stats.frames_corrupt );
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -157,6 +229,11 @@ void MyControllerDeviceDriver::Deactivate()
 	{
 		my_input_thread_.join();
 	}
+
+	MyCloseInputSocket();
+
+	animation_tree_.reset();
+	animation_clip_.reset();
 }
 
 
@@ -186,16 +263,10 @@ vr::DriverPose_t MyControllerDeviceDriver::GetPose()
 	// Get the orientation of the hmd from the 3x4 matrix GetRawTrackedDevicePoses returns
 	const vr::HmdQuaternion_t hmd_orientation = HmdQuaternion_FromMatrix( hmd_pose.mDeviceToAbsoluteTracking );
 
-	const vr::HmdQuaternion_t offset_orientation = HmdQuaternion_FromEulerAngles( DEG_TO_RAD( 90.f ), DEG_TO_RAD( 90.f ), 0.f );
-
 	// Set the pose orientation to the hmd orientation with the offset applied.
-	pose.qRotation = hmd_orientation * offset_orientation;
+	pose.qRotation = hmd_orientation * k_qHandOffsetOrientation;
 
-	const vr::HmdVector3_t offset_position = {
-		my_controller_role_ == vr::TrackedControllerRole_LeftHand ? -0.15f : 0.15f, // translate the controller left/right 0.15m depending on its role
-		0.1f,																		// shift it up a little to make it more in view
-		-0.5f,																		// put each controller 0.5m forward in front of the hmd so we can see it.
-	};
+	const vr::HmdVector3_t &offset_position = my_controller_role_ == vr::TrackedControllerRole_LeftHand ? k_vecLeftHandOffsetPosition : k_vecRightHandOffsetPosition;
 
 	// Rotate our offset by the hmd quaternion (so the controllers are always facing towards us), and add then add the position of the hmd to put it into position.
 	const vr::HmdVector3_t position = hmd_position + ( offset_position * hmd_orientation );
@@ -254,15 +325,8 @@ void MyControllerDeviceDriver::MyInputThread()
 		}
 
 
-		vr::VRBoneTransform_t transforms[ 31 ];
 		// Pass our calculated curl and splay values to our skeleton simulation model to compute the bone transforms for.
-		my_hand_simulation_->ComputeSkeletonTransforms(
-			my_controller_role_, { last_curl_, last_curl_, last_curl_, last_curl_, last_curl_ }, { last_splay_, last_splay_, last_splay_, last_splay_, last_splay_ }, transforms );
-		// Update the skeleton components.
-		// Applications can choose between using a skeleton as if it's holding a controller, or an interpretation with having it without one.
-		// As ours is just a simulation, let's just set them to the same transforms.
-		vr::VRDriverInput()->UpdateSkeletonComponent( input_handles_[ MyComponent_skeleton ], vr::VRSkeletalMotionRange_WithController, transforms, 31 );
-		vr::VRDriverInput()->UpdateSkeletonComponent( input_handles_[ MyComponent_skeleton ], vr::VRSkeletalMotionRange_WithoutController, transforms, 31 );
+		MySubmitSkeleton( { last_curl_, last_curl_, last_curl_, last_curl_, last_curl_ }, { last_splay_, last_splay_, last_splay_, last_splay_, last_splay_ } );
 
 
 		// We'll also update our pose here as well
@@ -273,6 +337,192 @@ void MyControllerDeviceDriver::MyInputThread()
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Computes the skeleton for the given curls and splays, blends any animation clip over it and hands it to
+// SteamVR. Without a clip playing, nothing is done if the input is what we submitted last time.
+// Also updates the finger scalar components.
+//-----------------------------------------------------------------------------
+void MyControllerDeviceDriver::MySubmitSkeleton( const MyFingerCurls &curls, const MyFingerSplays &splays )
+{
+	if ( !animation_tree_ && has_submitted_skeleton_ && memcmp( &curls, &submitted_curls_, sizeof( curls ) ) == 0 && memcmp( &splays, &submitted_splays_, sizeof( splays ) ) == 0 )
+		return;
+
+	has_submitted_skeleton_ = true;
+	submitted_curls_ = curls;
+	submitted_splays_ = splays;
+
+	// Applications can choose between using a skeleton as if it's holding a controller, or an interpretation with having it
+	// without one. Without one, the hand follows the curls as they are. With one, the fingers stop where they would close
+	// around the controller's grip.
+	const MyFingerCurls grip_curls = {
+		std::min( curls.thumb, k_withControllerMaxCurls.thumb ),
+		std::min( curls.index, k_withControllerMaxCurls.index ),
+		std::min( curls.middle, k_withControllerMaxCurls.middle ),
+		std::min( curls.ring, k_withControllerMaxCurls.ring ),
+		std::min( curls.pinky, k_withControllerMaxCurls.pinky ),
+	};
+
+	vr::VRBoneTransform_t transforms[ eBone_Count ] = {};
+	vr::VRBoneTransform_t grip_transforms[ eBone_Count ] = {};
+	my_hand_simulation_->ComputeSkeletonTransforms( my_controller_role_, curls, splays, transforms );
+	my_hand_simulation_->ComputeSkeletonTransforms( my_controller_role_, grip_curls, splays, grip_transforms );
+
+	if ( animation_tree_ )
+	{
+		const double animation_time = std::chrono::duration< double >( std::chrono::steady_clock::now() - animation_start_ ).count();
+		animation_tree_->Evaluate( animation_time, transforms );
+		animation_tree_->Evaluate( animation_time, grip_transforms );
+	}
+
+	// Update the skeleton components.
+	vr::VRDriverInput()->UpdateSkeletonComponent( input_handles_[ MyComponent_skeleton ], vr::VRSkeletalMotionRange_WithController, grip_transforms, eBone_Count );
+	vr::VRDriverInput()->UpdateSkeletonComponent( input_handles_[ MyComponent_skeleton ], vr::VRSkeletalMotionRange_WithoutController, transforms, eBone_Count );
+
+	vr::VRDriverInput()->UpdateScalarComponent( input_handles_[ MyComponent_indexFinger ], curls.index, 0.0 );
+	vr::VRDriverInput()->UpdateScalarComponent( input_handles_[ MyComponent_middleFinger ], curls.middle, 0.0 );
+	vr::VRDriverInput()->UpdateScalarComponent( input_handles_[ MyComponent_ringFinger ], curls.ring, 0.0 );
+	vr::VRDriverInput()->UpdateScalarComponent( input_handles_[ MyComponent_pinkyFinger ], curls.pinky, 0.0 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Binds the UDP socket the glove for our hand sends its frames to.
+//-----------------------------------------------------------------------------
+bool MyControllerDeviceDriver::MyOpenInputSocket()
+{
+#if defined( _WIN32 )
+	WSADATA wsa_data;
+	if ( WSAStartup( MAKEWORD( 2, 2 ), &wsa_data ) != 0 )
+	{
+		DriverLog( "WSAStartup failed" );
+		return false;
+	}
+#endif
+
+	const int port = my_controller_role_ == vr::TrackedControllerRole_LeftHand ? GLOVE_PORT_LEFT : GLOVE_PORT_RIGHT;
+
+	input_socket_ = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	if ( input_socket_ == INVALID_SOCKET )
+	{
+		DriverLog( "Failed to create glove input socket" );
+		MyCloseInputSocket();
+		return false;
+	}
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl( INADDR_ANY );
+	address.sin_port = htons( ( u_short )port );
+
+	if ( bind( input_socket_, ( sockaddr * )&address, sizeof( address ) ) == SOCKET_ERROR )
+	{
+		DriverLog( "Failed to bind glove input socket to port %d", port );
+		MyCloseInputSocket();
+		return false;
+	}
+
+	// Don't block forever, the input thread needs to keep updating our pose and notice when we deactivate
+#if defined( _WIN32 )
+	DWORD timeout = k_nInputSocketTimeoutMs;
+	setsockopt( input_socket_, SOL_SOCKET, SO_RCVTIMEO, ( const char * )&timeout, sizeof( timeout ) );
+#else
+	timeval timeout = { 0, k_nInputSocketTimeoutMs * 1000 };
+	setsockopt( input_socket_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+#endif
+
+	link_tracker_.ResetSequence();
+
+	DriverLog( "Listening for %s hand glove input on UDP port %d", my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "left" : "right", port );
+	return true;
+}
+
+void MyControllerDeviceDriver::MyCloseInputSocket()
+{
+	if ( input_socket_ != INVALID_SOCKET )
+	{
+#if defined( _WIN32 )
+		closesocket( input_socket_ );
+#else
+		close( input_socket_ );
+#endif
+		input_socket_ = INVALID_SOCKET;
+	}
+
+#if defined( _WIN32 )
+	if ( use_network_input_ )
+		WSACleanup();
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Whether every curl and splay of a NetFramePayload_HandCurlSplay frame is a finite number. Other frames have
+// nothing to check.
+//-----------------------------------------------------------------------------
+static bool IsFiniteHandFrame( const NetFrame &frame )
+{
+	if ( frame.payload_type != NetFramePayload_HandCurlSplay || frame.payload_length < k_unHandCurlSplayPayloadSize )
+		return true;
+
+	float values[ 10 ];
+	memcpy( values, frame.payload, sizeof( values ) );
+	for ( float value : values )
+	{
+		if ( !std::isfinite( value ) )
+			return false;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Like MyInputThread, but the curls and splays come from the glove. The skeleton is updated whenever a newer
+// frame arrives, so at the glove's own rate, rather than on a timer.
+//-----------------------------------------------------------------------------
+void MyControllerDeviceDriver::MyNetworkInputThread()
+{
+	while ( is_active_ )
+	{
+		uint8_t buffer[ k_unNetFrameMaxSize ];
+		const int received = recv( input_socket_, ( char * )buffer, sizeof( buffer ), 0 );
+
+		if ( received > 0 )
+		{
+			NetFrame frame;
+			size_t consumed = 0;
+
+			if ( NetFrame_Decode( buffer, received, frame, consumed ) != NetFrameResult_Ok || consumed != ( size_t )received )
+			{
+				link_tracker_.OnCorrupt();
+			}
+			else if ( !IsFiniteHandFrame( frame ) )
+			{
+				// A glove sending NaN or infinity is as broken as a bad checksum, and must not reach the skeleton
+				link_tracker_.OnCorrupt();
+			}
+			else if ( link_tracker_.OnFrame( frame.sequence ) == NetLinkTracker::Verdict_InOrder ) // drop late and duplicate frames
+			{
+				if ( frame.payload_type == NetFramePayload_HandCurlSplay && frame.payload_length >= k_unHandCurlSplayPayloadSize )
+				{
+					float values[ 10 ];
+					memcpy( values, frame.payload, sizeof( values ) );
+
+					MySubmitSkeleton( { values[ 0 ], values[ 1 ], values[ 2 ], values[ 3 ], values[ 4 ] }, { values[ 5 ], values[ 6 ], values[ 7 ], values[ 8 ], values[ 9 ] } );
+				}
+				else
+				{
+					DriverLog( "Unexpected frame from glove: type %d, %d bytes", frame.payload_type, frame.payload_length );
+				}
+			}
+		}
+		else if ( animation_tree_ && has_submitted_skeleton_ )
+		{
+			// Keep the animation playing between glove frames
+			MySubmitSkeleton( submitted_curls_, submitted_splays_ );
+		}
+
+		// Our pose follows the hmd, so keep it moving whether or not the glove sent anything
+		vr::VRServerDriverHost()->TrackedDevicePoseUpdated( my_controller_index_, GetPose(), sizeof( vr::DriverPose_t ) );
+	}
+}
+
 
 //-----------------------------------------------------------------------------
 // Purpose: Our IServerTrackedDeviceProvider needs our serial number to add us to vrserver.
@@ -3,14 +3,34 @@
 
 #include <array>
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <string>
 #include <thread>
 
+#include "hand_animation.h"
 #include "hand_simulation.h"
+#include "netframe.h"
 
 #include "openvr_driver.h"
 
+#if defined( _WIN32 )
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+#include <winsock2.h>
+#pragma comment( lib, "Ws2_32.lib" )
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define INVALID_SOCKET -1
+#define SOCKET_ERROR -1
+typedef int SOCKET;
+#endif
+
+// UDP ports the gloves send their curl and splay frames to, when network_input is enabled
+#define GLOVE_PORT_LEFT 12347
+#define GLOVE_PORT_RIGHT 12348
 
 enum MyComponent
 {
@@ -53,6 +73,12 @@ public:
 
 private:
 	void MyInputThread();
+	void MyNetworkInputThread();
+
+	bool MyOpenInputSocket();
+	void MyCloseInputSocket();
+
+	void MySubmitSkeleton( const MyFingerCurls &curls, const MyFingerSplays &splays );
 
 	std::thread my_input_thread_;
 
@@ -64,6 +90,24 @@ private:
 	std::atomic< float > last_curl_ = 0.f;
 	std::atomic< float > last_splay_ = 0.f;
 
+	// Per-finger input from a glove over the network (see netframe.h), instead of the synthetic animation above
+	bool use_network_input_ = false;
+	SOCKET input_socket_ = INVALID_SOCKET;
+	NetLinkTracker link_tracker_;
+
+	// What the skeleton was last computed from, so it is only recomputed when the input changes
+	bool has_submitted_skeleton_ = false;
+	MyFingerCurls submitted_curls_{};
+	MyFingerSplays submitted_splays_{};
+
+	// A recorded animation layered over the finger input (see hand_animation.h), when animation_clip is set
+	std::string animation_clip_path_;
+	float animation_clip_weight_ = 1.f;
+	bool animation_clip_additive_ = false;
+	std::unique_ptr< HandClipFile > animation_clip_;
+	std::unique_ptr< HandBlendTree > animation_tree_;
+	std::chrono::steady_clock::time_point animation_start_;
+
 	vr::TrackedDeviceIndex_t my_controller_index_ = vr::k_unTrackedDeviceIndexInvalid;
 
 	vr::ETrackedControllerRole my_controller_role_ = vr::TrackedControllerRole_Invalid;
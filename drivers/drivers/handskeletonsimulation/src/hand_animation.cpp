@@ -0,0 +1,417 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "hand_animation.h"
+
+#include "driverlog.h"
+#include "vrmath_simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if defined( _WIN32 )
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const float k_flOrientationScale = 32767.f;
+
+static const vr::VRBoneTransform_t k_IdentityBoneTransform = { { 0.f, 0.f, 0.f, 1.f }, { 1.f, 0.f, 0.f, 0.f } };
+
+// Bones whose mirror swaps quaternion components, see ComputeBoneTransformMetacarpal in hand_simulation.cpp
+static bool IsMetacarpal( int bone )
+{
+	return bone == eBone_Thumb0 || bone == eBone_IndexFinger0 || bone == eBone_MiddleFinger0 || bone == eBone_RingFinger0 || bone == eBone_PinkyFinger0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Converts a bone transform between the left and right hand, the same way the hand simulation builds its right
+// hand from the left one. Applying it twice gives back the same rotation.
+//-----------------------------------------------------------------------------
+static void MirrorBoneTransform( int bone, vr::VRBoneTransform_t &transform )
+{
+	transform.position.v[ 0 ] = -transform.position.v[ 0 ];
+
+	vr::HmdQuaternionf_t &q = transform.orientation;
+	if ( IsMetacarpal( bone ) )
+	{
+		q = { q.x, -q.w, q.z, -q.y };
+	}
+	else if ( bone < eBone_Thumb0 || bone >= eBone_Aux_Thumb )
+	{
+		// The root, wrist and aux bones are in the skeleton's space, which is reflected across its yz plane
+		q.y = -q.y;
+		q.z = -q.z;
+	}
+}
+
+static void DecodeBoneKey( const HandClipBoneKey &key, vr::VRBoneTransform_t &out_transform )
+{
+	out_transform.position = { key.position[ 0 ], key.position[ 1 ], key.position[ 2 ], 1.f };
+	out_transform.orientation = {
+		key.orientation[ 0 ] / k_flOrientationScale,
+		key.orientation[ 1 ] / k_flOrientationScale,
+		key.orientation[ 2 ] / k_flOrientationScale,
+		key.orientation[ 3 ] / k_flOrientationScale,
+	};
+}
+
+static int16_t EncodeOrientationComponent( float value )
+{
+	return ( int16_t )std::lround( std::min( std::max( value, -1.f ), 1.f ) * k_flOrientationScale );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: out = a + ( b - a ) * t, with b's orientation flipped into a's hemisphere and the result renormalized
+//-----------------------------------------------------------------------------
+static void BlendBoneTransform( const vr::VRBoneTransform_t &a, const vr::VRBoneTransform_t &b, float t, vr::VRBoneTransform_t &out_transform )
+{
+	for ( int i = 0; i < 3; i++ )
+		out_transform.position.v[ i ] = a.position.v[ i ] + ( b.position.v[ i ] - a.position.v[ i ] ) * t;
+	out_transform.position.v[ 3 ] = 1.f;
+
+	out_transform.orientation = HmdQuaternionf_Nlerp( a.orientation, b.orientation, t );
+}
+
+bool HandClip::FromMemory( const void *data, size_t size, HandClip &out_clip )
+{
+	out_clip = HandClip();
+
+	if ( !data || size < sizeof( HandClipFileHeader ) )
+		return false;
+
+	const HandClipFileHeader *header = static_cast< const HandClipFileHeader * >( data );
+	if ( header->magic != k_unHandClipMagic || header->version != k_unHandClipVersion || header->bone_count != eBone_Count || header->key_count == 0 )
+		return false;
+
+	const size_t times_size = ( size_t )header->key_count * sizeof( float );
+	const size_t keys_size = ( size_t )header->key_count * eBone_Count * sizeof( HandClipBoneKey );
+	if ( size < sizeof( HandClipFileHeader ) + times_size + keys_size )
+		return false;
+
+	const float *key_times = reinterpret_cast< const float * >( header + 1 );
+
+	// Key times have to be usable for searching
+	if ( !( key_times[ 0 ] == 0.f ) || !( header->duration >= key_times[ header->key_count - 1 ] ) )
+		return false;
+	for ( uint32_t key = 1; key < header->key_count; key++ )
+	{
+		if ( !( key_times[ key ] > key_times[ key - 1 ] ) )
+			return false;
+	}
+
+	out_clip.header = header;
+	out_clip.key_times = key_times;
+	out_clip.keys = reinterpret_cast< const HandClipBoneKey * >( key_times + header->key_count );
+	return true;
+}
+
+vr::ETrackedControllerRole HandClip::Role() const
+{
+	return ( header->flags & HandClipFlag_RightHand ) ? vr::TrackedControllerRole_RightHand : vr::TrackedControllerRole_LeftHand;
+}
+
+bool HandClip_WriteFile( const char *path, const float *key_times, const vr::VRBoneTransform_t *keys, uint32_t key_count, float duration, uint32_t flags )
+{
+	FILE *file = fopen( path, "wb" );
+	if ( !file )
+		return false;
+
+	HandClipFileHeader header{};
+	header.magic = k_unHandClipMagic;
+	header.version = k_unHandClipVersion;
+	header.bone_count = eBone_Count;
+	header.key_count = key_count;
+	header.flags = flags;
+	header.duration = duration;
+
+	bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1 && fwrite( key_times, sizeof( float ), key_count, file ) == key_count;
+
+	for ( size_t i = 0; ok && i < ( size_t )key_count * eBone_Count; i++ )
+	{
+		const vr::VRBoneTransform_t &transform = keys[ i ];
+
+		HandClipBoneKey key;
+		key.position[ 0 ] = transform.position.v[ 0 ];
+		key.position[ 1 ] = transform.position.v[ 1 ];
+		key.position[ 2 ] = transform.position.v[ 2 ];
+		key.orientation[ 0 ] = EncodeOrientationComponent( transform.orientation.w );
+		key.orientation[ 1 ] = EncodeOrientationComponent( transform.orientation.x );
+		key.orientation[ 2 ] = EncodeOrientationComponent( transform.orientation.y );
+		key.orientation[ 3 ] = EncodeOrientationComponent( transform.orientation.z );
+
+		ok = fwrite( &key, sizeof( key ), 1, file ) == 1;
+	}
+
+	return fclose( file ) == 0 && ok;
+}
+
+HandClipFile::~HandClipFile()
+{
+	Close();
+}
+
+bool HandClipFile::Open( const char *path )
+{
+	Close();
+
+#if defined( _WIN32 )
+	HANDLE file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if ( file == INVALID_HANDLE_VALUE )
+	{
+		DriverLog( "Failed to open hand clip %s (error %lu)", path, GetLastError() );
+		return false;
+	}
+	file_handle_ = file;
+
+	LARGE_INTEGER file_size;
+	if ( !GetFileSizeEx( file, &file_size ) || file_size.QuadPart == 0 )
+	{
+		DriverLog( "Hand clip %s is empty", path );
+		Close();
+		return false;
+	}
+
+	mapping_handle_ = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	mapping_ = mapping_handle_ ? MapViewOfFile( mapping_handle_, FILE_MAP_READ, 0, 0, 0 ) : nullptr;
+	if ( !mapping_ )
+	{
+		DriverLog( "Failed to map hand clip %s (error %lu)", path, GetLastError() );
+		Close();
+		return false;
+	}
+	mapping_size_ = ( size_t )file_size.QuadPart;
+#else
+	const int file = open( path, O_RDONLY );
+	if ( file < 0 )
+	{
+		DriverLog( "Failed to open hand clip %s", path );
+		return false;
+	}
+
+	struct stat file_stat;
+	if ( fstat( file, &file_stat ) != 0 || file_stat.st_size == 0 )
+	{
+		DriverLog( "Hand clip %s is empty", path );
+		close( file );
+		return false;
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	void *mapping = mmap( nullptr, ( size_t )file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0 );
+	close( file );
+
+	if ( mapping == MAP_FAILED )
+	{
+		DriverLog( "Failed to map hand clip %s", path );
+		return false;
+	}
+	mapping_ = mapping;
+	mapping_size_ = ( size_t )file_stat.st_size;
+#endif
+
+	if ( !HandClip::FromMemory( mapping_, mapping_size_, clip_ ) )
+	{
+		DriverLog( "%s is not a valid hand clip", path );
+		Close();
+		return false;
+	}
+
+	DriverLog( "Loaded hand clip %s: %u keys, %.2fs", path, clip_.KeyCount(), clip_.header->duration );
+	return true;
+}
+
+void HandClipFile::Close()
+{
+	clip_ = HandClip();
+
+#if defined( _WIN32 )
+	if ( mapping_ )
+		UnmapViewOfFile( mapping_ );
+	if ( mapping_handle_ )
+		CloseHandle( mapping_handle_ );
+	if ( file_handle_ )
+		CloseHandle( file_handle_ );
+	mapping_handle_ = nullptr;
+	file_handle_ = nullptr;
+#else
+	if ( mapping_ )
+		munmap( const_cast< void * >( mapping_ ), mapping_size_ );
+#endif
+
+	mapping_ = nullptr;
+	mapping_size_ = 0;
+}
+
+void HandClipCursor::Bind( const HandClip *clip, vr::ETrackedControllerRole target_role )
+{
+	clip_ = clip;
+	mirror_ = clip && clip->Role() != target_role;
+	key_ = 0;
+}
+
+uint32_t HandClipCursor::FindKey( float time ) const
+{
+	const float *first = clip_->key_times;
+	const float *last = first + clip_->KeyCount();
+
+	// Last key at or before time. Times before the first key (0) were clamped by the caller.
+	return ( uint32_t )( std::upper_bound( first, last, time ) - first ) - 1;
+}
+
+void HandClipCursor::Sample( double time, vr::VRBoneTransform_t *out_transforms )
+{
+	const float duration = clip_->header->duration;
+	const uint32_t key_count = clip_->KeyCount();
+
+	float clip_time;
+	if ( clip_->IsLooping() && duration > 0.f )
+	{
+		clip_time = ( float )std::fmod( time, ( double )duration );
+		if ( clip_time < 0.f )
+			clip_time += duration;
+	}
+	else
+	{
+		clip_time = ( float )std::min( std::max( time, 0.0 ), ( double )duration );
+	}
+
+	// Most samples land in the same key interval as last time, or one or two keys on
+	const float *key_times = clip_->key_times;
+	if ( clip_time < key_times[ key_ ] )
+	{
+		key_ = FindKey( clip_time );
+	}
+	else
+	{
+		int steps = 0;
+		while ( key_ + 1 < key_count && key_times[ key_ + 1 ] <= clip_time && steps < 4 )
+		{
+			key_++;
+			steps++;
+		}
+
+		if ( key_ + 1 < key_count && key_times[ key_ + 1 ] <= clip_time )
+			key_ = FindKey( clip_time );
+	}
+
+	// Between the last key and the end of a looping clip, blend back towards the first key
+	const uint32_t next_key = key_ + 1 < key_count ? key_ + 1 : ( clip_->IsLooping() ? 0 : key_ );
+	const float next_time = key_ + 1 < key_count ? key_times[ key_ + 1 ] : duration;
+	const float span = next_time - key_times[ key_ ];
+	const float t = span > 0.f ? std::min( ( clip_time - key_times[ key_ ] ) / span, 1.f ) : 0.f;
+
+	const HandClipBoneKey *from = clip_->Key( key_ );
+	const HandClipBoneKey *to = clip_->Key( next_key );
+
+	for ( int bone = 0; bone < eBone_Count; bone++ )
+	{
+		vr::VRBoneTransform_t a, b;
+		DecodeBoneKey( from[ bone ], a );
+		DecodeBoneKey( to[ bone ], b );
+
+		BlendBoneTransform( a, b, t, out_transforms[ bone ] );
+
+		if ( mirror_ )
+			MirrorBoneTransform( bone, out_transforms[ bone ] );
+	}
+}
+
+void HandClipCursor::SampleFirstKey( vr::VRBoneTransform_t *out_transforms ) const
+{
+	const HandClipBoneKey *first = clip_->Key( 0 );
+
+	for ( int bone = 0; bone < eBone_Count; bone++ )
+	{
+		vr::VRBoneTransform_t key;
+		DecodeBoneKey( first[ bone ], key );
+
+		// Renormalize away the quantization
+		BlendBoneTransform( key, key, 0.f, out_transforms[ bone ] );
+
+		if ( mirror_ )
+			MirrorBoneTransform( bone, out_transforms[ bone ] );
+	}
+}
+
+HandBlendTree::HandBlendTree( vr::ETrackedControllerRole role )
+	: role_( role )
+{
+}
+
+int HandBlendTree::AddClipLayer( const HandClip *clip, EHandBlendMode mode, float weight, double start_time, float speed )
+{
+	layers_.emplace_back();
+
+	Layer &layer = layers_.back();
+	layer.cursor.Bind( clip, role_ );
+	layer.mode = mode;
+	layer.weight = weight;
+	layer.start_time = start_time;
+	layer.speed = speed;
+	std::fill( std::begin( layer.bone_weights ), std::end( layer.bone_weights ), 1.f );
+	layer.cursor.SampleFirstKey( layer.reference );
+
+	return ( int )layers_.size() - 1;
+}
+
+void HandBlendTree::SetLayerWeight( int layer, float weight )
+{
+	layers_[ layer ].weight = weight;
+}
+
+void HandBlendTree::SetLayerBoneWeights( int layer, const float bone_weights[ eBone_Count ] )
+{
+	std::copy( bone_weights, bone_weights + eBone_Count, layers_[ layer ].bone_weights );
+}
+
+void HandBlendTree::RestartLayer( int layer, double start_time )
+{
+	layers_[ layer ].start_time = start_time;
+}
+
+void HandBlendTree::Evaluate( double time, vr::VRBoneTransform_t *in_out_transforms )
+{
+	for ( Layer &layer : layers_ )
+	{
+		if ( layer.weight <= 0.f )
+			continue;
+
+		layer.cursor.Sample( ( time - layer.start_time ) * layer.speed, layer_pose_ );
+
+		for ( int bone = 0; bone < eBone_Count; bone++ )
+		{
+			const float weight = std::min( layer.weight * layer.bone_weights[ bone ], 1.f );
+			if ( weight <= 0.f )
+				continue;
+
+			vr::VRBoneTransform_t &out_transform = in_out_transforms[ bone ];
+
+			if ( layer.mode == HandBlendMode_Override )
+			{
+				BlendBoneTransform( out_transform, layer_pose_[ bone ], weight, out_transform );
+				continue;
+			}
+
+			// Additive: how far the layer has moved from its first key, scaled by the weight, applied in the bone's parent space
+			const vr::VRBoneTransform_t &reference = layer.reference[ bone ];
+			vr::VRBoneTransform_t delta;
+			delta.orientation = HmdQuaternionf_Multiply( HmdQuaternionf_Conjugate( reference.orientation ), layer_pose_[ bone ].orientation );
+			for ( int i = 0; i < 3; i++ )
+				delta.position.v[ i ] = layer_pose_[ bone ].position.v[ i ] - reference.position.v[ i ];
+
+			vr::VRBoneTransform_t scaled_delta;
+			BlendBoneTransform( k_IdentityBoneTransform, delta, weight, scaled_delta );
+
+			for ( int i = 0; i < 3; i++ )
+				out_transform.position.v[ i ] += scaled_delta.position.v[ i ];
+			out_transform.orientation = HmdQuaternionf_Multiply( out_transform.orientation, scaled_delta.orientation );
+		}
+	}
+}
@@ -0,0 +1,174 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include "hand_simulation.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+Hand clip file layout (little endian, every section 4 byte aligned):
+
+	HandClipFileHeader  header
+	float               key_times[ key_count ]                   seconds, ascending, first one 0
+	HandClipBoneKey     keys[ key_count ][ bone_count ]          bone transforms in the Skeletal Input API's space
+
+Clips are played straight out of the mapped file, nothing is unpacked on load.
+*/
+
+static const uint32_t k_unHandClipMagic = 0x504c4348; // "HCLP"
+static const uint16_t k_unHandClipVersion = 1;
+
+enum EHandClipFlags : uint32_t
+{
+	HandClipFlag_Loop = 1 << 0,
+	HandClipFlag_RightHand = 1 << 1, // recorded on a right hand, otherwise a left one
+};
+
+struct HandClipFileHeader
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t bone_count; // eBone_Count
+	uint32_t key_count;
+	uint32_t flags; // EHandClipFlags
+	float duration; // seconds, at least the time of the last key
+	uint32_t reserved[ 3 ];
+};
+
+// 20 bytes instead of the 32 of a vr::VRBoneTransform_t
+struct HandClipBoneKey
+{
+	float position[ 3 ];
+	int16_t orientation[ 4 ]; // w, x, y, z scaled to -32767-32767
+};
+
+static_assert( sizeof( HandClipFileHeader ) == 32, "HandClipFileHeader must match the file layout" );
+static_assert( sizeof( HandClipBoneKey ) == 20, "HandClipBoneKey must match the file layout" );
+
+//-----------------------------------------------------------------------------
+// Purpose: A validated view of a clip in memory. It doesn't own the memory.
+//-----------------------------------------------------------------------------
+struct HandClip
+{
+	const HandClipFileHeader *header = nullptr;
+	const float *key_times = nullptr;
+	const HandClipBoneKey *keys = nullptr;
+
+	// Checks the header and sizes and points the view into data. Returns false (leaving out_clip empty) if it isn't a clip.
+	static bool FromMemory( const void *data, size_t size, HandClip &out_clip );
+
+	uint32_t KeyCount() const { return header->key_count; }
+	bool IsLooping() const { return ( header->flags & HandClipFlag_Loop ) != 0; }
+	vr::ETrackedControllerRole Role() const;
+
+	const HandClipBoneKey *Key( uint32_t key ) const { return keys + ( size_t )key * eBone_Count; }
+};
+
+// Writes a clip file, for recording or converting animations. keys holds key_count * eBone_Count transforms.
+bool HandClip_WriteFile( const char *path, const float *key_times, const vr::VRBoneTransform_t *keys, uint32_t key_count, float duration, uint32_t flags );
+
+//-----------------------------------------------------------------------------
+// Purpose: Maps a clip file into memory read only
+//-----------------------------------------------------------------------------
+class HandClipFile
+{
+public:
+	HandClipFile() = default;
+	~HandClipFile();
+
+	HandClipFile( const HandClipFile & ) = delete;
+	HandClipFile &operator=( const HandClipFile & ) = delete;
+
+	// Logs why and returns false if the file can't be mapped or isn't a valid clip
+	bool Open( const char *path );
+	void Close();
+
+	const HandClip &GetClip() const { return clip_; }
+
+private:
+	HandClip clip_;
+
+	const void *mapping_ = nullptr;
+	size_t mapping_size_ = 0;
+
+#if defined( _WIN32 )
+	void *file_handle_ = nullptr;
+	void *mapping_handle_ = nullptr;
+#endif
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Samples a clip, remembering the key it last sampled from.
+// Playing forward only ever has to look at the next key or two, so a sample costs the same however long the clip is.
+// Seeking backwards or jumping ahead falls back to a binary search. The clip is mirrored when it was recorded on the
+// other hand.
+//-----------------------------------------------------------------------------
+class HandClipCursor
+{
+public:
+	void Bind( const HandClip *clip, vr::ETrackedControllerRole target_role );
+
+	// time is wrapped for looping clips and clamped otherwise
+	void Sample( double time, vr::VRBoneTransform_t *out_transforms );
+
+	// The clip's first key, in the target hand's space
+	void SampleFirstKey( vr::VRBoneTransform_t *out_transforms ) const;
+
+	const HandClip *GetClip() const { return clip_; }
+
+private:
+	uint32_t FindKey( float time ) const;
+
+	const HandClip *clip_ = nullptr;
+	bool mirror_ = false;
+	uint32_t key_ = 0;
+};
+
+enum EHandBlendMode
+{
+	HandBlendMode_Override, // blend from what's below towards the layer's pose
+	HandBlendMode_Additive, // add the layer's motion relative to its clip's first key on top of what's below
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Blends clip layers over a base hand pose.
+//
+// Layers are applied bottom to top, each with its own playback clock, weight and per-bone weights (so a grip clip can
+// drive just the fingers, say). Everything is set up front; Evaluate does no allocation so it can run every frame on the
+// input thread.
+//-----------------------------------------------------------------------------
+class HandBlendTree
+{
+public:
+	explicit HandBlendTree( vr::ETrackedControllerRole role );
+
+	// Returns the new layer's index. The clip must outlive the tree. Playback starts at start_time (same clock as Evaluate).
+	int AddClipLayer( const HandClip *clip, EHandBlendMode mode, float weight, double start_time, float speed = 1.f );
+
+	void SetLayerWeight( int layer, float weight );
+	void SetLayerBoneWeights( int layer, const float bone_weights[ eBone_Count ] );
+	void RestartLayer( int layer, double start_time );
+
+	// Blends every layer onto in_out_transforms, which holds the base pose
+	void Evaluate( double time, vr::VRBoneTransform_t *in_out_transforms );
+
+	bool IsEmpty() const { return layers_.empty(); }
+
+private:
+	struct Layer
+	{
+		HandClipCursor cursor;
+		EHandBlendMode mode;
+		float weight;
+		double start_time;
+		float speed;
+		float bone_weights[ eBone_Count ];
+		vr::VRBoneTransform_t reference[ eBone_Count ]; // the clip's first key, what additive layers are relative to
+	};
+
+	vr::ETrackedControllerRole role_;
+	std::vector< Layer > layers_;
+	vr::VRBoneTransform_t layer_pose_[ eBone_Count ];
+};
@@ -3,6 +3,8 @@
 #include "hand_simulation.h"
 #include "vrmath.h"
 
+#include <algorithm>
+
 struct HandSimSplayableJoint
 {
 	vr::HmdVector2_t swing = { 0.f, 0.f };
@@ -40,7 +42,7 @@ struct HandSimHand
 };
 
 // rough finger lengths
-static const float finger_joint_lengths[5][5] = {
+static constexpr float finger_joint_lengths[5][5] = {
 	{ 0.05f, 0.05f, 0.035f, 0.025f, 0.f },	  // thumb
 	{ 0.03f, 0.073f, 0.045f, 0.025f, 0.02f }, // index
 	{ 0.01f, 0.091f, 0.049f, 0.03f, 0.02f },  // middle
@@ -48,6 +50,35 @@ static const float finger_joint_lengths[5][5] = {
 	{ 0.03f, 0.067f, 0.03f, 0.025f, 0.02f },  // pinky
 };
 
+// Default splay of the index, middle, ring and pinky finger joints, in degrees
+static constexpr float finger_metacarpal_splays[4] = { 13.f, 0.f, -15.f, -27.f };
+static constexpr float finger_proximal_splays[4] = { 3.f, 0.f, -1.f, -2.f };
+
+// Default bend of the intermediate and distal joints of the fingers, and the default metacarpal swing of the thumb, in degrees
+static constexpr float finger_default_joint_rotation = 5.f;
+static constexpr float thumb_default_metacarpal_swing[2] = { 10.f, 40.f };
+
+// How far each joint moves, in degrees, at a curl of 1 or a splay of +-1
+static constexpr float finger_metacarpal_curl_range = 5.f;
+static constexpr float finger_proximal_curl_range = 90.f;
+static constexpr float finger_proximal_splay_range = 15.f;
+static constexpr float finger_intermediate_curl_range = 80.f;
+static constexpr float finger_distal_curl_range = 80.f;
+
+static constexpr float thumb_metacarpal_curl_range = 5.f;
+static constexpr float thumb_metacarpal_splay_range = 5.f;
+static constexpr float thumb_proximal_curl_range = 90.f;
+static constexpr float thumb_proximal_splay_range = 20.f;
+static constexpr float thumb_distal_curl_range = 90.f;
+
+// Root and wrist bones of the left hand. The wrist was taken from the index controller pose.
+static constexpr vr::VRBoneTransform_t root_bone_transform = { { 0.000000f, 0.000000f, 0.000000f, 1.000000f }, { 1.000000f, -0.000000f, -0.000000f, 0.000000f } };
+static constexpr vr::VRBoneTransform_t wrist_bone_transform = { { -0.034038f, 0.036503f, 0.164722f, 1.000000f }, { -0.055147f, -0.078608f, -0.920279f, 0.379296f } };
+
+// The metacarpals' 90 degree turn from the wrist, see ComputeBoneTransformMetacarpal
+static constexpr vr::HmdQuaternion_t metacarpal_rotation = HmdQuaternion_FromEulerAnglesConstexpr(DEG_TO_RAD(90.0), DEG_TO_RAD(90.0), 0.0);
+static_assert(HmdQuaternion_NearlyEqual(metacarpal_rotation, { 0.5, 0.5, -0.5, 0.5 }, 1e-9), "metacarpal_rotation should be a quarter turn about two axes");
+
 //-----------------------------------------------------------------------------
 // Purpose: Sets up a default open hand pose which can then be manipulated with curl and splay values.
 // Much of this is very approximate.
@@ -61,15 +92,13 @@ static void InitHand(HandSimHand& out_hand)
 		finger.metacarpal.twist = 0.f;
 
 		finger.proximal.swing.v[1] = DEG_TO_RAD(10);
-		finger.intermediate.rotation = DEG_TO_RAD(5.f);
-
-		finger.intermediate.rotation = DEG_TO_RAD(5.f);
-		finger.distal.rotation = DEG_TO_RAD(5.f);
+		finger.intermediate.rotation = DEG_TO_RAD(finger_default_joint_rotation);
+		finger.distal.rotation = DEG_TO_RAD(finger_default_joint_rotation);
 	}
 
 	// Curl, splay and "twist" the thumb into a default position
-	out_hand.thumb.metacarpal.swing.v[0] = DEG_TO_RAD(10);
-	out_hand.thumb.metacarpal.swing.v[1] = DEG_TO_RAD(40);
+	out_hand.thumb.metacarpal.swing.v[0] = DEG_TO_RAD(thumb_default_metacarpal_swing[0]);
+	out_hand.thumb.metacarpal.swing.v[1] = DEG_TO_RAD(thumb_default_metacarpal_swing[1]);
 	out_hand.thumb.metacarpal.twist = DEG_TO_RAD(70);
 
 	out_hand.thumb.proximal.swing.v[0] = 0.f;
@@ -79,16 +108,12 @@ static void InitHand(HandSimHand& out_hand)
 	out_hand.thumb.distal.rotation = 0.f;
 
 	// Metacarpal splays for each of the fingers. Do this to add some spread to the fingers' metacarpal (the joints that connect to the wrist).
-	out_hand.fingers[0].metacarpal.swing.v[1] = DEG_TO_RAD(13.f);
-	out_hand.fingers[1].metacarpal.swing.v[1] = DEG_TO_RAD(-0.f);
-	out_hand.fingers[2].metacarpal.swing.v[1] = DEG_TO_RAD(-15.f);
-	out_hand.fingers[3].metacarpal.swing.v[1] = DEG_TO_RAD(-27.f);
+	for (int finger = 0; finger < 4; finger++)
+		out_hand.fingers[finger].metacarpal.swing.v[1] = DEG_TO_RAD(finger_metacarpal_splays[finger]);
 
 	// Proximal splays for each of the fingers. Do this to add some spread to the finger's proximal joints. These joints are also the ones that splay with the values provided.
-	out_hand.fingers[0].proximal.swing.v[1] = DEG_TO_RAD(3.f);
-	out_hand.fingers[1].proximal.swing.v[1] = DEG_TO_RAD(0.f);
-	out_hand.fingers[2].proximal.swing.v[1] = DEG_TO_RAD(-1.f);
-	out_hand.fingers[3].proximal.swing.v[1] = DEG_TO_RAD(-2.f);
+	for (int finger = 0; finger < 4; finger++)
+		out_hand.fingers[finger].proximal.swing.v[1] = DEG_TO_RAD(finger_proximal_splays[finger]);
 }
 
 //-----------------------------------------------------------------------------
@@ -98,13 +123,13 @@ static void InitHand(HandSimHand& out_hand)
 //-----------------------------------------------------------------------------
 static void ApplyGenericFingerTransform(const float curl, const float splay, HandSimFinger& out_finger)
 {
-	out_finger.metacarpal.swing.v[0] += DEG_TO_RAD(curl * 5.f); // the metacarpal only curls a little
+	out_finger.metacarpal.swing.v[0] += DEG_TO_RAD(curl * finger_metacarpal_curl_range); // the metacarpal only curls a little
 
-	out_finger.proximal.swing.v[0] += DEG_TO_RAD(curl * 90.f);
-	out_finger.proximal.swing.v[1] += DEG_TO_RAD(splay * 15.f);
+	out_finger.proximal.swing.v[0] += DEG_TO_RAD(curl * finger_proximal_curl_range);
+	out_finger.proximal.swing.v[1] += DEG_TO_RAD(splay * finger_proximal_splay_range);
 
-	out_finger.intermediate.rotation += DEG_TO_RAD(curl * 80.f);
-	out_finger.distal.rotation += DEG_TO_RAD(curl * 80.f);
+	out_finger.intermediate.rotation += DEG_TO_RAD(curl * finger_intermediate_curl_range);
+	out_finger.distal.rotation += DEG_TO_RAD(curl * finger_distal_curl_range);
 }
 
 
@@ -151,9 +176,7 @@ static void ComputeBoneTransformMetacarpal(const vr::ETrackedControllerRole role
 	leave the local coordinate systems of the remaining bones as-is This means that the metacarpals will be rotated 90 degrees from the wrist if trying to build a skeleton programmatically. So, we
 	apply this extra rotation to the metacarpals to account for this.
 	*/
-	vr::HmdQuaternion_t magic = { 0.5f, 0.5f, -0.5f, 0.5f };
-
-	vr::HmdQuaternion_t bone_orientation = magic * orientation;
+	vr::HmdQuaternion_t bone_orientation = metacarpal_rotation * orientation;
 
 	// Rotate the offset vector by the orientation
 	vr::HmdVector3_t bone_position = offset * bone_orientation;
@@ -216,7 +239,7 @@ static void ComputeSkeletalTransforms(const HandSimHand& hand, vr::VRBoneTransfo
 	}
 }
 
-void MyHandSimulation::ComputeSkeletonTransforms(vr::ETrackedControllerRole role, const MyFingerCurls& curls, const MyFingerSplays& splays, vr::VRBoneTransform_t* out_transforms)
+void MyHandSimulation::ComputeSkeletonTransformsAnalytic(vr::ETrackedControllerRole role, const MyFingerCurls& curls, const MyFingerSplays& splays, vr::VRBoneTransform_t* out_transforms)
 {
 	// This is where we store our internal representation of curls and splays for the hand.
 	HandSimHand hand{};
@@ -225,11 +248,10 @@ void MyHandSimulation::ComputeSkeletonTransforms(vr::ETrackedControllerRole role
 	hand.role = role;
 
 	// root bone. This is just 0s. It's aligned to /pose/raw.
-	out_transforms[0] = { { 0.000000f, 0.000000f, 0.000000f, 1.000000f }, { 1.000000f, -0.000000f, -0.000000f, 0.000000f } };
+	out_transforms[0] = root_bone_transform;
 
 	// wrist bone. This was taken from the index controller pose.
-
-	out_transforms[1] = { { -0.034038f, 0.036503f, 0.164722f, 1.000000f }, { -0.055147f, -0.078608f, -0.920279f, 0.379296f } };
+	out_transforms[1] = wrist_bone_transform;
 
 	//"up" axis is flipped between hands so invert
 	if (role == vr::TrackedControllerRole_RightHand)
@@ -244,15 +266,15 @@ void MyHandSimulation::ComputeSkeletonTransforms(vr::ETrackedControllerRole role
 	InitHand(hand);
 
 	// We need to apply the curls and splays separately to the thumb as it's special
-	hand.thumb.metacarpal.swing.v[0] += DEG_TO_RAD(curls.thumb * 5.f);
-	hand.thumb.metacarpal.swing.v[1] += DEG_TO_RAD(splays.thumb * 5.f);
+	hand.thumb.metacarpal.swing.v[0] += DEG_TO_RAD(curls.thumb * thumb_metacarpal_curl_range);
+	hand.thumb.metacarpal.swing.v[1] += DEG_TO_RAD(splays.thumb * thumb_metacarpal_splay_range);
 	hand.thumb.metacarpal.twist = 0.f;
 
-	hand.thumb.proximal.swing.v[0] += DEG_TO_RAD(curls.thumb * 90.f);
-	hand.thumb.proximal.swing.v[1] += DEG_TO_RAD(splays.thumb * 20.f);
+	hand.thumb.proximal.swing.v[0] += DEG_TO_RAD(curls.thumb * thumb_proximal_curl_range);
+	hand.thumb.proximal.swing.v[1] += DEG_TO_RAD(splays.thumb * thumb_proximal_splay_range);
 	hand.thumb.proximal.twist = 0.f;
 
-	hand.thumb.distal.rotation += DEG_TO_RAD(curls.thumb * 90.f);
+	hand.thumb.distal.rotation += DEG_TO_RAD(curls.thumb * thumb_distal_curl_range);
 
 	// But we can batch up the fingers with a generic apply function.
 	ApplyGenericFingerTransform(curls.index, splays.index, hand.fingers[0]);
@@ -262,4 +284,471 @@ void MyHandSimulation::ComputeSkeletonTransforms(vr::ETrackedControllerRole role
 
 	// Now compute
 	ComputeSkeletalTransforms(hand, out_transforms);
-}
\ No newline at end of file
+}
+
+// First bone and number of bones of each finger (thumb, index, middle, ring, pinky) in the skeleton
+static const int finger_first_bone[5] = { eBone_Thumb0, eBone_IndexFinger0, eBone_MiddleFinger0, eBone_RingFinger0, eBone_PinkyFinger0 };
+static const int finger_bone_count[5] = { 4, 5, 5, 5, 5 };
+
+static bool BoneTransformsDiffer(const vr::VRBoneTransform_t& a, const vr::VRBoneTransform_t& b)
+{
+	const float epsilon = 1e-6f;
+	for (int i = 0; i < 3; i++)
+	{
+		if (fabsf(a.position.v[i] - b.position.v[i]) > epsilon)
+			return true;
+	}
+
+	return fabsf(a.orientation.w - b.orientation.w) > epsilon || fabsf(a.orientation.x - b.orientation.x) > epsilon ||
+		fabsf(a.orientation.y - b.orientation.y) > epsilon || fabsf(a.orientation.z - b.orientation.z) > epsilon;
+}
+
+int MyHandSimulation::TableIndex(int hand, int finger, int curl_sample, int splay_sample)
+{
+	return (((hand * k_nFingers + finger) * k_nCurlSamples + curl_sample) * k_nSplaySamples + splay_sample) * k_nMaxBonesPerFinger;
+}
+
+MyHandSimulation::MyHandSimulation()
+	: finger_table_(2 * k_nFingers * k_nCurlSamples * k_nSplaySamples * k_nMaxBonesPerFinger)
+{
+	const vr::ETrackedControllerRole roles[2] = { vr::TrackedControllerRole_LeftHand, vr::TrackedControllerRole_RightHand };
+
+	for (int hand = 0; hand < 2; hand++)
+	{
+		for (int curl_sample = 0; curl_sample < k_nCurlSamples; curl_sample++)
+		{
+			for (int splay_sample = 0; splay_sample < k_nSplaySamples; splay_sample++)
+			{
+				// Fingers are independent of each other, so one skeleton with every finger at the same values fills in a grid point for all of them
+				const float curl = static_cast<float>(curl_sample) / (k_nCurlSamples - 1);
+				const float splay = static_cast<float>(splay_sample) / (k_nSplaySamples - 1) * 2.f - 1.f;
+
+				vr::VRBoneTransform_t transforms[eBone_Count]{};
+				ComputeSkeletonTransformsAnalytic(roles[hand], { curl, curl, curl, curl, curl }, { splay, splay, splay, splay, splay }, transforms);
+
+				for (int finger = 0; finger < k_nFingers; finger++)
+				{
+					vr::VRBoneTransform_t* samples = &finger_table_[TableIndex(hand, finger, curl_sample, splay_sample)];
+					std::copy_n(&transforms[finger_first_bone[finger]], finger_bone_count[finger], samples);
+
+					// q and -q are the same rotation. Flip samples into the same hemisphere as the neighbour they were reached from,
+					// so neighbouring samples can be blended directly without checking at runtime.
+					const vr::VRBoneTransform_t* neighbour = nullptr;
+					if (splay_sample > 0)
+						neighbour = &finger_table_[TableIndex(hand, finger, curl_sample, splay_sample - 1)];
+					else if (curl_sample > 0)
+						neighbour = &finger_table_[TableIndex(hand, finger, curl_sample - 1, splay_sample)];
+
+					for (int bone = 0; neighbour && bone < finger_bone_count[finger]; bone++)
+					{
+						vr::HmdQuaternionf_t& q = samples[bone].orientation;
+						const vr::HmdQuaternionf_t& n = neighbour[bone].orientation;
+						if (q.w * n.w + q.x * n.x + q.y * n.y + q.z * n.z < 0.f)
+							q = { -q.w, -q.x, -q.y, -q.z };
+					}
+				}
+
+				fixed_bones_[hand][eBone_Root] = transforms[eBone_Root];
+				fixed_bones_[hand][eBone_Wrist] = transforms[eBone_Wrist];
+			}
+		}
+	}
+
+	// Find out which inputs each bone moves with, by comparing every sample with the first sample of its row and column
+	for (int finger = 0; finger < k_nFingers; finger++)
+	{
+		for (int bone = 0; bone < finger_bone_count[finger]; bone++)
+		{
+			uint8_t inputs = BoneInput_None;
+
+			for (int hand = 0; hand < 2; hand++)
+			{
+				for (int curl_sample = 0; curl_sample < k_nCurlSamples; curl_sample++)
+				{
+					for (int splay_sample = 0; splay_sample < k_nSplaySamples; splay_sample++)
+					{
+						const vr::VRBoneTransform_t& sample = finger_table_[TableIndex(hand, finger, curl_sample, splay_sample) + bone];
+						if (BoneTransformsDiffer(sample, finger_table_[TableIndex(hand, finger, 0, splay_sample) + bone]))
+							inputs |= BoneInput_Curl;
+						if (BoneTransformsDiffer(sample, finger_table_[TableIndex(hand, finger, curl_sample, 0) + bone]))
+							inputs |= BoneInput_Splay;
+					}
+				}
+			}
+
+			bone_inputs_[finger][bone] = inputs;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Clamps a curl or splay to the range the table covers. A NaN becomes low: std::min and std::max would pass it
+// through, and the table path turns the clamped value into a sample index.
+//-----------------------------------------------------------------------------
+static inline float ClampInput(float value, float low, float high)
+{
+	return !(value > low) ? low : std::min(value, high);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Blends N grid samples of a bone. Orientations are blended with a normalized lerp, which is close enough to
+// slerp for neighbouring samples. The table is built with neighbouring orientations in the same hemisphere, so no sign
+// checks are needed here.
+//-----------------------------------------------------------------------------
+template < int N >
+static void BlendBoneSamples(const vr::VRBoneTransform_t* const samples[N], const float weights[N], vr::VRBoneTransform_t& out_bone)
+{
+	float position[3] = { 0.f, 0.f, 0.f };
+	float w = 0.f, x = 0.f, y = 0.f, z = 0.f;
+
+	for (int corner = 0; corner < N; corner++)
+	{
+		const vr::VRBoneTransform_t& sample = *samples[corner];
+		const float weight = weights[corner];
+
+		position[0] += weight * sample.position.v[0];
+		position[1] += weight * sample.position.v[1];
+		position[2] += weight * sample.position.v[2];
+
+		w += weight * sample.orientation.w;
+		x += weight * sample.orientation.x;
+		y += weight * sample.orientation.y;
+		z += weight * sample.orientation.z;
+	}
+
+	const float inv_length = 1.f / sqrtf(w * w + x * x + y * y + z * z);
+
+	out_bone.position = { position[0], position[1], position[2], 1.f };
+	out_bone.orientation = { w * inv_length, x * inv_length, y * inv_length, z * inv_length };
+}
+
+void MyHandSimulation::ComputeSkeletonTransforms(vr::ETrackedControllerRole role, const MyFingerCurls& curls, const MyFingerSplays& splays, vr::VRBoneTransform_t* out_transforms)
+{
+	const int hand = role == vr::TrackedControllerRole_RightHand ? 1 : 0;
+
+	out_transforms[eBone_Root] = fixed_bones_[hand][eBone_Root];
+	out_transforms[eBone_Wrist] = fixed_bones_[hand][eBone_Wrist];
+
+	const float finger_curls[k_nFingers] = { curls.thumb, curls.index, curls.middle, curls.ring, curls.pinky };
+	const float finger_splays[k_nFingers] = { splays.thumb, splays.index, splays.middle, splays.ring, splays.pinky };
+
+	for (int finger = 0; finger < k_nFingers; finger++)
+	{
+		// Position in the grid, split into the lower sample and the fraction towards the next one
+		const float curl_position = ClampInput(finger_curls[finger], 0.f, 1.f) * (k_nCurlSamples - 1);
+		const float splay_position = (ClampInput(finger_splays[finger], -1.f, 1.f) + 1.f) * 0.5f * (k_nSplaySamples - 1);
+
+		const int curl_sample = std::min(static_cast<int>(curl_position), k_nCurlSamples - 2);
+		const int splay_sample = std::min(static_cast<int>(splay_position), k_nSplaySamples - 2);
+
+		const float curl_t = curl_position - curl_sample;
+		const float splay_t = splay_position - splay_sample;
+
+		const vr::VRBoneTransform_t* low_low = &finger_table_[TableIndex(hand, finger, curl_sample, splay_sample)];
+		const vr::VRBoneTransform_t* high_low = &finger_table_[TableIndex(hand, finger, curl_sample + 1, splay_sample)];
+		const vr::VRBoneTransform_t* low_high = &finger_table_[TableIndex(hand, finger, curl_sample, splay_sample + 1)];
+		const vr::VRBoneTransform_t* high_high = &finger_table_[TableIndex(hand, finger, curl_sample + 1, splay_sample + 1)];
+
+		const float curl_weights[2] = { 1.f - curl_t, curl_t };
+		const float splay_weights[2] = { 1.f - splay_t, splay_t };
+		const float weights[4] = {
+			curl_weights[0] * splay_weights[0],
+			curl_weights[1] * splay_weights[0],
+			curl_weights[0] * splay_weights[1],
+			curl_weights[1] * splay_weights[1],
+		};
+
+		vr::VRBoneTransform_t* out_bones = &out_transforms[finger_first_bone[finger]];
+
+		// Only blend along the axes a bone actually moves with, most joints only follow the curl
+		for (int bone = 0; bone < finger_bone_count[finger]; bone++)
+		{
+			switch (bone_inputs_[finger][bone])
+			{
+				case BoneInput_None:
+					out_bones[bone] = low_low[bone];
+					break;
+
+				case BoneInput_Curl:
+				{
+					const vr::VRBoneTransform_t* const samples[2] = { &low_low[bone], &high_low[bone] };
+					BlendBoneSamples<2>(samples, curl_weights, out_bones[bone]);
+					break;
+				}
+
+				case BoneInput_Splay:
+				{
+					const vr::VRBoneTransform_t* const samples[2] = { &low_low[bone], &low_high[bone] };
+					BlendBoneSamples<2>(samples, splay_weights, out_bones[bone]);
+					break;
+				}
+
+				default:
+				{
+					const vr::VRBoneTransform_t* const samples[4] = { &low_low[bone], &high_low[bone], &low_high[bone], &high_high[bone] };
+					BlendBoneSamples<4>(samples, weights, out_bones[bone]);
+					break;
+				}
+			}
+		}
+	}
+}
+
+// Orientation and position of one bone for each hand in a batch group, one array per component
+struct BatchBoneLanes
+{
+	alignas(32) float orientation[4][MyHandSimulation::k_nBatchLanes]; // w, x, y, z
+	alignas(32) float position[3][MyHandSimulation::k_nBatchLanes];
+};
+
+static const float batch_deg_to_rad = 3.14159265f / 180.f;
+
+// cos(h) and sin(h) / h, both as polynomials in h^2. The half angles of the model stay within 1 radian once the inputs are
+// clamped, where these are as accurate as float allows. Being even in h, a swing needs neither the sqrt of its squared
+// angle nor a division by it, and neither needs a call into the C library, so the lane loops below vectorize.
+static inline float BatchCosHalfAngle(float h2)
+{
+	return 1.f + h2 * (-1.f / 2.f + h2 * (1.f / 24.f + h2 * (-1.f / 720.f + h2 * (1.f / 40320.f + h2 * (-1.f / 3628800.f)))));
+}
+
+static inline float BatchSinOverHalfAngle(float h2)
+{
+	return 1.f + h2 * (-1.f / 6.f + h2 * (1.f / 120.f + h2 * (-1.f / 5040.f + h2 * (1.f / 362880.f))));
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: HmdQuaternion_FromSwingTwist with no twist, for every lane. Swings are in radians.
+//-----------------------------------------------------------------------------
+static void BatchSwingOrientation(const float* swing_x, const float* swing_y, BatchBoneLanes& out_bone)
+{
+	for (int lane = 0; lane < MyHandSimulation::k_nBatchLanes; lane++)
+	{
+		const float half_theta_squared = (swing_x[lane] * swing_x[lane] + swing_y[lane] * swing_y[lane]) * 0.25f;
+		const float sin_half_theta_over_theta = 0.5f * BatchSinOverHalfAngle(half_theta_squared);
+
+		out_bone.orientation[0][lane] = BatchCosHalfAngle(half_theta_squared);
+		out_bone.orientation[1][lane] = 0.f;
+		out_bone.orientation[2][lane] = swing_y[lane] * sin_half_theta_over_theta;
+		out_bone.orientation[3][lane] = swing_x[lane] * sin_half_theta_over_theta;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: HmdQuaternion_FromEulerAngles(rotation, 0, 0) for every lane. Rotations are in radians.
+//-----------------------------------------------------------------------------
+static void BatchRollOrientation(const float* rotation, BatchBoneLanes& out_bone)
+{
+	for (int lane = 0; lane < MyHandSimulation::k_nBatchLanes; lane++)
+	{
+		const float half_rotation = rotation[lane] * 0.5f;
+		const float half_rotation_squared = half_rotation * half_rotation;
+
+		out_bone.orientation[0][lane] = BatchCosHalfAngle(half_rotation_squared);
+		out_bone.orientation[1][lane] = 0.f;
+		out_bone.orientation[2][lane] = 0.f;
+		out_bone.orientation[3][lane] = half_rotation * BatchSinOverHalfAngle(half_rotation_squared);
+	}
+}
+
+static void BatchIdentityOrientation(BatchBoneLanes& out_bone)
+{
+	for (int lane = 0; lane < MyHandSimulation::k_nBatchLanes; lane++)
+	{
+		out_bone.orientation[0][lane] = 1.f;
+		out_bone.orientation[1][lane] = 0.f;
+		out_bone.orientation[2][lane] = 0.f;
+		out_bone.orientation[3][lane] = 0.f;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: ComputeBoneTransform for every lane: the bone is offset along x, which is flipped for right hands (sign -1)
+//-----------------------------------------------------------------------------
+static void BatchBonePosition(const float* sign, const float joint_length, BatchBoneLanes& out_bone)
+{
+	for (int lane = 0; lane < MyHandSimulation::k_nBatchLanes; lane++)
+	{
+		out_bone.position[0][lane] = sign[lane] * joint_length;
+		out_bone.position[1][lane] = 0.f;
+		out_bone.position[2][lane] = 0.f;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: ComputeBoneTransformMetacarpal for every lane, on the orientation already in out_bone.
+// Instead of swapping components for right hands, both the left and the mirrored orientation are computed and mixed by
+// mirror (0 for left hands, 1 for right), so every lane runs the same instructions.
+//-----------------------------------------------------------------------------
+static void BatchMetacarpalTransform(const float* sign, const float* mirror, const float joint_length, BatchBoneLanes& out_bone)
+{
+	// See ComputeBoneTransformMetacarpal for where this comes from
+	constexpr float magic_w = static_cast<float>(metacarpal_rotation.w), magic_x = static_cast<float>(metacarpal_rotation.x);
+	constexpr float magic_y = static_cast<float>(metacarpal_rotation.y), magic_z = static_cast<float>(metacarpal_rotation.z);
+
+	for (int lane = 0; lane < MyHandSimulation::k_nBatchLanes; lane++)
+	{
+		const float qw = out_bone.orientation[0][lane];
+		const float qx = out_bone.orientation[1][lane];
+		const float qy = out_bone.orientation[2][lane];
+		const float qz = out_bone.orientation[3][lane];
+
+		// magic * orientation
+		const float w = magic_w * qw - magic_x * qx - magic_y * qy - magic_z * qz;
+		const float x = magic_w * qx + magic_x * qw + magic_y * qz - magic_z * qy;
+		const float y = magic_w * qy - magic_x * qz + magic_y * qw + magic_z * qx;
+		const float z = magic_w * qz + magic_x * qy - magic_y * qx + magic_z * qw;
+
+		// The offset (joint_length, 0, 0) rotated by the unmirrored orientation is its first column
+		out_bone.position[0][lane] = sign[lane] * joint_length * (1.f - 2.f * (y * y + z * z));
+		out_bone.position[1][lane] = joint_length * 2.f * (x * y + w * z);
+		out_bone.position[2][lane] = joint_length * 2.f * (x * z - w * y);
+
+		// Right hands swap w with x and y with z, then negate x and z
+		const float m = mirror[lane];
+		out_bone.orientation[0][lane] = w + m * (x - w);
+		out_bone.orientation[1][lane] = x + m * (-w - x);
+		out_bone.orientation[2][lane] = y + m * (z - y);
+		out_bone.orientation[3][lane] = z + m * (-y - z);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Scatters one bone of a batch group into each hand's skeleton
+//-----------------------------------------------------------------------------
+static void BatchStoreBone(const BatchBoneLanes& bone_lanes, const int bone, const int lane_count, vr::VRBoneTransform_t* out_hands)
+{
+	for (int lane = 0; lane < lane_count; lane++)
+	{
+		vr::VRBoneTransform_t& out_transform = out_hands[lane * eBone_Count + bone];
+
+		out_transform.position.v[0] = bone_lanes.position[0][lane];
+		out_transform.position.v[1] = bone_lanes.position[1][lane];
+		out_transform.position.v[2] = bone_lanes.position[2][lane];
+		out_transform.position.v[3] = 1.f;
+
+		out_transform.orientation.w = bone_lanes.orientation[0][lane];
+		out_transform.orientation.x = bone_lanes.orientation[1][lane];
+		out_transform.orientation.y = bone_lanes.orientation[2][lane];
+		out_transform.orientation.z = bone_lanes.orientation[3][lane];
+	}
+}
+
+void MyHandSimulation::ComputeSkeletonTransformsBatch(const MyHandBatchInput& input, size_t hand_count, vr::VRBoneTransform_t* out_transforms)
+{
+	const int lanes = k_nBatchLanes;
+
+	for (size_t first_hand = 0; first_hand < hand_count; first_hand += lanes)
+	{
+		const int lane_count = static_cast<int>(std::min<size_t>(lanes, hand_count - first_hand));
+		vr::VRBoneTransform_t* out_hands = out_transforms + first_hand * eBone_Count;
+
+		// Gather the group's inputs. A short last group repeats its last hand in the spare lanes, which are never stored.
+		alignas(32) float sign[lanes];
+		alignas(32) float mirror[lanes];
+		alignas(32) float curls[k_nFingers][lanes];
+		alignas(32) float splays[k_nFingers][lanes];
+
+		for (int lane = 0; lane < lanes; lane++)
+		{
+			const size_t hand = first_hand + std::min(lane, lane_count - 1);
+
+			mirror[lane] = input.roles[hand] == vr::TrackedControllerRole_RightHand ? 1.f : 0.f;
+			sign[lane] = 1.f - 2.f * mirror[lane];
+
+			for (int finger = 0; finger < k_nFingers; finger++)
+			{
+				curls[finger][lane] = ClampInput(input.curls[finger][hand], 0.f, 1.f);
+				splays[finger][lane] = ClampInput(input.splays[finger][hand], -1.f, 1.f);
+			}
+		}
+
+		// The root and wrist bones are constant apart from the mirroring
+		for (int lane = 0; lane < lane_count; lane++)
+		{
+			vr::VRBoneTransform_t* out_hand = out_hands + lane * eBone_Count;
+
+			out_hand[eBone_Root] = root_bone_transform;
+
+			out_hand[eBone_Wrist] = wrist_bone_transform;
+			out_hand[eBone_Wrist].position.v[0] *= sign[lane];
+			out_hand[eBone_Wrist].orientation.y *= sign[lane];
+			out_hand[eBone_Wrist].orientation.z *= sign[lane];
+		}
+
+		BatchBoneLanes bone;
+		alignas(32) float swing_x[lanes];
+		alignas(32) float swing_y[lanes];
+		alignas(32) float rotation[lanes];
+
+		// Thumb
+		for (int lane = 0; lane < lanes; lane++)
+		{
+			swing_x[lane] = (thumb_default_metacarpal_swing[0] + curls[0][lane] * thumb_metacarpal_curl_range) * batch_deg_to_rad;
+			swing_y[lane] = (thumb_default_metacarpal_swing[1] + splays[0][lane] * thumb_metacarpal_splay_range) * batch_deg_to_rad;
+		}
+		BatchSwingOrientation(swing_x, swing_y, bone);
+		BatchMetacarpalTransform(sign, mirror, finger_joint_lengths[0][0], bone);
+		BatchStoreBone(bone, eBone_Thumb0, lane_count, out_hands);
+
+		for (int lane = 0; lane < lanes; lane++)
+		{
+			swing_x[lane] = curls[0][lane] * thumb_proximal_curl_range * batch_deg_to_rad;
+			swing_y[lane] = splays[0][lane] * thumb_proximal_splay_range * batch_deg_to_rad;
+		}
+		BatchSwingOrientation(swing_x, swing_y, bone);
+		BatchBonePosition(sign, finger_joint_lengths[0][1], bone);
+		BatchStoreBone(bone, eBone_Thumb1, lane_count, out_hands);
+
+		for (int lane = 0; lane < lanes; lane++)
+			rotation[lane] = curls[0][lane] * thumb_distal_curl_range * batch_deg_to_rad;
+		BatchRollOrientation(rotation, bone);
+		BatchBonePosition(sign, finger_joint_lengths[0][2], bone);
+		BatchStoreBone(bone, eBone_Thumb2, lane_count, out_hands);
+
+		BatchIdentityOrientation(bone);
+		BatchBonePosition(sign, finger_joint_lengths[0][3], bone);
+		BatchStoreBone(bone, eBone_Thumb3, lane_count, out_hands);
+
+		// index, middle, ring, pinky
+		for (int finger = 1; finger < k_nFingers; finger++)
+		{
+			const float* finger_curls = curls[finger];
+			const float* finger_splays = splays[finger];
+			const int first_bone = finger_first_bone[finger];
+
+			for (int lane = 0; lane < lanes; lane++)
+			{
+				swing_x[lane] = finger_curls[lane] * finger_metacarpal_curl_range * batch_deg_to_rad;
+				swing_y[lane] = finger_metacarpal_splays[finger - 1] * batch_deg_to_rad;
+			}
+			BatchSwingOrientation(swing_x, swing_y, bone);
+			BatchMetacarpalTransform(sign, mirror, finger_joint_lengths[finger][0], bone);
+			BatchStoreBone(bone, first_bone, lane_count, out_hands);
+
+			for (int lane = 0; lane < lanes; lane++)
+			{
+				swing_x[lane] = finger_curls[lane] * finger_proximal_curl_range * batch_deg_to_rad;
+				swing_y[lane] = (finger_proximal_splays[finger - 1] + finger_splays[lane] * finger_proximal_splay_range) * batch_deg_to_rad;
+			}
+			BatchSwingOrientation(swing_x, swing_y, bone);
+			BatchBonePosition(sign, finger_joint_lengths[finger][1], bone);
+			BatchStoreBone(bone, first_bone + 1, lane_count, out_hands);
+
+			for (int lane = 0; lane < lanes; lane++)
+				rotation[lane] = (finger_default_joint_rotation + finger_curls[lane] * finger_intermediate_curl_range) * batch_deg_to_rad;
+			BatchRollOrientation(rotation, bone);
+			BatchBonePosition(sign, finger_joint_lengths[finger][2], bone);
+			BatchStoreBone(bone, first_bone + 2, lane_count, out_hands);
+
+			for (int lane = 0; lane < lanes; lane++)
+				rotation[lane] = (finger_default_joint_rotation + finger_curls[lane] * finger_distal_curl_range) * batch_deg_to_rad;
+			BatchRollOrientation(rotation, bone);
+			BatchBonePosition(sign, finger_joint_lengths[finger][3], bone);
+			BatchStoreBone(bone, first_bone + 3, lane_count, out_hands);
+
+			BatchIdentityOrientation(bone);
+			BatchBonePosition(sign, finger_joint_lengths[finger][4], bone);
+			BatchStoreBone(bone, first_bone + 4, lane_count, out_hands);
+		}
+	}
+}
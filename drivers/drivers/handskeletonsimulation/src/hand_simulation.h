@@ -3,6 +3,8 @@
 
 #include "openvr_driver.h"
 
+#include <vector>
+
 // 0-1 values (1 fully curled)
 struct MyFingerCurls
 {
@@ -59,8 +61,64 @@ enum HandSkeletonBone : vr::BoneIndex_t
 	eBone_Count
 };
 
+// Per-finger inputs for a batch of hands, laid out as one array per value (thumb, index, middle, ring, pinky) with an
+// entry per hand, so that consecutive hands sit in consecutive SIMD lanes.
+struct MyHandBatchInput
+{
+	const vr::ETrackedControllerRole *roles;
+	const float *curls[ 5 ];
+	const float *splays[ 5 ];
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Builds hand skeletons from per-finger curl and splay values.
+//
+// Each finger's bones depend only on that finger's curl and splay, so on construction we sample the analytic model over
+// a grid of curl and splay values per finger and hand. ComputeSkeletonTransforms then just blends the four surrounding
+// grid samples of each finger (nlerp for orientations), which avoids all of the trig and double-precision quaternion
+// maths of the analytic path.
+//-----------------------------------------------------------------------------
 class MyHandSimulation
 {
 public:
+	MyHandSimulation();
+
+	// Curls are clamped to 0-1 and splays to -1-1, the range the table covers. A NaN is taken as the low end.
 	void ComputeSkeletonTransforms( vr::ETrackedControllerRole role, const MyFingerCurls &curls, const MyFingerSplays &splays, vr::VRBoneTransform_t *out_transforms );
+
+	// The model the table is sampled from. Slower, but exact and not limited to the table's range.
+	void ComputeSkeletonTransformsAnalytic( vr::ETrackedControllerRole role, const MyFingerCurls &curls, const MyFingerSplays &splays, vr::VRBoneTransform_t *out_transforms );
+
+	// Evaluates the analytic model for hand_count hands at once, writing hand_count * eBone_Count transforms (hand after
+	// hand, like the single hand functions). Hands are processed in groups of k_nBatchLanes with every joint angle,
+	// quaternion and bone position held in per-lane arrays, so the whole skeleton is straight-line arithmetic that the
+	// compiler turns into SIMD. Left and right hands can be mixed freely within a group. Curls are clamped to 0-1 and
+	// splays to -1-1. As with the functions above, the aux bones are not written.
+	static void ComputeSkeletonTransformsBatch( const MyHandBatchInput &input, size_t hand_count, vr::VRBoneTransform_t *out_transforms );
+
+	static const int k_nBatchLanes = 8;
+
+private:
+	static const int k_nCurlSamples = 17;
+	static const int k_nSplaySamples = 9;
+	static const int k_nFingers = 5;
+	static const int k_nMaxBonesPerFinger = 5;
+
+	enum EBoneInput : uint8_t
+	{
+		BoneInput_None = 0,
+		BoneInput_Curl = 1,
+		BoneInput_Splay = 2,
+	};
+
+	static int TableIndex( int hand, int finger, int curl_sample, int splay_sample );
+
+	// [hand][finger][curl sample][splay sample][bone in finger], hand 0 is left and 1 is right
+	std::vector< vr::VRBoneTransform_t > finger_table_;
+
+	// Which of curl and splay (EBoneInput flags) each bone of each finger moves with, found while building the table
+	uint8_t bone_inputs_[ k_nFingers ][ k_nMaxBonesPerFinger ];
+
+	// The root and wrist bones don't move with the fingers
+	vr::VRBoneTransform_t fixed_bones_[ 2 ][ 2 ];
 };
\ No newline at end of file
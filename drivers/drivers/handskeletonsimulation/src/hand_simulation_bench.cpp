@@ -0,0 +1,254 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Checks MyHandSimulation's table and batch paths against the analytic model, and times all three.
+//
+// Random curls and splays, for left and right hands, go through ComputeSkeletonTransforms and
+// ComputeSkeletonTransformsAnalytic. The largest orientation and position differences over all bones are reported, and
+// the run fails if they are over what the table is meant to hold to, or if NaN inputs don't come out as the low end of
+// the range. The same hands then go through ComputeSkeletonTransformsBatch, which evaluates the analytic model itself
+// and so has to match it to float precision, last group partial included. Then each path is timed over the same inputs,
+// in nanoseconds per skeleton and in hands per millisecond.
+//
+// Not part of the driver build. From this directory, with the OpenVR headers:
+//
+//   g++ -O2 -I<openvr>/headers -I../../../utils/vrmath hand_simulation_bench.cpp hand_simulation.cpp -o hand_simulation_bench
+//
+// and again with -O3 -mavx2 -mfma to see the batch path at the width it is laid out for.
+//
+// Usage: hand_simulation_bench [hands, default 20000] [runs, default 20]
+#include "hand_simulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Table versus analytic, over every bone the functions write
+static const double k_flMaxOrientationErrorDegrees = 0.05;
+static const double k_flMaxPositionErrorMetres = 1e-5;
+
+// Batch versus analytic, which compute the same model and differ only by rounding
+static const double k_flMaxBatchComponentError = 1e-6;
+static const double k_flMaxBatchPositionErrorMetres = 1e-7;
+
+// Hands per ComputeSkeletonTransformsBatch call when timing it
+static const int k_nBatchChunkHands = 64;
+
+static uint32_t rng_state = 0x12345678;
+
+static float RandomFloat(float low, float high)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return low + (high - low) * static_cast<float>(rng_state >> 8) * (1.f / 16777216.f);
+}
+
+struct HandInput
+{
+	vr::ETrackedControllerRole role;
+	MyFingerCurls curls;
+	MyFingerSplays splays;
+};
+
+static double SecondsNow()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Angle of the rotation from b to a. Taken from the relative quaternion with atan2, as acos of the dot product can't
+// resolve the small differences this is looking for.
+static double OrientationErrorDegrees(const vr::HmdQuaternionf_t& a, const vr::HmdQuaternionf_t& b)
+{
+	const double w = (double)a.w * b.w + (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z;
+	const double x = (double)a.x * b.w - (double)a.w * b.x - (double)a.y * b.z + (double)a.z * b.y;
+	const double y = (double)a.y * b.w - (double)a.w * b.y - (double)a.z * b.x + (double)a.x * b.z;
+	const double z = (double)a.z * b.w - (double)a.w * b.z - (double)a.x * b.y + (double)a.y * b.x;
+	return 2.0 * std::atan2(std::sqrt(x * x + y * y + z * z), std::fabs(w)) * 180.0 / 3.14159265358979323846;
+}
+
+static double PositionError(const vr::HmdVector4_t& a, const vr::HmdVector4_t& b)
+{
+	const double x = a.v[0] - b.v[0], y = a.v[1] - b.v[1], z = a.v[2] - b.v[2];
+	return std::sqrt(x * x + y * y + z * z);
+}
+
+// Best time of `runs` calls to run_pass, in seconds
+template < typename Function >
+static double BestSeconds(int runs, Function run_pass)
+{
+	double best = 1e30;
+	for (int run = 0; run < runs; run++)
+	{
+		const double start = SecondsNow();
+		run_pass();
+		best = std::min(best, SecondsNow() - start);
+	}
+	return best;
+}
+
+int main(int argc, char** argv)
+{
+	const int hand_count = argc > 1 ? atoi(argv[1]) : 20000;
+	const int runs = argc > 2 ? atoi(argv[2]) : 20;
+	if (hand_count <= 0 || runs <= 0)
+	{
+		fprintf(stderr, "Usage: hand_simulation_bench [hands, default 20000] [runs, default 20]\n");
+		return 2;
+	}
+
+	std::vector<HandInput> inputs(hand_count);
+	for (int i = 0; i < hand_count; i++)
+	{
+		HandInput& input = inputs[i];
+		input.role = (i & 1) ? vr::TrackedControllerRole_RightHand : vr::TrackedControllerRole_LeftHand;
+		input.curls = { RandomFloat(0.f, 1.f), RandomFloat(0.f, 1.f), RandomFloat(0.f, 1.f), RandomFloat(0.f, 1.f), RandomFloat(0.f, 1.f) };
+		input.splays = { RandomFloat(-1.f, 1.f), RandomFloat(-1.f, 1.f), RandomFloat(-1.f, 1.f), RandomFloat(-1.f, 1.f), RandomFloat(-1.f, 1.f) };
+	}
+	// The ends of the range, where the table lookup clamps to its last cell
+	inputs[0].curls = { 1.f, 1.f, 1.f, 1.f, 1.f };
+	inputs[0].splays = { 1.f, 1.f, 1.f, 1.f, 1.f };
+	if (hand_count > 1)
+	{
+		inputs[1].curls = { 0.f, 0.f, 0.f, 0.f, 0.f };
+		inputs[1].splays = { -1.f, -1.f, -1.f, -1.f, -1.f };
+	}
+
+	MyHandSimulation simulation;
+
+	double max_orientation_error = 0.0;
+	double max_position_error = 0.0;
+	int worst_bone = 0;
+	for (const HandInput& input : inputs)
+	{
+		vr::VRBoneTransform_t table[eBone_Count] = {};
+		vr::VRBoneTransform_t analytic[eBone_Count] = {};
+		simulation.ComputeSkeletonTransforms(input.role, input.curls, input.splays, table);
+		simulation.ComputeSkeletonTransformsAnalytic(input.role, input.curls, input.splays, analytic);
+
+		// The aux bones are not written by either
+		for (int bone = 0; bone < eBone_Aux_Thumb; bone++)
+		{
+			const double orientation_error = OrientationErrorDegrees(table[bone].orientation, analytic[bone].orientation);
+			if (orientation_error > max_orientation_error)
+			{
+				max_orientation_error = orientation_error;
+				worst_bone = bone;
+			}
+			max_position_error = std::max(max_position_error, PositionError(table[bone].position, analytic[bone].position));
+		}
+	}
+
+	// A NaN must come out as the low end of the range rather than index outside the table
+	const float nan = std::nanf("");
+	bool nan_safe = true;
+	for (int hand = 0; hand < 2; hand++)
+	{
+		const vr::ETrackedControllerRole role = hand ? vr::TrackedControllerRole_RightHand : vr::TrackedControllerRole_LeftHand;
+		vr::VRBoneTransform_t from_nan[eBone_Count] = {};
+		vr::VRBoneTransform_t from_low[eBone_Count] = {};
+		simulation.ComputeSkeletonTransforms(role, { nan, nan, nan, nan, nan }, { nan, nan, nan, nan, nan }, from_nan);
+		simulation.ComputeSkeletonTransforms(role, { 0.f, 0.f, 0.f, 0.f, 0.f }, { -1.f, -1.f, -1.f, -1.f, -1.f }, from_low);
+		nan_safe = nan_safe && memcmp(from_nan, from_low, sizeof(from_nan)) == 0;
+	}
+	printf("NaN curls and splays: %s\n", nan_safe ? "ok" : "FAILED");
+
+	const bool accurate = max_orientation_error <= k_flMaxOrientationErrorDegrees && max_position_error <= k_flMaxPositionErrorMetres;
+	printf("%d hands: table vs analytic max orientation error %.4f degrees (bone %d), max position error %.2f um: %s\n",
+		hand_count, max_orientation_error, worst_bone, max_position_error * 1e6, accurate ? "ok" : "FAILED");
+
+	// The batch path takes one array per value. Leave the last group short unless there is only one.
+	const size_t batch_count = hand_count % MyHandSimulation::k_nBatchLanes == 0 && hand_count > MyHandSimulation::k_nBatchLanes ? hand_count - 3 : hand_count;
+	std::vector<vr::ETrackedControllerRole> batch_roles(hand_count);
+	std::vector<float> batch_values[10];
+	for (std::vector<float>& values : batch_values)
+		values.resize(hand_count);
+	for (int i = 0; i < hand_count; i++)
+	{
+		const HandInput& input = inputs[i];
+		const float values[10] = {
+			input.curls.thumb, input.curls.index, input.curls.middle, input.curls.ring, input.curls.pinky,
+			input.splays.thumb, input.splays.index, input.splays.middle, input.splays.ring, input.splays.pinky,
+		};
+		batch_roles[i] = input.role;
+		for (int value = 0; value < 10; value++)
+			batch_values[value][i] = values[value];
+	}
+	MyHandBatchInput batch_input;
+	batch_input.roles = batch_roles.data();
+	for (int finger = 0; finger < 5; finger++)
+	{
+		batch_input.curls[finger] = batch_values[finger].data();
+		batch_input.splays[finger] = batch_values[5 + finger].data();
+	}
+
+	std::vector<vr::VRBoneTransform_t> batch(hand_count * eBone_Count);
+	MyHandSimulation::ComputeSkeletonTransformsBatch(batch_input, batch_count, batch.data());
+
+	double max_batch_component_error = 0.0;
+	double max_batch_position_error = 0.0;
+	for (size_t i = 0; i < batch_count; i++)
+	{
+		vr::VRBoneTransform_t analytic[eBone_Count] = {};
+		simulation.ComputeSkeletonTransformsAnalytic(inputs[i].role, inputs[i].curls, inputs[i].splays, analytic);
+
+		const vr::VRBoneTransform_t* hand = &batch[i * eBone_Count];
+		for (int bone = 0; bone < eBone_Aux_Thumb; bone++)
+		{
+			const vr::HmdQuaternionf_t& a = hand[bone].orientation;
+			const vr::HmdQuaternionf_t& b = analytic[bone].orientation;
+			const double component_error = std::max(std::max(std::fabs(a.w - b.w), std::fabs(a.x - b.x)), std::max(std::fabs(a.y - b.y), std::fabs(a.z - b.z)));
+			max_batch_component_error = std::max(max_batch_component_error, component_error);
+			max_batch_position_error = std::max(max_batch_position_error, PositionError(hand[bone].position, analytic[bone].position));
+		}
+	}
+
+	const bool batch_matches = max_batch_component_error <= k_flMaxBatchComponentError && max_batch_position_error <= k_flMaxBatchPositionErrorMetres;
+	printf("%zu hands: batch vs analytic max quaternion component error %.2g, max position error %.2g m: %s\n",
+		batch_count, max_batch_component_error, max_batch_position_error, batch_matches ? "ok" : "FAILED");
+
+	// Timing. Each pass goes over every hand once; sink keeps the per-hand paths from being optimized away.
+	vr::VRBoneTransform_t transforms[eBone_Count] = {};
+	float sink = 0.f;
+	const double analytic_seconds = BestSeconds(runs, [&]() {
+		for (const HandInput& input : inputs)
+		{
+			simulation.ComputeSkeletonTransformsAnalytic(input.role, input.curls, input.splays, transforms);
+			sink += transforms[eBone_IndexFinger3].orientation.w;
+		}
+	});
+	const double table_seconds = BestSeconds(runs, [&]() {
+		for (const HandInput& input : inputs)
+		{
+			simulation.ComputeSkeletonTransforms(input.role, input.curls, input.splays, transforms);
+			sink += transforms[eBone_IndexFinger3].orientation.w;
+		}
+	});
+	// The batch goes through in chunks written to the same place, as the per-hand paths reuse one skeleton. Writing all
+	// the hands out would time the memory rather than the solver.
+	const double batch_seconds = BestSeconds(runs, [&]() {
+		for (int first_hand = 0; first_hand < hand_count; first_hand += k_nBatchChunkHands)
+		{
+			MyHandBatchInput chunk = batch_input;
+			chunk.roles += first_hand;
+			for (int finger = 0; finger < 5; finger++)
+			{
+				chunk.curls[finger] += first_hand;
+				chunk.splays[finger] += first_hand;
+			}
+			MyHandSimulation::ComputeSkeletonTransformsBatch(chunk, std::min(k_nBatchChunkHands, hand_count - first_hand), batch.data());
+			sink += batch[eBone_IndexFinger3].orientation.w;
+		}
+	});
+	if (sink == 12345.f)
+		printf(" ");
+
+	printf("best of %d runs over %d hands:\n", runs, hand_count);
+	printf("  analytic %6.0f ns per skeleton, %6.0f hands/ms\n", analytic_seconds * 1e9 / hand_count, hand_count * 1e-3 / analytic_seconds);
+	printf("  table    %6.0f ns per skeleton, %6.0f hands/ms\n", table_seconds * 1e9 / hand_count, hand_count * 1e-3 / table_seconds);
+	printf("  batch    %6.0f ns per skeleton, %6.0f hands/ms\n", batch_seconds * 1e9 / hand_count, hand_count * 1e-3 / batch_seconds);
+
+	return accurate && nan_safe && batch_matches ? 0 : 1;
+}
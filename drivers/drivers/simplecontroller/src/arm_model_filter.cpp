@@ -0,0 +1,173 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "arm_model_filter.h"
+
+static const float k_flGravity = 9.80665f;
+
+// Initial uncertainty of velocity (m/s) and accelerometer bias (m/s^2), before the first correction
+static const float k_flInitialVelocitySigma = 1.f;
+static const float k_flInitialBiasSigma = 0.5f;
+
+ArmModelParams ArmModelParams_Default()
+{
+	ArmModelParams params;
+	params.shoulder_offset = { 0.19f, -0.26f, 0.1f };
+	params.upper_arm_length = 0.28f;
+	params.forearm_length = 0.3f;
+	params.elbow_bend_ratio = 0.4f;
+
+	params.accel_noise = 0.5f;
+	params.accel_bias_walk = 0.05f;
+	params.body_model_noise = 0.2f;
+	return params;
+}
+
+// Rotation about the world up axis that matches the heading of q
+static vr::HmdQuaternion_t HmdQuaternion_YawOnly( const vr::HmdQuaternion_t &q )
+{
+	const vr::HmdVector3_t forward = HmdVector3_Forward * q;
+	const double yaw = atan2( -forward.v[ 0 ], -forward.v[ 2 ] );
+	return { cos( yaw * 0.5 ), 0.0, sin( yaw * 0.5 ), 0.0 };
+}
+
+ArmModelFilter::ArmModelFilter( bool left_hand, const ArmModelParams &params )
+	: params_( params )
+	, initialized_( false )
+{
+	if ( left_hand )
+		params_.shoulder_offset.v[ 0 ] = -params_.shoulder_offset.v[ 0 ];
+
+	Reset();
+}
+
+void ArmModelFilter::Reset()
+{
+	initialized_ = false;
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		position_[ i ] = 0.f;
+		velocity_[ i ] = 0.f;
+		accel_bias_[ i ] = 0.f;
+
+		cov_pp_[ i ] = params_.body_model_noise * params_.body_model_noise;
+		cov_pv_[ i ] = 0.f;
+		cov_pb_[ i ] = 0.f;
+		cov_vv_[ i ] = k_flInitialVelocitySigma * k_flInitialVelocitySigma;
+		cov_vb_[ i ] = 0.f;
+		cov_bb_[ i ] = k_flInitialBiasSigma * k_flInitialBiasSigma;
+	}
+}
+
+void ArmModelFilter::Predict( const vr::HmdQuaternion_t &orientation, const vr::HmdVector3_t &specific_force, float dt )
+{
+	if ( !initialized_ || dt <= 0.f )
+		return;
+
+	// Accelerometers measure specific force, so at rest they read +g upwards
+	const vr::HmdVector3_t world_force = specific_force * orientation;
+
+	alignas( 16 ) float accel[ 4 ] = { world_force.v[ 0 ], world_force.v[ 1 ] - k_flGravity, world_force.v[ 2 ], 0.f };
+
+	const float dt2 = dt * dt;
+	const float q_accel = params_.accel_noise * params_.accel_noise;
+	const float q_bias = params_.accel_bias_walk * params_.accel_bias_walk * dt;
+
+	// Error state transition per axis:
+	//     | 1  dt  -dt^2/2 |
+	// F = | 0  1   -dt     |
+	//     | 0  0    1      |
+	const float f_pb = -0.5f * dt2;
+	const float f_vb = -dt;
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		const float a = accel[ i ] - accel_bias_[ i ];
+		position_[ i ] += velocity_[ i ] * dt + 0.5f * a * dt2;
+		velocity_[ i ] += a * dt;
+
+		// P = F * P * F^T + Q, with Q from white acceleration noise plus a bias random walk
+		const float fp_pp = cov_pp_[ i ] + dt * cov_pv_[ i ] + f_pb * cov_pb_[ i ];
+		const float fp_pv = cov_pv_[ i ] + dt * cov_vv_[ i ] + f_pb * cov_vb_[ i ];
+		const float fp_pb = cov_pb_[ i ] + dt * cov_vb_[ i ] + f_pb * cov_bb_[ i ];
+		const float fp_vv = cov_vv_[ i ] + f_vb * cov_vb_[ i ];
+		const float fp_vb = cov_vb_[ i ] + f_vb * cov_bb_[ i ];
+
+		cov_pp_[ i ] = fp_pp + dt * fp_pv + f_pb * fp_pb + 0.25f * dt2 * dt2 * q_accel;
+		cov_pv_[ i ] = fp_pv + f_vb * fp_pb + 0.5f * dt2 * dt * q_accel;
+		cov_pb_[ i ] = fp_pb;
+		cov_vv_[ i ] = fp_vv + f_vb * fp_vb + dt2 * q_accel;
+		cov_vb_[ i ] = fp_vb;
+		cov_bb_[ i ] += q_bias;
+	}
+}
+
+vr::HmdVector3_t ArmModelFilter::ArmModelPosition( const vr::HmdVector3_t &hmd_position, const vr::HmdQuaternion_t &hmd_orientation, const vr::HmdQuaternion_t &controller_orientation ) const
+{
+	// The body is assumed to face wherever the head faces, ignoring head pitch and roll
+	const vr::HmdQuaternion_t body_yaw = HmdQuaternion_YawOnly( hmd_orientation );
+	const vr::HmdVector3_t shoulder = hmd_position + ( params_.shoulder_offset * body_yaw );
+
+	// The upper arm follows part of the controller's rotation, the forearm all of it
+	const vr::HmdQuaternion_t controller_in_body = -body_yaw * controller_orientation;
+	const vr::HmdQuaternion_t upper_arm_orientation = body_yaw * HmdQuaternion_Slerp( HmdQuaternion_Identity, controller_in_body, params_.elbow_bend_ratio );
+
+	const vr::HmdVector3_t upper_arm = { 0.f, -params_.upper_arm_length, 0.f };
+	const vr::HmdVector3_t forearm = { 0.f, 0.f, -params_.forearm_length };
+
+	const vr::HmdVector3_t elbow = shoulder + ( upper_arm * upper_arm_orientation );
+	return elbow + ( forearm * controller_orientation );
+}
+
+void ArmModelFilter::Correct( const vr::HmdVector3_t &hmd_position, const vr::HmdQuaternion_t &hmd_orientation, const vr::HmdQuaternion_t &controller_orientation )
+{
+	const vr::HmdVector3_t measurement = ArmModelPosition( hmd_position, hmd_orientation, controller_orientation );
+
+	if ( !initialized_ )
+	{
+		Reset();
+		for ( int i = 0; i < 3; i++ )
+			position_[ i ] = measurement.v[ i ];
+		initialized_ = true;
+		return;
+	}
+
+	alignas( 16 ) const float z[ 4 ] = { measurement.v[ 0 ], measurement.v[ 1 ], measurement.v[ 2 ], 0.f };
+	const float r = params_.body_model_noise * params_.body_model_noise;
+
+	// H = [ 1 0 0 ] per axis, so the innovation covariance and gain come straight out of the first covariance row
+	for ( int i = 0; i < 4; i++ )
+	{
+		const float innovation = z[ i ] - position_[ i ];
+		const float inv_s = 1.f / ( cov_pp_[ i ] + r );
+
+		const float k_p = cov_pp_[ i ] * inv_s;
+		const float k_v = cov_pv_[ i ] * inv_s;
+		const float k_b = cov_pb_[ i ] * inv_s;
+
+		// Inject the error estimate into the nominal state; the error state is zero again afterwards
+		position_[ i ] += k_p * innovation;
+		velocity_[ i ] += k_v * innovation;
+		accel_bias_[ i ] += k_b * innovation;
+
+		// P = ( I - K * H ) * P
+		const float pp = cov_pp_[ i ];
+		const float pv = cov_pv_[ i ];
+		const float pb = cov_pb_[ i ];
+		cov_pp_[ i ] = pp - k_p * pp;
+		cov_pv_[ i ] = pv - k_p * pv;
+		cov_pb_[ i ] = pb - k_p * pb;
+		cov_vv_[ i ] -= k_v * pv;
+		cov_vb_[ i ] -= k_v * pb;
+		cov_bb_[ i ] -= k_b * pb;
+	}
+}
+
+vr::HmdVector3_t ArmModelFilter::GetPosition() const
+{
+	return { position_[ 0 ], position_[ 1 ], position_[ 2 ] };
+}
+
+vr::HmdVector3_t ArmModelFilter::GetVelocity() const
+{
+	return { velocity_[ 0 ], velocity_[ 1 ], velocity_[ 2 ] };
+}
@@ -0,0 +1,65 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include "vrmath.h"
+
+struct ArmModelParams
+{
+	// Right hand values in HMD space with the head's yaw only. x is mirrored for the left hand.
+	vr::HmdVector3_t shoulder_offset;
+	float upper_arm_length;
+	float forearm_length;   // elbow to the centre of the controller
+	float elbow_bend_ratio; // share of the controller's rotation (relative to the body) taken by the upper arm
+
+	float accel_noise;		// m/s^2, white noise on the accelerometer
+	float accel_bias_walk;	// m/s^2 per sqrt(s), how fast the accelerometer bias may drift
+	float body_model_noise; // m, how far the real hand typically is from where the arm model puts it
+};
+
+ArmModelParams ArmModelParams_Default();
+
+//-----------------------------------------------------------------------------
+// Purpose: Estimates the position and velocity of a hand held controller by integrating its accelerometer, and keeps
+// the estimate from drifting away by pulling it towards an elbow model anchored to the HMD.
+//
+// The controller fuses its own orientation on board, so orientation is an input here rather than part of the state.
+// That leaves an error state of position, velocity and accelerometer bias per world axis, and with a position
+// measurement the three axes do not interact. Each quantity is therefore stored as four lanes (x, y, z, unused)
+// and every predict/correct step is the same straight line 4-wide arithmetic on all axes at once.
+//-----------------------------------------------------------------------------
+class ArmModelFilter
+{
+public:
+	explicit ArmModelFilter( bool left_hand, const ArmModelParams &params = ArmModelParams_Default() );
+
+	void Reset();
+
+	// specific_force is the raw accelerometer reading in the controller's frame (m/s^2, gravity included),
+	// orientation rotates that frame into world space.
+	void Predict( const vr::HmdQuaternion_t &orientation, const vr::HmdVector3_t &specific_force, float dt );
+
+	// Fuses the arm model position for the given HMD pose. The first call initializes the filter.
+	void Correct( const vr::HmdVector3_t &hmd_position, const vr::HmdQuaternion_t &hmd_orientation, const vr::HmdQuaternion_t &controller_orientation );
+
+	vr::HmdVector3_t ArmModelPosition( const vr::HmdVector3_t &hmd_position, const vr::HmdQuaternion_t &hmd_orientation, const vr::HmdQuaternion_t &controller_orientation ) const;
+
+	bool IsInitialized() const { return initialized_; }
+	vr::HmdVector3_t GetPosition() const;
+	vr::HmdVector3_t GetVelocity() const;
+
+private:
+	ArmModelParams params_;
+	bool initialized_;
+
+	alignas( 16 ) float position_[ 4 ];
+	alignas( 16 ) float velocity_[ 4 ];
+	alignas( 16 ) float accel_bias_[ 4 ];
+
+	// Upper triangle of the symmetric 3x3 error covariance (p = position, v = velocity, b = bias), per axis
+	alignas( 16 ) float cov_pp_[ 4 ];
+	alignas( 16 ) float cov_pv_[ 4 ];
+	alignas( 16 ) float cov_pb_[ 4 ];
+	alignas( 16 ) float cov_vv_[ 4 ];
+	alignas( 16 ) float cov_vb_[ 4 ];
+	alignas( 16 ) float cov_bb_[ 4 ];
+};
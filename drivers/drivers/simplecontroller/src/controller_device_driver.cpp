@@ -2,6 +2,10 @@
 #include "controller_device_driver.h"
 
 #include "driverlog.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 // vrmath.h is already included in the header
 
 // Let's create some variables for strings used in getting settings.
@@ -10,9 +14,43 @@ static const char* my_controller_right_settings_section = "driver_simplecontroll
 static const char* my_controller_left_settings_section = "driver_simplecontroller_right_controller";
 static const char* my_controller_settings_key_model_number = "mycontroller_model_number";
 static const char* my_controller_settings_key_serial_number = "mycontroller_serial_number";
+static const char* my_controller_settings_key_framed_protocol = "framed_protocol";
+static const char* my_controller_settings_key_udp_transport = "udp_transport";
+static const char* my_controller_settings_key_pose_interpolation_delay_ms = "pose_interpolation_delay_ms";
+static const char* my_controller_settings_key_position_filter = "position_filter";
 
 #define RECV_BUFFER_SIZE 512
 
+// Size of the NetFramePayload_ControllerIMU payload, see netframe.h
+static const uint16_t k_unControllerIMUPayloadSize = 24;
+static const uint16_t k_unControllerIMUWithAccelerationPayloadSize = 36;
+
+// Longest gap between IMU samples the position filter integrates over. After a longer gap it restarts from the arm model.
+static const double k_flPositionFilterMaxGap = 0.1;
+
+// How often link statistics are written to the log while data is flowing
+static const std::chrono::seconds k_linkStatsLogInterval(10);
+
+// Where each controller sits relative to the hmd when the IMU doesn't give a position: 0.15m to its side, up a little and
+// 0.3m in front, closer than the original simplecontroller for easier viewing
+static constexpr vr::HmdVector3_t k_vecLeftControllerOffsetPosition = { -0.15f, 0.1f, -0.3f };
+static constexpr vr::HmdVector3_t k_vecRightControllerOffsetPosition = { 0.15f, 0.1f, -0.3f };
+
+// Timestamps for pose_history_, in seconds
+static double MySecondsNow()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int MyLastSocketError()
+{
+#if defined(_WIN32)
+	return WSAGetLastError();
+#else
+	return errno;
+#endif
+}
+
 MyControllerDeviceDriver::MyControllerDeviceDriver(vr::ETrackedControllerRole role)
 	: my_controller_index_(vr::k_unTrackedDeviceIndexInvalid)
 	, my_controller_role_(role)
@@ -20,7 +58,17 @@ MyControllerDeviceDriver::MyControllerDeviceDriver(vr::ETrackedControllerRole ro
 	, tcp_server_active_(false)
 	, listen_socket_(INVALID_SOCKET)
 	, client_socket_(INVALID_SOCKET)
+	, use_framed_protocol_(false)
+	, use_udp_transport_(false)
 	, new_imu_data_available_(false)
+	, pose_interpolation_delay_(0.0)
+	, use_position_filter_(false)
+	, position_filter_(role == vr::TrackedControllerRole_LeftHand)
+	, last_filter_time_(0.0)
+	, filtered_pose_valid_(false)
+	, filtered_pose_time_(0.0)
+	, filtered_position_{}
+	, filtered_velocity_{}
 {
 	// Determine port based on role to avoid conflict if two instances are made
 	server_port_ = (my_controller_role_ == vr::TrackedControllerRole_LeftHand) ? TCP_PORT_LEFT : TCP_PORT_RIGHT;
@@ -30,6 +78,8 @@ MyControllerDeviceDriver::MyControllerDeviceDriver(vr::ETrackedControllerRole ro
 	latest_imu_data_.a_click = false;
 	latest_imu_data_.trigger_click = false;
 	latest_imu_data_.trigger_value = 0.0f;
+	latest_imu_data_.has_acceleration = false;
+	latest_imu_data_.acceleration = {};
 
 	char model_number[1024];
 	vr::VRSettings()->GetString(my_controller_main_settings_section, my_controller_settings_key_model_number, model_number, sizeof(model_number));
@@ -42,6 +92,16 @@ MyControllerDeviceDriver::MyControllerDeviceDriver(vr::ETrackedControllerRole ro
 
 	DriverLog("My Controller (%s) Model Number: %s", (my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "Left" : "Right"), my_controller_model_number_.c_str());
 	DriverLog("My Controller (%s) Serial Number: %s", (my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "Left" : "Right"), my_controller_serial_number_.c_str());
+
+	use_framed_protocol_ = vr::VRSettings()->GetBool(my_controller_main_settings_section, my_controller_settings_key_framed_protocol);
+	use_udp_transport_ = vr::VRSettings()->GetBool(my_controller_main_settings_section, my_controller_settings_key_udp_transport);
+
+	use_position_filter_ = vr::VRSettings()->GetBool(my_controller_main_settings_section, my_controller_settings_key_position_filter);
+	pose_interpolation_delay_ = std::max(0.f, vr::VRSettings()->GetFloat(my_controller_main_settings_section, my_controller_settings_key_pose_interpolation_delay_ms)) / 1000.0;
+
+	DriverLog("My Controller (%s) Protocol: %s over %s (CRC32C %s)", (my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "Left" : "Right"),
+		use_framed_protocol_ ? "framed" : "text", use_udp_transport_ ? "UDP" : "TCP",
+		NetFrame_Crc32cIsHardwareAccelerated() ? "hardware" : "software");
 }
 
 MyControllerDeviceDriver::~MyControllerDeviceDriver()
@@ -108,7 +168,15 @@ vr::EVRInitError MyControllerDeviceDriver::Activate(uint32_t unObjectId)
 	tcp_server_active_ = true;
 	new_imu_data_available_ = false;
 	latest_imu_data_.orientation = HmdQuaternion_Identity; // Reset
-	my_tcp_server_thread_ = std::thread(&MyControllerDeviceDriver::MyTCPServerThreadFunction, this);
+	frame_decoder_.Reset();
+	link_tracker_.ResetSequence();
+	pose_history_.Clear();
+	MyResetPositionFilter();
+	last_link_stats_log_ = std::chrono::steady_clock::now();
+	if (use_udp_transport_)
+		my_tcp_server_thread_ = std::thread(&MyControllerDeviceDriver::MyUDPServerThreadFunction, this);
+	else
+		my_tcp_server_thread_ = std::thread(&MyControllerDeviceDriver::MyTCPServerThreadFunction, this);
 
 	DriverLog("MyControllerDeviceDriver::Activate for %s hand, ObjectId: %d", (my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "Left" : "Right"), unObjectId);
 	return vr::VRInitError_None;
@@ -120,7 +188,7 @@ void MyControllerDeviceDriver::MyTCPServerThreadFunction()
 
 	listen_socket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 	if (listen_socket_ == INVALID_SOCKET) {
-		DriverLog("Socket creation failed: %d", (_WIN32) ? WSAGetLastError() : errno);
+		DriverLog("Socket creation failed: %d", MyLastSocketError());
 		return;
 	}
 
@@ -129,8 +197,8 @@ void MyControllerDeviceDriver::MyTCPServerThreadFunction()
 	service.sin_addr.s_addr = inet_addr("0.0.0.0"); // Listen on all available interfaces
 	service.sin_port = htons((u_short)server_port_);
 
-	if (bind(listen_socket_, (SOCKADDR*)&service, sizeof(service)) == SOCKET_ERROR) {
-		DriverLog("Bind failed: %d", (_WIN32) ? WSAGetLastError() : errno);
+	if (bind(listen_socket_, (sockaddr*)&service, sizeof(service)) == SOCKET_ERROR) {
+		DriverLog("Bind failed: %d", MyLastSocketError());
 #if defined(_WIN32)
 		closesocket(listen_socket_);
 #else
@@ -141,7 +209,7 @@ void MyControllerDeviceDriver::MyTCPServerThreadFunction()
 	}
 
 	if (listen(listen_socket_, 1) == SOCKET_ERROR) {
-		DriverLog("Listen failed: %d", (_WIN32) ? WSAGetLastError() : errno);
+		DriverLog("Listen failed: %d", MyLastSocketError());
 #if defined(_WIN32)
 		closesocket(listen_socket_);
 #else
@@ -160,7 +228,7 @@ void MyControllerDeviceDriver::MyTCPServerThreadFunction()
 			client_socket_ = accept(listen_socket_, NULL, NULL);
 			if (client_socket_ == INVALID_SOCKET) {
 				if (tcp_server_active_) { // Avoid error log if we are shutting down
-					DriverLog("Accept failed: %d", (_WIN32) ? WSAGetLastError() : errno);
+					DriverLog("Accept failed: %d", MyLastSocketError());
 				}
 				// If accept fails and we are still active, potentially wait and retry or break
 				// For simplicity, if accept fails and we're not shutting down, we might exit the loop or retry after a delay.
@@ -174,6 +242,12 @@ void MyControllerDeviceDriver::MyTCPServerThreadFunction()
 				}
 			}
 			DriverLog("ESP32 connected to %s hand server.", (my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "Left" : "Right"));
+
+			// A new connection starts its own sequence; partial frames from the old one are meaningless
+			frame_decoder_.Reset();
+			link_tracker_.ResetSequence();
+			pose_history_.Clear();
+			MyResetPositionFilter();
 		}
 
 		if (client_socket_ != INVALID_SOCKET)
@@ -182,28 +256,28 @@ void MyControllerDeviceDriver::MyTCPServerThreadFunction()
 			int recv_len = recv(client_socket_, recvbuf, RECV_BUFFER_SIZE - 1, 0); // -1 for null terminator
 
 			if (recv_len > 0) {
-				recvbuf[recv_len] = '\0'; // Null-terminate the received data
-
-				IMUData received_data_temp;
-				// Protocol: "qx,qy,qz,qw;btnA_click,btnTrig_click,trig_val\n"
-				int items = sscanf_s(recvbuf, "%lf,%lf,%lf,%lf;%d,%d,%f", // Use %lf for float if HmdQuaternion uses double, else %f
-					&received_data_temp.orientation.x, &received_data_temp.orientation.y,
-					&received_data_temp.orientation.z, &received_data_temp.orientation.w,
-					(int*)&received_data_temp.a_click, (int*)&received_data_temp.trigger_click,
-					&received_data_temp.trigger_value);
-
-				if (items == 7) { // Check if all parts were parsed
-					std::lock_guard<std::mutex> lock(imu_data_mutex_);
-					latest_imu_data_ = received_data_temp;
-					new_imu_data_available_ = true;
+				if (use_framed_protocol_) {
+					frame_decoder_.Push(reinterpret_cast<const uint8_t*>(recvbuf), recv_len);
+
+					NetFrame frame;
+					ENetFrameResult result;
+					while ((result = frame_decoder_.Next(frame)) != NetFrameResult_Incomplete) {
+						if (result == NetFrameResult_Ok)
+							MyHandleFrame(frame);
+						else
+							link_tracker_.OnCorrupt();
+					}
 				}
 				else {
-					DriverLog("Malformed data from ESP32: %s (parsed %d items)", recvbuf, items);
+					recvbuf[recv_len] = '\0'; // Null-terminate the received data
+					MyHandleTextPacket(recvbuf);
 				}
 
+				MyLogLinkStats(false);
 			}
 			else if (recv_len == 0) {
 				DriverLog("ESP32 disconnected from %s hand server.", (my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "Left" : "Right"));
+				MyLogLinkStats(true);
 #if defined(_WIN32)
 				closesocket(client_socket_);
 #else
@@ -213,7 +287,7 @@ void MyControllerDeviceDriver::MyTCPServerThreadFunction()
 			}
 			else { // recv_len < 0
 				if (tcp_server_active_) {
-					DriverLog("Recv failed for %s hand: %d", (my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "Left" : "Right"), (_WIN32) ? WSAGetLastError() : errno);
+					DriverLog("Recv failed for %s hand: %d", (my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "Left" : "Right"), MyLastSocketError());
 				}
 #if defined(_WIN32)
 				closesocket(client_socket_);
@@ -249,6 +323,220 @@ void MyControllerDeviceDriver::MyTCPServerThreadFunction()
 	DriverLog("TCP Server thread stopped for %s hand.", (my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "Left" : "Right"));
 }
 
+void MyControllerDeviceDriver::MyUDPServerThreadFunction()
+{
+	DriverLog("UDP Server thread started for %s hand on port %d.", (my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "Left" : "Right"), server_port_);
+
+	listen_socket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (listen_socket_ == INVALID_SOCKET) {
+		DriverLog("Socket creation failed: %d", MyLastSocketError());
+		return;
+	}
+
+	sockaddr_in service;
+	service.sin_family = AF_INET;
+	service.sin_addr.s_addr = inet_addr("0.0.0.0"); // Listen on all available interfaces
+	service.sin_port = htons((u_short)server_port_);
+
+	if (bind(listen_socket_, (sockaddr*)&service, sizeof(service)) == SOCKET_ERROR) {
+		DriverLog("Bind failed: %d", MyLastSocketError());
+#if defined(_WIN32)
+		closesocket(listen_socket_);
+#else
+		close(listen_socket_);
+#endif
+		listen_socket_ = INVALID_SOCKET;
+		return;
+	}
+
+	// Wake up periodically so Deactivate doesn't depend on closing the socket under a blocked recv()
+#if defined(_WIN32)
+	DWORD timeout_ms = 100;
+	setsockopt(listen_socket_, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout_ms, sizeof(timeout_ms));
+#else
+	timeval timeout = { 0, 100000 };
+	setsockopt(listen_socket_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+
+	while (tcp_server_active_)
+	{
+		char recvbuf[RECV_BUFFER_SIZE];
+		int recv_len = recv(listen_socket_, recvbuf, RECV_BUFFER_SIZE - 1, 0); // -1 for null terminator
+		if (recv_len <= 0)
+			continue; // Timeout, or the socket was closed by Deactivate
+
+		if (use_framed_protocol_) {
+			// One frame per datagram. Anything that doesn't decode cleanly is dropped as a whole.
+			NetFrame frame;
+			size_t consumed = 0;
+			if (NetFrame_Decode(reinterpret_cast<const uint8_t*>(recvbuf), recv_len, frame, consumed) == NetFrameResult_Ok && consumed == (size_t)recv_len)
+				MyHandleFrame(frame);
+			else
+				link_tracker_.OnCorrupt();
+		}
+		else {
+			recvbuf[recv_len] = '\0';
+			MyHandleTextPacket(recvbuf);
+		}
+
+		MyLogLinkStats(false);
+	}
+
+	MyLogLinkStats(true);
+
+	if (listen_socket_ != INVALID_SOCKET) {
+#if defined(_WIN32)
+		closesocket(listen_socket_);
+#else
+		close(listen_socket_);
+#endif
+		listen_socket_ = INVALID_SOCKET;
+	}
+	DriverLog("UDP Server thread stopped for %s hand.", (my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "Left" : "Right"));
+}
+
+void MyControllerDeviceDriver::MyHandleTextPacket(const char* packet)
+{
+	IMUData received_data_temp;
+	int a_click = 0;
+	int trigger_click = 0;
+
+	// Protocol: "qx,qy,qz,qw;btnA_click,btnTrig_click,trig_val[;ax,ay,az]\n"
+	// The buttons are read into ints: %d writes sizeof(int) bytes, which would overrun the bool members.
+	int items = sscanf_s(packet, "%lf,%lf,%lf,%lf;%d,%d,%f;%f,%f,%f", // HmdQuaternion_t uses doubles, hence %lf
+		&received_data_temp.orientation.x, &received_data_temp.orientation.y,
+		&received_data_temp.orientation.z, &received_data_temp.orientation.w,
+		&a_click, &trigger_click,
+		&received_data_temp.trigger_value,
+		&received_data_temp.acceleration.v[0], &received_data_temp.acceleration.v[1], &received_data_temp.acceleration.v[2]);
+
+	if (items == 7 || items == 10) { // Check if all parts were parsed, the acceleration is optional
+		received_data_temp.a_click = a_click != 0;
+		received_data_temp.trigger_click = trigger_click != 0;
+		received_data_temp.has_acceleration = items == 10;
+
+		MyApplyIMUData(received_data_temp);
+	}
+	else {
+		DriverLog("Malformed data from ESP32: %s (parsed %d items)", packet, items);
+	}
+}
+
+void MyControllerDeviceDriver::MyHandleFrame(const NetFrame& frame)
+{
+	// Classify first so that every well-formed frame counts towards the link statistics.
+	// Only the newest frame is applied: a late frame carries an older orientation than the one we already have.
+	if (link_tracker_.OnFrame(frame.sequence) != NetLinkTracker::Verdict_InOrder)
+		return;
+
+	if (frame.payload_type != NetFramePayload_ControllerIMU || frame.payload_length < k_unControllerIMUPayloadSize) {
+		DriverLog("Unexpected frame from ESP32: type %d, %d bytes", frame.payload_type, frame.payload_length);
+		return;
+	}
+
+	float values[5]; // qw, qx, qy, qz, trigger_value
+	memcpy(values, frame.payload, sizeof(values));
+	const uint8_t buttons = frame.payload[20];
+
+	IMUData received_data_temp;
+	received_data_temp.orientation.w = values[0];
+	received_data_temp.orientation.x = values[1];
+	received_data_temp.orientation.y = values[2];
+	received_data_temp.orientation.z = values[3];
+	received_data_temp.trigger_value = values[4];
+	received_data_temp.a_click = (buttons & 0x01) != 0;
+	received_data_temp.trigger_click = (buttons & 0x02) != 0;
+
+	received_data_temp.has_acceleration = frame.payload_length >= k_unControllerIMUWithAccelerationPayloadSize;
+	if (received_data_temp.has_acceleration)
+		memcpy(received_data_temp.acceleration.v, frame.payload + k_unControllerIMUPayloadSize, sizeof(received_data_temp.acceleration.v));
+	else
+		received_data_temp.acceleration = {};
+
+	MyApplyIMUData(received_data_temp);
+}
+
+void MyControllerDeviceDriver::MyApplyIMUData(const IMUData& received_data)
+{
+	// The sender's quaternion is only approximately unit length, while vrmath's rotations and the position filter
+	// assume an exact unit quaternion
+	const vr::HmdQuaternion_t& q = received_data.orientation;
+	const double norm_squared = q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z;
+	if (!(norm_squared > 1e-6 && norm_squared < 1e6)) { // also rejects NaN
+		DriverLog("Ignoring degenerate orientation from ESP32: %f,%f,%f,%f", q.x, q.y, q.z, q.w);
+		return;
+	}
+
+	IMUData data = received_data;
+	data.orientation = HmdQuaternion_Normalize(q);
+
+	{
+		std::lock_guard<std::mutex> lock(imu_data_mutex_);
+		latest_imu_data_ = data;
+		new_imu_data_available_ = true;
+	}
+
+	TimedPose sample = {};
+	sample.time = MySecondsNow();
+	sample.orientation = data.orientation;
+	pose_history_.Push(sample);
+
+	if (use_position_filter_ && data.has_acceleration)
+		MyUpdatePositionFilter(data, sample.time);
+}
+
+void MyControllerDeviceDriver::MyUpdatePositionFilter(const IMUData& data, double time)
+{
+	// The protocol carries no sample timestamps, so the filter steps by arrival time
+	const double dt = time - last_filter_time_;
+	last_filter_time_ = time;
+	if (dt > k_flPositionFilterMaxGap)
+		position_filter_.Reset();
+	else
+		position_filter_.Predict(data.orientation, data.acceleration, static_cast<float>(dt));
+
+	vr::TrackedDevicePose_t hmd_pose;
+	vr::VRServerDriverHost()->GetRawTrackedDevicePoses(0.f, &hmd_pose, 1);
+	if (hmd_pose.bPoseIsValid) {
+		const vr::HmdVector3_t hmd_position = HmdVector3_From34Matrix(hmd_pose.mDeviceToAbsoluteTracking);
+		const vr::HmdQuaternion_t hmd_orientation = HmdQuaternion_FromMatrix(hmd_pose.mDeviceToAbsoluteTracking);
+		position_filter_.Correct(hmd_position, hmd_orientation, data.orientation);
+	}
+
+	std::lock_guard<std::mutex> lock(imu_data_mutex_);
+	filtered_pose_valid_ = position_filter_.IsInitialized();
+	filtered_pose_time_ = time;
+	filtered_position_ = position_filter_.GetPosition();
+	filtered_velocity_ = position_filter_.GetVelocity();
+}
+
+void MyControllerDeviceDriver::MyResetPositionFilter()
+{
+	position_filter_.Reset();
+	last_filter_time_ = 0.0;
+
+	// GetPose must not keep extrapolating the estimate of the filter we just threw away
+	std::lock_guard<std::mutex> lock(imu_data_mutex_);
+	filtered_pose_valid_ = false;
+}
+
+void MyControllerDeviceDriver::MyLogLinkStats(bool force)
+{
+	if (!use_framed_protocol_)
+		return;
+
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (!force && now - last_link_stats_log_ < k_linkStatsLogInterval)
+		return;
+	last_link_stats_log_ = now;
+
+	const NetLinkStats stats = link_tracker_.GetStats();
+	DriverLog("Link stats for %s hand: %llu accepted, %llu lost, %llu late, %llu duplicate, %llu corrupt",
+		(my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "Left" : "Right"),
+		(unsigned long long)stats.frames_accepted, (unsigned long long)stats.frames_lost, (unsigned long long)stats.frames_late,
+		(unsigned long long)stats.frames_duplicate, (unsigned long long)stats.frames_corrupt);
+}
+
 
 void* MyControllerDeviceDriver::GetComponent(const char* pchComponentNameAndVersion)
 {
@@ -259,6 +547,14 @@ void MyControllerDeviceDriver::DebugRequest(const char* pchRequest, char* pchRes
 {
 	if (unResponseBufferSize >= 1)
 		pchResponseBuffer[0] = 0;
+
+	// "link_stats" returns the framed protocol counters, e.g. for a dashboard overlay or a debugging tool
+	if (strcmp(pchRequest, "link_stats") == 0 && unResponseBufferSize > 0) {
+		const NetLinkStats stats = link_tracker_.GetStats();
+		snprintf(pchResponseBuffer, unResponseBufferSize, "accepted=%llu lost=%llu late=%llu duplicate=%llu corrupt=%llu",
+			(unsigned long long)stats.frames_accepted, (unsigned long long)stats.frames_lost, (unsigned long long)stats.frames_late,
+			(unsigned long long)stats.frames_duplicate, (unsigned long long)stats.frames_corrupt);
+	}
 }
 
 vr::DriverPose_t MyControllerDeviceDriver::GetPose()
@@ -270,20 +566,53 @@ vr::DriverPose_t MyControllerDeviceDriver::GetPose()
 	pose.deviceIsConnected = true; // Assume connected if ESP32 is sending data or fallback is active
 	pose.result = vr::TrackingResult_Running_OK;
 
+	bool has_imu_data;
+	vr::HmdQuaternion_t latest_orientation;
+	bool has_filtered_pose;
+	double filtered_pose_time;
+	vr::HmdVector3_t filtered_position;
+	vr::HmdVector3_t filtered_velocity;
 	{ // Scope for the lock
 		std::lock_guard<std::mutex> lock(imu_data_mutex_);
-		if (new_imu_data_available_) {
-			pose.qRotation = latest_imu_data_.orientation;
-			// If you derive position from IMU (e.g., via sensor fusion), set it here.
-			// pose.vecPosition[0] = ...;
-			// pose.vecPosition[1] = ...;
-			// pose.vecPosition[2] = ...;
-		}
-		else {
-			// Fallback: if no IMU data, use identity rotation or last known good.
-			// For this example, let's use identity rotation.
-			pose.qRotation = HmdQuaternion_Identity;
+		has_imu_data = new_imu_data_available_;
+		latest_orientation = latest_imu_data_.orientation;
+		has_filtered_pose = filtered_pose_valid_;
+		filtered_pose_time = filtered_pose_time_;
+		filtered_position = filtered_position_;
+		filtered_velocity = filtered_velocity_;
+	}
+
+	// Rotation and the filtered position below are both evaluated at this time, so they stay in step when a delay
+	// is configured
+	const double now = MySecondsNow();
+	const double sample_time = now - pose_interpolation_delay_;
+
+	TimedPose sample;
+	if (!has_imu_data) {
+		// Fallback: if no IMU data, use identity rotation or last known good.
+		// For this example, let's use identity rotation.
+		pose.qRotation = HmdQuaternion_Identity;
+	}
+	else if (pose_history_.Sample(sample_time, sample)) {
+		// With a delay of 0 this is the newest sample. A small delay (about one sample interval) trades latency for
+		// smooth motion, as we then always interpolate between two received samples.
+		pose.qRotation = sample.orientation;
+	}
+	else {
+		pose.qRotation = latest_orientation;
+	}
+
+	// --- Positional tracking from the accelerometer, if enabled and the sender provides it ---
+	// The filter is stepped per IMU sample and its estimate is carried to the sample time (backwards when the delay
+	// puts it before the last step). Once samples stop for longer than the filter itself would integrate over, the
+	// estimate is stale and the HMD arm offset below takes over.
+	if (use_position_filter_ && has_filtered_pose && now - filtered_pose_time <= k_flPositionFilterMaxGap) {
+		const float age = static_cast<float>(sample_time - filtered_pose_time);
+		for (int i = 0; i < 3; i++) {
+			pose.vecPosition[i] = filtered_position.v[i] + filtered_velocity.v[i] * age;
+			pose.vecVelocity[i] = filtered_velocity.v[i];
 		}
+		return pose;
 	}
 
 	// --- Positional tracking (still HMD-based from simplecontroller) ---
@@ -307,11 +636,7 @@ vr::DriverPose_t MyControllerDeviceDriver::GetPose()
 		// You might want a fixed offset in world space or a more sophisticated setup
 		// if your IMU doesn't provide absolute position.
 
-		const vr::HmdVector3_t offset_position = {
-			my_controller_role_ == vr::TrackedControllerRole_LeftHand ? -0.15f : 0.15f,
-			0.1f,
-			-0.3f, // Closer than original simplecontroller for easier viewing
-		};
+		const vr::HmdVector3_t& offset_position = my_controller_role_ == vr::TrackedControllerRole_LeftHand ? k_vecLeftControllerOffsetPosition : k_vecRightControllerOffsetPosition;
 
 		// Rotate our offset by the hmd quaternion and add the HMD position
 		const vr::HmdVector3_t controller_position = hmd_position + (offset_position * hmd_orientation);
@@ -6,9 +6,13 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <chrono>
 #include <vector> // For recv buffer if needed, though char array is fine
 
+#include "arm_model_filter.h"
+#include "netframe.h"
 #include "openvr_driver.h"
+#include "posehistory.h"
 #include "vrmath.h" // For HmdQuaternion_t, HmdVector3_t, etc.
 
 // Networking includes (Windows)
@@ -50,6 +54,8 @@ struct IMUData {
 	float trigger_value;
 	bool a_click;
 	bool trigger_click;
+	bool has_acceleration;
+	vr::HmdVector3_t acceleration; // accelerometer reading in the controller's frame, m/s^2 with gravity
 	// Add other data like button presses, joystick axes, etc.
 	// For simplicity, we'll just add a button state
 	// uint64_t timestamp; // Optional, for freshness
@@ -90,6 +96,14 @@ public:
 
 private:
 	void MyTCPServerThreadFunction(); // The function our TCP server thread will run
+	void MyUDPServerThreadFunction(); // Used instead of the TCP server when udp_transport is set
+
+	void MyHandleTextPacket( const char *packet );
+	void MyHandleFrame( const NetFrame &frame );
+	void MyApplyIMUData( const IMUData &data );
+	void MyUpdatePositionFilter( const IMUData &data, double time );
+	void MyResetPositionFilter();
+	void MyLogLinkStats( bool force );
 
 	std::atomic< vr::TrackedDeviceIndex_t > my_controller_index_;
 	vr::ETrackedControllerRole my_controller_role_;
@@ -110,8 +124,30 @@ private:
 	SOCKET client_socket_;
 	int server_port_;
 
+	// Framed protocol (see netframe.h). Off by default, so existing senders keep working with the text protocol.
+	bool use_framed_protocol_;
+	bool use_udp_transport_;
+	NetFrameDecoder frame_decoder_;
+	NetLinkTracker link_tracker_;
+	std::chrono::steady_clock::time_point last_link_stats_log_;
+
 	// Shared IMU data
 	std::mutex imu_data_mutex_;
 	IMUData latest_imu_data_;
 	bool new_imu_data_available_; // To indicate if GetPose should use IMU data
+
+	// Orientation of every applied IMU sample, stamped with its arrival time. Written by the server thread, read
+	// lock-free by GetPose. The position is left at zero as ours is derived from the HMD at query time.
+	PoseHistory< 64 > pose_history_;
+	double pose_interpolation_delay_; // seconds GetPose looks back into pose_history_
+
+	// Optional positional tracking from the accelerometer, held near an HMD-anchored arm model.
+	// position_filter_ is only touched by the server thread, which publishes its output under imu_data_mutex_.
+	bool use_position_filter_;
+	ArmModelFilter position_filter_;
+	double last_filter_time_;
+	bool filtered_pose_valid_;
+	double filtered_pose_time_;
+	vr::HmdVector3_t filtered_position_;
+	vr::HmdVector3_t filtered_velocity_;
 };
\ No newline at end of file
@@ -13,6 +13,10 @@ static const char *my_tracker_main_settings_section = "driver_simpletrackers";
 // These are the keys we want to retrieve the values for in the settings
 static const char *my_tracker_settings_key_model_number = "mytracker_model_number";
 
+// Where the first tracker sits relative to the hmd, and how far along x each following one is moved
+static constexpr vr::HmdVector3_t k_vecFirstTrackerOffsetPosition = { -0.15f, 0.1f, -0.5f };
+static constexpr float k_flTrackerSpacing = 0.15f;
+
 MyTrackerDeviceDriver::MyTrackerDeviceDriver( unsigned int my_tracker_id )
 {
 	// Set a member to keep track of whether we've activated yet or not
@@ -150,9 +154,9 @@ vr::DriverPose_t MyTrackerDeviceDriver::GetPose()
 	pose.qRotation = hmd_orientation;
 
 	const vr::HmdVector3_t offset_position = {
-		-0.15f + my_tracker_id_ * 0.15, // translate our tracker depending on the id we were provided
-		0.1f,							// shift it up a little to make it more in view
-		-0.5f,							// put each controller 0.5m forward in front of the hmd so we can see it.
+		k_vecFirstTrackerOffsetPosition.v[ 0 ] + my_tracker_id_ * k_flTrackerSpacing, // translate our tracker depending on the id we were provided
+		k_vecFirstTrackerOffsetPosition.v[ 1 ],										 // shift it up a little to make it more in view
+		k_vecFirstTrackerOffsetPosition.v[ 2 ],										 // put each controller 0.5m forward in front of the hmd so we can see it.
 	};
 
 	// Rotate our offset by the hmd quaternion (so the controllers are always facing towards us), and add then add the
@@ -0,0 +1,391 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "netframe.h"
+
+#include <cstring>
+
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __x86_64__ ) || defined( __i386__ )
+#define NETFRAME_CRC_X86 1
+#include <nmmintrin.h>
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+#elif defined( __ARM_FEATURE_CRC32 )
+#define NETFRAME_CRC_ARM 1
+#include <arm_acle.h>
+#endif
+
+#if defined( NETFRAME_CRC_X86 ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define NETFRAME_TARGET_SSE42 __attribute__( ( target( "sse4.2" ) ) )
+#else
+#define NETFRAME_TARGET_SSE42
+#endif
+
+// Number of consecutive frames older than the reorder window before we assume the sender restarted its sequence.
+static const int k_nSequenceResyncThreshold = 16;
+
+static uint16_t ReadU16( const uint8_t *p )
+{
+	return (uint16_t)( p[ 0 ] | ( p[ 1 ] << 8 ) );
+}
+
+static uint32_t ReadU32( const uint8_t *p )
+{
+	return (uint32_t)p[ 0 ] | ( (uint32_t)p[ 1 ] << 8 ) | ( (uint32_t)p[ 2 ] << 16 ) | ( (uint32_t)p[ 3 ] << 24 );
+}
+
+static void WriteU16( uint8_t *p, uint16_t v )
+{
+	p[ 0 ] = (uint8_t)( v );
+	p[ 1 ] = (uint8_t)( v >> 8 );
+}
+
+static void WriteU32( uint8_t *p, uint32_t v )
+{
+	p[ 0 ] = (uint8_t)( v );
+	p[ 1 ] = (uint8_t)( v >> 8 );
+	p[ 2 ] = (uint8_t)( v >> 16 );
+	p[ 3 ] = (uint8_t)( v >> 24 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Table driven fallback, one byte at a time. Frames are small, so this is plenty.
+//-----------------------------------------------------------------------------
+struct Crc32cTable
+{
+	uint32_t entries[ 256 ];
+
+	Crc32cTable()
+	{
+		for ( uint32_t i = 0; i < 256; i++ )
+		{
+			uint32_t crc = i;
+			for ( int bit = 0; bit < 8; bit++ )
+			{
+				crc = ( crc & 1 ) ? ( crc >> 1 ) ^ 0x82F63B78u : ( crc >> 1 );
+			}
+			entries[ i ] = crc;
+		}
+	}
+};
+
+static uint32_t Crc32cSoftware( uint32_t crc, const uint8_t *data, size_t length )
+{
+	static const Crc32cTable table;
+
+	while ( length-- )
+	{
+		crc = table.entries[ ( crc ^ *data++ ) & 0xff ] ^ ( crc >> 8 );
+	}
+	return crc;
+}
+
+#if defined( NETFRAME_CRC_X86 )
+NETFRAME_TARGET_SSE42 static uint32_t Crc32cHardware( uint32_t crc, const uint8_t *data, size_t length )
+{
+#if defined( _M_X64 ) || defined( __x86_64__ )
+	uint64_t crc64 = crc;
+	while ( length >= 8 )
+	{
+		uint64_t chunk;
+		memcpy( &chunk, data, sizeof( chunk ) );
+		crc64 = _mm_crc32_u64( crc64, chunk );
+		data += 8;
+		length -= 8;
+	}
+	crc = (uint32_t)crc64;
+#endif
+	while ( length >= 4 )
+	{
+		uint32_t chunk;
+		memcpy( &chunk, data, sizeof( chunk ) );
+		crc = _mm_crc32_u32( crc, chunk );
+		data += 4;
+		length -= 4;
+	}
+	while ( length-- )
+	{
+		crc = _mm_crc32_u8( crc, *data++ );
+	}
+	return crc;
+}
+
+static bool CpuHasSse42()
+{
+#if defined( _MSC_VER )
+	int info[ 4 ];
+	__cpuid( info, 1 );
+	return ( info[ 2 ] & ( 1 << 20 ) ) != 0;
+#else
+	return __builtin_cpu_supports( "sse4.2" );
+#endif
+}
+#elif defined( NETFRAME_CRC_ARM )
+static uint32_t Crc32cHardware( uint32_t crc, const uint8_t *data, size_t length )
+{
+	while ( length >= 8 )
+	{
+		uint64_t chunk;
+		memcpy( &chunk, data, sizeof( chunk ) );
+		crc = __crc32cd( crc, chunk );
+		data += 8;
+		length -= 8;
+	}
+	while ( length-- )
+	{
+		crc = __crc32cb( crc, *data++ );
+	}
+	return crc;
+}
+#endif
+
+bool NetFrame_Crc32cIsHardwareAccelerated()
+{
+#if defined( NETFRAME_CRC_X86 )
+	static const bool has_sse42 = CpuHasSse42();
+	return has_sse42;
+#elif defined( NETFRAME_CRC_ARM )
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint32_t NetFrame_Crc32c( const void *data, size_t length )
+{
+	const uint8_t *bytes = static_cast< const uint8_t * >( data );
+
+#if defined( NETFRAME_CRC_X86 ) || defined( NETFRAME_CRC_ARM )
+	if ( NetFrame_Crc32cIsHardwareAccelerated() )
+	{
+		return ~Crc32cHardware( 0xFFFFFFFFu, bytes, length );
+	}
+#endif
+	return ~Crc32cSoftware( 0xFFFFFFFFu, bytes, length );
+}
+
+ENetFrameResult NetFrame_Decode( const uint8_t *data, size_t length, NetFrame &out_frame, size_t &consumed )
+{
+	consumed = 0;
+
+	if ( length < k_unNetFrameHeaderSize )
+		return NetFrameResult_Incomplete;
+
+	if ( ReadU16( data ) != k_unNetFrameMagic || data[ 2 ] != k_unNetFrameVersion )
+		return NetFrameResult_BadHeader;
+
+	const uint16_t payload_length = ReadU16( data + 8 );
+	if ( payload_length > k_unNetFrameMaxPayload )
+		return NetFrameResult_BadHeader;
+
+	const size_t checked_size = k_unNetFrameHeaderSize + payload_length;
+	if ( length < checked_size + k_unNetFrameTrailerSize )
+		return NetFrameResult_Incomplete;
+
+	if ( ReadU32( data + checked_size ) != NetFrame_Crc32c( data, checked_size ) )
+		return NetFrameResult_BadChecksum;
+
+	out_frame.payload_type = data[ 3 ];
+	out_frame.sequence = ReadU32( data + 4 );
+	out_frame.payload_length = payload_length;
+	memcpy( out_frame.payload, data + k_unNetFrameHeaderSize, payload_length );
+
+	consumed = checked_size + k_unNetFrameTrailerSize;
+	return NetFrameResult_Ok;
+}
+
+size_t NetFrame_Encode( uint8_t payload_type, uint32_t sequence, const void *payload, uint16_t payload_length, uint8_t *out_buffer )
+{
+	if ( payload_length > k_unNetFrameMaxPayload )
+		return 0;
+
+	WriteU16( out_buffer, k_unNetFrameMagic );
+	out_buffer[ 2 ] = k_unNetFrameVersion;
+	out_buffer[ 3 ] = payload_type;
+	WriteU32( out_buffer + 4, sequence );
+	WriteU16( out_buffer + 8, payload_length );
+	memcpy( out_buffer + k_unNetFrameHeaderSize, payload, payload_length );
+
+	const size_t checked_size = k_unNetFrameHeaderSize + payload_length;
+	WriteU32( out_buffer + checked_size, NetFrame_Crc32c( out_buffer, checked_size ) );
+
+	return checked_size + k_unNetFrameTrailerSize;
+}
+
+NetFrameDecoder::NetFrameDecoder()
+	: read_position_( 0 )
+	, discarded_bytes_( 0 )
+	, resyncing_( false )
+{
+	buffer_.reserve( k_unNetFrameMaxSize * 4 );
+}
+
+void NetFrameDecoder::Push( const uint8_t *data, size_t length )
+{
+	// Drop what has already been consumed before growing, so the buffer stays around a few frames in size.
+	if ( read_position_ > 0 )
+	{
+		buffer_.erase( buffer_.begin(), buffer_.begin() + read_position_ );
+		read_position_ = 0;
+	}
+	buffer_.insert( buffer_.end(), data, data + length );
+}
+
+ENetFrameResult NetFrameDecoder::Next( NetFrame &out_frame )
+{
+	const uint8_t magic_lo = (uint8_t)( k_unNetFrameMagic & 0xff );
+	const uint8_t magic_hi = (uint8_t)( k_unNetFrameMagic >> 8 );
+
+	for ( ;; )
+	{
+		const size_t available = buffer_.size() - read_position_;
+		const uint8_t *p = buffer_.data() + read_position_;
+
+		if ( available < 2 )
+			return NetFrameResult_Incomplete;
+
+		if ( p[ 0 ] != magic_lo || p[ 1 ] != magic_hi )
+		{
+			// Skip to the next byte that could start a frame.
+			size_t skip = 1;
+			while ( skip + 1 < available && !( p[ skip ] == magic_lo && p[ skip + 1 ] == magic_hi ) )
+				skip++;
+
+			read_position_ += skip;
+			discarded_bytes_ += skip;
+
+			// Bytes that do not start with the magic are a frame whose header was damaged. Report the start of each
+			// damaged run, not every false magic found while scanning through it.
+			if ( !resyncing_ )
+			{
+				resyncing_ = true;
+				return NetFrameResult_BadHeader;
+			}
+			continue;
+		}
+
+		size_t consumed;
+		const ENetFrameResult result = NetFrame_Decode( p, available, out_frame, consumed );
+		if ( result == NetFrameResult_Ok )
+		{
+			read_position_ += consumed;
+			resyncing_ = false;
+			return NetFrameResult_Ok;
+		}
+
+		if ( result == NetFrameResult_Incomplete )
+			return NetFrameResult_Incomplete;
+
+		// Resync one byte past this magic. A checksum failure means the header looked right, so it is always a dropped
+		// frame; a bad header is only reported if it starts a damaged run.
+		read_position_ += 1;
+		discarded_bytes_ += 1;
+		const bool report = result == NetFrameResult_BadChecksum || !resyncing_;
+		resyncing_ = true;
+		if ( report )
+			return result;
+	}
+}
+
+void NetFrameDecoder::Reset()
+{
+	buffer_.clear();
+	read_position_ = 0;
+	resyncing_ = false;
+}
+
+NetLinkTracker::NetLinkTracker()
+	: has_sequence_( false )
+	, highest_sequence_( 0 )
+	, seen_window_( 0 )
+	, stale_run_( 0 )
+	, frames_accepted_( 0 )
+	, frames_late_( 0 )
+	, frames_duplicate_( 0 )
+	, frames_lost_( 0 )
+	, frames_corrupt_( 0 )
+{
+}
+
+NetLinkTracker::EVerdict NetLinkTracker::OnFrame( uint32_t sequence )
+{
+	if ( !has_sequence_ )
+	{
+		has_sequence_ = true;
+		highest_sequence_ = sequence;
+		seen_window_ = 1;
+		stale_run_ = 0;
+		frames_accepted_.fetch_add( 1, std::memory_order_relaxed );
+		return Verdict_InOrder;
+	}
+
+	// Signed distance handles the 32-bit sequence wrapping around.
+	const int32_t distance = (int32_t)( sequence - highest_sequence_ );
+
+	if ( distance > 0 )
+	{
+		if ( distance > 1 )
+		{
+			frames_lost_.fetch_add( (uint64_t)( distance - 1 ), std::memory_order_relaxed );
+		}
+
+		seen_window_ = ( distance >= k_nWindowSize ) ? 0 : ( seen_window_ << distance );
+		seen_window_ |= 1;
+		highest_sequence_ = sequence;
+		stale_run_ = 0;
+		frames_accepted_.fetch_add( 1, std::memory_order_relaxed );
+		return Verdict_InOrder;
+	}
+
+	const uint32_t age = (uint32_t)( -(int64_t)distance );
+	if ( age < (uint32_t)k_nWindowSize )
+	{
+		stale_run_ = 0;
+
+		const uint64_t bit = 1ull << age;
+		if ( seen_window_ & bit )
+		{
+			frames_duplicate_.fetch_add( 1, std::memory_order_relaxed );
+			return Verdict_Duplicate;
+		}
+
+		// This one was counted as lost when we skipped over it.
+		seen_window_ |= bit;
+		if ( frames_lost_.load( std::memory_order_relaxed ) > 0 )
+		{
+			frames_lost_.fetch_sub( 1, std::memory_order_relaxed );
+		}
+		frames_late_.fetch_add( 1, std::memory_order_relaxed );
+		return Verdict_Late;
+	}
+
+	// Too old to tell apart from a duplicate. If this keeps happening the sender has most likely restarted.
+	frames_late_.fetch_add( 1, std::memory_order_relaxed );
+	if ( ++stale_run_ >= k_nSequenceResyncThreshold )
+	{
+		ResetSequence();
+	}
+	return Verdict_Late;
+}
+
+void NetLinkTracker::OnCorrupt()
+{
+	frames_corrupt_.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void NetLinkTracker::ResetSequence()
+{
+	has_sequence_ = false;
+	seen_window_ = 0;
+	stale_run_ = 0;
+}
+
+NetLinkStats NetLinkTracker::GetStats() const
+{
+	NetLinkStats stats;
+	stats.frames_accepted = frames_accepted_.load( std::memory_order_relaxed );
+	stats.frames_late = frames_late_.load( std::memory_order_relaxed );
+	stats.frames_duplicate = frames_duplicate_.load( std::memory_order_relaxed );
+	stats.frames_lost = frames_lost_.load( std::memory_order_relaxed );
+	stats.frames_corrupt = frames_corrupt_.load( std::memory_order_relaxed );
+	return stats;
+}
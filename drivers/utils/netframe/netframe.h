@@ -0,0 +1,153 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Framed wire format shared by the network-fed drivers.
+//
+// Every frame is little-endian and laid out as:
+//
+//   offset  size  field
+//   0       2     magic          (k_unNetFrameMagic)
+//   2       1     version        (k_unNetFrameVersion)
+//   3       1     payload type   (ENetFramePayloadType)
+//   4       4     sequence       (incremented by one per frame by the sender)
+//   8       2     payload length (bytes, at most k_unNetFrameMaxPayload)
+//   10      n     payload
+//   10 + n  4     CRC32C of bytes [0, 10 + n)
+//
+// On a stream transport (TCP) frames are concatenated and NetFrameDecoder resynchronizes on the magic after a
+// corrupt frame. On a datagram transport (UDP) each datagram carries exactly one frame.
+//-----------------------------------------------------------------------------
+static const uint16_t k_unNetFrameMagic = 0x5647; // "GV" on the wire
+static const uint8_t k_unNetFrameVersion = 1;
+static const size_t k_unNetFrameHeaderSize = 10;
+static const size_t k_unNetFrameTrailerSize = 4;
+static const size_t k_unNetFrameMaxPayload = 256;
+static const size_t k_unNetFrameMaxSize = k_unNetFrameHeaderSize + k_unNetFrameMaxPayload + k_unNetFrameTrailerSize;
+
+enum ENetFramePayloadType : uint8_t
+{
+	NetFramePayload_Invalid = 0,
+
+	// 24 bytes: float qw, qx, qy, qz, float trigger_value, uint8 buttons (bit 0 a_click, bit 1 trigger_click), 3 bytes padding
+	// optionally followed by 12 bytes: float ax, ay, az, the accelerometer reading in m/s^2 (gravity included)
+	NetFramePayload_ControllerIMU = 1,
+
+	// 40 bytes: float curl[ 5 ] (0-1), float splay[ 5 ] (-1-1), each ordered thumb, index, middle, ring, pinky
+	NetFramePayload_HandCurlSplay = 2,
+};
+
+enum ENetFrameResult
+{
+	NetFrameResult_Ok,
+	NetFrameResult_Incomplete,	// not enough bytes buffered yet
+	NetFrameResult_BadHeader,	// wrong magic, version or an oversized length
+	NetFrameResult_BadChecksum, // CRC32C mismatch
+};
+
+struct NetFrame
+{
+	uint8_t payload_type;
+	uint32_t sequence;
+	uint16_t payload_length;
+	uint8_t payload[ k_unNetFrameMaxPayload ];
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: CRC32C (Castagnoli), as used by iSCSI/ext4. Uses SSE4.2 or ARMv8 CRC instructions when the CPU has them,
+// and a table driven implementation otherwise.
+//-----------------------------------------------------------------------------
+uint32_t NetFrame_Crc32c( const void *data, size_t length );
+bool NetFrame_Crc32cIsHardwareAccelerated();
+
+//-----------------------------------------------------------------------------
+// Purpose: Decodes a single frame from the start of data. On success, consumed is set to the size of the frame.
+// For datagram transports, anything other than NetFrameResult_Ok means the datagram should be dropped.
+//-----------------------------------------------------------------------------
+ENetFrameResult NetFrame_Decode( const uint8_t *data, size_t length, NetFrame &out_frame, size_t &consumed );
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes a frame into out_buffer, which must hold at least k_unNetFrameMaxSize bytes.
+// Returns the number of bytes written, or 0 if the payload is too large.
+//-----------------------------------------------------------------------------
+size_t NetFrame_Encode( uint8_t payload_type, uint32_t sequence, const void *payload, uint16_t payload_length, uint8_t *out_buffer );
+
+//-----------------------------------------------------------------------------
+// Purpose: Reassembles frames out of a byte stream.
+//-----------------------------------------------------------------------------
+class NetFrameDecoder
+{
+public:
+	NetFrameDecoder();
+
+	void Push( const uint8_t *data, size_t length );
+
+	// Returns NetFrameResult_Incomplete once no more frames can be extracted from what has been pushed so far.
+	// NetFrameResult_BadHeader and NetFrameResult_BadChecksum are reported once per dropped frame, after which the
+	// decoder has already skipped past it. A damaged header is reported once for the whole run of bytes skipped until
+	// the next good frame.
+	ENetFrameResult Next( NetFrame &out_frame );
+
+	void Reset();
+
+	uint64_t DiscardedBytes() const { return discarded_bytes_; }
+
+private:
+	std::vector< uint8_t > buffer_;
+	size_t read_position_;
+	uint64_t discarded_bytes_;
+	bool resyncing_;	// skipping a damaged run, already reported
+};
+
+struct NetLinkStats
+{
+	uint64_t frames_accepted;	// in order, applied
+	uint64_t frames_late;		// arrived after a newer frame, not applied
+	uint64_t frames_duplicate;	// sequence already seen
+	uint64_t frames_lost;		// sequence gaps that have not (yet) been filled by late frames
+	uint64_t frames_corrupt;	// bad header or checksum
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Classifies incoming sequence numbers and keeps per-link loss, reorder and duplicate counters.
+// OnFrame/OnCorrupt must be called from a single thread; GetStats may be called from any thread.
+//-----------------------------------------------------------------------------
+class NetLinkTracker
+{
+public:
+	enum EVerdict
+	{
+		Verdict_InOrder,   // newest frame so far, use it
+		Verdict_Late,	   // older than the newest frame, drop it for "latest value" consumers
+		Verdict_Duplicate, // already seen, drop it
+	};
+
+	NetLinkTracker();
+
+	EVerdict OnFrame( uint32_t sequence );
+	void OnCorrupt();
+
+	// Forget the sequence history (e.g. on reconnect) but keep the counters.
+	void ResetSequence();
+
+	NetLinkStats GetStats() const;
+
+private:
+	static const int k_nWindowSize = 64;
+
+	bool has_sequence_;
+	uint32_t highest_sequence_;
+	uint64_t seen_window_; // bit n set = highest_sequence_ - n has been received
+	int stale_run_;
+
+	std::atomic< uint64_t > frames_accepted_;
+	std::atomic< uint64_t > frames_late_;
+	std::atomic< uint64_t > frames_duplicate_;
+	std::atomic< uint64_t > frames_lost_;
+	std::atomic< uint64_t > frames_corrupt_;
+};
@@ -0,0 +1,226 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include "vrmath.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+struct TimedPose
+{
+	double time; // seconds, on whatever monotonic clock the writer and readers agree on
+	vr::HmdVector3_t position;
+	vr::HmdQuaternion_t orientation;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Fixed capacity history of timestamped poses for a single device, used to answer "where was the device at
+// time T" for latency compensation and for lining devices up against each other.
+//
+// One thread may write (Push/Clear). Any number of threads may read (Sample/Newest) at the same time without taking a
+// lock: every slot carries a sequence counter that is odd while the writer is inside it, so a reader that races the
+// writer notices and retries rather than blocking it. The pose itself is stored as relaxed atomic words, so a reader
+// that copies a slot mid-write gets a torn value it then throws away, rather than a data race.
+//-----------------------------------------------------------------------------
+template < uint32_t Capacity >
+class PoseHistory
+{
+	static_assert( Capacity >= 2 && ( Capacity & ( Capacity - 1 ) ) == 0, "Capacity must be a power of two" );
+
+public:
+	PoseHistory()
+		: write_count_( 0 )
+		, first_index_( 0 )
+		, newest_time_( 0.0 )
+	{
+		for ( Slot &slot : slots_ )
+		{
+			slot.sequence.store( 0, std::memory_order_relaxed );
+			slot.index.store( 0, std::memory_order_relaxed );
+			for ( std::atomic< uint64_t > &word : slot.pose )
+				word.store( 0, std::memory_order_relaxed );
+		}
+	}
+
+	// Appends a pose. Poses must arrive in time order so the history stays sorted; an older pose is rejected and
+	// false is returned.
+	bool Push( const TimedPose &pose )
+	{
+		const uint64_t count = write_count_.load( std::memory_order_relaxed );
+		if ( count != first_index_.load( std::memory_order_relaxed ) && pose.time < newest_time_ )
+			return false;
+
+		Slot &slot = slots_[ count & k_unMask ];
+		const uint32_t sequence = slot.sequence.load( std::memory_order_relaxed );
+		slot.sequence.store( sequence + 1, std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_release );
+
+		uint64_t words[ k_unPoseWords ] = {};
+		memcpy( words, &pose, sizeof( TimedPose ) );
+		for ( uint32_t i = 0; i < k_unPoseWords; i++ )
+			slot.pose[ i ].store( words[ i ], std::memory_order_relaxed );
+		slot.index.store( count, std::memory_order_relaxed );
+
+		slot.sequence.store( sequence + 2, std::memory_order_release );
+
+		newest_time_ = pose.time;
+		write_count_.store( count + 1, std::memory_order_release );
+		return true;
+	}
+
+	// Forgets every pose pushed so far, e.g. when the device reconnects and its old samples no longer apply.
+	void Clear()
+	{
+		first_index_.store( write_count_.load( std::memory_order_relaxed ), std::memory_order_release );
+	}
+
+	// Returns the pose at the given time: interpolated between the two neighbouring samples (lerp for the position,
+	// slerp for the orientation), or clamped to the oldest/newest sample outside the stored range.
+	// O(log Capacity). Returns false if the history is empty, or if the writer kept overwriting the slots being read.
+	bool Sample( double time, TimedPose &out_pose ) const
+	{
+		for ( int attempt = 0; attempt < k_nMaxAttempts; attempt++ )
+		{
+			uint64_t first, count;
+			if ( !GetRange( first, count ) )
+				return false;
+
+			TimedPose newest;
+			if ( !ReadSlot( count - 1, newest ) )
+				continue;
+			if ( time >= newest.time )
+			{
+				out_pose = newest;
+				return true;
+			}
+
+			TimedPose oldest;
+			if ( !ReadSlot( first, oldest ) )
+				continue;
+			if ( time <= oldest.time )
+			{
+				out_pose = oldest;
+				return true;
+			}
+
+			// Invariant: before.time <= time < after.time
+			uint64_t low = first;
+			uint64_t high = count - 1;
+			TimedPose before = oldest;
+			TimedPose after = newest;
+			bool torn = false;
+
+			while ( high - low > 1 )
+			{
+				const uint64_t middle = low + ( high - low ) / 2;
+
+				TimedPose pose;
+				if ( !ReadSlot( middle, pose ) )
+				{
+					torn = true;
+					break;
+				}
+
+				if ( pose.time <= time )
+				{
+					low = middle;
+					before = pose;
+				}
+				else
+				{
+					high = middle;
+					after = pose;
+				}
+			}
+
+			if ( torn )
+				continue;
+
+			const double span = after.time - before.time;
+			const double t = span > 0.0 ? ( time - before.time ) / span : 0.0;
+
+			out_pose.time = time;
+			out_pose.position = HmdVector3_Lerp( before.position, after.position, static_cast< float >( t ) );
+			out_pose.orientation = HmdQuaternion_Slerp( before.orientation, after.orientation, t );
+			return true;
+		}
+
+		return false;
+	}
+
+	bool Newest( TimedPose &out_pose ) const
+	{
+		for ( int attempt = 0; attempt < k_nMaxAttempts; attempt++ )
+		{
+			uint64_t first, count;
+			if ( !GetRange( first, count ) )
+				return false;
+
+			if ( ReadSlot( count - 1, out_pose ) )
+				return true;
+		}
+
+		return false;
+	}
+
+	uint32_t Size() const
+	{
+		uint64_t first, count;
+		return GetRange( first, count ) ? static_cast< uint32_t >( count - first ) : 0;
+	}
+
+private:
+	static const uint32_t k_unMask = Capacity - 1;
+	static const int k_nMaxAttempts = 4;
+	static const uint32_t k_unPoseWords = ( sizeof( TimedPose ) + sizeof( uint64_t ) - 1 ) / sizeof( uint64_t );
+	static_assert( std::is_trivially_copyable< TimedPose >::value, "TimedPose is copied as raw words" );
+
+	struct Slot
+	{
+		std::atomic< uint32_t > sequence;
+		std::atomic< uint64_t > index; // which push wrote this slot, to catch a slot that was reused while we were searching
+		std::atomic< uint64_t > pose[ k_unPoseWords ];
+	};
+
+	// The readable range is [first, count). One slot is kept back so the slot the writer fills next is never searched.
+	bool GetRange( uint64_t &first, uint64_t &count ) const
+	{
+		count = write_count_.load( std::memory_order_acquire );
+		first = first_index_.load( std::memory_order_acquire );
+		if ( count >= Capacity )
+			first = std::max( first, count - ( Capacity - 1 ) );
+
+		return count > first;
+	}
+
+	bool ReadSlot( uint64_t index, TimedPose &out_pose ) const
+	{
+		const Slot &slot = slots_[ index & k_unMask ];
+
+		const uint32_t sequence_before = slot.sequence.load( std::memory_order_acquire );
+		if ( sequence_before & 1 )
+			return false;
+
+		uint64_t words[ k_unPoseWords ];
+		for ( uint32_t i = 0; i < k_unPoseWords; i++ )
+			words[ i ] = slot.pose[ i ].load( std::memory_order_relaxed );
+		const uint64_t slot_index = slot.index.load( std::memory_order_relaxed );
+
+		std::atomic_thread_fence( std::memory_order_acquire );
+		const uint32_t sequence_after = slot.sequence.load( std::memory_order_relaxed );
+
+		if ( sequence_before != sequence_after || slot_index != index )
+			return false;
+
+		memcpy( &out_pose, words, sizeof( TimedPose ) );
+		return true;
+	}
+
+	Slot slots_[ Capacity ];
+	std::atomic< uint64_t > write_count_;
+	std::atomic< uint64_t > first_index_;
+	double newest_time_; // only touched by the writer
+};
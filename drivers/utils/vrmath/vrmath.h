@@ -11,7 +11,7 @@
 #define DEG_TO_RAD( degrees ) ( ( degrees )*M_PI / 180.0 )
 #define RAD_TO_DEG( radians ) ( ( radians )*180.0 / M_PI )
 
-static const vr::HmdQuaternion_t HmdQuaternion_Identity = { 1.f, 0.f, 0.f, 0.f };
+static constexpr vr::HmdQuaternion_t HmdQuaternion_Identity = { 1.f, 0.f, 0.f, 0.f };
 
 // right hand coordinate system
 static const vr::HmdVector3_t HmdVector3_Right = { 1.f, 0, 0 };
@@ -21,22 +21,117 @@ static const vr::HmdVector3_t HmdVector3_Down = { 0, -1.f, 0 };
 static const vr::HmdVector3_t HmdVector3_Forward = { 0, 0, -1.f };
 static const vr::HmdVector3_t HmdVector3_Backward = { 0, 0, 1.f };
 
-// 3x3 or 3x4 matrix
-template < class T >
-vr::HmdQuaternion_t HmdQuaternion_FromMatrix( const T &matrix )
+/*
+Compile time maths, for fixed offsets and rotations that would otherwise be worked out on every pose. The <cmath>
+functions aren't constexpr, so these sum Taylor series and iterate instead. They're accurate to a few ulp in double but far
+slower than <cmath>, so use them to initialise constexpr values and stick to the regular functions everywhere else.
+*/
+
+static constexpr double ConstexprMath_Abs( const double x )
+{
+	return x < 0.0 ? -x : x;
+}
+
+static constexpr double ConstexprMath_Sqrt( const double x )
+{
+	if ( !( x > 0.0 ) )
+		return 0.0;
+
+	// Newton's method from above the root converges monotonically, so stop as soon as it stops going down
+	double guess = x > 1.0 ? x : 1.0;
+	for ( int i = 0; i < 1100; i++ )
+	{
+		const double next = 0.5 * ( guess + x / guess );
+		if ( !( next < guess ) )
+			break;
+		guess = next;
+	}
+
+	return guess;
+}
+
+// x brought into [-pi, pi], where the Taylor series below converge in at most 20 or so terms
+static constexpr double ConstexprMath_WrapAngle( const double x )
+{
+	const double two_pi = 2.0 * M_PI;
+	const double turns = x / two_pi;
+	return x - two_pi * static_cast< double >( static_cast< long long >( turns < 0.0 ? turns - 0.5 : turns + 0.5 ) );
+}
+
+static constexpr double ConstexprMath_Sin( const double angle )
+{
+	const double x = ConstexprMath_WrapAngle( angle );
+
+	double term = x;
+	double sum = x;
+	for ( int n = 1; n < 30; n++ )
+	{
+		term *= -x * x / ( ( 2.0 * n ) * ( 2.0 * n + 1.0 ) );
+		const double next = sum + term;
+		if ( next == sum )
+			break;
+		sum = next;
+	}
+
+	return sum;
+}
+
+static constexpr double ConstexprMath_Cos( const double angle )
 {
-	vr::HmdQuaternion_t q{};
+	const double x = ConstexprMath_WrapAngle( angle );
 
-	q.w = sqrt( fmax( 0, 1 + matrix.m[ 0 ][ 0 ] + matrix.m[ 1 ][ 1 ] + matrix.m[ 2 ][ 2 ] ) ) / 2;
-	q.x = sqrt( fmax( 0, 1 + matrix.m[ 0 ][ 0 ] - matrix.m[ 1 ][ 1 ] - matrix.m[ 2 ][ 2 ] ) ) / 2;
-	q.y = sqrt( fmax( 0, 1 - matrix.m[ 0 ][ 0 ] + matrix.m[ 1 ][ 1 ] - matrix.m[ 2 ][ 2 ] ) ) / 2;
-	q.z = sqrt( fmax( 0, 1 - matrix.m[ 0 ][ 0 ] - matrix.m[ 1 ][ 1 ] + matrix.m[ 2 ][ 2 ] ) ) / 2;
+	double term = 1.0;
+	double sum = 1.0;
+	for ( int n = 1; n < 30; n++ )
+	{
+		term *= -x * x / ( ( 2.0 * n - 1.0 ) * ( 2.0 * n ) );
+		const double next = sum + term;
+		if ( next == sum )
+			break;
+		sum = next;
+	}
 
-	q.x = copysign( q.x, matrix.m[ 2 ][ 1 ] - matrix.m[ 1 ][ 2 ] );
-	q.y = copysign( q.y, matrix.m[ 0 ][ 2 ] - matrix.m[ 2 ][ 0 ] );
-	q.z = copysign( q.z, matrix.m[ 1 ][ 0 ] - matrix.m[ 0 ][ 1 ] );
+	return sum;
+}
 
-	return q;
+
+// 3x3 or 3x4 matrix, whose rotation part must be orthonormal. The result has w >= 0.
+//
+// Shepperd's method: 4 * q.w^2, 4 * q.x^2, 4 * q.y^2 and 4 * q.z^2 are all simple sums of the diagonal, and each product
+// of two components is a sum or difference of two off diagonal terms. Taking the square root of only the largest of the
+// four (which is at least 1) and dividing the products by it keeps full precision everywhere, including near 180 degree
+// rotations where q.w and the antisymmetric terms go to zero. The case is picked by index rather than by branching.
+template < class T >
+vr::HmdQuaternion_t HmdQuaternion_FromMatrix( const T &matrix )
+{
+	const double m00 = matrix.m[ 0 ][ 0 ], m11 = matrix.m[ 1 ][ 1 ], m22 = matrix.m[ 2 ][ 2 ];
+
+	// 4 * q.w * q.x, q.w * q.y, q.w * q.z, q.x * q.y, q.x * q.z, q.y * q.z
+	const double wx = matrix.m[ 2 ][ 1 ] - matrix.m[ 1 ][ 2 ];
+	const double wy = matrix.m[ 0 ][ 2 ] - matrix.m[ 2 ][ 0 ];
+	const double wz = matrix.m[ 1 ][ 0 ] - matrix.m[ 0 ][ 1 ];
+	const double xy = matrix.m[ 0 ][ 1 ] + matrix.m[ 1 ][ 0 ];
+	const double xz = matrix.m[ 0 ][ 2 ] + matrix.m[ 2 ][ 0 ];
+	const double yz = matrix.m[ 1 ][ 2 ] + matrix.m[ 2 ][ 1 ];
+
+	// 4 * q.w^2, q.x^2, q.y^2, q.z^2
+	const double diagonals[ 4 ] = { 1 + m00 + m11 + m22, 1 + m00 - m11 - m22, 1 - m00 + m11 - m22, 1 - m00 - m11 + m22 };
+
+	int largest = 0;
+	for ( int i = 1; i < 4; i++ )
+		largest = diagonals[ i ] > diagonals[ largest ] ? i : largest;
+
+	// Row i is 4 * q_i times the whole quaternion
+	const double cases[ 4 ][ 4 ] = {
+		{ diagonals[ 0 ], wx, wy, wz },
+		{ wx, diagonals[ 1 ], xy, xz },
+		{ wy, xy, diagonals[ 2 ], yz },
+		{ wz, xz, yz, diagonals[ 3 ] },
+	};
+	const double *q = cases[ largest ];
+
+	const double scale = copysign( 0.5 / sqrt( diagonals[ largest ] ), q[ 0 ] );
+	return { q[ 0 ] * scale, q[ 1 ] * scale, q[ 2 ] * scale, q[ 3 ] * scale };
 }
 
 static vr::HmdQuaternion_t HmdQuaternion_FromSwingTwist( const vr::HmdVector2_t &swing, const float twist )
@@ -80,6 +175,27 @@ static vr::HmdQuaternion_t HmdQuaternion_FromSwingTwist( const vr::HmdVector2_t
 	return result;
 }
 
+// HmdQuaternion_FromSwingTwist for constant expressions
+static constexpr vr::HmdQuaternion_t HmdQuaternion_FromSwingTwistConstexpr( const vr::HmdVector2_t &swing, const float twist )
+{
+	const double swing_squared = static_cast< double >( swing.v[ 0 ] ) * swing.v[ 0 ] + static_cast< double >( swing.v[ 1 ] ) * swing.v[ 1 ];
+	const double theta_swing = ConstexprMath_Sqrt( swing_squared );
+
+	const double cos_half_theta_swing = ConstexprMath_Cos( theta_swing * 0.5 );
+	const double cos_half_theta_twist = ConstexprMath_Cos( twist * 0.5 );
+	const double sin_half_theta_twist = ConstexprMath_Sin( twist * 0.5 );
+
+	// sin( theta / 2 ) / theta tends to 1/2 as the swing goes to 0
+	const double sin_half_theta_swing_over_theta = swing_squared > 0.0 ? ConstexprMath_Sin( theta_swing * 0.5 ) / theta_swing : 0.5;
+
+	return {
+		cos_half_theta_swing * cos_half_theta_twist,
+		cos_half_theta_swing * sin_half_theta_twist,
+		( swing.v[ 1 ] * cos_half_theta_twist - swing.v[ 0 ] * sin_half_theta_twist ) * sin_half_theta_swing_over_theta,
+		( swing.v[ 0 ] * cos_half_theta_twist + swing.v[ 1 ] * sin_half_theta_twist ) * sin_half_theta_swing_over_theta,
+	};
+}
+
 static vr::HmdQuaternion_t HmdQuaternion_Normalize( const vr::HmdQuaternion_t &q )
 {
 	vr::HmdQuaternion_t result{};
@@ -110,6 +226,59 @@ static vr::HmdQuaternion_t HmdQuaternion_FromEulerAngles(double roll, double pit
   return q;
 }
 
+// HmdQuaternion_FromEulerAngles for constant expressions
+static constexpr vr::HmdQuaternion_t HmdQuaternion_FromEulerAnglesConstexpr( const double roll, const double pitch, const double yaw )
+{
+	const double cr = ConstexprMath_Cos( roll * 0.5 );
+	const double sr = ConstexprMath_Sin( roll * 0.5 );
+	const double cp = ConstexprMath_Cos( pitch * 0.5 );
+	const double sp = ConstexprMath_Sin( pitch * 0.5 );
+	const double cy = ConstexprMath_Cos( yaw * 0.5 );
+	const double sy = ConstexprMath_Sin( yaw * 0.5 );
+
+	return {
+		cr * cp * cy + sr * sp * sy,
+		cr * sp * cy + sr * cp * sy,
+		cr * cp * sy - sr * sp * cy,
+		sr * cp * cy - cr * sp * sy,
+	};
+}
+
+// Spherical linear interpolation from a (t = 0) to b (t = 1), taking the shortest path
+static vr::HmdQuaternion_t HmdQuaternion_Slerp( const vr::HmdQuaternion_t &a, const vr::HmdQuaternion_t &b, double t )
+{
+	double cos_theta = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+
+	// q and -q are the same rotation, flip one so we don't go the long way around
+	double sign = 1.0;
+	if ( cos_theta < 0.0 )
+	{
+		cos_theta = -cos_theta;
+		sign = -1.0;
+	}
+
+	double weight_a = 1.0 - t;
+	double weight_b = t;
+
+	// Fall back to a normalized lerp when the rotations are nearly identical, as sin( theta ) goes to 0
+	if ( cos_theta < 0.9995 )
+	{
+		const double theta = acos( cos_theta );
+		const double sin_theta = sin( theta );
+		weight_a = sin( ( 1.0 - t ) * theta ) / sin_theta;
+		weight_b = sin( t * theta ) / sin_theta;
+	}
+
+	weight_b *= sign;
+
+	return HmdQuaternion_Normalize( {
+		weight_a * a.w + weight_b * b.w,
+		weight_a * a.x + weight_b * b.x,
+		weight_a * a.y + weight_b * b.y,
+		weight_a * a.z + weight_b * b.z,
+	} );
+}
+
 template < class T, class Q >
 void HmdQuaternion_ConvertQuaternion( const T &in_quaternion, Q &out_quaternion )
 {
@@ -119,12 +288,12 @@ void HmdQuaternion_ConvertQuaternion( const T &in_quaternion, Q &out_quaternion
 	out_quaternion.z = in_quaternion.z;
 }
 
-static vr::HmdQuaternion_t operator-( const vr::HmdQuaternion_t &q )
+static constexpr vr::HmdQuaternion_t operator-( const vr::HmdQuaternion_t &q )
 {
 	return { q.w, -q.x, -q.y, -q.z };
 }
 
-static vr::HmdQuaternion_t operator*( const vr::HmdQuaternion_t &lhs, const vr::HmdQuaternion_t &rhs )
+static constexpr vr::HmdQuaternion_t operator*( const vr::HmdQuaternion_t &lhs, const vr::HmdQuaternion_t &rhs )
 {
 	return {
 		lhs.w * rhs.w - lhs.x * rhs.x - lhs.y * rhs.y - lhs.z * rhs.z,
@@ -134,6 +303,19 @@ static vr::HmdQuaternion_t operator*( const vr::HmdQuaternion_t &lhs, const vr::
 	};
 }
 
+static constexpr bool HmdQuaternion_NearlyEqual( const vr::HmdQuaternion_t &a, const vr::HmdQuaternion_t &b, const double tolerance )
+{
+	return ConstexprMath_Abs( a.w - b.w ) <= tolerance && ConstexprMath_Abs( a.x - b.x ) <= tolerance && ConstexprMath_Abs( a.y - b.y ) <= tolerance &&
+		   ConstexprMath_Abs( a.z - b.z ) <= tolerance;
+}
+
+static_assert( ConstexprMath_Abs( ConstexprMath_Sin( M_PI / 6.0 ) - 0.5 ) < 1e-9, "ConstexprMath_Sin is off" );
+static_assert( ConstexprMath_Abs( ConstexprMath_Cos( -20.0 * M_PI / 3.0 ) + 0.5 ) < 1e-9, "ConstexprMath_Cos is off" );
+static_assert( ConstexprMath_Abs( ConstexprMath_Sqrt( 2.0 ) * ConstexprMath_Sqrt( 2.0 ) - 2.0 ) < 1e-15, "ConstexprMath_Sqrt is off" );
+static_assert( HmdQuaternion_NearlyEqual( HmdQuaternion_FromEulerAnglesConstexpr( DEG_TO_RAD( 90.0 ), DEG_TO_RAD( 90.0 ), 0.0 ), { 0.5, 0.5, -0.5, 0.5 }, 1e-9 ),
+	"HmdQuaternion_FromEulerAnglesConstexpr is off" );
+static_assert( HmdQuaternion_NearlyEqual( HmdQuaternion_FromSwingTwistConstexpr( { 0.f, 0.f }, 0.f ), HmdQuaternion_Identity, 0.0 ), "HmdQuaternion_FromSwingTwistConstexpr is off" );
+
 static vr::HmdVector3_t HmdVector3_From34Matrix( const vr::HmdMatrix34_t &matrix )
 {
 	return { matrix.m[ 0 ][ 3 ], matrix.m[ 1 ][ 3 ], matrix.m[ 2 ][ 3 ] };
@@ -183,13 +365,29 @@ static vr::HmdVector3d_t operator-( const vr::HmdVector3d_t &vec1, const vr::Hmd
 	return { vec1.v[ 0 ] - vec2.v[ 0 ], vec1.v[ 1 ] - vec2.v[ 1 ], vec1.v[ 2 ] - vec2.v[ 2 ] };
 }
 
+// Rotates vec by the unit quaternion q, i.e. q * vec * q^-1, without building the two quaternion products:
+// t = 2 * ( q.xyz x vec ), result = vec + q.w * t + q.xyz x t
+// q must be normalized (see HmdQuaternion_Normalize); otherwise the result is neither a rotation nor q * vec * q^-1.
 static vr::HmdVector3_t operator*( const vr::HmdVector3_t &vec, const vr::HmdQuaternion_t &q )
 {
-	const vr::HmdQuaternion_t qvec = { 0.0, vec.v[ 0 ], vec.v[ 1 ], vec.v[ 2 ] };
+	const double tx = 2.0 * ( q.y * vec.v[ 2 ] - q.z * vec.v[ 1 ] );
+	const double ty = 2.0 * ( q.z * vec.v[ 0 ] - q.x * vec.v[ 2 ] );
+	const double tz = 2.0 * ( q.x * vec.v[ 1 ] - q.y * vec.v[ 0 ] );
 
-	const vr::HmdQuaternion_t qResult = (q * qvec) * (-q);
+	return {
+		static_cast< float >( vec.v[ 0 ] + q.w * tx + ( q.y * tz - q.z * ty ) ),
+		static_cast< float >( vec.v[ 1 ] + q.w * ty + ( q.z * tx - q.x * tz ) ),
+		static_cast< float >( vec.v[ 2 ] + q.w * tz + ( q.x * ty - q.y * tx ) ),
+	};
+}
 
-	return { static_cast< float >( qResult.x ), static_cast< float >( qResult.y ), static_cast< float >( qResult.z ) };
+static vr::HmdVector3_t HmdVector3_Lerp( const vr::HmdVector3_t &a, const vr::HmdVector3_t &b, float t )
+{
+	return {
+		a.v[ 0 ] + ( b.v[ 0 ] - a.v[ 0 ] ) * t,
+		a.v[ 1 ] + ( b.v[ 1 ] - a.v[ 1 ] ) * t,
+		a.v[ 2 ] + ( b.v[ 2 ] - a.v[ 2 ] ) * t,
+	};
 }
 
 template < class T, class V >
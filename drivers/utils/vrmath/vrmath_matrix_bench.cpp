@@ -0,0 +1,344 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Checks the matrix to quaternion conversions, HmdQuaternion_FromMatrix in vrmath.h and HmdPosef_FromMatrix34Batch in
+// vrmath_simd.h, against a long double reference and against the four square root version vrmath.h used before, and
+// times them.
+//
+// Each set of rotations is made as long double quaternions and turned into matrices: double 3x3s for vrmath.h, so its
+// own error isn't hidden under the rounding of the matrix, and float HmdMatrix34_t for the float functions. The sets are
+// random rotations, rotations within a few degrees of 180 (down to exactly 180) about random axes, and the 24 axis
+// aligned rotations. For every set and function this checks the properties the functions promise:
+//   - the quaternion is the matrix's rotation (either sign, as at 180 degrees w is 0 and both are right)
+//   - it is unit length
+//   - w >= 0
+//   - the batch gives the same poses as HmdPosef_FromMatrix34, positions included, with a scalar tail after the lanes
+// and the run fails if any doesn't hold. The old version is reported alongside, but not held to them.
+//
+// Not part of any build. From this directory, with the OpenVR headers:
+//
+//   g++ -O2 -I<openvr>/headers vrmath_matrix_bench.cpp -o vrmath_matrix_bench
+//
+// and again with -DVRMATH_SIMD_DISABLE, -mavx2 and -mavx2 -mfma for the other batch paths.
+//
+// Usage: vrmath_matrix_bench [rotations per set, default 100001] [runs, default 20]
+
+#include "vrmath.h"
+#include "vrmath_simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Largest component error against the reference, for double and float matrices
+static const double k_flMaxDoubleError = 1e-14;
+static const double k_flMaxFloatError = 5e-7;
+
+// How far from unit length
+static const double k_flMaxDoubleLengthError = 1e-14;
+static const double k_flMaxFloatLengthError = 1e-6;
+
+// Batch against HmdPosef_FromMatrix34. The same kernel, apart from how a compiler fuses multiply-adds.
+static const double k_flMaxBatchError = 1e-6;
+
+struct Matrix33d
+{
+	double m[ 3 ][ 3 ];
+};
+
+struct ReferenceQuaternion
+{
+	long double w, x, y, z;
+};
+
+struct RotationSet
+{
+	const char *name;
+	std::vector< ReferenceQuaternion > references;
+	std::vector< Matrix33d > double_matrices;
+	std::vector< vr::HmdMatrix34_t > float_matrices;
+};
+
+static uint32_t rng_state = 0x12345678;
+
+static double RandomDouble( double low, double high )
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return low + ( high - low ) * ( rng_state >> 8 ) * ( 1.0 / 16777216.0 );
+}
+
+// The four square root version HmdQuaternion_FromMatrix was before Shepperd's method, for comparison
+template < class T >
+static vr::HmdQuaternion_t OldQuaternionFromMatrix( const T &matrix )
+{
+	vr::HmdQuaternion_t q{};
+
+	q.w = sqrt( fmax( 0, 1 + matrix.m[ 0 ][ 0 ] + matrix.m[ 1 ][ 1 ] + matrix.m[ 2 ][ 2 ] ) ) / 2;
+	q.x = sqrt( fmax( 0, 1 + matrix.m[ 0 ][ 0 ] - matrix.m[ 1 ][ 1 ] - matrix.m[ 2 ][ 2 ] ) ) / 2;
+	q.y = sqrt( fmax( 0, 1 - matrix.m[ 0 ][ 0 ] + matrix.m[ 1 ][ 1 ] - matrix.m[ 2 ][ 2 ] ) ) / 2;
+	q.z = sqrt( fmax( 0, 1 - matrix.m[ 0 ][ 0 ] - matrix.m[ 1 ][ 1 ] + matrix.m[ 2 ][ 2 ] ) ) / 2;
+
+	q.x = copysign( q.x, matrix.m[ 2 ][ 1 ] - matrix.m[ 1 ][ 2 ] );
+	q.y = copysign( q.y, matrix.m[ 0 ][ 2 ] - matrix.m[ 2 ][ 0 ] );
+	q.z = copysign( q.z, matrix.m[ 1 ][ 0 ] - matrix.m[ 0 ][ 1 ] );
+
+	return q;
+}
+
+static void AddRotation( RotationSet &set, ReferenceQuaternion q )
+{
+	const long double length = std::sqrt( q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z );
+	q = { q.w / length, q.x / length, q.y / length, q.z / length };
+	set.references.push_back( q );
+
+	const long double m[ 3 ][ 3 ] = {
+		{ 1 - 2 * ( q.y * q.y + q.z * q.z ), 2 * ( q.x * q.y - q.w * q.z ), 2 * ( q.x * q.z + q.w * q.y ) },
+		{ 2 * ( q.x * q.y + q.w * q.z ), 1 - 2 * ( q.x * q.x + q.z * q.z ), 2 * ( q.y * q.z - q.w * q.x ) },
+		{ 2 * ( q.x * q.z - q.w * q.y ), 2 * ( q.y * q.z + q.w * q.x ), 1 - 2 * ( q.x * q.x + q.y * q.y ) },
+	};
+
+	Matrix33d double_matrix;
+	vr::HmdMatrix34_t float_matrix;
+	for ( int row = 0; row < 3; row++ )
+	{
+		for ( int column = 0; column < 3; column++ )
+		{
+			double_matrix.m[ row ][ column ] = ( double )m[ row ][ column ];
+			float_matrix.m[ row ][ column ] = ( float )m[ row ][ column ];
+		}
+		float_matrix.m[ row ][ 3 ] = ( float )RandomDouble( -2.0, 2.0 );
+	}
+	set.double_matrices.push_back( double_matrix );
+	set.float_matrices.push_back( float_matrix );
+}
+
+static void AddAxisAngle( RotationSet &set, long double angle )
+{
+	// A random axis, uniform over the sphere
+	long double x, y, z, length_squared;
+	do
+	{
+		x = RandomDouble( -1.0, 1.0 );
+		y = RandomDouble( -1.0, 1.0 );
+		z = RandomDouble( -1.0, 1.0 );
+		length_squared = x * x + y * y + z * z;
+	} while ( length_squared < 0.01 || length_squared > 1.0 );
+
+	const long double scale = std::sin( angle / 2 ) / std::sqrt( length_squared );
+	AddRotation( set, { std::cos( angle / 2 ), x * scale, y * scale, z * scale } );
+}
+
+// Error of q against the reference, taking whichever sign of q is closer
+template < class Q >
+static double ReferenceError( const Q &q, const ReferenceQuaternion &reference )
+{
+	double same = 0.0, flipped = 0.0;
+	const long double components[ 4 ][ 2 ] = { { q.w, reference.w }, { q.x, reference.x }, { q.y, reference.y }, { q.z, reference.z } };
+	for ( const auto &component : components )
+	{
+		same = std::max( same, ( double )std::fabs( component[ 0 ] - component[ 1 ] ) );
+		flipped = std::max( flipped, ( double )std::fabs( component[ 0 ] + component[ 1 ] ) );
+	}
+	return std::min( same, flipped );
+}
+
+template < class Q >
+static double LengthError( const Q &q )
+{
+	return std::fabs( std::sqrt( ( double )q.w * q.w + ( double )q.x * q.x + ( double )q.y * q.y + ( double )q.z * q.z ) - 1.0 );
+}
+
+struct Properties
+{
+	double max_error = 0.0;
+	double max_length_error = 0.0;
+	int negative_w = 0;
+
+	template < class Q >
+	void Add( const Q &q, const ReferenceQuaternion &reference )
+	{
+		max_error = std::max( max_error, ReferenceError( q, reference ) );
+		max_length_error = std::max( max_length_error, LengthError( q ) );
+		negative_w += q.w < 0;
+	}
+
+	bool Report( const char *name, double error_tolerance, double length_tolerance ) const
+	{
+		const bool ok = max_error <= error_tolerance && max_length_error <= length_tolerance && negative_w == 0;
+		printf( "    %-28s error %8.2g, length %8.2g, w < 0 %6d", name, max_error, max_length_error, negative_w );
+		if ( error_tolerance > 0.0 )
+			printf( " %s", ok ? "ok" : "FAILED" );
+		printf( "\n" );
+		return ok;
+	}
+};
+
+static double SecondsNow()
+{
+	return std::chrono::duration< double >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// Best time of runs calls to run_pass, in ns per matrix
+template < typename Function >
+static double BestNanoseconds( int runs, size_t count, Function run_pass )
+{
+	double best = 1e30;
+	for ( int run = 0; run < runs; run++ )
+	{
+		const double start = SecondsNow();
+		run_pass();
+		best = std::min( best, SecondsNow() - start );
+	}
+	return best * 1e9 / count;
+}
+
+int main( int argc, char **argv )
+{
+	const int count = argc > 1 ? atoi( argv[ 1 ] ) : 100001;
+	const int runs = argc > 2 ? atoi( argv[ 2 ] ) : 20;
+	if ( count <= 0 || runs <= 0 )
+	{
+		fprintf( stderr, "Usage: vrmath_matrix_bench [rotations per set, default 100001] [runs, default 20]\n" );
+		return 2;
+	}
+
+	const long double pi = 3.141592653589793238462643383279502884L;
+
+	RotationSet sets[ 3 ];
+	sets[ 0 ].name = "random rotations";
+	sets[ 1 ].name = "near 180 degrees";
+	sets[ 2 ].name = "axis aligned";
+
+	for ( int i = 0; i < count; i++ )
+	{
+		AddRotation( sets[ 0 ], { RandomDouble( -1.0, 1.0 ), RandomDouble( -1.0, 1.0 ), RandomDouble( -1.0, 1.0 ), RandomDouble( -1.0, 1.0 ) } );
+
+		// From a few degrees short of 180 to 1e-9 radians short, and every 16th exactly 180
+		const long double short_by = i % 16 == 0 ? 0.0L : std::pow( 10.0L, ( long double )RandomDouble( -9.0, -1.0 ) );
+		AddAxisAngle( sets[ 1 ], pi - short_by );
+	}
+
+	// Every rotation that maps the axes onto the axes: 0, 90, 180 and 270 degrees about each axis and their combinations
+	const long double h = 0.5L, r = 1.0L / std::sqrt( 2.0L );
+	const ReferenceQuaternion axis_aligned[ 24 ] = {
+		{ 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 },
+		{ r, r, 0, 0 }, { r, -r, 0, 0 }, { r, 0, r, 0 }, { r, 0, -r, 0 }, { r, 0, 0, r }, { r, 0, 0, -r },
+		{ 0, r, r, 0 }, { 0, r, -r, 0 }, { 0, r, 0, r }, { 0, r, 0, -r }, { 0, 0, r, r }, { 0, 0, r, -r },
+		{ h, h, h, h }, { h, h, h, -h }, { h, h, -h, h }, { h, h, -h, -h },
+		{ h, -h, h, h }, { h, -h, h, -h }, { h, -h, -h, h }, { h, -h, -h, -h },
+	};
+	for ( const ReferenceQuaternion &q : axis_aligned )
+		AddRotation( sets[ 2 ], q );
+
+#if VRMATH_SIMD_AVX2 && VRMATH_SIMD_FMA
+	const char *path = "AVX2 + FMA";
+#elif VRMATH_SIMD_AVX2
+	const char *path = "AVX2";
+#elif VRMATH_SIMD_SSE2
+	const char *path = "SSE2";
+#else
+	const char *path = "scalar";
+#endif
+	printf( "%s batches\n", path );
+
+	bool ok = true;
+	for ( RotationSet &set : sets )
+	{
+		const size_t set_count = set.references.size();
+		Properties old_double, new_double, old_float, new_float, batch;
+
+		// Leave a tail after the last full group of lanes
+		const size_t batch_count = set_count % 8 == 0 ? set_count - 3 : set_count;
+		std::vector< HmdPosef_t > poses( batch_count );
+		HmdPosef_FromMatrix34Batch( set.float_matrices.data(), poses.data(), batch_count );
+
+		double batch_error = 0.0;
+		bool positions_copied = true;
+		for ( size_t i = 0; i < set_count; i++ )
+		{
+			const ReferenceQuaternion &reference = set.references[ i ];
+			old_double.Add( OldQuaternionFromMatrix( set.double_matrices[ i ] ), reference );
+			new_double.Add( HmdQuaternion_FromMatrix( set.double_matrices[ i ] ), reference );
+			old_float.Add( OldQuaternionFromMatrix( set.float_matrices[ i ] ), reference );
+			new_float.Add( HmdQuaternion_FromMatrix( set.float_matrices[ i ] ), reference );
+
+			if ( i < batch_count )
+			{
+				const HmdPosef_t single = HmdPosef_FromMatrix34( set.float_matrices[ i ] );
+				batch.Add( poses[ i ].orientation, reference );
+
+				const vr::HmdQuaternionf_t &a = poses[ i ].orientation, &b = single.orientation;
+				batch_error = std::max( { batch_error, ( double )std::fabs( a.w - b.w ), ( double )std::fabs( a.x - b.x ), ( double )std::fabs( a.y - b.y ), ( double )std::fabs( a.z - b.z ) } );
+				positions_copied = positions_copied && memcmp( &poses[ i ].position, &single.position, sizeof( single.position ) ) == 0 &&
+					poses[ i ].position.v[ 0 ] == set.float_matrices[ i ].m[ 0 ][ 3 ] && poses[ i ].position.v[ 1 ] == set.float_matrices[ i ].m[ 1 ][ 3 ] &&
+					poses[ i ].position.v[ 2 ] == set.float_matrices[ i ].m[ 2 ][ 3 ];
+			}
+		}
+
+		printf( "%s, %zu rotations:\n", set.name, set_count );
+		printf( "  double matrices\n" );
+		old_double.Report( "old HmdQuaternion_FromMatrix", 0.0, 0.0 );
+		ok &= new_double.Report( "HmdQuaternion_FromMatrix", k_flMaxDoubleError, k_flMaxDoubleLengthError );
+		printf( "  float matrices\n" );
+		old_float.Report( "old HmdQuaternion_FromMatrix", 0.0, 0.0 );
+		ok &= new_float.Report( "HmdQuaternion_FromMatrix", k_flMaxFloatError, k_flMaxFloatLengthError );
+		ok &= batch.Report( "HmdPosef_FromMatrix34Batch", k_flMaxFloatError, k_flMaxFloatLengthError );
+
+		const bool batch_ok = batch_error <= k_flMaxBatchError && positions_copied;
+		printf( "    batch vs HmdPosef_FromMatrix34 over %zu: orientation %.2g, positions %s: %s\n", batch_count, batch_error,
+			positions_copied ? "exact" : "differ", batch_ok ? "ok" : "FAILED" );
+		ok &= batch_ok;
+	}
+
+	// Timing, on float matrices as the drivers get them from GetRawTrackedDevicePoses. Both the random rotations, where
+	// which of the four cases is taken can't be predicted, and a pose stream: a device turning a little from one matrix
+	// to the next, as it would between frames.
+	RotationSet stream;
+	ReferenceQuaternion turning = { 1, 0, 0, 0 };
+	for ( int i = 0; i < count; i++ )
+	{
+		turning = { turning.w + RandomDouble( -0.02, 0.02 ), turning.x + RandomDouble( -0.02, 0.02 ), turning.y + RandomDouble( -0.02, 0.02 ), turning.z + RandomDouble( -0.02, 0.02 ) };
+		AddRotation( stream, turning );
+		turning = stream.references.back();
+	}
+
+	printf( "ns per matrix, best of %d runs:\n", runs );
+	const RotationSet *timed_sets[ 2 ] = { &sets[ 0 ], &stream };
+	const char *timed_names[ 2 ] = { "random rotations", "pose stream" };
+	std::vector< vr::HmdQuaternion_t > quaternions( count );
+	std::vector< HmdPosef_t > poses( count );
+	float sink = 0.f;
+
+	for ( int timed = 0; timed < 2; timed++ )
+	{
+		const std::vector< vr::HmdMatrix34_t > &matrices = timed_sets[ timed ]->float_matrices;
+
+		const double old_ns = BestNanoseconds( runs, count, [ & ]() {
+			for ( int i = 0; i < count; i++ )
+				quaternions[ i ] = OldQuaternionFromMatrix( matrices[ i ] );
+		} );
+		sink += ( float )quaternions[ count / 2 ].w;
+		const double new_ns = BestNanoseconds( runs, count, [ & ]() {
+			for ( int i = 0; i < count; i++ )
+				quaternions[ i ] = HmdQuaternion_FromMatrix( matrices[ i ] );
+		} );
+		sink += ( float )quaternions[ count / 2 ].w;
+		const double single_ns = BestNanoseconds( runs, count, [ & ]() {
+			for ( int i = 0; i < count; i++ )
+				poses[ i ] = HmdPosef_FromMatrix34( matrices[ i ] );
+		} );
+		sink += poses[ count / 2 ].orientation.w;
+		const double batch_ns = BestNanoseconds( runs, count, [ & ]() { HmdPosef_FromMatrix34Batch( matrices.data(), poses.data(), count ); } );
+		sink += poses[ count / 2 ].orientation.w;
+
+		printf( "  %-16s old %.1f, HmdQuaternion_FromMatrix %.1f, HmdPosef_FromMatrix34 %.1f, batch %.1f\n", timed_names[ timed ], old_ns, new_ns, single_ns, batch_ns );
+	}
+
+	if ( sink == 12345.f )
+		printf( " " );
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,577 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include "openvr_driver.h"
+
+#include <cmath>
+#include <cstddef>
+
+/*
+Single precision quaternion and vector maths on the OpenVR float types (vr::HmdQuaternionf_t, vr::HmdVector3_t), for
+hot paths that vrmath.h's double precision functions are too slow for.
+
+Every operation is written once, as a kernel templated on a lane type: a plain float for single values and the scalar
+fallback, or 4 (SSE2) or 8 (AVX2) floats for the batch functions, which transpose their inputs so each lane works on a
+different element. Which of those the batch functions use is decided at compile time, define VRMATH_SIMD_DISABLE to
+force the scalar path. Multiply-adds are fused when the compiler targets FMA as well (-mfma, or MSVC's /arch:AVX2,
+which implies it); GCC and clang's -mavx2 alone does not, and gets a multiply and an add.
+
+Quaternions are w, x, y, z like vrmath.h, and HmdQuaternionf_Rotate( q, v ) is vrmath.h's v * q.
+*/
+
+#if !defined( VRMATH_SIMD_DISABLE ) && ( defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 ) )
+#define VRMATH_SIMD_SSE2 1
+#include <emmintrin.h>
+#if defined( __AVX2__ )
+#define VRMATH_SIMD_AVX2 1
+#include <immintrin.h>
+#if defined( __FMA__ ) || ( defined( _MSC_VER ) && !defined( __clang__ ) )
+#define VRMATH_SIMD_FMA 1
+#endif
+#endif
+#endif
+
+struct HmdPosef_t
+{
+	vr::HmdQuaternionf_t orientation;
+	vr::HmdVector3_t position;
+};
+
+static const vr::HmdQuaternionf_t HmdQuaternionf_Identity = { 1.f, 0.f, 0.f, 0.f };
+
+// ----- Lane types -----
+
+static inline float VrmMulAdd( float a, float b, float c ) { return a * b + c; }
+static inline float VrmSqrt( float a ) { return std::sqrt( a ); }
+static inline float VrmSelect( bool mask, float a, float b ) { return mask ? a : b; }
+static inline bool VrmLess( float a, float b ) { return a < b; }
+
+#if VRMATH_SIMD_SSE2
+struct VrmF4
+{
+	__m128 v;
+	VrmF4() = default;
+	VrmF4( __m128 value ) : v( value ) {}
+	VrmF4( float value ) : v( _mm_set1_ps( value ) ) {}
+};
+
+static inline VrmF4 operator+( VrmF4 a, VrmF4 b ) { return _mm_add_ps( a.v, b.v ); }
+static inline VrmF4 operator-( VrmF4 a, VrmF4 b ) { return _mm_sub_ps( a.v, b.v ); }
+static inline VrmF4 operator*( VrmF4 a, VrmF4 b ) { return _mm_mul_ps( a.v, b.v ); }
+static inline VrmF4 operator/( VrmF4 a, VrmF4 b ) { return _mm_div_ps( a.v, b.v ); }
+static inline VrmF4 operator-( VrmF4 a ) { return _mm_xor_ps( a.v, _mm_set1_ps( -0.f ) ); }
+static inline VrmF4 VrmSqrt( VrmF4 a ) { return _mm_sqrt_ps( a.v ); }
+static inline VrmF4 VrmLess( VrmF4 a, VrmF4 b ) { return _mm_cmplt_ps( a.v, b.v ); }
+static inline VrmF4 VrmSelect( VrmF4 mask, VrmF4 a, VrmF4 b ) { return _mm_or_ps( _mm_and_ps( mask.v, a.v ), _mm_andnot_ps( mask.v, b.v ) ); }
+#if VRMATH_SIMD_FMA
+static inline VrmF4 VrmMulAdd( VrmF4 a, VrmF4 b, VrmF4 c ) { return _mm_fmadd_ps( a.v, b.v, c.v ); }
+#else
+static inline VrmF4 VrmMulAdd( VrmF4 a, VrmF4 b, VrmF4 c ) { return _mm_add_ps( _mm_mul_ps( a.v, b.v ), c.v ); }
+#endif
+#endif
+
+#if VRMATH_SIMD_AVX2
+struct VrmF8
+{
+	__m256 v;
+	VrmF8() = default;
+	VrmF8( __m256 value ) : v( value ) {}
+	VrmF8( float value ) : v( _mm256_set1_ps( value ) ) {}
+};
+
+static inline VrmF8 operator+( VrmF8 a, VrmF8 b ) { return _mm256_add_ps( a.v, b.v ); }
+static inline VrmF8 operator-( VrmF8 a, VrmF8 b ) { return _mm256_sub_ps( a.v, b.v ); }
+static inline VrmF8 operator*( VrmF8 a, VrmF8 b ) { return _mm256_mul_ps( a.v, b.v ); }
+static inline VrmF8 operator/( VrmF8 a, VrmF8 b ) { return _mm256_div_ps( a.v, b.v ); }
+static inline VrmF8 operator-( VrmF8 a ) { return _mm256_xor_ps( a.v, _mm256_set1_ps( -0.f ) ); }
+static inline VrmF8 VrmSqrt( VrmF8 a ) { return _mm256_sqrt_ps( a.v ); }
+static inline VrmF8 VrmLess( VrmF8 a, VrmF8 b ) { return _mm256_cmp_ps( a.v, b.v, _CMP_LT_OQ ); }
+static inline VrmF8 VrmSelect( VrmF8 mask, VrmF8 a, VrmF8 b ) { return _mm256_blendv_ps( b.v, a.v, mask.v ); }
+#if VRMATH_SIMD_FMA
+static inline VrmF8 VrmMulAdd( VrmF8 a, VrmF8 b, VrmF8 c ) { return _mm256_fmadd_ps( a.v, b.v, c.v ); }
+#else
+static inline VrmF8 VrmMulAdd( VrmF8 a, VrmF8 b, VrmF8 c ) { return _mm256_add_ps( _mm256_mul_ps( a.v, b.v ), c.v ); }
+#endif
+#endif
+
+template < class V >
+struct VrmQuat
+{
+	V w, x, y, z;
+};
+
+template < class V >
+struct VrmVec3
+{
+	V x, y, z;
+};
+
+// ----- Kernels -----
+
+template < class V >
+static inline VrmQuat< V > VrmQuat_Multiply( const VrmQuat< V > &a, const VrmQuat< V > &b )
+{
+	return {
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+	};
+}
+
+// q * v * q^-1 for a unit quaternion, without building the two quaternion products:
+// t = 2 * ( q.xyz x v ), v' = v + q.w * t + q.xyz x t
+template < class V >
+static inline VrmVec3< V > VrmQuat_Rotate( const VrmQuat< V > &q, const VrmVec3< V > &v )
+{
+	const V tx = ( q.y * v.z - q.z * v.y ) * V( 2.f );
+	const V ty = ( q.z * v.x - q.x * v.z ) * V( 2.f );
+	const V tz = ( q.x * v.y - q.y * v.x ) * V( 2.f );
+
+	return {
+		VrmMulAdd( q.w, tx, v.x ) + ( q.y * tz - q.z * ty ),
+		VrmMulAdd( q.w, ty, v.y ) + ( q.z * tx - q.x * tz ),
+		VrmMulAdd( q.w, tz, v.z ) + ( q.x * ty - q.y * tx ),
+	};
+}
+
+template < class V >
+static inline V VrmQuat_Dot( const VrmQuat< V > &a, const VrmQuat< V > &b )
+{
+	return VrmMulAdd( a.w, b.w, VrmMulAdd( a.x, b.x, VrmMulAdd( a.y, b.y, a.z * b.z ) ) );
+}
+
+// A zero quaternion comes back as the identity
+template < class V >
+static inline VrmQuat< V > VrmQuat_Normalize( const VrmQuat< V > &q )
+{
+	const V length_squared = VrmQuat_Dot( q, q );
+	const V valid = VrmLess( V( 0.f ), length_squared );
+	const V inv_length = V( 1.f ) / VrmSqrt( VrmSelect( valid, length_squared, V( 1.f ) ) );
+
+	return {
+		VrmSelect( valid, q.w * inv_length, V( 1.f ) ),
+		VrmSelect( valid, q.x * inv_length, V( 0.f ) ),
+		VrmSelect( valid, q.y * inv_length, V( 0.f ) ),
+		VrmSelect( valid, q.z * inv_length, V( 0.f ) ),
+	};
+}
+
+// Normalized lerp along the shorter arc
+template < class V >
+static inline VrmQuat< V > VrmQuat_Nlerp( const VrmQuat< V > &a, const VrmQuat< V > &b, V t )
+{
+	const V tb = VrmSelect( VrmLess( VrmQuat_Dot( a, b ), V( 0.f ) ), -t, t );
+	const V ta = V( 1.f ) - t;
+
+	return VrmQuat_Normalize( VrmQuat< V >{
+		VrmMulAdd( a.w, ta, b.w * tb ),
+		VrmMulAdd( a.x, ta, b.x * tb ),
+		VrmMulAdd( a.y, ta, b.y * tb ),
+		VrmMulAdd( a.z, ta, b.z * tb ),
+	} );
+}
+
+// ----- Single values -----
+
+static inline VrmQuat< float > VrmQuat_Load( const vr::HmdQuaternionf_t &q ) { return { q.w, q.x, q.y, q.z }; }
+static inline vr::HmdQuaternionf_t VrmQuat_Store( const VrmQuat< float > &q ) { return { q.w, q.x, q.y, q.z }; }
+static inline VrmVec3< float > VrmVec3_Load( const vr::HmdVector3_t &v ) { return { v.v[ 0 ], v.v[ 1 ], v.v[ 2 ] }; }
+static inline vr::HmdVector3_t VrmVec3_Store( const VrmVec3< float > &v ) { return { v.x, v.y, v.z }; }
+
+static inline vr::HmdQuaternionf_t HmdQuaternionf_Multiply( const vr::HmdQuaternionf_t &a, const vr::HmdQuaternionf_t &b )
+{
+	return VrmQuat_Store( VrmQuat_Multiply( VrmQuat_Load( a ), VrmQuat_Load( b ) ) );
+}
+
+static inline vr::HmdQuaternionf_t HmdQuaternionf_Conjugate( const vr::HmdQuaternionf_t &q )
+{
+	return { q.w, -q.x, -q.y, -q.z };
+}
+
+static inline vr::HmdVector3_t HmdQuaternionf_Rotate( const vr::HmdQuaternionf_t &q, const vr::HmdVector3_t &v )
+{
+	return VrmVec3_Store( VrmQuat_Rotate( VrmQuat_Load( q ), VrmVec3_Load( v ) ) );
+}
+
+static inline float HmdQuaternionf_Dot( const vr::HmdQuaternionf_t &a, const vr::HmdQuaternionf_t &b )
+{
+	return VrmQuat_Dot( VrmQuat_Load( a ), VrmQuat_Load( b ) );
+}
+
+static inline vr::HmdQuaternionf_t HmdQuaternionf_Normalize( const vr::HmdQuaternionf_t &q )
+{
+	return VrmQuat_Store( VrmQuat_Normalize( VrmQuat_Load( q ) ) );
+}
+
+static inline vr::HmdQuaternionf_t HmdQuaternionf_Nlerp( const vr::HmdQuaternionf_t &a, const vr::HmdQuaternionf_t &b, float t )
+{
+	return VrmQuat_Store( VrmQuat_Nlerp( VrmQuat_Load( a ), VrmQuat_Load( b ), t ) );
+}
+
+// Constant angular speed, unlike nlerp. Falls back to nlerp where the two are too close for acos to be accurate.
+static inline vr::HmdQuaternionf_t HmdQuaternionf_Slerp( const vr::HmdQuaternionf_t &a, const vr::HmdQuaternionf_t &b, float t )
+{
+	float cos_theta = HmdQuaternionf_Dot( a, b );
+	const float sign = cos_theta < 0.f ? -1.f : 1.f;
+	cos_theta *= sign;
+
+	if ( cos_theta > 0.9995f )
+		return HmdQuaternionf_Nlerp( a, b, t );
+
+	const float theta = std::acos( cos_theta );
+	const float inv_sin_theta = 1.f / std::sin( theta );
+	const float ta = std::sin( ( 1.f - t ) * theta ) * inv_sin_theta;
+	const float tb = std::sin( t * theta ) * inv_sin_theta * sign;
+
+	return { a.w * ta + b.w * tb, a.x * ta + b.x * tb, a.y * ta + b.y * tb, a.z * ta + b.z * tb };
+}
+
+static inline vr::HmdVector3_t HmdPosef_TransformPoint( const HmdPosef_t &pose, const vr::HmdVector3_t &point )
+{
+	const vr::HmdVector3_t rotated = HmdQuaternionf_Rotate( pose.orientation, point );
+	return { rotated.v[ 0 ] + pose.position.v[ 0 ], rotated.v[ 1 ] + pose.position.v[ 1 ], rotated.v[ 2 ] + pose.position.v[ 2 ] };
+}
+
+// a applied after b: transforming by the result is transforming by b, then by a
+static inline HmdPosef_t HmdPosef_Multiply( const HmdPosef_t &a, const HmdPosef_t &b )
+{
+	return { HmdQuaternionf_Multiply( a.orientation, b.orientation ), HmdPosef_TransformPoint( a, b.position ) };
+}
+
+// ----- Conversions. float to double is exact, so float -> double -> float gives back the same bits. -----
+
+static inline vr::HmdQuaternionf_t HmdQuaternionf_FromHmdQuaternion( const vr::HmdQuaternion_t &q )
+{
+	return { ( float )q.w, ( float )q.x, ( float )q.y, ( float )q.z };
+}
+
+static inline vr::HmdQuaternion_t HmdQuaternion_FromHmdQuaternionf( const vr::HmdQuaternionf_t &q )
+{
+	return { q.w, q.x, q.y, q.z };
+}
+
+static inline HmdPosef_t HmdPosef_FromDriverPose( const vr::DriverPose_t &pose )
+{
+	return { HmdQuaternionf_FromHmdQuaternion( pose.qRotation ), { ( float )pose.vecPosition[ 0 ], ( float )pose.vecPosition[ 1 ], ( float )pose.vecPosition[ 2 ] } };
+}
+
+// Only writes qRotation and vecPosition
+static inline void HmdPosef_ToDriverPose( const HmdPosef_t &pose, vr::DriverPose_t &out_pose )
+{
+	out_pose.qRotation = HmdQuaternion_FromHmdQuaternionf( pose.orientation );
+	for ( int i = 0; i < 3; i++ )
+		out_pose.vecPosition[ i ] = pose.position.v[ i ];
+}
+
+// ----- Batches -----
+
+// See HmdQuaternion_FromMatrix in vrmath.h. Every lane computes all four cases and keeps the largest with selects.
+template < class V >
+static inline VrmQuat< V > VrmQuat_FromMatrix( V m00, V m01, V m02, V m10, V m11, V m12, V m20, V m21, V m22 )
+{
+	const V wx = m21 - m12, wy = m02 - m20, wz = m10 - m01;
+	const V xy = m01 + m10, xz = m02 + m20, yz = m12 + m21;
+
+	V t = V( 1.f ) + m00 + m11 + m22;
+	VrmQuat< V > q = { t, wx, wy, wz };
+
+	const V tx = V( 1.f ) + m00 - m11 - m22;
+	const auto use_x = VrmLess( t, tx );
+	t = VrmSelect( use_x, tx, t );
+	q = { VrmSelect( use_x, wx, q.w ), VrmSelect( use_x, tx, q.x ), VrmSelect( use_x, xy, q.y ), VrmSelect( use_x, xz, q.z ) };
+
+	const V ty = V( 1.f ) - m00 + m11 - m22;
+	const auto use_y = VrmLess( t, ty );
+	t = VrmSelect( use_y, ty, t );
+	q = { VrmSelect( use_y, wy, q.w ), VrmSelect( use_y, xy, q.x ), VrmSelect( use_y, ty, q.y ), VrmSelect( use_y, yz, q.z ) };
+
+	const V tz = V( 1.f ) - m00 - m11 + m22;
+	const auto use_z = VrmLess( t, tz );
+	t = VrmSelect( use_z, tz, t );
+	q = { VrmSelect( use_z, wz, q.w ), VrmSelect( use_z, xz, q.x ), VrmSelect( use_z, yz, q.y ), VrmSelect( use_z, tz, q.z ) };
+
+	const V scale = V( 0.5f ) / VrmSqrt( t );
+	const V signed_scale = VrmSelect( VrmLess( q.w, V( 0.f ) ), -scale, scale );
+	return { q.w * signed_scale, q.x * signed_scale, q.y * signed_scale, q.z * signed_scale };
+}
+
+// Single values pick the case by index instead, as selects on plain floats turn into unpredictable branches
+template <>
+inline VrmQuat< float > VrmQuat_FromMatrix( float m00, float m01, float m02, float m10, float m11, float m12, float m20, float m21, float m22 )
+{
+	const float diagonals[ 4 ] = { 1.f + m00 + m11 + m22, 1.f + m00 - m11 - m22, 1.f - m00 + m11 - m22, 1.f - m00 - m11 + m22 };
+
+	int largest = 0;
+	for ( int i = 1; i < 4; i++ )
+		largest = diagonals[ i ] > diagonals[ largest ] ? i : largest;
+
+	const float wx = m21 - m12, wy = m02 - m20, wz = m10 - m01;
+	const float xy = m01 + m10, xz = m02 + m20, yz = m12 + m21;
+	const float cases[ 4 ][ 4 ] = {
+		{ diagonals[ 0 ], wx, wy, wz },
+		{ wx, diagonals[ 1 ], xy, xz },
+		{ wy, xy, diagonals[ 2 ], yz },
+		{ wz, xz, yz, diagonals[ 3 ] },
+	};
+	const float *q = cases[ largest ];
+
+	const float scale = std::copysign( 0.5f / std::sqrt( diagonals[ largest ] ), q[ 0 ] );
+	return { q[ 0 ] * scale, q[ 1 ] * scale, q[ 2 ] * scale, q[ 3 ] * scale };
+}
+
+static inline vr::HmdQuaternionf_t HmdQuaternionf_FromMatrix34( const vr::HmdMatrix34_t &m )
+{
+	return VrmQuat_Store( VrmQuat_FromMatrix( m.m[ 0 ][ 0 ], m.m[ 0 ][ 1 ], m.m[ 0 ][ 2 ], m.m[ 1 ][ 0 ], m.m[ 1 ][ 1 ], m.m[ 1 ][ 2 ], m.m[ 2 ][ 0 ], m.m[ 2 ][ 1 ], m.m[ 2 ][ 2 ] ) );
+}
+
+static inline HmdPosef_t HmdPosef_FromMatrix34( const vr::HmdMatrix34_t &m )
+{
+	return { HmdQuaternionf_FromMatrix34( m ), { m.m[ 0 ][ 3 ], m.m[ 1 ][ 3 ], m.m[ 2 ][ 3 ] } };
+}
+
+#if VRMATH_SIMD_SSE2
+#define VRMATH_SHUFFLE( a, b, i0, i1, i2, i3 ) _mm_shuffle_ps( a, b, _MM_SHUFFLE( i3, i2, i1, i0 ) )
+
+static inline VrmQuat< VrmF4 > VrmQuat_Load4( const vr::HmdQuaternionf_t *q )
+{
+	__m128 w = _mm_loadu_ps( &q[ 0 ].w ), x = _mm_loadu_ps( &q[ 1 ].w ), y = _mm_loadu_ps( &q[ 2 ].w ), z = _mm_loadu_ps( &q[ 3 ].w );
+	_MM_TRANSPOSE4_PS( w, x, y, z );
+	return { w, x, y, z };
+}
+
+static inline void VrmQuat_Store4( const VrmQuat< VrmF4 > &q, vr::HmdQuaternionf_t *out )
+{
+	__m128 a = q.w.v, b = q.x.v, c = q.y.v, d = q.z.v;
+	_MM_TRANSPOSE4_PS( a, b, c, d );
+	_mm_storeu_ps( &out[ 0 ].w, a );
+	_mm_storeu_ps( &out[ 1 ].w, b );
+	_mm_storeu_ps( &out[ 2 ].w, c );
+	_mm_storeu_ps( &out[ 3 ].w, d );
+}
+
+// Four packed vectors (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3) to and from one register per component
+static inline VrmVec3< VrmF4 > VrmVec3_Load4( const vr::HmdVector3_t *v )
+{
+	const float *p = v[ 0 ].v;
+	const __m128 a = _mm_loadu_ps( p ), b = _mm_loadu_ps( p + 4 ), c = _mm_loadu_ps( p + 8 );
+
+	const __m128 x = VRMATH_SHUFFLE( a, VRMATH_SHUFFLE( b, c, 2, 0, 1, 0 ), 0, 3, 0, 2 );
+	const __m128 y = VRMATH_SHUFFLE( VRMATH_SHUFFLE( a, b, 1, 0, 0, 0 ), VRMATH_SHUFFLE( b, c, 3, 0, 2, 0 ), 0, 2, 0, 2 );
+	const __m128 z = VRMATH_SHUFFLE( VRMATH_SHUFFLE( a, b, 2, 0, 1, 0 ), c, 0, 2, 0, 3 );
+	return { x, y, z };
+}
+
+static inline void VrmVec3_Store4( const VrmVec3< VrmF4 > &v, vr::HmdVector3_t *out )
+{
+	const __m128 x = v.x.v, y = v.y.v, z = v.z.v;
+	float *p = out[ 0 ].v;
+
+	_mm_storeu_ps( p, VRMATH_SHUFFLE( VRMATH_SHUFFLE( x, y, 0, 0, 0, 0 ), VRMATH_SHUFFLE( z, x, 0, 0, 1, 0 ), 0, 2, 0, 2 ) );
+	_mm_storeu_ps( p + 4, VRMATH_SHUFFLE( VRMATH_SHUFFLE( y, z, 1, 0, 1, 0 ), VRMATH_SHUFFLE( x, y, 2, 0, 2, 0 ), 0, 2, 0, 2 ) );
+	_mm_storeu_ps( p + 8, VRMATH_SHUFFLE( VRMATH_SHUFFLE( z, x, 2, 0, 3, 0 ), VRMATH_SHUFFLE( y, z, 3, 0, 3, 0 ), 0, 2, 0, 2 ) );
+}
+
+// Each row of four 3x4 matrices, transposed so every element of the matrix is a register
+static inline void VrmMatrix34_Load4( const vr::HmdMatrix34_t *matrices, VrmF4 out[ 3 ][ 4 ] )
+{
+	for ( int row = 0; row < 3; row++ )
+	{
+		__m128 a = _mm_loadu_ps( matrices[ 0 ].m[ row ] ), b = _mm_loadu_ps( matrices[ 1 ].m[ row ] );
+		__m128 c = _mm_loadu_ps( matrices[ 2 ].m[ row ] ), d = _mm_loadu_ps( matrices[ 3 ].m[ row ] );
+		_MM_TRANSPOSE4_PS( a, b, c, d );
+		out[ row ][ 0 ] = a;
+		out[ row ][ 1 ] = b;
+		out[ row ][ 2 ] = c;
+		out[ row ][ 3 ] = d;
+	}
+}
+
+#if VRMATH_SIMD_AVX2
+static inline VrmF8 VrmF8_Combine( VrmF4 low, VrmF4 high )
+{
+	return _mm256_insertf128_ps( _mm256_castps128_ps256( low.v ), high.v, 1 );
+}
+
+static inline VrmF4 VrmF8_Low( VrmF8 a ) { return _mm256_castps256_ps128( a.v ); }
+static inline VrmF4 VrmF8_High( VrmF8 a ) { return _mm256_extractf128_ps( a.v, 1 ); }
+
+static inline VrmQuat< VrmF8 > VrmQuat_Load8( const vr::HmdQuaternionf_t *q )
+{
+	const VrmQuat< VrmF4 > low = VrmQuat_Load4( q ), high = VrmQuat_Load4( q + 4 );
+	return { VrmF8_Combine( low.w, high.w ), VrmF8_Combine( low.x, high.x ), VrmF8_Combine( low.y, high.y ), VrmF8_Combine( low.z, high.z ) };
+}
+
+static inline void VrmQuat_Store8( const VrmQuat< VrmF8 > &q, vr::HmdQuaternionf_t *out )
+{
+	VrmQuat_Store4( { VrmF8_Low( q.w ), VrmF8_Low( q.x ), VrmF8_Low( q.y ), VrmF8_Low( q.z ) }, out );
+	VrmQuat_Store4( { VrmF8_High( q.w ), VrmF8_High( q.x ), VrmF8_High( q.y ), VrmF8_High( q.z ) }, out + 4 );
+}
+
+static inline VrmVec3< VrmF8 > VrmVec3_Load8( const vr::HmdVector3_t *v )
+{
+	const VrmVec3< VrmF4 > low = VrmVec3_Load4( v ), high = VrmVec3_Load4( v + 4 );
+	return { VrmF8_Combine( low.x, high.x ), VrmF8_Combine( low.y, high.y ), VrmF8_Combine( low.z, high.z ) };
+}
+
+static inline void VrmVec3_Store8( const VrmVec3< VrmF8 > &v, vr::HmdVector3_t *out )
+{
+	VrmVec3_Store4( { VrmF8_Low( v.x ), VrmF8_Low( v.y ), VrmF8_Low( v.z ) }, out );
+	VrmVec3_Store4( { VrmF8_High( v.x ), VrmF8_High( v.y ), VrmF8_High( v.z ) }, out + 4 );
+}
+
+static inline void VrmMatrix34_Load8( const vr::HmdMatrix34_t *matrices, VrmF8 out[ 3 ][ 4 ] )
+{
+	VrmF4 low[ 3 ][ 4 ], high[ 3 ][ 4 ];
+	VrmMatrix34_Load4( matrices, low );
+	VrmMatrix34_Load4( matrices + 4, high );
+
+	for ( int row = 0; row < 3; row++ )
+	{
+		for ( int column = 0; column < 4; column++ )
+			out[ row ][ column ] = VrmF8_Combine( low[ row ][ column ], high[ row ][ column ] );
+	}
+}
+#endif
+#endif
+
+// Widest lane type available, with its loads and stores
+#if VRMATH_SIMD_AVX2
+typedef VrmF8 VrmWide;
+static const size_t k_unVrmWideLanes = 8;
+#define VrmQuat_LoadWide VrmQuat_Load8
+#define VrmQuat_StoreWide VrmQuat_Store8
+#define VrmVec3_LoadWide VrmVec3_Load8
+#define VrmVec3_StoreWide VrmVec3_Store8
+#define VrmMatrix34_LoadWide VrmMatrix34_Load8
+#elif VRMATH_SIMD_SSE2
+typedef VrmF4 VrmWide;
+static const size_t k_unVrmWideLanes = 4;
+#define VrmQuat_LoadWide VrmQuat_Load4
+#define VrmQuat_StoreWide VrmQuat_Store4
+#define VrmVec3_LoadWide VrmVec3_Load4
+#define VrmVec3_StoreWide VrmVec3_Store4
+#define VrmMatrix34_LoadWide VrmMatrix34_Load4
+#endif
+
+// out[ i ] = rotations[ i ] applied to vectors[ i ]. out may alias vectors.
+static inline void HmdQuaternionf_RotateBatch( const vr::HmdQuaternionf_t *rotations, const vr::HmdVector3_t *vectors, vr::HmdVector3_t *out, size_t count )
+{
+	size_t i = 0;
+#if VRMATH_SIMD_SSE2
+	for ( ; i + k_unVrmWideLanes <= count; i += k_unVrmWideLanes )
+		VrmVec3_StoreWide( VrmQuat_Rotate( VrmQuat_LoadWide( rotations + i ), VrmVec3_LoadWide( vectors + i ) ), out + i );
+#endif
+	for ( ; i < count; i++ )
+		out[ i ] = HmdQuaternionf_Rotate( rotations[ i ], vectors[ i ] );
+}
+
+// out[ i ] = a[ i ] * b[ i ]. out may alias either input.
+static inline void HmdQuaternionf_MultiplyBatch( const vr::HmdQuaternionf_t *a, const vr::HmdQuaternionf_t *b, vr::HmdQuaternionf_t *out, size_t count )
+{
+	size_t i = 0;
+#if VRMATH_SIMD_SSE2
+	for ( ; i + k_unVrmWideLanes <= count; i += k_unVrmWideLanes )
+		VrmQuat_StoreWide( VrmQuat_Multiply( VrmQuat_LoadWide( a + i ), VrmQuat_LoadWide( b + i ) ), out + i );
+#endif
+	for ( ; i < count; i++ )
+		out[ i ] = HmdQuaternionf_Multiply( a[ i ], b[ i ] );
+}
+
+static inline void HmdQuaternionf_NormalizeBatch( vr::HmdQuaternionf_t *q, size_t count )
+{
+	size_t i = 0;
+#if VRMATH_SIMD_SSE2
+	for ( ; i + k_unVrmWideLanes <= count; i += k_unVrmWideLanes )
+		VrmQuat_StoreWide( VrmQuat_Normalize( VrmQuat_LoadWide( q + i ) ), q + i );
+#endif
+	for ( ; i < count; i++ )
+		q[ i ] = HmdQuaternionf_Normalize( q[ i ] );
+}
+
+// out[ i ] = nlerp( a[ i ], b[ i ], t ). out may alias either input.
+static inline void HmdQuaternionf_NlerpBatch( const vr::HmdQuaternionf_t *a, const vr::HmdQuaternionf_t *b, float t, vr::HmdQuaternionf_t *out, size_t count )
+{
+	size_t i = 0;
+#if VRMATH_SIMD_SSE2
+	const VrmWide wide_t( t );
+	for ( ; i + k_unVrmWideLanes <= count; i += k_unVrmWideLanes )
+		VrmQuat_StoreWide( VrmQuat_Nlerp( VrmQuat_LoadWide( a + i ), VrmQuat_LoadWide( b + i ), wide_t ), out + i );
+#endif
+	for ( ; i < count; i++ )
+		out[ i ] = HmdQuaternionf_Nlerp( a[ i ], b[ i ], t );
+}
+
+// Poses from device to tracking space matrices, e.g. the results of GetRawTrackedDevicePoses
+static inline void HmdPosef_FromMatrix34Batch( const vr::HmdMatrix34_t *matrices, HmdPosef_t *out, size_t count )
+{
+	size_t i = 0;
+#if VRMATH_SIMD_SSE2
+	for ( ; i + k_unVrmWideLanes <= count; i += k_unVrmWideLanes )
+	{
+		VrmWide m[ 3 ][ 4 ];
+		VrmMatrix34_LoadWide( matrices + i, m );
+
+		vr::HmdQuaternionf_t orientations[ k_unVrmWideLanes ];
+		vr::HmdVector3_t positions[ k_unVrmWideLanes ];
+		VrmQuat_StoreWide( VrmQuat_FromMatrix( m[ 0 ][ 0 ], m[ 0 ][ 1 ], m[ 0 ][ 2 ], m[ 1 ][ 0 ], m[ 1 ][ 1 ], m[ 1 ][ 2 ], m[ 2 ][ 0 ], m[ 2 ][ 1 ], m[ 2 ][ 2 ] ), orientations );
+		VrmVec3_StoreWide( { m[ 0 ][ 3 ], m[ 1 ][ 3 ], m[ 2 ][ 3 ] }, positions );
+
+		for ( size_t lane = 0; lane < k_unVrmWideLanes; lane++ )
+			out[ i + lane ] = { orientations[ lane ], positions[ lane ] };
+	}
+#endif
+	for ( ; i < count; i++ )
+		out[ i ] = HmdPosef_FromMatrix34( matrices[ i ] );
+}
+
+// Transforms many points by one pose. out may alias points.
+static inline void HmdPosef_TransformPointsBatch( const HmdPosef_t &pose, const vr::HmdVector3_t *points, vr::HmdVector3_t *out, size_t count )
+{
+	size_t i = 0;
+#if VRMATH_SIMD_SSE2
+	const VrmQuat< VrmWide > q = { pose.orientation.w, pose.orientation.x, pose.orientation.y, pose.orientation.z };
+	const VrmWide tx( pose.position.v[ 0 ] ), ty( pose.position.v[ 1 ] ), tz( pose.position.v[ 2 ] );
+
+	for ( ; i + k_unVrmWideLanes <= count; i += k_unVrmWideLanes )
+	{
+		const VrmVec3< VrmWide > rotated = VrmQuat_Rotate( q, VrmVec3_LoadWide( points + i ) );
+		VrmVec3_StoreWide( { rotated.x + tx, rotated.y + ty, rotated.z + tz }, out + i );
+	}
+#endif
+	for ( ; i < count; i++ )
+		out[ i ] = HmdPosef_TransformPoint( pose, points[ i ] );
+}
+
+// out[ i ] = a[ i ] * b[ i ] for arrays of poses, e.g. bones to their parents. out may alias either input.
+static inline void HmdPosef_MultiplyBatch( const HmdPosef_t *a, const HmdPosef_t *b, HmdPosef_t *out, size_t count )
+{
+	size_t i = 0;
+#if VRMATH_SIMD_SSE2
+	// Poses aren't packed like quaternion or vector arrays, so gather the lanes through the stack
+	for ( ; i + k_unVrmWideLanes <= count; i += k_unVrmWideLanes )
+	{
+		vr::HmdQuaternionf_t qa[ k_unVrmWideLanes ], qb[ k_unVrmWideLanes ];
+		vr::HmdVector3_t pa[ k_unVrmWideLanes ], pb[ k_unVrmWideLanes ];
+		for ( size_t lane = 0; lane < k_unVrmWideLanes; lane++ )
+		{
+			qa[ lane ] = a[ i + lane ].orientation;
+			qb[ lane ] = b[ i + lane ].orientation;
+			pa[ lane ] = a[ i + lane ].position;
+			pb[ lane ] = b[ i + lane ].position;
+		}
+
+		const VrmQuat< VrmWide > wide_qa = VrmQuat_LoadWide( qa );
+		const VrmVec3< VrmWide > wide_pa = VrmVec3_LoadWide( pa );
+		const VrmVec3< VrmWide > rotated = VrmQuat_Rotate( wide_qa, VrmVec3_LoadWide( pb ) );
+
+		VrmQuat_StoreWide( VrmQuat_Multiply( wide_qa, VrmQuat_LoadWide( qb ) ), qa );
+		VrmVec3_StoreWide( { rotated.x + wide_pa.x, rotated.y + wide_pa.y, rotated.z + wide_pa.z }, pa );
+
+		for ( size_t lane = 0; lane < k_unVrmWideLanes; lane++ )
+			out[ i + lane ] = { qa[ lane ], pa[ lane ] };
+	}
+#endif
+	for ( ; i < count; i++ )
+		out[ i ] = HmdPosef_Multiply( a[ i ], b[ i ] );
+}
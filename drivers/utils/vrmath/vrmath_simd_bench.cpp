@@ -0,0 +1,293 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Checks vrmath_simd.h against the double precision functions in vrmath.h, and times the two.
+//
+// Random unit quaternions and vectors go through each single value function and the matching vrmath.h one, and the
+// largest difference of any component is reported. The batch functions are then checked against the single value
+// functions over the same arrays, with a count that leaves a scalar tail, and the float -> double -> float conversions
+// for bit exact round trips. The run fails if anything is over its tolerance. Then the main operations are timed, in ns
+// per element, best of a number of runs.
+//
+// Not part of any build. From this directory, with the OpenVR headers:
+//
+//   g++ -O2 -I<openvr>/headers vrmath_simd_bench.cpp -o vrmath_simd_bench
+//
+// and again with -DVRMATH_SIMD_DISABLE, -mavx2 and -mavx2 -mfma for the other paths.
+//
+// Usage: vrmath_simd_bench [elements, default 4099] [runs, default 200]
+
+#include "vrmath.h"
+#include "vrmath_simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Float against double. Rotations of vectors up to unit length, and products of unit quaternions.
+static const double k_flMaxRotateError = 1e-6;
+static const double k_flMaxQuaternionError = 5e-7;
+
+// Batch against single value. The same kernels, but a compiler may fuse the single value multiply-adds differently.
+static const double k_flMaxBatchError = 1e-6;
+
+static uint32_t rng_state = 0x12345678;
+
+static float RandomFloat( float low, float high )
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return low + ( high - low ) * static_cast< float >( rng_state >> 8 ) * ( 1.f / 16777216.f );
+}
+
+static vr::HmdQuaternionf_t RandomRotation()
+{
+	vr::HmdQuaternionf_t q;
+	float length_squared;
+	do
+	{
+		q = { RandomFloat( -1.f, 1.f ), RandomFloat( -1.f, 1.f ), RandomFloat( -1.f, 1.f ), RandomFloat( -1.f, 1.f ) };
+		length_squared = q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z;
+	} while ( length_squared < 0.01f || length_squared > 1.f );
+
+	const float inv_length = 1.f / std::sqrt( length_squared );
+	return { q.w * inv_length, q.x * inv_length, q.y * inv_length, q.z * inv_length };
+}
+
+static double SecondsNow()
+{
+	return std::chrono::duration< double >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// Best time of runs calls to run_pass, in ns per element
+template < typename Function >
+static double BestNanoseconds( int runs, size_t count, Function run_pass )
+{
+	double best = 1e30;
+	for ( int run = 0; run < runs; run++ )
+	{
+		const double start = SecondsNow();
+		run_pass();
+		best = std::min( best, SecondsNow() - start );
+	}
+	return best * 1e9 / count;
+}
+
+static double QuaternionError( const vr::HmdQuaternionf_t &a, const vr::HmdQuaternion_t &b )
+{
+	return std::max( std::max( std::fabs( a.w - b.w ), std::fabs( a.x - b.x ) ), std::max( std::fabs( a.y - b.y ), std::fabs( a.z - b.z ) ) );
+}
+
+static double QuaternionError( const vr::HmdQuaternionf_t &a, const vr::HmdQuaternionf_t &b )
+{
+	return QuaternionError( a, HmdQuaternion_FromHmdQuaternionf( b ) );
+}
+
+static double VectorError( const vr::HmdVector3_t &a, const vr::HmdVector3_t &b )
+{
+	return std::max( std::max( std::fabs( a.v[ 0 ] - b.v[ 0 ] ), std::fabs( a.v[ 1 ] - b.v[ 1 ] ) ), std::fabs( a.v[ 2 ] - b.v[ 2 ] ) );
+}
+
+// vrmath.h's rotation before it moved to the cross product form, as a timing reference
+static vr::HmdVector3_t RotateByQuaternionProducts( const vr::HmdVector3_t &vec, const vr::HmdQuaternion_t &q )
+{
+	const vr::HmdQuaternion_t qvec = { 0.0, vec.v[ 0 ], vec.v[ 1 ], vec.v[ 2 ] };
+	const vr::HmdQuaternion_t result = ( q * qvec ) * ( -q );
+	return { static_cast< float >( result.x ), static_cast< float >( result.y ), static_cast< float >( result.z ) };
+}
+
+static bool Report( const char *name, double error, double tolerance )
+{
+	const bool ok = error <= tolerance;
+	printf( "  %-34s %8.2g %s\n", name, error, ok ? "ok" : "FAILED" );
+	return ok;
+}
+
+int main( int argc, char **argv )
+{
+	const int count = argc > 1 ? atoi( argv[ 1 ] ) : 4099;
+	const int runs = argc > 2 ? atoi( argv[ 2 ] ) : 200;
+	if ( count <= 0 || runs <= 0 )
+	{
+		fprintf( stderr, "Usage: vrmath_simd_bench [elements, default 4099] [runs, default 200]\n" );
+		return 2;
+	}
+
+#if VRMATH_SIMD_AVX2 && VRMATH_SIMD_FMA
+	const char *path = "AVX2 + FMA";
+#elif VRMATH_SIMD_AVX2
+	const char *path = "AVX2";
+#elif VRMATH_SIMD_SSE2
+	const char *path = "SSE2";
+#else
+	const char *path = "scalar";
+#endif
+	printf( "%d elements, %s batches\n", count, path );
+
+	std::vector< vr::HmdQuaternionf_t > qa( count ), qb( count );
+	std::vector< vr::HmdQuaternion_t > dqa( count ), dqb( count );
+	std::vector< vr::HmdVector3_t > vectors( count );
+	std::vector< HmdPosef_t > pa( count ), pb( count );
+	for ( int i = 0; i < count; i++ )
+	{
+		qa[ i ] = RandomRotation();
+		qb[ i ] = RandomRotation();
+		dqa[ i ] = HmdQuaternion_FromHmdQuaternionf( qa[ i ] );
+		dqb[ i ] = HmdQuaternion_FromHmdQuaternionf( qb[ i ] );
+		vectors[ i ] = { RandomFloat( -1.f, 1.f ), RandomFloat( -1.f, 1.f ), RandomFloat( -1.f, 1.f ) };
+		pa[ i ] = { qa[ i ], { RandomFloat( -2.f, 2.f ), RandomFloat( -2.f, 2.f ), RandomFloat( -2.f, 2.f ) } };
+		pb[ i ] = { qb[ i ], vectors[ i ] };
+	}
+
+	// ----- Single values against vrmath.h -----
+
+	double rotate_error = 0.0, multiply_error = 0.0, normalize_error = 0.0, slerp_error = 0.0, transform_error = 0.0;
+	for ( int i = 0; i < count; i++ )
+	{
+		rotate_error = std::max( rotate_error, VectorError( HmdQuaternionf_Rotate( qa[ i ], vectors[ i ] ), vectors[ i ] * dqa[ i ] ) );
+		multiply_error = std::max( multiply_error, QuaternionError( HmdQuaternionf_Multiply( qa[ i ], qb[ i ] ), dqa[ i ] * dqb[ i ] ) );
+
+		// Scaled away from unit length, so there is something to normalize
+		const float scale = RandomFloat( 0.1f, 10.f );
+		const vr::HmdQuaternionf_t scaled = { qa[ i ].w * scale, qa[ i ].x * scale, qa[ i ].y * scale, qa[ i ].z * scale };
+		normalize_error = std::max( normalize_error, QuaternionError( HmdQuaternionf_Normalize( scaled ), HmdQuaternion_Normalize( HmdQuaternion_FromHmdQuaternionf( scaled ) ) ) );
+
+		const float t = RandomFloat( 0.f, 1.f );
+		slerp_error = std::max( slerp_error, QuaternionError( HmdQuaternionf_Slerp( qa[ i ], qb[ i ], t ), HmdQuaternion_Slerp( dqa[ i ], dqb[ i ], t ) ) );
+
+		const vr::HmdVector3_t expected = ( vectors[ i ] * dqa[ i ] ) + pa[ i ].position;
+		transform_error = std::max( transform_error, VectorError( HmdPosef_TransformPoint( pa[ i ], vectors[ i ] ), expected ) );
+	}
+
+	bool ok = true;
+	printf( "max component error against vrmath.h:\n" );
+	ok &= Report( "HmdQuaternionf_Rotate", rotate_error, k_flMaxRotateError );
+	ok &= Report( "HmdQuaternionf_Multiply", multiply_error, k_flMaxQuaternionError );
+	ok &= Report( "HmdQuaternionf_Normalize", normalize_error, k_flMaxQuaternionError );
+	ok &= Report( "HmdQuaternionf_Slerp", slerp_error, k_flMaxQuaternionError );
+	ok &= Report( "HmdPosef_TransformPoint", transform_error, k_flMaxRotateError );
+
+	// ----- Batches against single values -----
+
+	std::vector< vr::HmdQuaternionf_t > out_q( count );
+	std::vector< vr::HmdVector3_t > out_v( count );
+	std::vector< HmdPosef_t > out_p( count );
+	double batch_error;
+	const float nlerp_t = 0.3f;
+
+	printf( "max component error of the batches against single values:\n" );
+
+	HmdQuaternionf_RotateBatch( qa.data(), vectors.data(), out_v.data(), count );
+	batch_error = 0.0;
+	for ( int i = 0; i < count; i++ )
+		batch_error = std::max( batch_error, VectorError( out_v[ i ], HmdQuaternionf_Rotate( qa[ i ], vectors[ i ] ) ) );
+	ok &= Report( "HmdQuaternionf_RotateBatch", batch_error, k_flMaxBatchError );
+
+	HmdQuaternionf_MultiplyBatch( qa.data(), qb.data(), out_q.data(), count );
+	batch_error = 0.0;
+	for ( int i = 0; i < count; i++ )
+		batch_error = std::max( batch_error, QuaternionError( out_q[ i ], HmdQuaternionf_Multiply( qa[ i ], qb[ i ] ) ) );
+	ok &= Report( "HmdQuaternionf_MultiplyBatch", batch_error, k_flMaxBatchError );
+
+	// A few zero quaternions among them, which come back as the identity
+	for ( int i = 0; i < count; i++ )
+		out_q[ i ] = i % 97 == 0 ? vr::HmdQuaternionf_t{ 0.f, 0.f, 0.f, 0.f } : vr::HmdQuaternionf_t{ qa[ i ].w * 3.f, qa[ i ].x * 3.f, qa[ i ].y * 3.f, qa[ i ].z * 3.f };
+	std::vector< vr::HmdQuaternionf_t > unnormalized = out_q;
+	HmdQuaternionf_NormalizeBatch( out_q.data(), count );
+	batch_error = 0.0;
+	for ( int i = 0; i < count; i++ )
+		batch_error = std::max( batch_error, QuaternionError( out_q[ i ], HmdQuaternionf_Normalize( unnormalized[ i ] ) ) );
+	batch_error = std::max( batch_error, QuaternionError( out_q[ 0 ], HmdQuaternionf_Identity ) );
+	ok &= Report( "HmdQuaternionf_NormalizeBatch", batch_error, k_flMaxBatchError );
+
+	HmdQuaternionf_NlerpBatch( qa.data(), qb.data(), nlerp_t, out_q.data(), count );
+	batch_error = 0.0;
+	for ( int i = 0; i < count; i++ )
+		batch_error = std::max( batch_error, QuaternionError( out_q[ i ], HmdQuaternionf_Nlerp( qa[ i ], qb[ i ], nlerp_t ) ) );
+	ok &= Report( "HmdQuaternionf_NlerpBatch", batch_error, k_flMaxBatchError );
+
+	HmdPosef_TransformPointsBatch( pa[ 0 ], vectors.data(), out_v.data(), count );
+	batch_error = 0.0;
+	for ( int i = 0; i < count; i++ )
+		batch_error = std::max( batch_error, VectorError( out_v[ i ], HmdPosef_TransformPoint( pa[ 0 ], vectors[ i ] ) ) );
+	ok &= Report( "HmdPosef_TransformPointsBatch", batch_error, k_flMaxBatchError );
+
+	HmdPosef_MultiplyBatch( pa.data(), pb.data(), out_p.data(), count );
+	batch_error = 0.0;
+	for ( int i = 0; i < count; i++ )
+	{
+		const HmdPosef_t expected = HmdPosef_Multiply( pa[ i ], pb[ i ] );
+		batch_error = std::max( batch_error, QuaternionError( out_p[ i ].orientation, expected.orientation ) );
+		batch_error = std::max( batch_error, VectorError( out_p[ i ].position, expected.position ) );
+	}
+	ok &= Report( "HmdPosef_MultiplyBatch", batch_error, k_flMaxBatchError );
+
+	// ----- Conversions -----
+
+	bool round_trips = true;
+	for ( int i = 0; i < count; i++ )
+	{
+		const vr::HmdQuaternionf_t back = HmdQuaternionf_FromHmdQuaternion( HmdQuaternion_FromHmdQuaternionf( qa[ i ] ) );
+
+		vr::DriverPose_t driver_pose = {};
+		HmdPosef_ToDriverPose( pa[ i ], driver_pose );
+		const HmdPosef_t pose_back = HmdPosef_FromDriverPose( driver_pose );
+
+		round_trips = round_trips && memcmp( &back, &qa[ i ], sizeof( back ) ) == 0 && memcmp( &pose_back, &pa[ i ], sizeof( pose_back ) ) == 0;
+	}
+	printf( "float -> double -> float round trips: %s\n", round_trips ? "ok" : "FAILED" );
+	ok &= round_trips;
+
+	// ----- Timing -----
+
+	float sink = 0.f;
+	const double old_rotate_ns = BestNanoseconds( runs, count, [ & ]() {
+		for ( int i = 0; i < count; i++ )
+			out_v[ i ] = RotateByQuaternionProducts( vectors[ i ], dqa[ i ] );
+	} );
+	const double vrmath_rotate_ns = BestNanoseconds( runs, count, [ & ]() {
+		for ( int i = 0; i < count; i++ )
+			out_v[ i ] = vectors[ i ] * dqa[ i ];
+	} );
+	sink += out_v[ count / 2 ].v[ 0 ];
+	const double single_rotate_ns = BestNanoseconds( runs, count, [ & ]() {
+		for ( int i = 0; i < count; i++ )
+			out_v[ i ] = HmdQuaternionf_Rotate( qa[ i ], vectors[ i ] );
+	} );
+	sink += out_v[ count / 2 ].v[ 0 ];
+	const double batch_rotate_ns = BestNanoseconds( runs, count, [ & ]() { HmdQuaternionf_RotateBatch( qa.data(), vectors.data(), out_v.data(), count ); } );
+	sink += out_v[ count / 2 ].v[ 0 ];
+
+	std::vector< vr::HmdQuaternion_t > out_dq( count );
+	const double vrmath_multiply_ns = BestNanoseconds( runs, count, [ & ]() {
+		for ( int i = 0; i < count; i++ )
+			out_dq[ i ] = dqa[ i ] * dqb[ i ];
+	} );
+	sink += ( float )out_dq[ count / 2 ].w;
+	const double batch_multiply_ns = BestNanoseconds( runs, count, [ & ]() { HmdQuaternionf_MultiplyBatch( qa.data(), qb.data(), out_q.data(), count ); } );
+	sink += out_q[ count / 2 ].w;
+
+	const double vrmath_slerp_ns = BestNanoseconds( runs, count, [ & ]() {
+		for ( int i = 0; i < count; i++ )
+			out_dq[ i ] = HmdQuaternion_Slerp( dqa[ i ], dqb[ i ], nlerp_t );
+	} );
+	sink += ( float )out_dq[ count / 2 ].w;
+	const double batch_nlerp_ns = BestNanoseconds( runs, count, [ & ]() { HmdQuaternionf_NlerpBatch( qa.data(), qb.data(), nlerp_t, out_q.data(), count ); } );
+	sink += out_q[ count / 2 ].w;
+
+	const double batch_pose_multiply_ns = BestNanoseconds( runs, count, [ & ]() { HmdPosef_MultiplyBatch( pa.data(), pb.data(), out_p.data(), count ); } );
+	sink += out_p[ count / 2 ].orientation.w;
+
+	if ( sink == 12345.f )
+		printf( " " );
+
+	printf( "ns per element, best of %d runs:\n", runs );
+	printf( "  rotate:   two quaternion products (old vrmath.h) %.1f, vrmath.h %.1f, float single %.1f, batch %.1f\n", old_rotate_ns, vrmath_rotate_ns, single_rotate_ns, batch_rotate_ns );
+	printf( "  multiply: vrmath.h %.1f, batch %.1f\n", vrmath_multiply_ns, batch_multiply_ns );
+	printf( "  vrmath.h slerp %.1f, nlerp batch %.1f\n", vrmath_slerp_ns, batch_nlerp_ns );
+	printf( "  pose multiply batch %.1f\n", batch_pose_multiply_ns );
+
+	return ok ? 0 : 1;
+}
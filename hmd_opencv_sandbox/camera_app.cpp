@@ -1,6 +1,7 @@
 #include "camera_app.h"
 #include "common_hello.h"
 #include "hmd_opencv_sandbox.h"
+#include "stereo_half.h"
 #include <iostream>
 
 
@@ -12,11 +13,9 @@
 CameraApp::settings_t g_savesettings[NUM_SAVED_SETTINGS];
 
 CameraApp::CameraApp( CMainApplication * parentApp ) :
-	m_ipxUpdatePlace( 0 )
-	, m_frameno( 0 )
+	m_frameno( 0 )
 	, m_opencv_p( this )
-	, m_maxframeno( 100000 )
-	, m_ipxUpdatePlaceLast( 0 )
+	, m_maxframeno( 65536 ) //The point cloud keeps frame numbers in 16 bits.
 	, m_shdCharlesFloor( CONTENT_FOLDER"/charlesfloor" )
 	, m_shdDumb( CONTENT_FOLDER"/dumb" )
 	, m_shdPointCloud( CONTENT_FOLDER"/pointcloud" )
@@ -212,42 +211,41 @@ bool CameraApp::BInit()
 	m_geoCharlesFloor.SetRenderType( 0, GL_TRIANGLES );
 	m_geoCharlesFloor.Check();
 
-	//Point cloud
+	//Point cloud, as StereoDotVertex: 3 floats' worth each.
 	{
-		m_geoPointCloud.SetArrayProps( 0, 1, 8 );
-		m_geoPointCloud.SetArrayPropsAdvanced( 0, 0, 4, 0 ); //Position
-		m_geoPointCloud.SetArrayPropsAdvanced( 0, 1, 4, 4 ); //Color
+		m_geoPointCloud.SetArrayProps( 0, 1, sizeof( StereoDotVertex ) / sizeof( float ) );
+		m_geoPointCloud.SetArrayPropsAdvanced( 0, 0, 3, 0, GL_HALF_FLOAT );            //Position
+		m_geoPointCloud.SetArrayPropsAdvanced( 0, 1, 4, 8, GL_UNSIGNED_BYTE, true );   //Color
+		m_geoPointCloud.SetArrayPropsAdvanced( 0, 2, 1, 3, GL_UNSIGNED_SHORT );        //Frame
 		m_geoPointCloud.SetRenderType( 0, GL_POINTS );
-		std::vector<float> & pointclouddata = m_geoPointCloud.GetVertexArrayPtr();
-		pointclouddata.resize( m_uiPointCloudCount * 8 );
+		std::vector< StereoDot > initial( m_uiPointCloudCount );
 		for ( int i = 0; i < (int)m_uiPointCloudCount; i++ )
 		{
-			pointclouddata[i * 8 + 0] = i * 0.01f;
-			pointclouddata[i * 8 + 1] = i * 0.01f;
-			pointclouddata[i * 8 + 2] = i * 0.01f;
-			pointclouddata[i * 8 + 3] = 1;
-
-			pointclouddata[i * 8 + 4] = 1.0;
-			pointclouddata[i * 8 + 5] = 0.5;
-			pointclouddata[i * 8 + 6] = 0.0;
-			pointclouddata[i * 8 + 7] = 1.0;
+			StereoDot d = { i * 0.01f, i * 0.01f, i * 0.01f, 1, 1.0f, 0.5f, 0.0f, 1.0f };
+			initial[i] = d;
 		}
+		std::vector<float> & pointclouddata = m_geoPointCloud.GetVertexArrayPtr();
+		pointclouddata.resize( m_uiPointCloudCount * sizeof( StereoDotVertex ) / sizeof( float ) );
+		PackStereoDots( &initial[0], m_uiPointCloudCount, (StereoDotVertex*)&pointclouddata[0] );
 		m_geoPointCloud.Check();
+		m_pointRing.Init( m_uiPointCloudCount );
 	}
 
 	glGenTextures( 1, &m_iTexture );
 
 	////////////////////////////////////////////////////////////////////////////
-	//For depth geometry
+	//For depth geometry.  The positions are 4 half floats, Reproject's, in 2 floats' worth.
 	{
-		m_geoDepthMap.SetArrayProps( 0, 1, 4 );
+		m_geoDepthMap.SetArrayProps( 0, 1, 2 );
+		m_geoDepthMap.SetArrayPropsAdvanced( 0, 0, 4, 0, GL_HALF_FLOAT );
 		m_geoDepthMap.SetArrayProps( 1, 0, 2 );
 
 		std::vector<float> & depth_vc = m_geoDepthMap.GetVertexArrayPtr( 0 );
 		std::vector<float> & depth_tc = m_geoDepthMap.GetVertexArrayPtr( 1 );
 		int uiDepthVertCount = DEPTHMAPX * DEPTHMAPY;
 		depth_tc.resize( uiDepthVertCount * 2 );
-		depth_vc.resize( uiDepthVertCount * 4 );
+		depth_vc.resize( uiDepthVertCount * 2 );
+		uint16_t * depth_hc = (uint16_t*)&depth_vc[0];
 		for ( int y = 0; y < DEPTHMAPY; y++ )
 			for ( int x = 0; x < DEPTHMAPX; x++ )
 			{
@@ -258,10 +256,10 @@ bool CameraApp::BInit()
 				float cy = 10.0f * y / (DEPTHMAPY - 1) - 5;
 				float sincR = sqrt( cx * cx + cy * cy );
 				float sinc = sin( sincR ) / sincR;
-				depth_vc[(x + y * DEPTHMAPX) * 4 + 0] = 2.0f * x / (DEPTHMAPY - 1) - 1.0f;
-				depth_vc[(x + y * DEPTHMAPX) * 4 + 1] = 1 ? nanf( "" ) : sinc;
-				depth_vc[(x + y * DEPTHMAPX) * 4 + 2] = 2.0f * y / (DEPTHMAPY - 1) - 1.0f;
-				depth_vc[(x + y * DEPTHMAPX) * 4 + 3] = 1.0;
+				depth_hc[(x + y * DEPTHMAPX) * 4 + 0] = FloatToHalf( 2.0f * x / (DEPTHMAPY - 1) - 1.0f );
+				depth_hc[(x + y * DEPTHMAPX) * 4 + 1] = FloatToHalf( 1 ? nanf( "" ) : sinc );
+				depth_hc[(x + y * DEPTHMAPX) * 4 + 2] = FloatToHalf( 2.0f * y / (DEPTHMAPY - 1) - 1.0f );
+				depth_hc[(x + y * DEPTHMAPX) * 4 + 3] = FloatToHalf( 1.0 );
 			}
 
 		//From https://github.com/cnlohr/spreadgine/blob/master/src/spreadgine_util.c:216
@@ -320,21 +318,13 @@ bool CameraApp::BInit()
 
 void CameraApp::EmitDot( float x, float y, float z, float w, float r, float g, float b, float a )
 {
-	m_ipxUpdatePlace++;
-	if ( m_ipxUpdatePlace == m_uiPointCloudCount )m_ipxUpdatePlace = 0;
-	int i = m_ipxUpdatePlace;
-
-	std::vector<float> & pointclouddata = m_geoPointCloud.GetVertexArrayPtr();
-
-	pointclouddata[i * 8 + 0] = x;
-	pointclouddata[i * 8 + 1] = y;
-	pointclouddata[i * 8 + 2] = z;
-	pointclouddata[i * 8 + 3] = w;
+	StereoDot dot = { x, y, z, w, r, g, b, a };
+	m_pointRing.Push( &dot, 1 );
+}
 
-	pointclouddata[i * 8 + 4] = r;
-	pointclouddata[i * 8 + 5] = g;
-	pointclouddata[i * 8 + 6] = b;
-	pointclouddata[i * 8 + 7] = a;
+void CameraApp::EmitDots( const StereoDot * pDots, int iCount )
+{
+	m_pointRing.Push( pDots, iCount );
 }
 
 void CameraApp::Shutdown()
@@ -362,6 +352,11 @@ void CameraApp::KeyDown( int32_t c )
 		m_opencv_p.m_bScreenshotNext = true;
 		return;
 	}
+	if ( c == 'c' )
+	{
+		m_opencv_p.ToggleRecording();
+		return;
+	}
 
 	bool bSettingsChanged = true;
 
@@ -380,6 +375,8 @@ void CameraApp::KeyDown( int32_t c )
 	case SDLK_f:       settings.iFloorType = (settings.iFloorType+1)%4; break;
 	case SDLK_g:       settings.bGreenMode = !settings.bGreenMode; break;
 	case SDLK_d:       settings.iStereoAlg++; break;
+	case SDLK_x:       settings.iStereoSearch++; break;
+	case SDLK_v:       settings.iStereoChecks++; break;
 	case SDLK_7:		if ( settings.fAntMaxDist < 30 ) settings.fAntMaxDist += .5; break;
 	case SDLK_u:		if ( settings.fAntMaxDist >= 0.5 ) settings.fAntMaxDist -= .5; break;
 	case SDLK_8:		if ( settings.fImportanceOfDist < 30 ) settings.fImportanceOfDist += .5f; break;
@@ -427,25 +424,19 @@ void CameraApp::Prerender()
 	//Update any dots and update the render thread.
 	m_opencv_p.Prerender();
 
-	//Update our points with any that were written into the points array.
-	//Tricky: Only update dots which have changd.
+	//Upload just the dots pushed since last time, straight from the ring.
 	{
-		int to_update = m_ipxUpdatePlace - m_ipxUpdatePlaceLast;
+		bool bBound = false;
 		int vbo = m_geoPointCloud.GetVBO();
-		std::vector<float> & pointclouddata = m_geoPointCloud.GetVertexArrayPtr();
-		if ( to_update < 0 )
-		{
-			//Tricky: to_update has flipped.
-			glBindBuffer( GL_ARRAY_BUFFER, vbo );
-			glBufferSubData( GL_ARRAY_BUFFER, (GLintptr)(sizeof( float ) * 8 * m_ipxUpdatePlaceLast), sizeof( float ) * (m_uiPointCloudCount - m_ipxUpdatePlaceLast) * 8, &pointclouddata[m_ipxUpdatePlaceLast * 8] );
-			glBufferSubData( GL_ARRAY_BUFFER, 0, sizeof( float ) * (m_ipxUpdatePlace), &pointclouddata[0] );
-		}
-		else if ( to_update > 0 )
+		m_pointRing.Consume( [&]( int iFirst, const StereoDotVertex * pVerts, int iCount )
 		{
-			glBindBuffer( GL_ARRAY_BUFFER, vbo );
-			glBufferSubData( GL_ARRAY_BUFFER, (GLintptr)(sizeof( float ) * 8 * m_ipxUpdatePlaceLast), sizeof( float ) * 8 * to_update, &pointclouddata[m_ipxUpdatePlaceLast * 8] );
-		}
-		m_ipxUpdatePlaceLast = m_ipxUpdatePlace;
+			if ( !bBound )
+			{
+				glBindBuffer( GL_ARRAY_BUFFER, vbo );
+				bBound = true;
+			}
+			glBufferSubData( GL_ARRAY_BUFFER, (GLintptr)( sizeof( StereoDotVertex ) * iFirst ), sizeof( StereoDotVertex ) * iCount, pVerts );
+		} );
 	}
 
 	std::stringstream err;
@@ -648,6 +639,8 @@ void CameraApp::settings_t::Print()
 		"savesettings.bGreenMode = %d\n"
 		"savesettings.fGeoAlpha = %.3f\n"
 		"savesettings.iStereoAlg = %d\n"
+		"savesettings.iStereoSearch = %d\n"
+		"savesettings.iStereoChecks = %d\n"
 		"savesettings.fAntMaxDist = %.3f\n"
 		"savesettings.fImportanceOfDist = %.3f\n"
 		"savesettings.iWhichAntShader = %d\n"
@@ -662,6 +655,8 @@ void CameraApp::settings_t::Print()
 		bGreenMode,
 		fGeoAlpha,
 		iStereoAlg,
+		iStereoSearch,
+		iStereoChecks,
 		fAntMaxDist,
 		fImportanceOfDist,
 		iWhichAntShader,
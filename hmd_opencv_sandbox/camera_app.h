@@ -35,6 +35,8 @@ public:
 	int m_maxframeno;
 
 	void EmitDot( float x, float y, float z, float w, float r, float g, float b, float a );
+	//The same for a batch.  Both are safe from any thread.
+	void EmitDots( const StereoDot * pDots, int iCount );
 	void Prerender();
 	void KeyDown( int32_t c );
 
@@ -55,6 +57,8 @@ public:
 		bool bGreenMode = 0;
 		float fGeoAlpha = 1.0;
 		int iStereoAlg = 0;
+		int iStereoSearch = 0; //StereoCensusSearch, for the census matcher.
+		int iStereoChecks = 0; //STEREO_CHECK_ flags.
 		float fAntMaxDist = 100.0;
 		float fImportanceOfDist = 0;
 		int iWhichAntShader = 0;
@@ -87,8 +91,7 @@ private:
 
 	GeometryObject m_geoPointCloud;
 	int m_uiPointCloudCount;
-	int m_ipxUpdatePlace;
-	int m_ipxUpdatePlaceLast;
+	StereoPointRing m_pointRing; //Dots on their way into m_geoPointCloud's VBO.
 
 	//For depth geometry.
 	ShaderFile m_shdWorld, m_shdWorld2, m_shdWorld3;
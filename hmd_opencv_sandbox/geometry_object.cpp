@@ -238,8 +238,12 @@ void GeometryObject::SetArrayProps( int index, bool dynamic, int stride )
 	m_vertdynamic[index] = dynamic;
 	if ( m_vertoffset[index].size() < 1 ) m_vertoffset[index].resize( 1 );
 	if ( m_vertelements[index].size() < 1 ) m_vertelements[index].resize( 1 );
+	if ( m_verttype[index].size() < 1 ) m_verttype[index].resize( 1 );
+	if ( m_vertnormalized[index].size() < 1 ) m_vertnormalized[index].resize( 1 );
 	m_vertoffset[index][0] = 0;
 	m_vertelements[index][0] = stride;
+	m_verttype[index][0] = GL_FLOAT;
+	m_vertnormalized[index][0] = false;
 	TaintVerts( index );
 }
 
@@ -250,18 +254,34 @@ void GeometryObject::CheckVertexProps( int index )
 	if ( (int)m_vertdynamic.size() <= index )	m_vertdynamic.resize( index + 1 );
 	if ( (int)m_vertoffset.size() <= index )	m_vertoffset.resize( index + 1 );
 	if ( (int)m_vertelements.size() <= index )	m_vertelements.resize( index + 1 );
+	if ( (int)m_verttype.size() <= index )		m_verttype.resize( index + 1 );
+	if ( (int)m_vertnormalized.size() <= index )	m_vertnormalized.resize( index + 1 );
 }
 
-void GeometryObject::SetArrayPropsAdvanced( int index, int part, int elements, int offset )
+void GeometryObject::SetArrayPropsAdvanced( int index, int part, int elements, int offset, unsigned int type, bool normalized )
 {
 	CheckVertexProps( index );
 	if ( (int)m_vertoffset[index].size() <= part )		m_vertoffset[index].resize( part+1 );
 	if ( (int)m_vertelements[index].size() <= part )	m_vertelements[index].resize( part+1 );
+	if ( (int)m_verttype[index].size() <= part )		m_verttype[index].resize( part+1, GL_FLOAT );
+	if ( (int)m_vertnormalized[index].size() <= part )	m_vertnormalized[index].resize( part+1 );
 	m_vertoffset[index][part] = offset;
 	m_vertelements[index][part] = elements;
+	m_verttype[index][part] = type;
+	m_vertnormalized[index][part] = normalized;
 	TaintVerts( index );
 }
 
+static int GLTypeSize( unsigned int type )
+{
+	switch ( type )
+	{
+	case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+	case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT: return 2;
+	default: return 4;
+	}
+}
+
 
 std::vector<unsigned int> & GeometryObject::GetIndexArrayPtr( int index )
 {
@@ -338,6 +358,7 @@ void GeometryObject::Check()
 
 		for ( unsigned i = 0; i < (unsigned)m_vertpos.size(); i++ )
 		{
+			bool bTainted = ( m_iTaintVertFlag & (1 << i) ) != 0;
 			m_iTaintVertFlag &= ~(1 << i);
 			if ( m_glVertBuffers.size() <= i )
 			{
@@ -352,6 +373,11 @@ void GeometryObject::Check()
 				//Invalid array.
 				continue;
 			}
+			if ( !bTainted )
+			{
+				//Buffer and attributes are still as they were; don't upload it again.
+				continue;
+			}
 
 			int stride = (i < m_vertstride.size()) ? m_vertstride[i] : 4;
 			int dynamic = (i < m_vertdynamic.size()) ? m_vertdynamic[i] : false;
@@ -361,7 +387,8 @@ void GeometryObject::Check()
 			if ( m_vertoffset[i].size() == 1 )
 			{
 				glEnableVertexAttribArray( i );
-				glVertexAttribPointer( i, stride, GL_FLOAT, GL_FALSE, stride * sizeof( float ), 0 );
+				unsigned int type = m_verttype[i][0];
+				glVertexAttribPointer( i, m_vertelements[i][0], type, m_vertnormalized[i][0], stride * sizeof( float ), (void*)(intptr_t)(m_vertoffset[i][0] * GLTypeSize( type )) );
 			}
 			else
 			{
@@ -370,9 +397,10 @@ void GeometryObject::Check()
 				{
 					glEnableVertexAttribArray( j );
 					int size = m_vertelements[i][j];
+					unsigned int type = m_verttype[i][j];
 					int istride = stride * sizeof( float );
-					void * ioffset = (void*)(m_vertoffset[i][j] * sizeof( float ));
-					glVertexAttribPointer( j, size, GL_FLOAT, GL_FALSE, istride, ioffset );
+					void * ioffset = (void*)(intptr_t)(m_vertoffset[i][j] * GLTypeSize( type ));
+					glVertexAttribPointer( j, size, type, m_vertnormalized[i][j], istride, ioffset );
 				}
 			}
 		}
@@ -21,7 +21,10 @@ public:
 	//Setup functions
 	void SetIndexArray( int index, std::vector<unsigned int> & intarray, unsigned int render_type );
 	void SetArrayProps( int index, bool dynamic, int stride );
-	void SetArrayPropsAdvanced( int index, int part, int elements, int offset );
+	//Stride is in floats whatever the parts are.  A part's offset is in elements of its own type,
+	//so a GL_UNSIGNED_BYTE part 8 bytes in has offset 8 and a GL_HALF_FLOAT one has offset 4.
+	//Integer types with normalized set come out 0..1 (or -1..1); without, as plain numbers.
+	void SetArrayPropsAdvanced( int index, int part, int elements, int offset, unsigned int type = 0x1406 /*GL_FLOAT*/, bool normalized = false );
 	std::vector<unsigned int> & GetIndexArrayPtr( int index = 0 );
 	std::vector<float> & GetVertexArrayPtr( int index = 0 );
 	inline void TaintIndices( int index = 0 ) { m_bTaintIAFlags |= 1 << index; }
@@ -66,6 +69,8 @@ private:
 	std::vector< int >						m_vertstride;
 	std::vector< std::vector< int > >		m_vertoffset;
 	std::vector< std::vector< int > >		m_vertelements;
+	std::vector< std::vector< unsigned int > > m_verttype;
+	std::vector< std::vector< bool > >		m_vertnormalized;
 	std::vector< bool >						m_vertdynamic;
 
 	std::vector< std::vector<unsigned int> > m_ia;
@@ -6,85 +6,92 @@
 #include "opencv2/core/affine.hpp"
 #include "opencv2/calib3d.hpp"
 #include "shared/Matrices.h"
+#include "stereo_core.h"
+#include "stereo_dots.h"
+#include "stereo_recording.h"
+#include "stereo_frame_queue.h"
+#include "stereo_pipeline.h"
+#include <atomic>
 #include <thread>
 #include <openvr.h>
 
 class CameraApp;
 
+#define OPENCV_OUTPUT_SLOTS 3
+#define OPENCV_OUTPUT_NEW   4 //Flag in OpenCVProcess::m_iOutputReady
+
+//Frames from the HMD's tracked camera.  OpenCVProcess reads them back from GL and publishes them
+//here on the GL thread; NextFrame blocks the processing thread until one arrives.
+class TrackedCameraFrameSource : public StereoFrameSource
+{
+public:
+	TrackedCameraFrameSource();
+	bool Open( vr::IVRSystem * pSystem );
+	virtual bool GetCalibration( StereoCalibration & calib );
+	virtual bool NextFrame( StereoFrame & frame );
+	//Copies the pixels into a queued frame, so the caller can unmap them straight away.
+	void Publish( const uint8_t * pPixels, const vr::CameraVideoStreamFrameHeader_t & header );
+	//Makes NextFrame return false, for shutting the processing thread down.
+	void Close() { m_queue.Close(); }
+	StereoFrameQueueStats GetQueueStats() { return m_queue.GetStats(); }
+
+	vr::TrackedCameraHandle_t m_pCamera;
+
+private:
+	vr::IVRSystem * m_pSystem;
+	StereoFrameQueue m_queue;
+	StereoFrameQueue::Slot * m_pHeld; //The frame the processing thread is working on.
+};
+
 class OpenCVProcess
 {
 public:
 	OpenCVProcess( CameraApp * parent );
 	~OpenCVProcess();
 	bool OpenCVAppStart();
-	void OpenCVAppUpdate();
+	//The pipeline's three stages, see Thread.
+	void OpenCVAppFrontEnd( const StereoFrame & frame, StereoFrameBuffers & b );
+	void OpenCVAppMatch( StereoFrameBuffers & b );
+	void OpenCVAppOutput( StereoFrameBuffers & b );
 	void Thread();
 	void Prerender();
-	void TakeScreenshot();
-
-	void ConvertToGray( cv::InputArray src, cv::OutputArray dst );
-	void BlurDepths();
-	Vector4 TransformToWorldSpace( float x, float y, int disp );
-	Vector4 TransformToLocalSpace( float x, float y, int disp );
-
-	vr::TrackedCameraHandle_t m_pCamera;
+	void TakeScreenshot( const StereoFrameBuffers & b );
+	//Called on the GL thread; the front end may clear the flag concurrently if the recorder fails to open.
+	void ToggleRecording() { bool b = m_bRecording.load(); while ( !m_bRecording.compare_exchange_weak( b, !b ) ) {} }
 
-	struct { float fx, cx, fy, cy; } m_cameraIntrinsics[2];
-	vr::HmdMatrix34_t  m_headFromCamera[2];
-	Vector4 m_centerFromLeftEye;
-	cv::Mat m_leftMap1, m_leftMap2, m_rightMap1, m_rightMap2;
-	Matrix4 m_R1, m_R1inv, m_Q, m_Qinv;
-	cv::Ptr< cv::StereoSGBM > m_stereo;
+	TrackedCameraFrameSource m_source;
+	StereoCalibration m_calib;
+	StereoCore m_core;
+	StereoPipeline m_pipeline;
+	StereoRecordingWriter m_recorder;
+	StereoDotEmitter m_dotEmitter;     //Output stage only.
+	std::vector< StereoDot > m_dots;
 
 	CameraApp * m_parent;
 
-	uint8_t * m_pFrameBuffer;
-	uint8_t * m_pFBSides[2];
-	uint32_t * m_pFBSidesColor[2];
-	uint16_t * m_pDisparity;
 	uint32_t * m_pColorOut;
-	uint32_t * m_pColorOut2;
-	uint32_t  m_iFBSideWidth;
-	uint32_t  m_iFBSideHeight;
-	std::vector< float > m_valids;
-	std::vector< float > m_depths;
 
-	uint32_t  m_iFBAlgoWidth;
-	uint32_t  m_iFBAlgoWidthExp;
-	uint32_t  m_iFBAlgoHeight;
+	//The output stage fills slot m_iOutputWrite and publishes it by swapping it for the slot in
+	//m_iOutputReady; Prerender swaps that for the one it uploaded last.  So neither side ever writes a
+	//slot the other is using, and a frame that hasn't been shown yet is only ever replaced by a newer one.
+	uint32_t * m_pColorOut2[OPENCV_OUTPUT_SLOTS];
+	std::vector< float > m_depthOut[OPENCV_OUTPUT_SLOTS]; //Half float positions, as Reproject writes them.
+	int m_iOutputWrite;                 //Output stage only.
+	int m_iOutputShow;                  //GL thread only.
+	std::atomic< int > m_iOutputReady;  //Slot index, | OPENCV_OUTPUT_NEW until Prerender takes it.
 	uint32_t  m_iProcFrames;
 	uint32_t  m_iFramesSinceFPS, m_iFPS;
 	double    m_dTimeOfLastFPS;
 
-	uint32_t  m_iFrameBufferLength;
-
-	int m_iHasFrameForUpdate;
-	int m_iDoneFrameOutput;
+	bool m_bReadbackPending;            //GL thread only: a frame is on its way into the PBO.
+	uint32_t m_iLastReadbackSequence;
 
 	vr::CameraVideoStreamFrameHeader_t m_lastFrameHeader;
-	Matrix4 m_lastFrameHeaderMatrix;
-	float m_CameraDistanceMeters;
-	cv::Mat m_cvQ;
 	std::thread * m_pthread;
-	bool m_bQuitThread;
-	float fNAN;
 
 	bool m_bScreenshotNext;
-	int m_iCurrentStereoAlgorithm;
+	std::atomic< bool > m_bRecording;
 	unsigned int m_iPBOids[2];
 	unsigned int m_iGLfrback;
 	unsigned int m_iGLimback;
-
-	//Matrices used in the stereo computation.
-	cv::Mat origStereoPair;
-	cv::Mat origLeft;
-	cv::Mat origRight;
-	cv::Mat rectLeft;
-	cv::Mat rectRight;
-	cv::Mat resizedLeftGray;
-	cv::Mat resizedRightGray;
-	cv::Mat resizedLeft;
-	cv::Mat resizedRight;
-	cv::Mat mdisparity;
-	cv::Mat mdisparity_expanded;
 };
\ No newline at end of file
@@ -0,0 +1,562 @@
+// Replays a stereo recording (see stereo_recording.h) through StereoCore with no headset or GL
+// context, and reports the time spent in each stage and a checksum of each stage's output.
+// Identical checksums before and after a change mean the pipeline still produces the same
+// depth; the recording is replayed several times and the checksums must match every pass.
+//
+// Needs only OpenCV.  For example:
+//   g++ -O2 -pthread -I.. -I. stereo_bench.cpp stereo_census.cpp stereo_core.cpp stereo_gray.cpp stereo_parallel.cpp stereo_pipeline.cpp
+//       stereo_recording.cpp ../shared/Matrices.cpp `pkg-config --cflags --libs opencv4` -o stereo_bench
+//
+// Usage: stereo_bench <manifest> [stereo algorithm 0..3] [passes] [--reference] [--validate] [--gray=equal|rec601|rec709] [--blur-radius=N] [--match-bands=N] [--checks=N] [--pipeline]
+//   --reference  use the full resolution rectify, downsample and gray stages instead of the fused one
+//   --validate   run both front ends on every frame and report how far apart their outputs are, and
+//                check the hole filling blur against a direct convolution, the ray tables
+//                against transforming each point from m_Q, and the half float points the depth
+//                mesh gets against the float ones
+//   --gray=      how the matcher's gray images are made, see stereo_gray.h
+//   --blur-radius=  box radius for BlurDepths' hole filling
+//   --match-bands=  how many row bands SGBM is split into, default one per core.  --validate
+//                   compares the banded disparity with matching the whole image at once
+//   --checks=    STEREO_CHECK_ flags for Match: 1 left-right consistency, 2 confidence, 3 both
+//   --pipeline   also replay through StereoPipeline, with the stages on their own threads, and check
+//                every frame's checksums against the serial run
+
+#include "stereo_core.h"
+#include "stereo_half.h"
+#include "stereo_pipeline.h"
+#include "stereo_recording.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define NUM_STAGES 7
+
+static const char * g_stageNames[NUM_STAGES] = { "rectify", "downsample", "gray", "front end", "match", "blur", "reproject" };
+
+struct BenchFrame
+{
+	StereoFrame frame;
+	std::vector< uint8_t > pixels;
+};
+
+//Per frame checksums of the gray images, the raw disparity, the blurred disparity and the points.
+struct FrameChecksums
+{
+	uint64_t gray, match, blur, points;
+};
+
+static uint64_t Fnv1a( const void * data, size_t len, uint64_t h = 0xcbf29ce484222325ULL )
+{
+	const uint8_t * p = (const uint8_t*)data;
+	for ( size_t i = 0; i < len; i++ )
+	{
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+//How far the fused front end strays from the full resolution reference.
+struct FrontEndDiff
+{
+	int maxColor, maxGray;
+	uint64_t colorOff, grayOff, samples;
+	double colorAbsSum;
+};
+
+static void CompareFrontEnd( StereoCore & core, const StereoFrame & frame, StereoFrameBuffers & b, FrontEndDiff & diff )
+{
+	core.Rectify( frame, b );
+	core.Downsample( b );
+	core.ConvertToGray( b );
+	std::vector< uint32_t > refColor[2] = { b.m_FBSidesColor[0], b.m_FBSidesColor[1] };
+	std::vector< uint8_t > refGray[2] = { b.m_FBSides[0], b.m_FBSides[1] };
+
+	core.RectifyDownsampleGray( frame, b );
+	for ( int eye = 0; eye < 2; eye++ )
+	{
+		const uint8_t * a = (const uint8_t*)&refColor[eye][0];
+		const uint8_t * f = (const uint8_t*)&b.m_FBSidesColor[eye][0];
+		for ( size_t i = 0; i < refColor[eye].size() * 4; i++ )
+		{
+			int d = abs( a[i] - f[i] );
+			if ( d > diff.maxColor ) diff.maxColor = d;
+			diff.colorOff += d != 0;
+			diff.colorAbsSum += d;
+		}
+		for ( size_t i = 0; i < refGray[eye].size(); i++ )
+		{
+			int d = abs( refGray[eye][i] - b.m_FBSides[eye][i] );
+			if ( d > diff.maxGray ) diff.maxGray = d;
+			diff.grayOff += d != 0;
+		}
+		diff.samples += refGray[eye].size();
+	}
+}
+
+//How far BlurDepths strays from the same blur done the slow way.
+struct BlurDiff
+{
+	double maxFilled; //Largest difference in depths / valids, in 16ths of a pixel.
+	double maxValid;
+	int maxDisparity;
+	uint64_t disparityOff, filled, samples;
+};
+
+//Direct form of one zero padded box pass along x (dx = 1) or y (dx = width).
+static void BoxPassDirect( const std::vector< double > & in, std::vector< double > & out, int w, int h, int r, bool bAlongY )
+{
+	for ( int y = 0; y < h; y++ )
+	{
+		for ( int x = 0; x < w; x++ )
+		{
+			double sum = 0;
+			for ( int k = -r; k <= r; k++ )
+			{
+				int sx = bAlongY ? x : x + k, sy = bAlongY ? y + k : y;
+				if ( sx >= 0 && sy >= 0 && sx < w && sy < h )
+					sum += in[sy * w + sx];
+			}
+			out[y * w + x] = sum / ( 2 * r + 1 );
+		}
+	}
+}
+
+//How far the banded matcher strays from matching the whole image at once.
+struct MatchBandDiff
+{
+	int maxDisparity; //16ths of a pixel.
+	uint64_t disparityOff, samples;
+};
+
+static void CompareMatchBands( StereoCore & core, StereoFrameBuffers & b, MatchBandDiff & diff )
+{
+	core.Match( b );
+	std::vector< uint16_t > banded = b.m_Disparity;
+	int iBands = core.m_iMatchBands;
+	core.m_iMatchBands = 1;
+	core.Match( b );
+	core.m_iMatchBands = iBands;
+	for ( size_t i = 0; i < banded.size(); i++ )
+	{
+		int e = abs( (int)banded[i] - (int)b.m_Disparity[i] );
+		if ( e > diff.maxDisparity ) diff.maxDisparity = e;
+		diff.disparityOff += e != 0;
+	}
+	diff.samples += banded.size();
+}
+
+//core and b hold the output of BlurDepths; disparity, valids and depths are what went into it.
+static void CompareBlur( const StereoCore & core, const StereoFrameBuffers & b, std::vector< uint16_t > disparity, const std::vector< float > & valids, const std::vector< float > & depths, BlurDiff & diff )
+{
+	int w = (int)core.m_iFBAlgoWidth, h = (int)core.m_iFBAlgoHeight, r = core.m_iBlurRadius;
+	std::vector< double > v( valids.begin(), valids.end() ), d( depths.begin(), depths.end() ), tmp( v.size() );
+	const uint8_t * conf = b.m_Confidence.empty() ? 0 : &b.m_Confidence[0];
+	for ( int y = 0; y < h; y++ )
+	{
+		for ( int x = 0; x < w; x++ )
+		{
+			int idx = y * w + x;
+			if ( conf && conf[idx] < core.m_iMinConfidence && disparity[idx] < 0xfff0 ) disparity[idx] = 0xfff0;
+			double c = conf ? conf[idx] / 255.0 : 1.0;
+			if ( disparity[idx] != 0 && disparity[idx] < w * 16 ) { v[idx] = c; d[idx] = disparity[idx] * c; }
+			if ( x >= w - 24 ) { v[idx] = 0; d[idx] = 0; }
+		}
+	}
+	for ( int pass = 0; pass < core.m_iBlurPasses; pass++ )
+	{
+		BoxPassDirect( v, tmp, w, h, r, false ); BoxPassDirect( tmp, v, w, h, r, true );
+		BoxPassDirect( d, tmp, w, h, r, false ); BoxPassDirect( tmp, d, w, h, r, true );
+	}
+	for ( int y = 0; y < h; y++ )
+	{
+		for ( int x = 1; x < w - 1; x++ )
+		{
+			int idx = y * w + x;
+			uint16_t pxi = disparity[idx];
+			if ( ( pxi == 0 || pxi >= w * 16 ) && v[idx] < .00005 )
+			{
+				disparity[idx] = 0xfff0;
+			}
+			else if ( pxi == 0 || pxi >= w * 16 )
+			{
+				disparity[idx] = (uint16_t)( d[idx] / v[idx] );
+				//The core has already applied the .9 carry to both, which leaves the ratio alone.
+				double filled = core.m_depths[idx] / core.m_valids[idx];
+				double e = fabs( filled - d[idx] / v[idx] );
+				if ( e > diff.maxFilled ) diff.maxFilled = e;
+				diff.filled++;
+			}
+			double ev = fabs( core.m_valids[idx] - v[idx] * .9 );
+			if ( ev > diff.maxValid ) diff.maxValid = ev;
+			if ( disparity[idx] < w * 16 || b.m_Disparity[idx] < w * 16 )
+			{
+				int e = abs( (int)disparity[idx] - (int)b.m_Disparity[idx] );
+				if ( e > diff.maxDisparity ) diff.maxDisparity = e;
+				diff.disparityOff += e != 0;
+			}
+			diff.samples++;
+		}
+	}
+}
+
+//How far Reproject's ray and depth tables stray from the direct transform, relative to the
+//point's distance from the camera, and for the half float points also in meters.
+struct ReprojectDiff
+{
+	double maxRelative, sumRelative, maxAbsolute;
+	uint64_t points, nanOff;
+};
+
+static void CompareReproject( const StereoCore & core, const StereoFrameBuffers & b, const std::vector< float > & points, ReprojectDiff & diff )
+{
+	int w = (int)core.m_iFBAlgoWidth, h = (int)core.m_iFBAlgoHeight;
+	Vector3 origin = b.worldFromRectified.getTranslation();
+	for ( int y = 0; y < h; y++ )
+	{
+		for ( int x = IGNORE_EDGE_DATA_PIXELS; x < w - IGNORE_EDGE_DATA_PIXELS; x++ )
+		{
+			const float * p = &points[( y * w + x ) * 4];
+			uint16_t d = b.m_Disparity[y * w + x];
+			if ( d >= 0xfff0 || d == 0 )
+			{
+				diff.nanOff += ( d >= 0xfff0 ) != ( p[0] != p[0] );
+				continue;
+			}
+			Vector4 direct = b.worldFromRectified * core.TransformToRectifiedSpace( (float)x, (float)y, d );
+			double dist = sqrt( ( direct.x - origin.x ) * ( direct.x - origin.x ) + ( direct.y - origin.y ) * ( direct.y - origin.y ) + ( direct.z - origin.z ) * ( direct.z - origin.z ) );
+			double e = sqrt( ( p[0] - direct.x ) * ( p[0] - direct.x ) + ( p[1] - direct.y ) * ( p[1] - direct.y ) + ( p[2] - direct.z ) * ( p[2] - direct.z ) ) / dist;
+			if ( e > diff.maxRelative ) diff.maxRelative = e;
+			diff.sumRelative += e;
+			diff.points++;
+		}
+	}
+}
+
+//How far the half float points are from the float ones, relative to the distance from the camera.
+static void CompareHalfPoints( const StereoCore & core, const StereoFrameBuffers & b, const std::vector< float > & points, const std::vector< uint16_t > & halfPoints, ReprojectDiff & diff )
+{
+	int w = (int)core.m_iFBAlgoWidth, h = (int)core.m_iFBAlgoHeight;
+	Vector3 origin = b.worldFromRectified.getTranslation();
+	for ( int y = 0; y < h; y++ )
+	{
+		for ( int x = IGNORE_EDGE_DATA_PIXELS; x < w - IGNORE_EDGE_DATA_PIXELS; x++ )
+		{
+			const float * p = &points[( y * w + x ) * 4];
+			const uint16_t * q = &halfPoints[( y * w + x ) * 4];
+			float hx = HalfToFloat( q[0] ), hy = HalfToFloat( q[1] ), hz = HalfToFloat( q[2] );
+			if ( p[0] != p[0] )
+			{
+				diff.nanOff += ( hx == hx );
+				continue;
+			}
+			double dist = sqrt( ( p[0] - origin.x ) * ( p[0] - origin.x ) + ( p[1] - origin.y ) * ( p[1] - origin.y ) + ( p[2] - origin.z ) * ( p[2] - origin.z ) );
+			double a = sqrt( ( hx - p[0] ) * ( hx - p[0] ) + ( hy - p[1] ) * ( hy - p[1] ) + ( hz - p[2] ) * ( hz - p[2] ) );
+			double e = a / dist;
+			if ( a > diff.maxAbsolute ) diff.maxAbsolute = a;
+			if ( e > diff.maxRelative ) diff.maxRelative = e;
+			diff.sumRelative += e;
+			diff.points++;
+		}
+	}
+}
+
+static double Now()
+{
+	return std::chrono::duration< double >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static void FrontEnd( StereoCore & core, const StereoFrame & frame, StereoFrameBuffers & b )
+{
+	if ( core.m_bFusedFrontEnd )
+	{
+		core.RectifyDownsampleGray( frame, b );
+	}
+	else
+	{
+		core.Rectify( frame, b );
+		core.Downsample( b );
+		core.ConvertToGray( b );
+	}
+}
+
+static uint64_t GrayChecksum( const StereoFrameBuffers & b )
+{
+	return Fnv1a( &b.m_FBSides[1][0], b.m_FBSides[1].size(), Fnv1a( &b.m_FBSides[0][0], b.m_FBSides[0].size() ) );
+}
+
+//Replays the recording through StereoPipeline and checks each frame against the serial run.
+//Returns the number of frames that differ.
+static int ReplayPipelined( StereoCore & core, const StereoCalibration & calib, const std::vector< BenchFrame > & frames,
+	const std::vector< FrameChecksums > & expected, int iPasses )
+{
+	size_t algoPixels = core.m_iFBAlgoWidth * core.m_iFBAlgoHeight;
+	std::vector< float > points( algoPixels * 4, 0.0f );
+	size_t iOutput = 0;
+	int iMismatches = 0;
+
+	StereoPipeline pipeline;
+	pipeline.Start( core,
+		[&]( const StereoFrame & frame, StereoFrameBuffers & b ) { FrontEnd( core, frame, b ); },
+		[&]( StereoFrameBuffers & b ) { core.Match( b ); },
+		[&]( StereoFrameBuffers & b )
+		{
+			FrameChecksums c;
+			c.gray = GrayChecksum( b );
+			c.match = Fnv1a( &b.m_Disparity[0], algoPixels * sizeof( uint16_t ) );
+			core.BlurDepths( b );
+			c.blur = Fnv1a( &b.m_Disparity[0], algoPixels * sizeof( uint16_t ) );
+			core.Reproject( b, &points[0] );
+			c.points = Fnv1a( &points[0], points.size() * sizeof( float ) );
+
+			size_t i = iOutput++ % frames.size();
+			if ( memcmp( &c, &expected[i], sizeof( c ) ) != 0 || b.sequence != frames[i].frame.sequence )
+			{
+				printf( "frame %6u  pipelined output differs from the serial run\n", b.sequence );
+				iMismatches++;
+			}
+		} );
+
+	double start = Now();
+	for ( int pass = 0; pass < iPasses; pass++ )
+	{
+		//Same fresh start as the serial passes, once the previous pass is all the way through.
+		pipeline.Flush();
+		core.Init( calib );
+		memset( &points[0], 0, points.size() * sizeof( float ) );
+		for ( size_t i = 0; i < frames.size(); i++ )
+			pipeline.Submit( frames[i].frame );
+	}
+	pipeline.Flush();
+	double elapsed = Now() - start;
+	StereoPipelineStats stats = pipeline.GetStats();
+	pipeline.Stop();
+
+	static const char * stageNames[STEREO_STAGES] = { "front end", "match", "output" };
+	printf( "\npipelined: %llu frames in %.3f s (%.1f frames/s), %d mismatches\n", (unsigned long long)stats.frames, elapsed,
+		stats.frames / elapsed, iMismatches );
+	printf( "%12s %10s %10s %10s\n", "stage", "mean ms", "busy %", "waiting %" );
+	for ( int s = 0; s < STEREO_STAGES; s++ )
+	{
+		printf( "%12s %10.3f %10.1f %10.1f\n", stageNames[s], stats.busy[s] / stats.frames * 1000.0,
+			100.0 * stats.busy[s] / stats.elapsed, 100.0 * stats.starved[s] / stats.elapsed );
+	}
+	return iMismatches;
+}
+
+int main( int argc, char ** argv )
+{
+	if ( argc < 2 )
+	{
+		fprintf( stderr, "Usage: %s <manifest> [stereo algorithm 0..3] [passes]\n", argv[0] );
+		return 1;
+	}
+	int iAlgorithm = 0;
+	int iPasses = 3;
+	bool bReference = false, bValidate = false, bPipeline = false;
+	StereoGrayWeighting grayWeighting = STEREO_GRAY_EQUAL;
+	int iBlurRadius = 0;
+	int iMatchBands = 0;
+	int iChecks = 0;
+	for ( int i = 2, iPositional = 0; i < argc; i++ )
+	{
+		if ( strcmp( argv[i], "--reference" ) == 0 ) bReference = true;
+		else if ( strcmp( argv[i], "--validate" ) == 0 ) bValidate = true;
+		else if ( strcmp( argv[i], "--pipeline" ) == 0 ) bPipeline = true;
+		else if ( strncmp( argv[i], "--blur-radius=", 14 ) == 0 ) iBlurRadius = atoi( argv[i] + 14 );
+		else if ( strncmp( argv[i], "--match-bands=", 14 ) == 0 ) iMatchBands = atoi( argv[i] + 14 );
+		else if ( strncmp( argv[i], "--checks=", 9 ) == 0 ) iChecks = atoi( argv[i] + 9 );
+		else if ( strncmp( argv[i], "--gray=", 7 ) == 0 )
+		{
+			for ( int w = 0; w < STEREO_GRAY_WEIGHTINGS; w++ )
+			{
+				if ( strcmp( argv[i] + 7, StereoGrayWeightingName( (StereoGrayWeighting)w ) ) == 0 )
+					grayWeighting = (StereoGrayWeighting)w;
+			}
+		}
+		else if ( iPositional++ == 0 ) iAlgorithm = atoi( argv[i] );
+		else iPasses = atoi( argv[i] );
+	}
+	if ( iPasses < 1 ) iPasses = 1;
+
+	StereoRecordingSource source;
+	StereoCalibration calib;
+	if ( !source.Open( argv[1] ) || !source.GetCalibration( calib ) )
+	{
+		fprintf( stderr, "Could not read recording %s\n", argv[1] );
+		return 1;
+	}
+
+	//Decode every frame up front so the timings only cover the pipeline.
+	std::vector< BenchFrame > frames( source.GetFrameCount() );
+	for ( size_t i = 0; i < frames.size(); i++ )
+	{
+		if ( !source.NextFrame( frames[i].frame ) )
+			return 1;
+		const StereoFrame & f = frames[i].frame;
+		frames[i].pixels.assign( f.pPixels, f.pPixels + f.width * f.height * 4 );
+		frames[i].frame.pPixels = &frames[i].pixels[0];
+	}
+	if ( frames.empty() )
+	{
+		fprintf( stderr, "%s has no frames\n", argv[1] );
+		return 1;
+	}
+
+	StereoCore core;
+	core.m_bFusedFrontEnd = !bReference;
+	core.m_grayWeighting = grayWeighting;
+	if ( iBlurRadius > 0 ) core.m_iBlurRadius = iBlurRadius;
+	if ( iMatchBands > 0 ) core.m_iMatchBands = iMatchBands;
+	core.SetAlgorithm( iAlgorithm );
+	core.SetChecks( iChecks );
+	if ( !core.Init( calib ) )
+	{
+		fprintf( stderr, "Could not set up the stereo pipeline for %ux%u frames\n", calib.frameWidth, calib.frameHeight );
+		return 1;
+	}
+	printf( "%s: %u frames, %ux%u, algorithm %d, %ux%u disparity, %s front end, %s gray (%s), %d match bands, checks %d\n", argv[1], (unsigned)frames.size(),
+		calib.frameWidth, calib.frameHeight, core.GetAlgorithm(), core.m_iFBAlgoWidth, core.m_iFBAlgoHeight,
+		bReference ? "reference" : "fused", StereoGrayWeightingName( grayWeighting ), StereoGrayKernelName( StereoGrayBestKernel() ),
+		core.GetMatchBandCount(), core.GetChecks() );
+
+	StereoFrameBuffers b;
+	core.InitBuffers( b );
+
+	if ( bValidate )
+	{
+		FrontEndDiff diff;
+		memset( &diff, 0, sizeof( diff ) );
+		for ( size_t i = 0; i < frames.size(); i++ )
+			CompareFrontEnd( core, frames[i].frame, b, diff );
+		printf( "fused vs reference: color max %d, mean %.4f, %.2f%% of channels differ; gray max %d, %.2f%% of pixels differ\n",
+			diff.maxColor, diff.colorAbsSum / ( diff.samples * 4 ), 100.0 * diff.colorOff / ( diff.samples * 4 ),
+			diff.maxGray, 100.0 * diff.grayOff / diff.samples );
+
+		if ( core.GetMatchBandCount() > 1 )
+		{
+			MatchBandDiff bandDiff;
+			memset( &bandDiff, 0, sizeof( bandDiff ) );
+			for ( size_t i = 0; i < frames.size(); i++ )
+			{
+				FrontEnd( core, frames[i].frame, b );
+				CompareMatchBands( core, b, bandDiff );
+			}
+			printf( "%d match bands vs whole image: %llu of %llu disparities differ (%.2f%%), max %d/16 px\n", core.GetMatchBandCount(),
+				(unsigned long long)bandDiff.disparityOff, (unsigned long long)bandDiff.samples, 100.0 * bandDiff.disparityOff / bandDiff.samples,
+				bandDiff.maxDisparity );
+		}
+	}
+
+	size_t algoPixels = core.m_iFBAlgoWidth * core.m_iFBAlgoHeight;
+	std::vector< float > points( algoPixels * 4, 0.0f );
+	std::vector< FrameChecksums > checksums( frames.size() );
+	double stageTotal[NUM_STAGES] = { 0 }, stageMin[NUM_STAGES], stageMax[NUM_STAGES] = { 0 };
+	for ( int s = 0; s < NUM_STAGES; s++ ) stageMin[s] = 1e30;
+	int iMismatches = 0;
+	BlurDiff blurDiff;
+	memset( &blurDiff, 0, sizeof( blurDiff ) );
+	ReprojectDiff reprojectDiff, halfDiff;
+	memset( &reprojectDiff, 0, sizeof( reprojectDiff ) );
+	memset( &halfDiff, 0, sizeof( halfDiff ) );
+	std::vector< uint16_t > halfPoints( bValidate ? algoPixels * 4 : 0 );
+	double halfTime = 0;
+	std::vector< uint16_t > blurInDisparity;
+	std::vector< float > blurInValids, blurInDepths;
+
+	for ( int pass = 0; pass < iPasses; pass++ )
+	{
+		//The blur carries confidence from frame to frame, so every pass starts from scratch.
+		core.Init( calib );
+		memset( &points[0], 0, points.size() * sizeof( float ) );
+
+		for ( size_t i = 0; i < frames.size(); i++ )
+		{
+			FrameChecksums c;
+			memset( &b.times, 0, sizeof( b.times ) );
+			FrontEnd( core, frames[i].frame, b );
+			c.gray = GrayChecksum( b );
+			core.Match( b );
+			c.match = Fnv1a( &b.m_Disparity[0], algoPixels * sizeof( uint16_t ) );
+			bool bCheckBlur = bValidate && pass == 0;
+			if ( bCheckBlur )
+			{
+				blurInDisparity = b.m_Disparity;
+				blurInValids = core.m_valids;
+				blurInDepths = core.m_depths;
+			}
+			core.BlurDepths( b );
+			if ( bCheckBlur )
+				CompareBlur( core, b, blurInDisparity, blurInValids, blurInDepths, blurDiff );
+			c.blur = Fnv1a( &b.m_Disparity[0], algoPixels * sizeof( uint16_t ) );
+			core.Reproject( b, &points[0] );
+			c.points = Fnv1a( &points[0], points.size() * sizeof( float ) );
+			if ( bCheckBlur )
+				CompareReproject( core, b, points, reprojectDiff );
+
+			const StereoStageTimes & t = b.times;
+			double times[NUM_STAGES] = { t.rectify, t.downsample, t.gray, t.frontEnd, t.match, t.blur, t.reproject };
+			for ( int s = 0; s < NUM_STAGES; s++ )
+			{
+				stageTotal[s] += times[s];
+				if ( times[s] < stageMin[s] ) stageMin[s] = times[s];
+				if ( times[s] > stageMax[s] ) stageMax[s] = times[s];
+			}
+			if ( bCheckBlur )
+			{
+				core.Reproject( b, &halfPoints[0] );
+				halfTime += b.times.reproject;
+				CompareHalfPoints( core, b, points, halfPoints, halfDiff );
+			}
+
+			if ( pass == 0 )
+			{
+				checksums[i] = c;
+				printf( "frame %6u  gray %016llx  match %016llx  blur %016llx  points %016llx\n", frames[i].frame.sequence,
+					(unsigned long long)c.gray, (unsigned long long)c.match, (unsigned long long)c.blur, (unsigned long long)c.points );
+			}
+			else if ( memcmp( &c, &checksums[i], sizeof( c ) ) != 0 )
+			{
+				printf( "frame %6u  pass %d: output differs from the first pass\n", frames[i].frame.sequence, pass );
+				iMismatches++;
+			}
+		}
+	}
+
+	if ( bValidate )
+	{
+		printf( "\nblur vs direct convolution: filled %llu holes, depth max %.4f/16 px, confidence max %.2g; %llu of %llu disparities differ, max %d/16 px\n",
+			(unsigned long long)blurDiff.filled, blurDiff.maxFilled, blurDiff.maxValid, (unsigned long long)blurDiff.disparityOff,
+			(unsigned long long)blurDiff.samples, blurDiff.maxDisparity );
+		printf( "reproject vs direct transform: %llu points, error max %.2g, mean %.2g of the distance; %llu NaNs misplaced\n",
+			(unsigned long long)reprojectDiff.points, reprojectDiff.maxRelative, reprojectDiff.points ? reprojectDiff.sumRelative / reprojectDiff.points : 0.0,
+			(unsigned long long)reprojectDiff.nanOff );
+		printf( "half float points: %.3f ms, error max %.2f mm, max %.2g, mean %.2g of the distance; %llu NaNs lost\n", halfTime * 1000.0 / frames.size(),
+			halfDiff.maxAbsolute * 1000.0, halfDiff.maxRelative, halfDiff.points ? halfDiff.sumRelative / halfDiff.points : 0.0, (unsigned long long)halfDiff.nanOff );
+	}
+
+	uint64_t overall = Fnv1a( &checksums[0], checksums.size() * sizeof( FrameChecksums ) );
+	double runs = (double)frames.size() * iPasses;
+	double total = 0;
+
+	printf( "\n%12s %10s %10s %10s\n", "stage", "mean ms", "min ms", "max ms" );
+	for ( int s = 0; s < NUM_STAGES; s++ )
+	{
+		if ( stageTotal[s] == 0 )
+			continue;
+		printf( "%12s %10.3f %10.3f %10.3f\n", g_stageNames[s], stageTotal[s] / runs * 1000.0, stageMin[s] * 1000.0, stageMax[s] * 1000.0 );
+		total += stageTotal[s];
+	}
+	printf( "%12s %10.3f   (%.1f frames/s)\n", "total", total / runs * 1000.0, runs / total );
+
+	if ( bPipeline )
+		iMismatches += ReplayPipelined( core, calib, frames, checksums, iPasses );
+	printf( "\nrecording checksum %016llx over %d passes, %d mismatches\n", (unsigned long long)overall, iPasses, iMismatches );
+
+	return iMismatches ? 2 : 0;
+}
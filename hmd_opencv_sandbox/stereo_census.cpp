@@ -0,0 +1,666 @@
+#include "stereo_census.h"
+#include <string.h>
+
+#if !defined(STEREO_SIMD_DISABLE) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define STEREO_CENSUS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+//The popcount instruction came with SSE4.2, so it has to be checked for at run time.  Only the
+//64 bit form is worth having.
+#if STEREO_CENSUS_SSE2 && ( defined(__x86_64__) || defined(_M_X64) )
+#define STEREO_CENSUS_POPCNT 1
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define STEREO_CENSUS_POPCNT_TARGET
+#else
+#define STEREO_CENSUS_POPCNT_TARGET __attribute__(( target( "popcnt" ) ))
+#endif
+#endif
+
+#define CENSUS_RX 4 //The window is 2 * CENSUS_RX + 1 wide and 2 * CENSUS_RY + 1 tall.
+#define CENSUS_RY 3
+#define CENSUS_MAX_COST 62 //Bits in a census code.
+#define PATH_GUARD 0xff    //Either side of every path's costs, so d - 1 and d + 1 never win at the ends.
+
+StereoCensusMatcher::StereoCensusMatcher() :
+	  m_iPaths( 8 )
+	, m_iP1( 10 )
+	, m_iP2( 120 )
+	, m_iUniqueness( 10 )
+	, m_search( STEREO_CENSUS_FULL )
+	, m_iSearchWindow( 16 )
+	, m_iRefreshFrames( 8 )
+	, m_iWidth( 0 )
+	, m_iHeight( 0 )
+	, m_iDisparities( 0 )
+	, m_iColumns( 0 )
+	, m_iSearch( 0 )
+	, m_iPathStride( 0 )
+	, m_iPathGuard( 0 )
+	, m_iFramesSinceRefresh( 0 )
+{
+}
+
+//Census
+
+//Scalar census of one pixel, p pointing at it in the padded image.  Neighbour n goes into bit
+//7 - n % 8 of byte n / 8, the same place the SSE2 version puts it.
+static uint64_t CensusPixel( const uint8_t * p, int pw )
+{
+	uint8_t planes[8] = { 0 };
+	int n = 0;
+	for ( int dy = -CENSUS_RY; dy <= CENSUS_RY; dy++ )
+	{
+		for ( int dx = -CENSUS_RX; dx <= CENSUS_RX; dx++ )
+		{
+			if ( dy == 0 && dx == 0 )
+				continue;
+			planes[n >> 3] = (uint8_t)( ( planes[n >> 3] << 1 ) | ( p[0] > p[dy * pw + dx] ) );
+			n++;
+		}
+	}
+	uint64_t code = 0;
+	for ( int i = 0; i < 8; i++ )
+		code |= (uint64_t)planes[i] << ( i * 8 );
+	return code;
+}
+
+#if STEREO_CENSUS_SSE2
+//16 pixels at once: one byte lane per pixel builds up 8 bits at a time, then an 8x16 byte
+//transpose turns the 8 byte planes into one 64 bit code per pixel.
+static void CensusPixels16( const uint8_t * p, int pw, uint64_t * pOut )
+{
+	const __m128i sign = _mm_set1_epi8( (char)0x80 ), one = _mm_set1_epi8( 1 );
+	__m128i center = _mm_xor_si128( _mm_loadu_si128( (const __m128i *)p ), sign );
+	__m128i planes[8];
+	for ( int i = 0; i < 8; i++ )
+		planes[i] = _mm_setzero_si128();
+	int n = 0;
+	for ( int dy = -CENSUS_RY; dy <= CENSUS_RY; dy++ )
+	{
+		for ( int dx = -CENSUS_RX; dx <= CENSUS_RX; dx++ )
+		{
+			if ( dy == 0 && dx == 0 )
+				continue;
+			//Unsigned compare by flipping the sign bits.
+			__m128i neighbour = _mm_xor_si128( _mm_loadu_si128( (const __m128i *)( p + dy * pw + dx ) ), sign );
+			__m128i bit = _mm_and_si128( _mm_cmpgt_epi8( center, neighbour ), one );
+			__m128i & plane = planes[n >> 3];
+			plane = _mm_or_si128( _mm_add_epi8( plane, plane ), bit );
+			n++;
+		}
+	}
+
+	__m128i a01lo = _mm_unpacklo_epi8( planes[0], planes[1] ), a01hi = _mm_unpackhi_epi8( planes[0], planes[1] );
+	__m128i a23lo = _mm_unpacklo_epi8( planes[2], planes[3] ), a23hi = _mm_unpackhi_epi8( planes[2], planes[3] );
+	__m128i a45lo = _mm_unpacklo_epi8( planes[4], planes[5] ), a45hi = _mm_unpackhi_epi8( planes[4], planes[5] );
+	__m128i a67lo = _mm_unpacklo_epi8( planes[6], planes[7] ), a67hi = _mm_unpackhi_epi8( planes[6], planes[7] );
+	__m128i b0[4] = { _mm_unpacklo_epi16( a01lo, a23lo ), _mm_unpackhi_epi16( a01lo, a23lo ), _mm_unpacklo_epi16( a01hi, a23hi ), _mm_unpackhi_epi16( a01hi, a23hi ) };
+	__m128i b1[4] = { _mm_unpacklo_epi16( a45lo, a67lo ), _mm_unpackhi_epi16( a45lo, a67lo ), _mm_unpacklo_epi16( a45hi, a67hi ), _mm_unpackhi_epi16( a45hi, a67hi ) };
+	for ( int i = 0; i < 4; i++ )
+	{
+		_mm_storeu_si128( (__m128i *)( pOut + i * 4 ), _mm_unpacklo_epi32( b0[i], b1[i] ) );
+		_mm_storeu_si128( (__m128i *)( pOut + i * 4 + 2 ), _mm_unpackhi_epi32( b0[i], b1[i] ) );
+	}
+}
+#endif
+
+void StereoCensusMatcher::Census( const uint8_t * pImage, int stride, int width, int height, uint64_t * pOut )
+{
+	//Repeat the edge pixels out to the window size, plus room for whole 16 pixel loads.
+	int pw = width + CENSUS_RX * 2 + 16;
+	m_padded.resize( (size_t)pw * ( height + CENSUS_RY * 2 ) );
+	for ( int py = 0; py < height + CENSUS_RY * 2; py++ )
+	{
+		int sy = py - CENSUS_RY;
+		sy = ( sy < 0 ) ? 0 : ( sy >= height ) ? height - 1 : sy;
+		const uint8_t * src = pImage + (size_t)sy * stride;
+		uint8_t * dst = &m_padded[(size_t)py * pw];
+		memset( dst, src[0], CENSUS_RX );
+		memcpy( dst + CENSUS_RX, src, width );
+		memset( dst + CENSUS_RX + width, src[width - 1], pw - CENSUS_RX - width );
+	}
+
+	for ( int y = 0; y < height; y++ )
+	{
+		const uint8_t * row = &m_padded[(size_t)( y + CENSUS_RY ) * pw + CENSUS_RX];
+		uint64_t * out = pOut + (size_t)y * width;
+		int x = 0;
+#if STEREO_CENSUS_SSE2
+		for ( ; x + 16 <= width; x += 16 )
+			CensusPixels16( row + x, pw, out + x );
+#endif
+		for ( ; x < width; x++ )
+			out[x] = CensusPixel( row + x, pw );
+	}
+}
+
+//Hamming costs
+
+static inline int Popcount64( uint64_t v )
+{
+	v = v - ( ( v >> 1 ) & 0x5555555555555555ULL );
+	v = ( v & 0x3333333333333333ULL ) + ( ( v >> 2 ) & 0x3333333333333333ULL );
+	v = ( v + ( v >> 4 ) ) & 0x0f0f0f0f0f0f0f0fULL;
+	return (int)( ( v * 0x0101010101010101ULL ) >> 56 );
+}
+
+//pRight[-d] is the right pixel disparity d away from pLeft[0].  Pixel i's costs start at
+//disparity pWindows[i], or 0 if pWindows is 0.
+static void CostRowPortable( const uint64_t * pLeft, const uint64_t * pRight, int count, int disparities, const uint16_t * pWindows, uint8_t * pOut )
+{
+	for ( int i = 0; i < count; i++, pOut += disparities )
+	{
+		uint64_t l = pLeft[i];
+		const uint64_t * r = pRight + i - ( pWindows ? pWindows[i] : 0 );
+		for ( int d = 0; d < disparities; d++ )
+			pOut[d] = (uint8_t)Popcount64( l ^ r[-d] );
+	}
+}
+
+#if STEREO_CENSUS_POPCNT
+//One instruction per cost beats counting bits in SSE2 registers here; there's no byte shuffle
+//in SSE2 to do it with a lookup table, and the bit twiddling version is a dozen instructions.
+STEREO_CENSUS_POPCNT_TARGET static void CostRowPopcnt( const uint64_t * pLeft, const uint64_t * pRight, int count, int disparities, const uint16_t * pWindows, uint8_t * pOut )
+{
+	for ( int i = 0; i < count; i++, pOut += disparities )
+	{
+		uint64_t l = pLeft[i];
+		const uint64_t * r = pRight + i - ( pWindows ? pWindows[i] : 0 );
+		for ( int d = 0; d < disparities; d++ )
+			pOut[d] = (uint8_t)_mm_popcnt_u64( l ^ r[-d] );
+	}
+}
+
+static bool CPUHasPopcnt()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid( info, 1 );
+	return ( info[2] & ( 1 << 23 ) ) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports( "popcnt" ) != 0;
+#endif
+}
+#endif
+
+typedef void ( *CostRowFn )( const uint64_t * pLeft, const uint64_t * pRight, int count, int disparities, const uint16_t * pWindows, uint8_t * pOut );
+
+static CostRowFn BestCostRow()
+{
+#if STEREO_CENSUS_POPCNT
+	if ( CPUHasPopcnt() )
+		return CostRowPopcnt;
+#endif
+	return CostRowPortable;
+}
+
+bool StereoCensusMatcher::UsesPopcountInstruction()
+{
+#if STEREO_CENSUS_POPCNT
+	static const bool bPopcnt = CPUHasPopcnt();
+	return bPopcnt;
+#else
+	return false;
+#endif
+}
+
+void StereoCensusMatcher::CostRow( int y )
+{
+	static const CostRowFn fn = BestCostRow();
+	const uint64_t * left = &m_census[0][(size_t)y * m_iWidth + m_iDisparities];
+	const uint64_t * right = &m_census[1][(size_t)y * m_iWidth + m_iDisparities];
+	const uint16_t * windows = ( m_iSearch < m_iDisparities ) ? &m_windows[(size_t)y * m_iColumns] : 0;
+	fn( left, right, m_iColumns, m_iSearch, windows, &m_costs[0] );
+}
+
+//Aggregation
+
+uint8_t StereoCensusMatcher::PathStep( const uint8_t * pCost, const uint8_t * pPrev, uint8_t prevMin, uint8_t * pOut, uint16_t * pSum )
+{
+	int D = m_iSearch;
+	int d = 0;
+	int outMin = 0xff;
+
+	if ( !pPrev )
+	{
+		//The path starts here.
+		for ( d = 0; d < D; d++ )
+		{
+			pOut[d] = pCost[d];
+			if ( pOut[d] < outMin ) outMin = pOut[d];
+			if ( pSum ) pSum[d] += pOut[d];
+		}
+		return (uint8_t)outMin;
+	}
+
+	//Compute clamps P2 so that nothing here can pass 255; only the + P1 on a guard can, and that saturates.
+	int jump = prevMin + m_iP2;
+	if ( jump > 0xff ) jump = 0xff;
+
+#if STEREO_CENSUS_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i p1 = _mm_set1_epi8( (char)m_iP1 );
+	const __m128i vjump = _mm_set1_epi8( (char)jump );
+	const __m128i base = _mm_set1_epi8( (char)prevMin );
+	__m128i vmin = _mm_set1_epi8( (char)0xff );
+	//d - 1 and d + 1 are put together from whole vectors rather than loaded one byte off, so the
+	//loads line up with the stores of the step before, which is often the one just done.
+	__m128i before = _mm_loadu_si128( (const __m128i *)( pPrev - 16 ) );
+	__m128i same = _mm_loadu_si128( (const __m128i *)pPrev );
+	for ( ; d + 16 <= D; d += 16 )
+	{
+		__m128i after = _mm_loadu_si128( (const __m128i *)( pPrev + d + 16 ) );
+		__m128i below = _mm_or_si128( _mm_slli_si128( same, 1 ), _mm_srli_si128( before, 15 ) );
+		__m128i above = _mm_or_si128( _mm_srli_si128( same, 1 ), _mm_slli_si128( after, 15 ) );
+		__m128i best = _mm_min_epu8( _mm_min_epu8( same, vjump ), _mm_adds_epu8( _mm_min_epu8( below, above ), p1 ) );
+		__m128i out = _mm_add_epi8( _mm_loadu_si128( (const __m128i *)( pCost + d ) ), _mm_sub_epi8( best, base ) );
+		_mm_storeu_si128( (__m128i *)( pOut + d ), out );
+		vmin = _mm_min_epu8( vmin, out );
+		if ( pSum )
+		{
+			__m128i * sum = (__m128i *)( pSum + d );
+			_mm_storeu_si128( sum, _mm_add_epi16( _mm_loadu_si128( sum ), _mm_unpacklo_epi8( out, zero ) ) );
+			_mm_storeu_si128( sum + 1, _mm_add_epi16( _mm_loadu_si128( sum + 1 ), _mm_unpackhi_epi8( out, zero ) ) );
+		}
+		before = same;
+		same = after;
+	}
+	vmin = _mm_min_epu8( vmin, _mm_srli_si128( vmin, 8 ) );
+	vmin = _mm_min_epu8( vmin, _mm_srli_si128( vmin, 4 ) );
+	vmin = _mm_min_epu8( vmin, _mm_srli_si128( vmin, 2 ) );
+	vmin = _mm_min_epu8( vmin, _mm_srli_si128( vmin, 1 ) );
+	outMin = _mm_cvtsi128_si32( vmin ) & 0xff;
+#endif
+
+	for ( ; d < D; d++ )
+	{
+		int neighbour = ( pPrev[d - 1] < pPrev[d + 1] ? pPrev[d - 1] : pPrev[d + 1] ) + m_iP1;
+		int best = pPrev[d];
+		if ( jump < best ) best = jump;
+		if ( neighbour < best ) best = neighbour;
+		pOut[d] = (uint8_t)( pCost[d] + best - prevMin );
+		if ( pOut[d] < outMin ) outMin = pOut[d];
+		if ( pSum ) pSum[d] += pOut[d];
+	}
+	return (uint8_t)outMin;
+}
+
+//Lowest entry of p[0 .. count).  The totals are all under 0x8000.
+static uint16_t MinOf( const uint16_t * p, int count )
+{
+	int d = 0;
+	uint16_t m = 0xffff;
+#if STEREO_CENSUS_SSE2
+	if ( count >= 8 )
+	{
+		__m128i vmin = _mm_loadu_si128( (const __m128i *)p );
+		for ( d = 8; d + 8 <= count; d += 8 )
+			vmin = _mm_min_epi16( vmin, _mm_loadu_si128( (const __m128i *)( p + d ) ) );
+		vmin = _mm_min_epi16( vmin, _mm_srli_si128( vmin, 8 ) );
+		vmin = _mm_min_epi16( vmin, _mm_srli_si128( vmin, 4 ) );
+		vmin = _mm_min_epi16( vmin, _mm_srli_si128( vmin, 2 ) );
+		m = (uint16_t)_mm_cvtsi128_si32( vmin );
+	}
+#endif
+	for ( ; d < count; d++ )
+		if ( p[d] < m ) m = p[d];
+	return m;
+}
+
+//Where m first appears in p.
+static int IndexOf( const uint16_t * p, int count, uint16_t m )
+{
+	int d = 0;
+#if STEREO_CENSUS_SSE2
+	const __m128i vm = _mm_set1_epi16( (short)m );
+	for ( ; d + 8 <= count; d += 8 )
+	{
+		int mask = _mm_movemask_epi8( _mm_cmpeq_epi16( _mm_loadu_si128( (const __m128i *)( p + d ) ), vm ) );
+		if ( mask )
+		{
+			while ( !( mask & 1 ) )
+			{
+				mask >>= 2;
+				d++;
+			}
+			return d;
+		}
+	}
+#endif
+	for ( ; d < count; d++ )
+		if ( p[d] == m ) return d;
+	return 0;
+}
+
+//Windows
+
+//Which entry of the neighbour's path costs has the same disparity as entry 0 here.  Past
+//m_iSearch + 1 either way they are all guard, which the path guard is sized for.
+static inline int WindowShift( const uint16_t * pHere, const uint16_t * pThere, int i, int from, int iSearch )
+{
+	if ( !pHere )
+		return 0;
+	int shift = pHere[i] - pThere[from];
+	return ( shift < -( iSearch + 1 ) ) ? -( iSearch + 1 ) : ( shift > iSearch + 1 ) ? iSearch + 1 : shift;
+}
+
+void StereoCensusMatcher::ChooseWindows( const int16_t * pSeed, int seedStride, int seedWidth, int seedHeight, int iScale )
+{
+	int D = m_iDisparities, S = m_iSearch;
+	int seedDisparities = D / iScale;
+	int step = ( iScale == 1 ) ? 2 : 1; //Look about 2 pixels around either way.
+	int center = D / 2;                  //For pixels with no estimate near them, the last one chosen.
+
+	//The seed in whole pixels of this image, -1 where there is none, with step columns of -1
+	//either side (and one more for odd widths) so the loop below needn't check.
+	int seedColumns = seedWidth - seedDisparities;
+	int padded = seedColumns + step * 2 + 1;
+	m_seeds.assign( (size_t)padded * seedHeight, -1 );
+	for ( int y = 0; y < seedHeight; y++ )
+	{
+		const int16_t * in = pSeed + (size_t)y * seedStride + seedDisparities;
+		int16_t * out = &m_seeds[(size_t)y * padded + step];
+		for ( int x = 0; x < seedColumns; x++ )
+		{
+			int d = ( in[x] * iScale + 8 ) / 16;
+			out[x] = (int16_t)( in[x] < 0 ? -1 : d < D ? d : D - 1 );
+		}
+	}
+
+	for ( int y = 0; y < m_iHeight; y++ )
+	{
+		const uint64_t * left = &m_census[0][(size_t)y * m_iWidth + D];
+		const uint64_t * right = &m_census[1][(size_t)y * m_iWidth + D];
+		uint16_t * windows = &m_windows[(size_t)y * m_iColumns];
+		int sy = y / iScale;
+		sy = ( sy < seedHeight ) ? sy : seedHeight - 1;
+		const int16_t * rows[3] = {
+			&m_seeds[(size_t)( sy - step >= 0 ? sy - step : sy ) * padded + step],
+			&m_seeds[(size_t)sy * padded + step],
+			&m_seeds[(size_t)( sy + step < seedHeight ? sy + step : sy ) * padded + step] };
+
+		for ( int i = 0; i < m_iColumns; i++ )
+		{
+			int sx = i / iScale;
+			int candidates[9], count = 0, lo = D, hi = -1;
+			for ( int r = 0; r < 3; r++ )
+			{
+				for ( int dx = -step; dx <= step; dx += step )
+				{
+					int d = rows[r][sx + dx];
+					if ( d < 0 )
+						continue;
+					candidates[count++] = d;
+					lo = ( d < lo ) ? d : lo;
+					hi = ( d > hi ) ? d : hi;
+				}
+			}
+
+			if ( count && lo == hi )
+			{
+				center = lo;
+			}
+			else if ( count )
+			{
+				int bestCost = 1000;
+				for ( int k = 0; k < count; k++ )
+				{
+					int cost = Popcount64( left[i] ^ right[i - candidates[k]] );
+					if ( cost < bestCost )
+					{
+						bestCost = cost;
+						center = candidates[k];
+					}
+				}
+			}
+
+			int first = center - S / 2;
+			first = ( first < 0 ) ? 0 : ( first > D - S ) ? D - S : first;
+			windows[i] = (uint16_t)first;
+		}
+	}
+}
+
+bool StereoCensusMatcher::MatchHalfResolution( const uint8_t * pLeft, const uint8_t * pRight, int stride )
+{
+	int hw = m_iWidth / 2, hh = m_iHeight / 2, hd = m_iDisparities / 2;
+	if ( hh < 1 || hw <= hd || hd < 1 )
+		return false;
+
+	if ( !m_halfResolution )
+		m_halfResolution.reset( new StereoCensusMatcher );
+	StereoCensusMatcher & half = *m_halfResolution;
+	half.m_iPaths = 4; //Only an estimate; the diagonals add little to it.
+	half.m_iP1 = m_iP1;
+	half.m_iP2 = m_iP2;
+	half.m_iUniqueness = m_iUniqueness;
+
+	const uint8_t * images[2] = { pLeft, pRight };
+	for ( int side = 0; side < 2; side++ )
+	{
+		m_halfImages[side].resize( (size_t)hw * hh );
+		for ( int y = 0; y < hh; y++ )
+		{
+			const uint8_t * a = images[side] + (size_t)y * 2 * stride;
+			const uint8_t * b = a + stride;
+			uint8_t * out = &m_halfImages[side][(size_t)y * hw];
+			for ( int x = 0; x < hw; x++ )
+				out[x] = (uint8_t)( ( a[x * 2] + a[x * 2 + 1] + b[x * 2] + b[x * 2 + 1] + 2 ) >> 2 );
+		}
+	}
+	m_halfDisparity.resize( (size_t)hw * hh );
+	half.Compute( &m_halfImages[0][0], &m_halfImages[1][0], hw, hw, hh, hd, &m_halfDisparity[0], hw );
+
+	ChooseWindows( &m_halfDisparity[0], hw, hw, hh, 2 );
+	return true;
+}
+
+void StereoCensusMatcher::Compute( const uint8_t * pLeft, const uint8_t * pRight, int stride, int width, int height,
+	int iDisparities, int16_t * pDisparity, int outStride )
+{
+	for ( int y = 0; y < height; y++ )
+	{
+		for ( int x = 0; x < width && x < iDisparities; x++ )
+			pDisparity[(size_t)y * outStride + x] = -16;
+	}
+	if ( width <= iDisparities || height <= 0 || iDisparities <= 0 )
+		return;
+
+	//Path costs are kept in bytes: a cost plus P2 has to fit.
+	if ( m_iP2 > 0xff - CENSUS_MAX_COST ) m_iP2 = 0xff - CENSUS_MAX_COST;
+	if ( m_iP1 < 0 ) m_iP1 = 0;
+	if ( m_iP1 > m_iP2 ) m_iP1 = m_iP2;
+
+	int D = iDisparities;
+	bool bWindows = m_search != STEREO_CENSUS_FULL && m_iSearchWindow > 0 && m_iSearchWindow < D &&
+		height >= 2 && width / 2 > D / 2 && D >= 2;
+	int S = bWindows ? m_iSearchWindow : D;
+	//Windowed paths read their neighbours' costs up to S + 1 entries off, which have to be guard,
+	//and PathStep reads a whole vector either side.
+	int iPathGuard = bWindows ? ( ( S + 2 + 15 ) & ~15 ) + 16 : 16;
+	int iPathStride = iPathGuard * 2 + ( ( S + 15 ) & ~15 );
+	int dirs = 5;
+	//The guards only need writing when the layout changes; PathStep never touches them.
+	bool bNewLayout = D != m_iDisparities || S != m_iSearch || width - D != m_iColumns || iPathGuard != m_iPathGuard;
+	if ( width != m_iWidth || height != m_iHeight || D != m_iDisparities )
+		m_previous.clear();
+	m_iWidth = width;
+	m_iHeight = height;
+	m_iDisparities = D;
+	m_iColumns = width - D;
+	m_iSearch = S;
+	m_iPathStride = iPathStride;
+	m_iPathGuard = iPathGuard;
+
+	for ( int side = 0; side < 2; side++ )
+	{
+		m_census[side].resize( (size_t)width * height );
+		if ( bNewLayout )
+			m_paths[side].assign( (size_t)dirs * m_iColumns * m_iPathStride, PATH_GUARD );
+		m_pathMins[side].resize( (size_t)dirs * m_iColumns );
+	}
+	Census( pLeft, stride, width, height, &m_census[0][0] );
+	Census( pRight, stride, width, height, &m_census[1][0] );
+
+	if ( bWindows )
+	{
+		m_windows.resize( (size_t)m_iColumns * height );
+		if ( m_search == STEREO_CENSUS_PREVIOUS && !m_previous.empty() && m_iFramesSinceRefresh < m_iRefreshFrames )
+		{
+			ChooseWindows( &m_previous[0], width, width, height, 1 );
+			m_iFramesSinceRefresh++;
+		}
+		else
+		{
+			MatchHalfResolution( pLeft, pRight, stride );
+			m_iFramesSinceRefresh = 0;
+		}
+	}
+
+	Aggregate( pDisparity, outStride );
+
+	if ( m_search != STEREO_CENSUS_PREVIOUS )
+	{
+		m_previous.clear();
+		return;
+	}
+	m_previous.resize( (size_t)width * height );
+	int matched = 0;
+	for ( int y = 0; y < height; y++ )
+	{
+		const int16_t * out = pDisparity + (size_t)y * outStride;
+		memcpy( &m_previous[(size_t)y * width], out, width * sizeof( int16_t ) );
+		for ( int x = D; x < width; x++ )
+			matched += out[x] >= 0;
+	}
+	if ( matched * 2 < m_iColumns * height )
+		m_iFramesSinceRefresh = m_iRefreshFrames;
+}
+
+void StereoCensusMatcher::Aggregate( int16_t * pDisparity, int outStride )
+{
+	int D = m_iDisparities, S = m_iSearch, height = m_iHeight;
+	bool bDiagonals = m_iPaths >= 8;
+	bool bWindows = S < D;
+
+	m_costs.resize( (size_t)m_iColumns * S );
+	m_forward.resize( (size_t)m_iColumns * S * height );
+	m_total.resize( S );
+
+	//Forward pass, top to bottom: along the row both ways, and down from the row above.
+	for ( int y = 0; y < height; y++ )
+	{
+		int cur = y & 1, prv = cur ^ 1;
+		uint8_t * curMins = &m_pathMins[cur][0];
+		const uint8_t * prvMins = &m_pathMins[prv][0];
+		const uint16_t * here = bWindows ? &m_windows[(size_t)y * m_iColumns] : 0;
+		const uint16_t * above = ( bWindows && y > 0 ) ? here - m_iColumns : 0;
+		uint16_t * forward = &m_forward[(size_t)y * m_iColumns * S];
+		memset( forward, 0, (size_t)m_iColumns * S * sizeof( uint16_t ) );
+		CostRow( y );
+
+		for ( int i = 0; i < m_iColumns; i++ )
+		{
+			const uint8_t * cost = &m_costs[(size_t)i * S];
+			uint16_t * sum = forward + (size_t)i * S;
+			int c = m_iColumns;
+			curMins[0 * c + i] = PathStep( cost, i > 0 ? PathCosts( cur, 0, i - 1 ) + WindowShift( here, here, i, i - 1, S ) : 0,
+				i > 0 ? curMins[0 * c + i - 1] : 0, PathCosts( cur, 0, i ), sum );
+			curMins[2 * c + i] = PathStep( cost, y > 0 ? PathCosts( prv, 2, i ) + WindowShift( here, above, i, i, S ) : 0,
+				y > 0 ? prvMins[2 * c + i] : 0, PathCosts( cur, 2, i ), sum );
+			if ( bDiagonals )
+			{
+				bool bUpLeft = y > 0 && i > 0, bUpRight = y > 0 && i + 1 < c;
+				curMins[3 * c + i] = PathStep( cost, bUpLeft ? PathCosts( prv, 3, i - 1 ) + WindowShift( here, above, i, i - 1, S ) : 0,
+					bUpLeft ? prvMins[3 * c + i - 1] : 0, PathCosts( cur, 3, i ), sum );
+				curMins[4 * c + i] = PathStep( cost, bUpRight ? PathCosts( prv, 4, i + 1 ) + WindowShift( here, above, i, i + 1, S ) : 0,
+					bUpRight ? prvMins[4 * c + i + 1] : 0, PathCosts( cur, 4, i ), sum );
+			}
+		}
+		for ( int i = m_iColumns - 1; i >= 0; i-- )
+		{
+			int c = m_iColumns;
+			bool bRight = i + 1 < c;
+			curMins[1 * c + i] = PathStep( &m_costs[(size_t)i * S], bRight ? PathCosts( cur, 1, i + 1 ) + WindowShift( here, here, i, i + 1, S ) : 0,
+				bRight ? curMins[1 * c + i + 1] : 0, PathCosts( cur, 1, i ), forward + (size_t)i * S );
+		}
+	}
+
+	//Backward pass, bottom to top: up from the row below, then pick the winner.
+	for ( int y = height - 1; y >= 0; y-- )
+	{
+		int cur = y & 1, prv = cur ^ 1;
+		uint8_t * curMins = &m_pathMins[cur][0];
+		const uint8_t * prvMins = &m_pathMins[prv][0];
+		const uint16_t * here = bWindows ? &m_windows[(size_t)y * m_iColumns] : 0;
+		bool bBelow = y + 1 < height;
+		const uint16_t * below = ( bWindows && bBelow ) ? here + m_iColumns : 0;
+		const uint16_t * forward = &m_forward[(size_t)y * m_iColumns * S];
+		int16_t * out = pDisparity + (size_t)y * outStride + D;
+		CostRow( y );
+
+		for ( int i = 0; i < m_iColumns; i++ )
+		{
+			const uint8_t * cost = &m_costs[(size_t)i * S];
+			uint16_t * total = &m_total[0];
+			int c = m_iColumns;
+			memcpy( total, forward + (size_t)i * S, S * sizeof( uint16_t ) );
+			curMins[2 * c + i] = PathStep( cost, bBelow ? PathCosts( prv, 2, i ) + WindowShift( here, below, i, i, S ) : 0,
+				bBelow ? prvMins[2 * c + i] : 0, PathCosts( cur, 2, i ), total );
+			if ( bDiagonals )
+			{
+				bool bDownLeft = bBelow && i > 0, bDownRight = bBelow && i + 1 < c;
+				curMins[3 * c + i] = PathStep( cost, bDownLeft ? PathCosts( prv, 3, i - 1 ) + WindowShift( here, below, i, i - 1, S ) : 0,
+					bDownLeft ? prvMins[3 * c + i - 1] : 0, PathCosts( cur, 3, i ), total );
+				curMins[4 * c + i] = PathStep( cost, bDownRight ? PathCosts( prv, 4, i + 1 ) + WindowShift( here, below, i, i + 1, S ) : 0,
+					bDownRight ? prvMins[4 * c + i + 1] : 0, PathCosts( cur, 4, i ), total );
+			}
+
+			uint16_t bestTotal = MinOf( total, S );
+			int best = IndexOf( total, S, bestTotal );
+			int lo = here ? here[i] : 0;
+
+			//At the edge of a window that doesn't reach the end of the range, the real minimum
+			//could be outside it.
+			if ( ( best == 0 && lo > 0 ) || ( best == S - 1 && lo + S < D ) )
+			{
+				out[i] = -16;
+				continue;
+			}
+
+			//Unique enough?  Nothing outside best - 1 .. best + 1 may come within m_iUniqueness
+			//percent.  Hide those three for a moment to find the runner up.
+			uint16_t saved[3];
+			for ( int k = 0; k < 3; k++ )
+			{
+				int d = best - 1 + k;
+				if ( d >= 0 && d < S ) { saved[k] = total[d]; total[d] = 0x7fff; }
+			}
+			int runnerUp = MinOf( total, S );
+			for ( int k = 0; k < 3; k++ )
+			{
+				int d = best - 1 + k;
+				if ( d >= 0 && d < S ) total[d] = saved[k];
+			}
+			if ( runnerUp * ( 100 - m_iUniqueness ) < bestTotal * 100 )
+			{
+				out[i] = -16;
+				continue;
+			}
+
+			//Sub-pixel, the same rounding as SGBM.
+			int d16 = ( lo + best ) * 16;
+			if ( best > 0 && best < S - 1 )
+			{
+				int denom2 = total[best - 1] + total[best + 1] - 2 * total[best];
+				if ( denom2 < 1 ) denom2 = 1;
+				d16 += ( ( total[best - 1] - total[best + 1] ) * 16 + denom2 ) / ( denom2 * 2 );
+			}
+			out[i] = (int16_t)d16;
+		}
+	}
+}
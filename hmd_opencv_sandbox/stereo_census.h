@@ -0,0 +1,93 @@
+#pragma once
+
+// A census transform semi-global matcher, the pipeline's alternative to cv::StereoSGBM for its
+// small gray images (StereoCore uses it for STEREO_ALGORITHM_CENSUS).
+//
+// Each pixel's 9x7 neighbourhood becomes 62 bits, one per neighbour darker than the center, and
+// the cost of a disparity is the Hamming distance between the left and right pixels' bits.  That
+// only depends on the order of the gray values, so it doesn't mind the two cameras exposing a
+// little differently.  The costs are smoothed along 4 or 8 straight paths through the image
+// (semi-global aggregation), the lowest total wins, and a parabola through it and its neighbours
+// gives the sub-pixel part.  The output is in SGBM's 16ths of a pixel, with -16 for no match.
+//
+// Costs are recomputed a row at a time in each of the two passes instead of being kept for the
+// whole image, so the only full size buffer is the forward pass's totals.  Define
+// STEREO_SIMD_DISABLE to build only the scalar code.
+//
+// Most of a scene sits in a narrow band of disparities, so instead of every pixel searching all
+// of them, the matcher can search a window of m_iSearchWindow disparities around an estimate.
+// The estimate comes from matching at half resolution first (the whole range there is an eighth
+// of the work), or from the previous frame's result.  Each pixel's window is centered on
+// whichever estimate around it has the lowest cost at that pixel, so the edges of objects pick up
+// the right side's estimate.  A winner at the edge of its window means the real minimum might be
+// outside it, so those pixels get no disparity.
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+enum StereoCensusSearch
+{
+	STEREO_CENSUS_FULL,     //Every disparity at every pixel.
+	STEREO_CENSUS_PYRAMID,  //A window around the half resolution result.
+	STEREO_CENSUS_PREVIOUS, //A window around the previous frame's result, falling back to the pyramid.
+	STEREO_CENSUS_SEARCHES
+};
+
+class StereoCensusMatcher
+{
+public:
+	StereoCensusMatcher();
+
+	//Matches width x height gray images whose rows are stride bytes apart, over disparities
+	//0 .. iDisparities - 1, into pDisparity with rows outStride int16s apart.  The first
+	//iDisparities columns can't be searched over the full range, and are -16 as with SGBM.
+	void Compute( const uint8_t * pLeft, const uint8_t * pRight, int stride, int width, int height,
+		int iDisparities, int16_t * pDisparity, int outStride );
+
+	int m_iPaths;      //4 (along rows and columns) or 8 (and the diagonals).
+	int m_iP1;         //Penalty for the disparity changing by one between neighbours on a path.
+	int m_iP2;         //Penalty for any bigger change.
+	int m_iUniqueness; //Percent by which the best total has to beat every other, except its neighbours.
+
+	StereoCensusSearch m_search;
+	int m_iSearchWindow;  //Disparities searched around the estimate.  Full search if it covers them all.
+	//STEREO_CENSUS_PREVIOUS still matches at half resolution every this many frames, and whenever
+	//fewer than half the previous frame's pixels had a disparity, so it can't get stuck.
+	int m_iRefreshFrames;
+
+	//Whether the Hamming costs use the CPU's popcount instruction, for the benchmark.
+	static bool UsesPopcountInstruction();
+
+private:
+	void Census( const uint8_t * pImage, int stride, int width, int height, uint64_t * pOut );
+	//Seeds each pixel's window from pSeed, a disparity image iScale times smaller than this one
+	//with the same layout as Compute's output.
+	void ChooseWindows( const int16_t * pSeed, int seedStride, int seedWidth, int seedHeight, int iScale );
+	bool MatchHalfResolution( const uint8_t * pLeft, const uint8_t * pRight, int stride );
+	void Aggregate( int16_t * pDisparity, int outStride );
+	void CostRow( int y );
+	//One step along a path: pOut = pCost + the cheapest way to get here from pPrev.  Returns the
+	//smallest entry of pOut.  pPrev == 0 starts the path.  pSum, if not 0, gets pOut added to it.
+	uint8_t PathStep( const uint8_t * pCost, const uint8_t * pPrev, uint8_t prevMin, uint8_t * pOut, uint16_t * pSum );
+	uint8_t * PathCosts( int row, int dir, int i ) { return &m_paths[row][( dir * m_iColumns + i ) * m_iPathStride + m_iPathGuard]; }
+
+	int m_iWidth, m_iHeight, m_iDisparities, m_iColumns; //m_iColumns = width - disparities, the ones with output.
+	int m_iSearch;                                        //Disparities searched per pixel, all of them without windows.
+	int m_iPathStride, m_iPathGuard;                      //m_iSearch rounded up to 16, with guard bytes either side.
+	std::vector< uint8_t > m_padded;                      //The image with its edges repeated, for the census window.
+	std::vector< uint64_t > m_census[2];
+	std::vector< uint16_t > m_windows;                    //First disparity of each pixel's window, if it has one.
+	std::vector< int16_t > m_seeds;                       //ChooseWindows' estimates.
+	std::vector< uint8_t > m_costs;                       //One row: m_iColumns x m_iSearch.
+	std::vector< uint16_t > m_forward;                    //Forward pass totals for the whole image.
+	std::vector< uint8_t > m_paths[2];                    //Path costs for the previous and current rows, which fit in bytes.
+	std::vector< uint8_t > m_pathMins[2];
+	std::vector< uint16_t > m_total;                      //One pixel's totals.
+
+	std::unique_ptr< StereoCensusMatcher > m_halfResolution;
+	std::vector< uint8_t > m_halfImages[2];
+	std::vector< int16_t > m_halfDisparity;
+	std::vector< int16_t > m_previous;                    //STEREO_CENSUS_PREVIOUS's last output, m_iWidth wide.
+	int m_iFramesSinceRefresh;
+};
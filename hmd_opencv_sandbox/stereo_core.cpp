@@ -0,0 +1,937 @@
+#include "stereo_core.h"
+#include "stereo_half.h"
+#include <opencv2/imgproc/types_c.h>
+#include <opencv2/imgproc.hpp>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if !defined( STEREO_SIMD_DISABLE ) && ( defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 ) )
+#define STEREO_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define RIGHT_EDGE_NO_TRUST 24
+
+//Stores the time from construction to destruction in a stage's timer.
+class StereoStageTimer
+{
+public:
+	StereoStageTimer( double & dest ) : m_dest( dest ), m_start( cv::getTickCount() ) { }
+	~StereoStageTimer() { m_dest = ( cv::getTickCount() - m_start ) / cv::getTickFrequency(); }
+private:
+	double & m_dest;
+	int64_t m_start;
+};
+
+static Matrix4 Matrix4FromCVMatrix( cv::Mat matin )
+{
+	Matrix4 out;
+	out.identity();
+	for ( int y = 0; y < matin.rows; y++ )
+	{
+		for ( int x = 0; x < matin.cols; x++ )
+		{
+			out[x + y * 4] = (float)matin.at<double>( y, x );
+		}
+	}
+	return out;
+}
+
+StereoFrameBuffers::StereoFrameBuffers() :
+	  sequence( 0 )
+	, timestamp( 0 )
+	, userFlags( 0 )
+{
+	memset( &times, 0, sizeof( times ) );
+	worldFromHead.identity();
+}
+
+StereoCore::StereoCore() :
+	  m_bFusedFrontEnd( true )
+	, m_grayWeighting( STEREO_GRAY_EQUAL )
+	, m_iMatchBands( STEREO_MATCH_BANDS )
+	, m_iMatchOverlap( 16 )
+	, m_iCensusWindow( 16 )
+	, m_iLeftRightTolerance( 16 )
+	, m_fTextureForFullConfidence( 6 )
+	, m_iMinConfidence( 16 )
+	, m_iBlurRadius( 2 )
+	, m_iBlurPasses( 3 )
+	, m_iFBSideWidth( 0 )
+	, m_iFBSideHeight( 0 )
+	, m_iFBAlgoWidth( 0 )
+	, m_iFBAlgoHeight( 0 )
+	, m_CameraDistanceMeters( 0 )
+	, m_iAlgorithm( -1 )
+	, m_iRequestedAlgorithm( 0 )
+	, m_iRequestedCensusSearch( STEREO_CENSUS_FULL )
+	, m_iRequestedChecks( 0 )
+{
+}
+
+bool StereoCore::Init( const StereoCalibration & calib )
+{
+	if ( calib.frameWidth < 2 * MOGRIFY_X || calib.frameHeight < MOGRIFY_Y )
+		return false;
+
+	m_iFBSideWidth = calib.frameWidth / 2;
+	m_iFBSideHeight = calib.frameHeight;
+	m_iFBAlgoWidth = m_iFBSideWidth / MOGRIFY_X;
+	m_iFBAlgoHeight = m_iFBSideHeight / MOGRIFY_Y;
+
+	//Create Rectification Maps
+
+	double tmp[3][3] = { 0 };
+	tmp[2][2] = 1.0;
+
+	/// ROW COL
+	tmp[0][0] = calib.intrinsics[0].fx;
+	tmp[0][2] = calib.intrinsics[0].cx;
+	tmp[1][1] = calib.intrinsics[0].fy;
+	tmp[1][2] = calib.intrinsics[0].cy;
+	cv::Mat K1 = cv::Mat( cv::Size( 3, 3 ), CV_64F, &(tmp[0][0]) ).clone();
+
+	tmp[0][0] = calib.intrinsics[1].fx;
+	tmp[0][2] = calib.intrinsics[1].cx;
+	tmp[1][1] = calib.intrinsics[1].fy;
+	tmp[1][2] = calib.intrinsics[1].cy;
+	cv::Mat K2 = cv::Mat( cv::Size( 3, 3 ), CV_64F, &(tmp[0][0]) ).clone();
+
+	double distortion_coefficients[2][STEREO_MAX_DISTORTION_PARAMETERS];
+	memcpy( distortion_coefficients, calib.distortion, sizeof( distortion_coefficients ) );
+	cv::Mat D1( calib.fisheye ? 4 : 8, 1, CV_64F, distortion_coefficients[0] );
+	cv::Mat D2( calib.fisheye ? 4 : 8, 1, CV_64F, distortion_coefficients[1] );
+
+	Matrix4 headFromLeftCamera_steamvr = calib.headFromCamera[0];
+	Matrix4 headFromRightCamera_steamvr = calib.headFromCamera[1];
+	Matrix4 RightCamerafromHead_steamvr = headFromRightCamera_steamvr.invert();
+	Matrix4 rotate180AroundX;
+	rotate180AroundX.identity();
+	rotate180AroundX.rotateX( 180 );
+	Matrix4 rightCameraFromLeftCamera_steamvr = RightCamerafromHead_steamvr * headFromLeftCamera_steamvr;
+	Matrix4	rightCameraFromLeftCamera_opencv = rotate180AroundX * rightCameraFromLeftCamera_steamvr * rotate180AroundX;
+
+	Vector4 RightEyeFromLeftEye = (rightCameraFromLeftCamera_steamvr * Vector4( 0, 0, 0, 1 ));
+	m_centerFromLeftEye = RightEyeFromLeftEye / 2;
+	m_CameraDistanceMeters = ( RightEyeFromLeftEye * Vector4( 1, 1, 1, 0 ) ).length();
+	m_centerFromLeftEye.w = 0;
+
+	double posetrans[3] = { rightCameraFromLeftCamera_opencv[12], rightCameraFromLeftCamera_opencv[13], rightCameraFromLeftCamera_opencv[14] };
+
+	rightCameraFromLeftCamera_opencv.transpose();
+	double posemat[9] = {
+		rightCameraFromLeftCamera_opencv[0], rightCameraFromLeftCamera_opencv[1], rightCameraFromLeftCamera_opencv[2],
+		rightCameraFromLeftCamera_opencv[4], rightCameraFromLeftCamera_opencv[5], rightCameraFromLeftCamera_opencv[6],
+		rightCameraFromLeftCamera_opencv[8], rightCameraFromLeftCamera_opencv[9], rightCameraFromLeftCamera_opencv[10] };
+
+	cv::Mat R( cv::Size( 3, 3 ), CV_64F, posemat /* Boy I hope the major is right */ );
+	cv::Mat T( 3, 1, CV_64F, posetrans );
+	cv::Mat R1, R2, P1, P2;
+	cv::Size sideSize( m_iFBSideWidth, m_iFBSideHeight );
+
+	if ( calib.fisheye )
+	{
+		cv::fisheye::stereoRectify( K1, D1, K2, D2, sideSize, R, T, R1, R2, P1, P2, m_cvQ, cv::CALIB_ZERO_DISPARITY, sideSize, 0.0, 0.7 );
+		cv::fisheye::initUndistortRectifyMap( K1, D1, R1, P1, sideSize, CV_16SC2, m_leftMap1, m_leftMap2 );
+		cv::fisheye::initUndistortRectifyMap( K2, D2, R2, P2, sideSize, CV_16SC2, m_rightMap1, m_rightMap2 );
+	}
+	else
+	{
+		cv::stereoRectify( K1, D1, K2, D2, sideSize, R, T, R1, R2, P1, P2, m_cvQ, cv::CALIB_ZERO_DISPARITY );
+		cv::initUndistortRectifyMap( K1, D1, R1, P1, sideSize, CV_16SC2, m_leftMap1, m_leftMap2 );
+		cv::initUndistortRectifyMap( K2, D2, R2, P2, sideSize, CV_16SC2, m_rightMap1, m_rightMap2 );
+	}
+
+	m_R1 = Matrix4FromCVMatrix( R1 );
+	m_R1inv = m_R1;
+	m_R1inv = m_R1inv.invert();
+	m_Q = Matrix4FromCVMatrix( m_cvQ );
+	BuildRayTables();
+
+	BuildFrontEndTaps( 0, m_leftMap1, m_leftMap2 );
+	BuildFrontEndTaps( 1, m_rightMap1, m_rightMap2 );
+
+	size_t algoPixels = m_iFBAlgoWidth * m_iFBAlgoHeight;
+	m_valids.assign( algoPixels, 1 );
+	m_depths.assign( algoPixels, 0 );
+	m_blurScratch[0].assign( algoPixels, 0 );
+	m_blurScratch[1].assign( algoPixels, 0 );
+	for ( int side = 0; side < 2; side++ )
+	{
+		m_flippedGray[side].assign( ( m_iFBAlgoWidth + NUM_DISP ) * m_iFBAlgoHeight, 0 );
+		m_textureScratch[side].assign( algoPixels, 0 );
+	}
+	m_rightDisparity.assign( algoPixels, -16 );
+
+	return true;
+}
+
+//TransformToRectifiedSpace is depth * ( ( x * MOGRIFY_X + Q[3] ) / Q[11], -( y * MOGRIFY_Y + Q[7] ) / Q[11], -1 ),
+//with depth = Q[11] * baseline / ( disparity * MOGRIFY_X ).  The ray only has x in one component
+//and y in another, so a column table and a row table cover every pixel.
+void StereoCore::BuildRayTables()
+{
+	Matrix3x4 localFromRectified( m_R1inv );
+	m_localRayColumns.resize( m_iFBAlgoWidth );
+	for ( uint32_t x = 0; x < m_iFBAlgoWidth; x++ )
+		m_localRayColumns[x] = localFromRectified.transformVector( Vector3( ( x * MOGRIFY_X + m_Q[3] ) / m_Q[11], 0, 0 ) );
+	m_localRayRows.resize( m_iFBAlgoHeight );
+	for ( uint32_t y = 0; y < m_iFBAlgoHeight; y++ )
+		m_localRayRows[y] = localFromRectified.transformVector( Vector3( 0, -( y * MOGRIFY_Y + m_Q[7] ) / m_Q[11], -1 ) );
+	m_localRayStepX = localFromRectified.transformVector( Vector3( MOGRIFY_X / m_Q[11], 0, 0 ) );
+	m_localRayStepY = localFromRectified.transformVector( Vector3( 0, -MOGRIFY_Y / m_Q[11], 0 ) );
+
+	m_depthFromDisparity.resize( 0x10000 );
+	for ( int d = 0; d < 0x10000; d++ )
+		m_depthFromDisparity[d] = ( d >= 0xfff0 ) ? nanf( "" ) : m_Q[11] * m_CameraDistanceMeters / ( (float)d / 16.f * MOGRIFY_X );
+}
+
+void StereoCore::InitBuffers( StereoFrameBuffers & b ) const
+{
+	size_t algoPixels = m_iFBAlgoWidth * m_iFBAlgoHeight;
+	b.worldRayColumns.resize( m_iFBAlgoWidth );
+	b.worldRayRows.resize( m_iFBAlgoHeight );
+	b.m_Disparity.assign( algoPixels, 0 );
+	for ( int side = 0; side < 2; side++ )
+	{
+		b.m_FBSides[side].assign( ( m_iFBAlgoWidth + NUM_DISP ) * m_iFBAlgoHeight, 0 );
+		b.m_FBSidesColor[side].assign( algoPixels, 0 );
+	}
+
+	//Set up what matrices we can to prevent dynamic memory allocation.
+	b.resizedLeft = cv::Mat( m_iFBAlgoHeight, m_iFBAlgoWidth, CV_8UC4, &b.m_FBSidesColor[0][0] );
+	b.resizedRight = cv::Mat( m_iFBAlgoHeight, m_iFBAlgoWidth, CV_8UC4, &b.m_FBSidesColor[1][0] );
+	b.resizedLeftGray = cv::Mat( m_iFBAlgoHeight, m_iFBAlgoWidth + NUM_DISP, CV_8U, &b.m_FBSides[0][0] );
+	b.resizedRightGray = cv::Mat( m_iFBAlgoHeight, m_iFBAlgoWidth + NUM_DISP, CV_8U, &b.m_FBSides[1][0] );
+	b.mdisparity = cv::Mat( m_iFBAlgoHeight, m_iFBAlgoWidth, CV_16S, &b.m_Disparity[0] );
+	//Allocated up front so the rectify can write into them a band of rows at a time.
+	b.rectLeft.create( m_iFBSideHeight, m_iFBSideWidth, CV_8UC4 );
+	b.rectRight.create( m_iFBSideHeight, m_iFBSideWidth, CV_8UC4 );
+}
+
+void StereoCore::SetAlgorithm( int iAlgorithm )
+{
+	if ( iAlgorithm < 0 || iAlgorithm >= STEREO_ALGORITHMS ) iAlgorithm = 0;
+	m_iRequestedAlgorithm = iAlgorithm;
+}
+
+void StereoCore::SetCensusSearch( int iSearch )
+{
+	if ( iSearch < 0 || iSearch >= STEREO_CENSUS_SEARCHES ) iSearch = STEREO_CENSUS_FULL;
+	m_iRequestedCensusSearch = iSearch;
+}
+
+//Makes the SGBM matcher for a preset.  Only called from Match.
+static cv::Ptr< cv::StereoSGBM > CreateMatcher( int iAlgorithm )
+{
+	cv::Ptr< cv::StereoSGBM > stereo;
+
+	if ( iAlgorithm == STEREO_ALGORITHM_CENSUS )
+		return stereo;
+
+	if ( iAlgorithm == 0 )
+	{
+		stereo = cv::StereoSGBM::create( 0, NUM_DISP, 7,
+			0, 0, 0,
+			4, 55,
+			25, 4,
+			cv::StereoSGBM::MODE_SGBM );
+	}
+	else if ( iAlgorithm == 1 )
+	{
+		stereo = cv::StereoSGBM::create( 0, NUM_DISP, 2,
+			0, 0, 0,
+			4, 35,
+			10, 3,
+			cv::StereoSGBM::MODE_SGBM );
+	}
+	else if ( iAlgorithm == 2 )
+	{
+		stereo = cv::StereoSGBM::create( 0, NUM_DISP, 15,
+			0, 0, 0,
+			4, 5,
+			200, 1,
+			cv::StereoSGBM::MODE_SGBM );
+	}
+	return stereo;
+}
+
+void StereoCore::Process( const StereoFrame & frame, StereoFrameBuffers & b, float * pPointsOut )
+{
+	if ( m_bFusedFrontEnd )
+	{
+		RectifyDownsampleGray( frame, b );
+	}
+	else
+	{
+		Rectify( frame, b );
+		Downsample( b );
+		ConvertToGray( b );
+	}
+	Match( b );
+	BlurDepths( b );
+	Reproject( b, pPointsOut );
+}
+
+void StereoCore::SetFrame( const StereoFrame & frame, StereoFrameBuffers & b ) const
+{
+	b.sequence = frame.sequence;
+	b.timestamp = frame.timestamp;
+	b.worldFromHead = frame.worldFromHead;
+	b.worldFromRectified = Matrix3x4( b.worldFromHead * m_R1inv );
+
+	//Turning the tables by the pose once per frame is a few hundred transforms, instead of one per point.
+	Matrix3x4 worldFromLocal( b.worldFromHead );
+	b.worldRayColumns.resize( m_localRayColumns.size() );
+	b.worldRayRows.resize( m_localRayRows.size() );
+	for ( size_t x = 0; x < m_localRayColumns.size(); x++ )
+		b.worldRayColumns[x] = worldFromLocal.transformVector( m_localRayColumns[x] );
+	for ( size_t y = 0; y < m_localRayRows.size(); y++ )
+		b.worldRayRows[y] = worldFromLocal.transformVector( m_localRayRows[y] );
+	b.worldRayStepX = worldFromLocal.transformVector( m_localRayStepX );
+	b.worldRayStepY = worldFromLocal.transformVector( m_localRayStepY );
+
+	b.origStereoPair = cv::Mat( m_iFBSideHeight, m_iFBSideWidth * 2, CV_8UC4, (void*)frame.pPixels );
+	b.origLeft = b.origStereoPair( cv::Rect( 0, 0, m_iFBSideWidth, m_iFBSideHeight ) );
+	b.origRight = b.origStereoPair( cv::Rect( m_iFBSideWidth, 0, m_iFBSideWidth, m_iFBSideHeight ) );
+}
+
+void StereoCore::KeepOriginal( StereoFrameBuffers & b ) const
+{
+	b.origStereoPair = b.origStereoPair.clone();
+	b.origLeft = b.origStereoPair( cv::Rect( 0, 0, m_iFBSideWidth, m_iFBSideHeight ) );
+	b.origRight = b.origStereoPair( cv::Rect( m_iFBSideWidth, 0, m_iFBSideWidth, m_iFBSideHeight ) );
+}
+
+//Rectifies rows [begin, end) of one eye.  Each output row only depends on its own row of the
+//maps, so bands of rows can go to different threads.
+void StereoCore::RemapRows( const cv::Mat & src, cv::Mat & dst, int eye, int begin, int end )
+{
+	const cv::Mat & map1 = eye ? m_rightMap1 : m_leftMap1;
+	const cv::Mat & map2 = eye ? m_rightMap2 : m_leftMap2;
+	cv::Mat dstRows = dst.rowRange( begin, end );
+	cv::remap( src, dstRows, map1.rowRange( begin, end ), map2.rowRange( begin, end ), CV_INTER_LINEAR, cv::BORDER_CONSTANT );
+}
+
+void StereoCore::Rectify( const StereoFrame & frame, StereoFrameBuffers & b )
+{
+	StereoStageTimer timer( b.times.rectify );
+
+	SetFrame( frame, b );
+	int rows = (int)m_iFBSideHeight;
+	m_parallel.For( rows * 2, [this, &b, rows]( int begin, int end )
+	{
+		//A band can straddle the two eyes.
+		if ( begin < rows )
+			RemapRows( b.origLeft, b.rectLeft, 0, begin, end < rows ? end : rows );
+		if ( end > rows )
+			RemapRows( b.origRight, b.rectRight, 1, ( begin > rows ? begin : rows ) - rows, end - rows );
+	} );
+}
+
+void StereoCore::RectifyForDisplay( StereoFrameBuffers & b, int eye )
+{
+	StereoStageTimer timer( b.times.rectify );
+
+	m_parallel.For( (int)m_iFBSideHeight, [this, &b, eye]( int begin, int end )
+	{
+		if ( eye == 0 )
+			RemapRows( b.origLeft, b.rectLeft, 0, begin, end );
+		else
+			RemapRows( b.origRight, b.rectRight, 1, begin, end );
+	} );
+}
+
+void StereoCore::Downsample( StereoFrameBuffers & b )
+{
+	StereoStageTimer timer( b.times.downsample );
+
+	//The eyes are independent until Match, so each is its own task.
+	m_parallel.For( 2, [this, &b]( int begin, int end )
+	{
+		for ( int eye = begin; eye < end; eye++ )
+		{
+			if ( eye == 0 )
+				cv::resize( b.rectLeft, b.resizedLeft, cv::Size( m_iFBAlgoWidth, m_iFBAlgoHeight ) );
+			else
+				cv::resize( b.rectRight, b.resizedRight, cv::Size( m_iFBAlgoWidth, m_iFBAlgoHeight ) );
+		}
+	} );
+}
+
+static void ConvertToGrayRows( const cv::Mat & msrc, cv::Mat & mdst, StereoGrayWeighting weighting )
+{
+	//You can do this the OpenCV way, but my alternative transform seems more successful.
+	if ( 0 )
+	{
+		cv::cvtColor( msrc, mdst, cv::COLOR_BGR2GRAY );
+	}
+	else
+	{
+		for ( int y = 0; y < msrc.rows; y++ )
+		{
+			StereoGrayRow( msrc.ptr< uint32_t >( y ), mdst.ptr< uint8_t >( y ) + NUM_DISP, msrc.cols, weighting );
+		}
+	}
+}
+
+void StereoCore::ConvertToGray( StereoFrameBuffers & b )
+{
+	StereoStageTimer timer( b.times.gray );
+
+	m_parallel.For( 2, [this, &b]( int begin, int end )
+	{
+		for ( int eye = begin; eye < end; eye++ )
+		{
+			if ( eye == 0 )
+				ConvertToGrayRows( b.resizedLeft, b.resizedLeftGray, m_grayWeighting );
+			else
+				ConvertToGrayRows( b.resizedRight, b.resizedRightGray, m_grayWeighting );
+		}
+	} );
+}
+
+//Works out which distorted pixels the full resolution remap followed by the downsample would
+//have blended into each algorithm pixel, so RectifyDownsampleGray can go straight there.
+//Uses the same 1/32 pixel sample positions as cv::remap with CV_16SC2 maps, the same zero
+//border, and the same sample points and clamping as cv::resize with INTER_LINEAR.
+void StereoCore::BuildFrontEndTaps( int eye, const cv::Mat & map1, const cv::Mat & map2 )
+{
+	int sideW = (int)m_iFBSideWidth;
+	int sideH = (int)m_iFBSideHeight;
+	int stride = sideW * 2;
+	double scaleX = (double)m_iFBSideWidth / m_iFBAlgoWidth;
+	double scaleY = (double)m_iFBSideHeight / m_iFBAlgoHeight;
+
+	std::vector< StereoFrontEndTap > & taps = m_frontEndTaps[eye];
+	taps.resize( m_iFBAlgoWidth * m_iFBAlgoHeight * 4 );
+
+	for ( uint32_t dy = 0; dy < m_iFBAlgoHeight; dy++ )
+	{
+		//Rectified rows and weights, as cv::resize picks them.
+		double fy = ( dy + 0.5 ) * scaleY - 0.5;
+		int ry = (int)floor( fy );
+		float ay = (float)( fy - ry );
+		int ry0 = ry, ry1 = ry + 1;
+		if ( ry < 0 ) { ry0 = ry1 = 0; ay = 0; }
+		if ( ry1 >= sideH ) { ry0 = ry1 = sideH - 1; ay = 0; }
+
+		for ( uint32_t dx = 0; dx < m_iFBAlgoWidth; dx++ )
+		{
+			double fx = ( dx + 0.5 ) * scaleX - 0.5;
+			int rx = (int)floor( fx );
+			float ax = (float)( fx - rx );
+			int rx0 = rx, rx1 = rx + 1;
+			if ( rx < 0 ) { rx0 = rx1 = 0; ax = 0; }
+			if ( rx1 >= sideW ) { rx0 = rx1 = sideW - 1; ax = 0; }
+
+			const int rxs[4] = { rx0, rx1, rx0, rx1 };
+			const int rys[4] = { ry0, ry0, ry1, ry1 };
+			const float rw[4] = { ( 1 - ax ) * ( 1 - ay ), ax * ( 1 - ay ), ( 1 - ax ) * ay, ax * ay };
+
+			for ( int t = 0; t < 4; t++ )
+			{
+				//Where the remap samples the distorted eye for this rectified pixel.
+				const int16_t * m1 = map1.ptr< int16_t >( rys[t] ) + rxs[t] * 2;
+				uint16_t tab = map2.ptr< uint16_t >( rys[t] )[rxs[t]];
+				int sx = m1[0], sy = m1[1];
+				float tx = ( tab & 31 ) / 32.0f, ty = ( ( tab >> 5 ) & 31 ) / 32.0f;
+
+				//Keep the 2x2 block inside the eye; pixels off the edge are black, as with BORDER_CONSTANT.
+				int bx = sx < 0 ? 0 : ( sx > sideW - 2 ? sideW - 2 : sx );
+				int by = sy < 0 ? 0 : ( sy > sideH - 2 ? sideH - 2 : sy );
+				float w[4] = { 0, 0, 0, 0 };
+				for ( int k = 0; k < 4; k++ )
+				{
+					int px = sx + ( k & 1 ), py = sy + ( k >> 1 );
+					if ( px < 0 || py < 0 || px >= sideW || py >= sideH )
+						continue;
+					float wx = ( k & 1 ) ? tx : 1 - tx;
+					float wy = ( k >> 1 ) ? ty : 1 - ty;
+					w[( px - bx ) * 2 + ( py - by )] += wx * wy;
+				}
+
+				StereoFrontEndTap & tap = taps[( dy * m_iFBAlgoWidth + dx ) * 4 + t];
+				tap.offset = by * stride + bx + eye * sideW;
+				for ( int k = 0; k < 4; k++ )
+					tap.weights[k] = (int16_t)lrintf( w[k] * rw[t] * 4096.0f );
+			}
+		}
+	}
+}
+
+void StereoCore::FrontEndRow( const uint8_t * frame, StereoFrameBuffers & b, int eye, int y )
+{
+	const StereoFrontEndTap * tap = &m_frontEndTaps[eye][y * m_iFBAlgoWidth * 4];
+	size_t stride = m_iFBSideWidth * 2 * 4;
+	uint32_t * color = &b.m_FBSidesColor[eye][y * m_iFBAlgoWidth];
+
+#if STEREO_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32( 2048 );
+	for ( uint32_t x = 0; x < m_iFBAlgoWidth; x++, tap += 4 )
+	{
+		__m128i acc = round;
+		for ( int t = 0; t < 4; t++ )
+		{
+			const uint8_t * p = frame + (size_t)tap[t].offset * 4;
+			__m128i top = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i *)p ), zero );
+			__m128i bottom = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i *)( p + stride ) ), zero );
+			__m128i w = _mm_loadl_epi64( (const __m128i *)tap[t].weights );
+			//Top and bottom pixel of each column side by side, times their pair of weights.
+			acc = _mm_add_epi32( acc, _mm_madd_epi16( _mm_unpacklo_epi16( top, bottom ), _mm_shuffle_epi32( w, _MM_SHUFFLE( 0, 0, 0, 0 ) ) ) );
+			acc = _mm_add_epi32( acc, _mm_madd_epi16( _mm_unpackhi_epi16( top, bottom ), _mm_shuffle_epi32( w, _MM_SHUFFLE( 1, 1, 1, 1 ) ) ) );
+		}
+		acc = _mm_srai_epi32( acc, 12 );
+		acc = _mm_packs_epi32( acc, acc );
+		color[x] = (uint32_t)_mm_cvtsi128_si32( _mm_packus_epi16( acc, acc ) );
+	}
+#else
+	for ( uint32_t x = 0; x < m_iFBAlgoWidth; x++, tap += 4 )
+	{
+		int acc[4] = { 2048, 2048, 2048, 2048 };
+		for ( int t = 0; t < 4; t++ )
+		{
+			const uint8_t * p = frame + (size_t)tap[t].offset * 4;
+			const int16_t * w = tap[t].weights;
+			for ( int c = 0; c < 4; c++ )
+				acc[c] += p[c] * w[0] + p[stride + c] * w[1] + p[4 + c] * w[2] + p[stride + 4 + c] * w[3];
+		}
+		uint32_t out = 0;
+		for ( int c = 0; c < 4; c++ )
+		{
+			int v = acc[c] >> 12;
+			out |= (uint32_t)( v > 255 ? 255 : v ) << ( c * 8 );
+		}
+		color[x] = out;
+	}
+#endif
+
+	StereoGrayRow( color, &b.m_FBSides[eye][y * ( m_iFBAlgoWidth + NUM_DISP ) + NUM_DISP], m_iFBAlgoWidth, m_grayWeighting );
+}
+
+void StereoCore::RectifyDownsampleGray( const StereoFrame & frame, StereoFrameBuffers & b )
+{
+	StereoStageTimer timer( b.times.frontEnd );
+
+	SetFrame( frame, b );
+	int rows = (int)m_iFBAlgoHeight;
+	m_parallel.For( rows * 2, [this, &frame, &b, rows]( int begin, int end )
+	{
+		for ( int i = begin; i < end; i++ )
+			FrontEndRow( frame.pPixels, b, i / rows, i % rows );
+	} );
+}
+
+int StereoCore::GetMatchBandCount() const
+{
+	int iBands = m_iMatchBands;
+	if ( iBands > (int)m_iFBAlgoHeight / 8 ) iBands = m_iFBAlgoHeight / 8; //Keep bands tall enough to be worth their overlap.
+	return ( iBands < 1 ) ? 1 : iBands;
+}
+
+void StereoCore::Match( StereoFrameBuffers & b )
+{
+	StereoStageTimer timer( b.times.match );
+
+	int rows = (int)m_iFBAlgoHeight;
+	int w = (int)m_iFBAlgoWidth;
+	int stride = w + NUM_DISP;
+	int iBands = GetMatchBandCount();
+
+	int iAlgorithm = m_iRequestedAlgorithm;
+	StereoCensusSearch censusSearch = (StereoCensusSearch)(int)m_iRequestedCensusSearch;
+	int iChecks = m_iRequestedChecks;
+	int iSides = ( iChecks & STEREO_CHECK_LEFT_RIGHT ) ? 2 : 1;
+	if ( iAlgorithm != m_iAlgorithm || (int)m_matchBands.size() != iBands * iSides )
+	{
+		m_matchBands.resize( iBands * iSides );
+		for ( size_t i = 0; i < m_matchBands.size(); i++ )
+			m_matchBands[i].stereo = CreateMatcher( iAlgorithm );
+		m_iAlgorithm = iAlgorithm;
+	}
+
+	//The right to left pass is the same match on the eyes mirrored and swapped: the mirrored
+	//right eye's pixels are to the right of where they appear in the mirrored left eye, as the
+	//left eye's are in the right.  The real pixels go after the padding, as in m_FBSides.
+	if ( iSides == 2 )
+	{
+		m_parallel.For( rows, [this, &b, w, stride]( int begin, int end )
+		{
+			for ( int y = begin; y < end; y++ )
+			{
+				for ( int side = 0; side < 2; side++ )
+				{
+					const uint8_t * in = &b.m_FBSides[1 - side][y * stride + NUM_DISP];
+					uint8_t * out = &m_flippedGray[side][y * stride + NUM_DISP];
+					for ( int x = 0; x < w; x++ )
+						out[x] = in[w - 1 - x];
+				}
+			}
+		} );
+	}
+
+	//Each band matches its own rows plus the overlap, then keeps only its own rows.  With one band
+	//this is the whole image, as before.  The right to left pass's bands go in the same batch.
+	m_parallel.For( iBands * iSides, [this, &b, rows, w, stride, iBands, censusSearch]( int begin, int end )
+	{
+		for ( int job = begin; job < end; job++ )
+		{
+			MatchBand & mb = m_matchBands[job];
+			int band = job % iBands;
+			bool bRightToLeft = job >= iBands;
+			int y0 = rows * band / iBands;
+			int y1 = rows * ( band + 1 ) / iBands;
+			int in0 = ( y0 - m_iMatchOverlap > 0 ) ? y0 - m_iMatchOverlap : 0;
+			int in1 = ( y1 + m_iMatchOverlap < rows ) ? y1 + m_iMatchOverlap : rows;
+			std::vector< uint8_t > * pGray = bRightToLeft ? m_flippedGray : b.m_FBSides;
+			if ( mb.stereo )
+			{
+				cv::Mat left( rows, stride, CV_8U, &pGray[0][0] );
+				cv::Mat right( rows, stride, CV_8U, &pGray[1][0] );
+				mb.stereo->compute( left.rowRange( in0, in1 ), right.rowRange( in0, in1 ), mb.disparity );
+			}
+			else
+			{
+				mb.disparity.create( in1 - in0, stride, CV_16S );
+				mb.census.m_search = censusSearch;
+				mb.census.m_iSearchWindow = m_iCensusWindow;
+				mb.census.Compute( &pGray[0][in0 * stride], &pGray[1][in0 * stride], stride, stride, in1 - in0,
+					NUM_DISP, mb.disparity.ptr< int16_t >( 0 ), (int)( mb.disparity.step / sizeof( int16_t ) ) );
+			}
+
+			for ( int y = y0; y < y1; y++ )
+			{
+				const uint16_t * indata = mb.disparity.ptr< uint16_t >( y - in0 ) + NUM_DISP;
+				void * outdata = bRightToLeft ? (void*)&m_rightDisparity[y * w] : (void*)b.mdisparity.ptr< uint16_t >( y );
+				memcpy( outdata, indata, w * sizeof( uint16_t ) );
+			}
+		}
+	} );
+
+	if ( iSides == 2 )
+		CheckLeftRight( b );
+
+	if ( iChecks & STEREO_CHECK_CONFIDENCE )
+		RateTexture( b );
+	else
+		b.m_Confidence.clear();
+}
+
+//Drops the disparities the right to left pass doesn't agree with: occluded pixels, which only
+//one eye sees, and most of the mismatches on repeating or flat surfaces.
+void StereoCore::CheckLeftRight( StereoFrameBuffers & b )
+{
+	int w = (int)m_iFBAlgoWidth;
+	m_parallel.For( (int)m_iFBAlgoHeight, [this, &b, w]( int begin, int end )
+	{
+		for ( int y = begin; y < end; y++ )
+		{
+			uint16_t * pDisparity = &b.m_Disparity[y * w];
+			const int16_t * pRight = &m_rightDisparity[y * w];
+			for ( int x = 0; x < w; x++ )
+			{
+				int d = pDisparity[x];
+				if ( d == 0 || d >= 0xfff0 )
+					continue;
+				//Where this pixel is in the right eye, and so in the mirrored output.
+				int xr = x - ( d + 8 ) / 16;
+				int dr = ( xr >= 0 ) ? pRight[w - 1 - xr] : -16;
+				if ( dr <= 0 || abs( d - dr ) > m_iLeftRightTolerance )
+					pDisparity[x] = 0xfff0;
+			}
+		}
+	} );
+}
+
+Vector4 StereoCore::TransformToRectifiedSpace( float x, float y, int disp ) const
+{
+	float fDisp = ( float ) disp / 16.f; //  16-bit fixed-point disparity map (where each disparity value has 4 fractional bits)
+	float lz = m_Q[11] * m_CameraDistanceMeters / ( fDisp * MOGRIFY_X );
+	float ly = -(y * MOGRIFY_Y + m_Q[7]) / m_Q[11];
+	float lx = (x * MOGRIFY_X + m_Q[3]) / m_Q[11];
+	lx *= lz;
+	ly *= lz;
+	lz *= -1;
+	return Vector4( lx, ly, lz, 1.0 );
+}
+
+Vector4 StereoCore::TransformToLocalSpace( float x, float y, int disp ) const
+{
+	return m_R1inv * TransformToRectifiedSpace( x, y, disp );
+}
+
+Vector4 StereoCore::TransformToWorldSpace( const StereoFrameBuffers & b, float x, float y, int disp ) const
+{
+	int ix = (int)x, iy = (int)y;
+	Vector3 ray = b.worldRayRows[iy] + b.worldRayColumns[ix] + b.worldRayStepX * ( x - ix ) + b.worldRayStepY * ( y - iy );
+	Vector3 p = b.worldFromRectified.getTranslation() + ray * m_depthFromDisparity[disp & 0xffff];
+	return Vector4( p.x, p.y, p.z, 1.0 );
+}
+
+//Sliding box sum along one row, zero outside it, divided by the full window so that confidence
+//fades towards the edges.  Sums are kept in double so adding and removing doesn't drift.
+static void BoxBlurRow( const float * in, float * out, int n, int r )
+{
+	double scale = 1.0 / ( 2 * r + 1 );
+	double sum = 0;
+	for ( int x = 0; x <= r && x < n; x++ )
+		sum += in[x];
+	for ( int x = 0; x < n; x++ )
+	{
+		out[x] = (float)( sum * scale );
+		if ( x + r + 1 < n ) sum += in[x + r + 1];
+		if ( x - r >= 0 ) sum -= in[x - r];
+	}
+}
+
+//The same down the columns, for output rows [y0, y1).  Runs along rows with a strip of column
+//sums, so it reads memory in order and any band of rows can be done on its own.
+static void BoxBlurColumns( const float * in, float * out, int w, int h, int r, int y0, int y1 )
+{
+	const int STRIP = 64;
+	double scale = 1.0 / ( 2 * r + 1 );
+	double sums[STRIP];
+	for ( int x0 = 0; x0 < w; x0 += STRIP )
+	{
+		int n = ( w - x0 < STRIP ) ? w - x0 : STRIP;
+		for ( int x = 0; x < n; x++ ) sums[x] = 0;
+		for ( int y = y0 - r; y <= y0 + r; y++ )
+		{
+			if ( y < 0 || y >= h ) continue;
+			const float * row = in + y * w + x0;
+			for ( int x = 0; x < n; x++ ) sums[x] += row[x];
+		}
+		for ( int y = y0; y < y1; y++ )
+		{
+			float * o = out + y * w + x0;
+			for ( int x = 0; x < n; x++ ) o[x] = (float)( sums[x] * scale );
+			if ( y + r + 1 < h )
+			{
+				const float * add = in + ( y + r + 1 ) * w + x0;
+				for ( int x = 0; x < n; x++ ) sums[x] += add[x];
+			}
+			if ( y - r >= 0 )
+			{
+				const float * sub = in + ( y - r ) * w + x0;
+				for ( int x = 0; x < n; x++ ) sums[x] -= sub[x];
+			}
+		}
+	}
+}
+
+//Rates each pixel by the mean horizontal gradient of the left eye over the blur's box around it.
+//Matching needs texture along the rows, and flat or vertically striped areas are where every
+//matcher guesses.
+void StereoCore::RateTexture( StereoFrameBuffers & b )
+{
+	int w = (int)m_iFBAlgoWidth;
+	int h = (int)m_iFBAlgoHeight;
+	int r = ( m_iBlurRadius < 1 ) ? 1 : m_iBlurRadius;
+	int stride = w + NUM_DISP;
+	float scale = 255.0f / ( m_fTextureForFullConfidence > 0 ? m_fTextureForFullConfidence : 1 );
+	b.m_Confidence.resize( w * h );
+
+	//Gradients into scratch 1, blurred along the rows into scratch 0.
+	m_parallel.For( h, [&]( int begin, int end )
+	{
+		for ( int y = begin; y < end; y++ )
+		{
+			const uint8_t * gray = &b.m_FBSides[0][y * stride + NUM_DISP];
+			float * gradient = &m_textureScratch[1][y * w];
+			gradient[0] = gradient[w - 1] = 0;
+			for ( int x = 1; x < w - 1; x++ )
+				gradient[x] = (float)abs( gray[x + 1] - gray[x - 1] );
+			BoxBlurRow( gradient, &m_textureScratch[0][y * w], w, r );
+		}
+	} );
+	m_parallel.For( h, [&]( int begin, int end )
+	{
+		BoxBlurColumns( &m_textureScratch[0][0], &m_textureScratch[1][0], w, h, r, begin, end );
+		for ( int i = begin * w; i < end * w; i++ )
+		{
+			float c = m_textureScratch[1][i] * scale;
+			b.m_Confidence[i] = (uint8_t)( c < 255 ? c : 255 );
+		}
+	} );
+}
+
+void StereoCore::BlurDepths( StereoFrameBuffers & b )
+{
+	//This does an actual blurring function.
+	StereoStageTimer timer( b.times.blur );
+
+	int w = (int)m_iFBAlgoWidth;
+	int h = (int)m_iFBAlgoHeight;
+	int r = ( m_iBlurRadius < 1 ) ? 1 : m_iBlurRadius;
+	uint16_t * pDisparity = &b.m_Disparity[0];
+	const uint8_t * pConfidence = b.m_Confidence.empty() ? 0 : &b.m_Confidence[0];
+
+	//Initialize the data for this frame
+	m_parallel.For( h, [&]( int begin, int end )
+	{
+		for ( int y = begin; y < end; y++ )
+		{
+			for ( int x = 0; x < w; x++ )
+			{
+				int idx = y * w + x;
+				uint16_t pxi = pDisparity[idx];
+				if ( pConfidence && pConfidence[idx] < m_iMinConfidence && pxi < 0xfff0 )
+				{
+					//Too little texture to believe, so it's a hole to fill like any other.
+					pDisparity[idx] = pxi = 0xfff0;
+				}
+				if ( pxi == 0 || pxi >= w * 16 )
+				{
+					//If we don't know the depth, then we just discard it.  We could handle that here.  Additionally,
+					//if we wanted, we could emit fake dots where we believe the floor to be.
+					//Right now, we do nothing.
+				}
+				else
+				{
+					//Weighted by confidence, so the blur leans on the well textured pixels.
+					float c = pConfidence ? pConfidence[idx] / 255.0f : 1.0f;
+					m_valids[idx] = c;
+					m_depths[idx] = pxi * c;
+				}
+
+				//Never trust the right side of the screen.
+				if ( x >= w - RIGHT_EDGE_NO_TRUST )
+				{
+					m_valids[idx] = 0;
+					m_depths[idx] = 0;
+				}
+			}
+		}
+	} );
+
+	//Normalized convolution: the confidence and the confidence weighted depth get the same blur,
+	//so depths / valids is a weighted average of the known depths around each hole.  A few box
+	//passes make a near gaussian, and each pass costs the same whatever the radius.
+	for ( int pass = 0; pass < m_iBlurPasses; pass++ )
+	{
+		m_parallel.For( h, [&]( int begin, int end )
+		{
+			for ( int y = begin; y < end; y++ )
+			{
+				BoxBlurRow( &m_valids[y * w], &m_blurScratch[0][y * w], w, r );
+				BoxBlurRow( &m_depths[y * w], &m_blurScratch[1][y * w], w, r );
+			}
+		} );
+		m_parallel.For( h, [&]( int begin, int end )
+		{
+			BoxBlurColumns( &m_blurScratch[0][0], &m_valids[0], w, h, r, begin, end );
+			BoxBlurColumns( &m_blurScratch[1][0], &m_depths[0], w, h, r, begin, end );
+		} );
+	}
+
+	m_parallel.For( h, [&]( int begin, int end )
+	{
+		for ( int y = begin; y < end; y++ )
+		{
+			for ( int x = 0; x < w; x++ )
+			{
+				int idx = y * w + x;
+				if ( x < 1 || x >= w - 1 )
+				{
+					//Must throw out edges.
+					pDisparity[idx] = 0xfff0;
+					continue;
+				}
+				uint16_t pxi = pDisparity[idx];
+				if ( pxi == 0 || pxi >= w * 16 )
+				{
+					if ( m_valids[idx] < .00005 )
+					{
+						m_valids[idx] = 0;
+						m_depths[idx] = 0;
+						pDisparity[idx] = 0xfff0;
+					}
+					else
+					{
+						pDisparity[idx] = (uint16_t)(m_depths[idx] / m_valids[idx]);
+					}
+				}
+				m_valids[idx] *= .9f;
+				m_depths[idx] *= .9f;
+			}
+		}
+	} );
+}
+
+//One row of Reproject, in each of its output formats.
+static void ReprojectRow( float * out, const uint16_t * pxin, const float * depths, const Vector3 * columns, Vector3 row, Vector3 origin,
+	const float * valids, uint32_t begin, uint32_t end )
+{
+	for ( uint32_t x = begin; x < end; x++ )
+	{
+		float depth = depths[pxin[x]];
+		out[x * 4 + 0] = origin.x + depth * ( row.x + columns[x].x );
+		out[x * 4 + 1] = origin.y + depth * ( row.y + columns[x].y );
+		out[x * 4 + 2] = origin.z + depth * ( row.z + columns[x].z );
+		out[x * 4 + 3] = ( pxin[x] >= 0xfff0 ) ? 0 : valids[x];
+	}
+}
+
+static void ReprojectRow( uint16_t * out, const uint16_t * pxin, const float * depths, const Vector3 * columns, Vector3 row, Vector3 origin,
+	const float * valids, uint32_t begin, uint32_t end )
+{
+	uint32_t x = begin;
+#if STEREO_HALF_F16C
+	//Four pixels at a time, each coordinate in its own register, then interleaved as halves.
+	__m128 rowX = _mm_set1_ps( row.x ), rowY = _mm_set1_ps( row.y ), rowZ = _mm_set1_ps( row.z );
+	__m128 originX = _mm_set1_ps( origin.x ), originY = _mm_set1_ps( origin.y ), originZ = _mm_set1_ps( origin.z );
+	for ( ; x + 4 <= end; x += 4 )
+	{
+		const Vector3 * c = &columns[x];
+		__m128 depth = _mm_setr_ps( depths[pxin[x]], depths[pxin[x + 1]], depths[pxin[x + 2]], depths[pxin[x + 3]] );
+		__m128 px = _mm_add_ps( originX, _mm_mul_ps( depth, _mm_add_ps( rowX, _mm_setr_ps( c[0].x, c[1].x, c[2].x, c[3].x ) ) ) );
+		__m128 py = _mm_add_ps( originY, _mm_mul_ps( depth, _mm_add_ps( rowY, _mm_setr_ps( c[0].y, c[1].y, c[2].y, c[3].y ) ) ) );
+		__m128 pz = _mm_add_ps( originZ, _mm_mul_ps( depth, _mm_add_ps( rowZ, _mm_setr_ps( c[0].z, c[1].z, c[2].z, c[3].z ) ) ) );
+		__m128i noDepth = _mm_cmpgt_epi32( _mm_setr_epi32( pxin[x], pxin[x + 1], pxin[x + 2], pxin[x + 3] ), _mm_set1_epi32( 0xffef ) );
+		__m128 pw = _mm_andnot_ps( _mm_castsi128_ps( noDepth ), _mm_loadu_ps( &valids[x] ) );
+
+		__m128i xy = FloatToHalf8( px, py ); //x0 x1 x2 x3 y0 y1 y2 y3
+		__m128i zw = FloatToHalf8( pz, pw );
+		xy = _mm_unpacklo_epi16( xy, _mm_srli_si128( xy, 8 ) );                 //x0 y0 x1 y1 ...
+		zw = _mm_unpacklo_epi16( zw, _mm_srli_si128( zw, 8 ) );
+		_mm_storeu_si128( (__m128i*)&out[x * 4], _mm_unpacklo_epi32( xy, zw ) );
+		_mm_storeu_si128( (__m128i*)&out[x * 4 + 8], _mm_unpackhi_epi32( xy, zw ) );
+	}
+#endif
+	for ( ; x < end; x++ )
+	{
+		float depth = depths[pxin[x]];
+		out[x * 4 + 0] = FloatToHalf( origin.x + depth * ( row.x + columns[x].x ) );
+		out[x * 4 + 1] = FloatToHalf( origin.y + depth * ( row.y + columns[x].y ) );
+		out[x * 4 + 2] = FloatToHalf( origin.z + depth * ( row.z + columns[x].z ) );
+		out[x * 4 + 3] = FloatToHalf( ( pxin[x] >= 0xfff0 ) ? 0 : valids[x] );
+	}
+}
+
+template< typename T > void StereoCore::ReprojectTo( StereoFrameBuffers & b, T * pPointsOut )
+{
+	StereoStageTimer timer( b.times.reproject );
+
+	//No depth is a NaN depth, which makes the whole point NaN without a branch.
+	Vector3 origin = b.worldFromRectified.getTranslation();
+	m_parallel.For( (int)m_iFBAlgoHeight, [this, &b, pPointsOut, origin]( int begin, int end )
+	{
+		for ( int y = begin; y < end; y++ )
+		{
+			ReprojectRow( &pPointsOut[y * m_iFBAlgoWidth * 4], &b.m_Disparity[y * m_iFBAlgoWidth], &m_depthFromDisparity[0], &b.worldRayColumns[0],
+				b.worldRayRows[y], origin, &m_valids[y * m_iFBAlgoWidth], IGNORE_EDGE_DATA_PIXELS, m_iFBAlgoWidth - IGNORE_EDGE_DATA_PIXELS );
+		}
+	} );
+}
+
+void StereoCore::Reproject( StereoFrameBuffers & b, float * pPointsOut )
+{
+	ReprojectTo( b, pPointsOut );
+}
+
+void StereoCore::Reproject( StereoFrameBuffers & b, uint16_t * pHalfPointsOut )
+{
+	ReprojectTo( b, pHalfPointsOut );
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+// The stereo depth pipeline (rectify, downsample, gray, SGBM, blur, reproject) with no GL or
+// OpenVR dependency, so it can run from recorded frames on a machine without a headset.
+// OpenCVProcess drives it from the live camera; stereo_bench.cpp drives it from a recording.
+
+#include "opencv2/core.hpp"
+#include "opencv2/calib3d.hpp"
+#include "shared/Matrices.h"
+#include "stereo_census.h"
+#include "stereo_gray.h"
+#include "stereo_parallel.h"
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#define NUM_DISP 96 //Max disparity.
+
+//Algorithms for StereoCore::SetAlgorithm.  0 .. 2 are SGBM presets.
+#define STEREO_ALGORITHM_CENSUS 3 //StereoCensusMatcher.
+#define STEREO_ALGORITHMS 4
+
+//Checks for StereoCore::SetChecks, or'd together.
+#define STEREO_CHECK_LEFT_RIGHT 1 //Also match right to left, and drop disparities the two passes disagree on.
+#define STEREO_CHECK_CONFIDENCE 2 //Rate each pixel by how much texture there is to match on.
+
+//Default for StereoCore::m_iMatchBands.  Fixed rather than one per thread, so the disparities
+//come out the same on every machine.
+#define STEREO_MATCH_BANDS 4
+
+#define MOGRIFY_X 4
+#define MOGRIFY_Y 4
+#define IGNORE_EDGE_DATA_PIXELS 4
+
+#define STEREO_MAX_DISTORTION_PARAMETERS 8 // vr::k_unMaxDistortionFunctionParameters
+
+//Everything the pipeline needs to know about the camera pair.
+struct StereoCalibration
+{
+	struct { float fx, cx, fy, cy; } intrinsics[2];
+	double distortion[2][STEREO_MAX_DISTORTION_PARAMETERS]; //Fisheye uses the first 4 of each.
+	Matrix4 headFromCamera[2];
+	uint32_t frameWidth;  //Both eyes, side by side.
+	uint32_t frameHeight;
+	bool fisheye;
+};
+
+//One side-by-side RGBA camera frame, left eye first, rows tightly packed.
+struct StereoFrame
+{
+	const uint8_t * pPixels;
+	uint32_t width;
+	uint32_t height;
+	Matrix4 worldFromHead;
+	double timestamp;
+	uint32_t sequence;
+};
+
+//Where frames come from: the live tracked camera, or a recording on disk.
+class StereoFrameSource
+{
+public:
+	virtual ~StereoFrameSource() {}
+	virtual bool GetCalibration( StereoCalibration & calib ) = 0;
+	//Frame pixels stay valid until the next call.  Returns false when no frame is available.
+	virtual bool NextFrame( StereoFrame & frame ) = 0;
+};
+
+//Seconds spent in each stage for the most recent frame.
+struct StereoStageTimes
+{
+	double rectify;
+	double downsample;
+	double gray;
+	double frontEnd; //Rectify, downsample and gray in one pass.
+	double match;
+	double blur;
+	double reproject;
+};
+
+//One bilinear sample of the distorted frame, prescaled by its share of the output pixel.
+//The weights are for the top left, bottom left, top right and bottom right pixels, in that
+//order, and add up to 4096 over the 4 taps of an output pixel.
+struct StereoFrontEndTap
+{
+	int32_t offset; //Top left pixel, counted from the start of the side-by-side frame.
+	int16_t weights[4];
+};
+
+//Everything the stages produce for one frame.  StereoCore keeps nothing per frame except the
+//blur's confidence, so a few of these let consecutive frames be in different stages at once
+//(see StereoPipeline).  StereoCore::InitBuffers sizes them.
+struct StereoFrameBuffers
+{
+	StereoFrameBuffers();
+
+	uint32_t sequence;
+	double timestamp;
+	Matrix4 worldFromHead;
+	Matrix3x4 worldFromRectified; // worldFromHead * m_R1inv, so each pixel only needs one transform
+	//StereoCore's rays turned by this frame's pose: pixel x, y at depth z is at worldFromHead's
+	//translation + z * ( worldRayRows[y] + worldRayColumns[x] ).  The steps are per pixel, for
+	//positions in between.
+	std::vector< Vector3 > worldRayColumns, worldRayRows;
+	Vector3 worldRayStepX, worldRayStepY;
+	StereoStageTimes times;
+	int userFlags; //Not used by StereoCore; lets whoever runs the stages pass things along with the frame.
+
+	//Algorithm sized buffers.
+	std::vector< uint8_t > m_FBSides[2];         //Gray, with NUM_DISP pixels of left padding per row.
+	std::vector< uint32_t > m_FBSidesColor[2];   //RGBA.
+	std::vector< uint16_t > m_Disparity;         //16ths of a pixel, 0xfff0 and up for no depth.
+	std::vector< uint8_t > m_Confidence;         //0 .. 255 per pixel with STEREO_CHECK_CONFIDENCE, otherwise empty.
+
+	//Matrices used in the stereo computation.  The orig ones point at the frame's pixels, so they
+	//are only good for as long as the frame is (KeepOriginal copies them).
+	cv::Mat origStereoPair;
+	cv::Mat origLeft;
+	cv::Mat origRight;
+	cv::Mat rectLeft;
+	cv::Mat rectRight;
+	cv::Mat resizedLeftGray;
+	cv::Mat resizedRightGray;
+	cv::Mat resizedLeft;
+	cv::Mat resizedRight;
+	cv::Mat mdisparity;
+};
+
+class StereoCore
+{
+public:
+	StereoCore();
+
+	bool Init( const StereoCalibration & calib );
+	void InitBuffers( StereoFrameBuffers & b ) const;
+	//0 .. STEREO_ALGORITHMS - 1, anything else wraps to 0.  Safe from any thread; the next Match picks it up.
+	void SetAlgorithm( int iAlgorithm );
+	int GetAlgorithm() const { return m_iRequestedAlgorithm; }
+	//How STEREO_ALGORITHM_CENSUS narrows its search, see StereoCensusSearch.  Out of range wraps
+	//to STEREO_CENSUS_FULL.  Safe from any thread, like SetAlgorithm.
+	void SetCensusSearch( int iSearch );
+	int GetCensusSearch() const { return m_iRequestedCensusSearch; }
+	//STEREO_CHECK_ flags for Match.  Safe from any thread, like SetAlgorithm.
+	void SetChecks( int iChecks ) { m_iRequestedChecks = iChecks & ( STEREO_CHECK_LEFT_RIGHT | STEREO_CHECK_CONFIDENCE ); }
+	int GetChecks() const { return m_iRequestedChecks; }
+
+	//Runs every stage on one frame.  pPointsOut takes 4 floats per algorithm pixel, see Reproject.
+	void Process( const StereoFrame & frame, StereoFrameBuffers & b, float * pPointsOut );
+
+	//The stages, in pipeline order.  The live app runs them one at a time so it can emit dots
+	//from the raw disparity before it is blurred.  Different stages may run on different threads
+	//at once as long as each has its own buffers; BlurDepths has to see the frames in order.
+	//
+	//RectifyDownsampleGray fills the algorithm sized color and gray buffers straight from the
+	//distorted frame, sampling only the pixels the downsample would have used.  Rectify, Downsample
+	//and ConvertToGray are the full resolution reference for it, and also fill rectLeft/rectRight.
+	void RectifyDownsampleGray( const StereoFrame & frame, StereoFrameBuffers & b );
+	void Rectify( const StereoFrame & frame, StereoFrameBuffers & b );
+	void Downsample( StereoFrameBuffers & b );
+	void ConvertToGray( StereoFrameBuffers & b );
+	void Match( StereoFrameBuffers & b );
+	void BlurDepths( StereoFrameBuffers & b );
+	//World space xyz and confidence per algorithm pixel, NaN where there is no depth.  The edge
+	//columns (IGNORE_EDGE_DATA_PIXELS) are left untouched.
+	void Reproject( StereoFrameBuffers & b, float * pPointsOut );
+	//The same as half floats (see stereo_half.h), 4 per algorithm pixel, for the depth mesh.
+	void Reproject( StereoFrameBuffers & b, uint16_t * pHalfPointsOut );
+
+	//Full resolution rectified image of one eye of the current frame, into rectLeft or rectRight,
+	//for display.  Not needed for depth.
+	void RectifyForDisplay( StereoFrameBuffers & b, int eye );
+	//Copies the original frame into b, so origLeft/origRight outlive the frame.
+	void KeepOriginal( StereoFrameBuffers & b ) const;
+
+	//From the ray tables and the depth table; x and y in [0, algo size).
+	Vector4 TransformToWorldSpace( const StereoFrameBuffers & b, float x, float y, int disp ) const;
+	//The direct formulas from m_Q, which the tables are made from.
+	Vector4 TransformToLocalSpace( float x, float y, int disp ) const;
+	Vector4 TransformToRectifiedSpace( float x, float y, int disp ) const;
+
+	bool m_bFusedFrontEnd; //Process uses RectifyDownsampleGray rather than the three reference stages.
+	StereoGrayWeighting m_grayWeighting; //How the gray images the matcher sees are made from RGB.
+	//Match splits the image into this many horizontal bands and runs SGBM on them at once, as
+	//many at a time as there are threads in the pool.  Each band also sees m_iMatchOverlap rows
+	//above and below it, so the paths SGBM aggregates along can settle before they reach the
+	//band's own rows.  The bands change the result slightly, so this doesn't follow the core count.
+	int m_iMatchBands;
+	int m_iMatchOverlap;
+	int GetMatchBandCount() const; //What Match actually uses.
+	int m_iCensusWindow; //Disparities the census matcher searches per pixel when it narrows its search.
+	//STEREO_CHECK_LEFT_RIGHT keeps a disparity if the right image's disparity where it lands is
+	//within this many 16ths of a pixel of it.
+	int m_iLeftRightTolerance;
+	//STEREO_CHECK_CONFIDENCE: the mean horizontal gradient, over the blur's box around a pixel,
+	//that counts as fully textured.  Pixels rated below m_iMinConfidence are treated as holes by
+	//BlurDepths, and shouldn't get dots; the rest count for their confidence in the blur.
+	float m_fTextureForFullConfidence;
+	int m_iMinConfidence;
+	//BlurDepths fills holes with box passes of this radius.  3 passes of radius 2 spread about as
+	//far as the 10 rounds of 3x3 it replaced, and the time doesn't depend on the radius.
+	int m_iBlurRadius;
+	int m_iBlurPasses;
+
+	uint32_t m_iFBSideWidth;
+	uint32_t m_iFBSideHeight;
+	uint32_t m_iFBAlgoWidth;
+	uint32_t m_iFBAlgoHeight;
+
+	Vector4 m_centerFromLeftEye;
+	float m_CameraDistanceMeters;
+	Matrix4 m_R1, m_R1inv, m_Q;
+
+	//Disparity to world space, split up so that it's one multiply-add per component.  The ray
+	//through an algorithm pixel at unit depth, already turned by m_R1inv, is the sum of a row's
+	//part and a column's part, and the depth for each 16-bit disparity is looked up.
+	std::vector< Vector3 > m_localRayColumns, m_localRayRows;
+	Vector3 m_localRayStepX, m_localRayStepY;
+	std::vector< float > m_depthFromDisparity; //All 65536 disparities: NaN from 0xfff0 up.
+
+	//The blur's state, carried from frame to frame.
+	std::vector< float > m_valids;               //Confidence.
+	std::vector< float > m_depths;               //Disparity times confidence.
+
+private:
+	void SetFrame( const StereoFrame & frame, StereoFrameBuffers & b ) const;
+	void BuildFrontEndTaps( int eye, const cv::Mat & map1, const cv::Mat & map2 );
+	void FrontEndRow( const uint8_t * pFrame, StereoFrameBuffers & b, int eye, int y );
+	void RemapRows( const cv::Mat & src, cv::Mat & dst, int eye, int begin, int end );
+	void CheckLeftRight( StereoFrameBuffers & b );
+	void RateTexture( StereoFrameBuffers & b );
+	void BuildRayTables();
+	template< typename T > void ReprojectTo( StereoFrameBuffers & b, T * pPointsOut );
+
+	//One horizontal band of Match, of one of the two passes.  The matchers keep scratch memory,
+	//and the census one its previous frame, so each band and pass has its own.
+	struct MatchBand
+	{
+		cv::Ptr< cv::StereoSGBM > stereo; //0 for STEREO_ALGORITHM_CENSUS.
+		StereoCensusMatcher census;
+		cv::Mat disparity;                //The band and its overlap rows, with the NUM_DISP padding columns.
+	};
+
+	StereoParallel m_parallel;
+	std::vector< StereoFrontEndTap > m_frontEndTaps[2]; //4 per algorithm pixel.
+	std::vector< float > m_blurScratch[2];              //Valids and depths between the row and column passes.
+	cv::Mat m_leftMap1, m_leftMap2, m_rightMap1, m_rightMap2;
+	cv::Mat m_cvQ;
+	std::vector< MatchBand > m_matchBands;              //Only touched by Match.  The right to left pass's bands follow the left's.
+	std::vector< uint8_t > m_flippedGray[2];            //The right to left pass's input: each eye mirrored, and the eyes swapped.
+	std::vector< int16_t > m_rightDisparity;            //Its output, mirrored, algorithm sized.
+	std::vector< float > m_textureScratch[2];          //RateTexture's, apart from m_blurScratch as Match and BlurDepths can overlap.
+	int m_iAlgorithm;                                   //What m_matchBands' matchers were made for.
+	std::atomic< int > m_iRequestedAlgorithm;
+	std::atomic< int > m_iRequestedCensusSearch;
+	std::atomic< int > m_iRequestedChecks;
+};
@@ -0,0 +1,200 @@
+// Times the app's dot emission (StereoDotEmitter) against the loop it replaced, which called
+// rand() for every pixel, transformed each dot on its own and wrote it into the point ring one at a
+// time.  Both write into a ring the size of the app's.
+//
+// Every frame of a recording is matched once, then each emitter goes over all of them several
+// times.  This reports points per millisecond for each, and how many dots each made per frame,
+// which should agree to within the randomness.
+//
+//   g++ -O2 -pthread -I.. -I. stereo_dot_bench.cpp stereo_dots.cpp stereo_census.cpp stereo_core.cpp stereo_gray.cpp
+//       stereo_parallel.cpp stereo_recording.cpp ../shared/Matrices.cpp `pkg-config --cflags --libs opencv4` -o stereo_dot_bench
+//
+// Usage: stereo_dot_bench <manifest> [passes] [--algorithm=N] [--every=N] [--importance=F]
+//   --every=       the app's iAntEvery: a pixel emits once in about this many frames
+//   --importance=  the app's fImportanceOfDist, which makes far pixels emit less
+
+#include "stereo_core.h"
+#include "stereo_dots.h"
+#include "stereo_recording.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define RING_DOTS ( 65536 * 2 )
+
+static double Now()
+{
+	return std::chrono::duration< double >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+//The point ring, as CameraApp keeps it.
+struct DotRing
+{
+	std::vector< float > data;
+	int place;
+
+	DotRing() : data( RING_DOTS * 8, 0.0f ), place( 0 ) { }
+
+	void Emit( float x, float y, float z, float w, float r, float g, float b, float a )
+	{
+		place++;
+		if ( place == RING_DOTS ) place = 0;
+		float * d = &data[place * 8];
+		d[0] = x; d[1] = y; d[2] = z; d[3] = w;
+		d[4] = r; d[5] = g; d[6] = b; d[7] = a;
+	}
+
+	void Emit( const StereoDot * pDots, int iCount )
+	{
+		while ( iCount > 0 )
+		{
+			int start = ( place + 1 == RING_DOTS ) ? 0 : place + 1;
+			int n = ( iCount < RING_DOTS - start ) ? iCount : RING_DOTS - start;
+			memcpy( &data[start * 8], pDots, n * sizeof( StereoDot ) );
+			place = start + n - 1;
+			pDots += n;
+			iCount -= n;
+		}
+	}
+};
+
+//The emission loop as OpenCVAppOutput had it.  Returns the number of dots.
+static int EmitWithRand( const StereoCore & core, const StereoFrameBuffers & b, int iAntEvery, float fImportanceOfDist, float fTime, DotRing & ring )
+{
+	int iDots = 0;
+	const uint8_t * pConfidence = b.m_Confidence.empty() ? 0 : &b.m_Confidence[0];
+	for ( unsigned y = 0; y < core.m_iFBAlgoHeight; y++ )
+	{
+		const uint16_t * pxin = &b.m_Disparity[y * core.m_iFBAlgoWidth];
+		for ( unsigned x = IGNORE_EDGE_DATA_PIXELS; x < core.m_iFBAlgoWidth - IGNORE_EDGE_DATA_PIXELS; x++ )
+		{
+			uint32_t pxc = pxin[x];
+			int conf = pConfidence ? pConfidence[x + y * core.m_iFBAlgoWidth] : 255;
+			uint32_t pxo = b.m_FBSidesColor[0][x + y * core.m_iFBAlgoWidth];
+			if ( pxc < 0xfff0 && pxc != 0 && conf >= core.m_iMinConfidence && conf > 0 )
+			{
+				float frx = x + ( rand() % 1000 ) / 1000.0f;
+				float fry = y + ( rand() % 1000 ) / 1000.0f;
+				Vector4 Worldspace = core.TransformToWorldSpace( b, frx, fry, pxc );
+				int emitevery = (int)( iAntEvery + fImportanceOfDist * 200 / pxc );
+				if ( emitevery < 1 ) emitevery = 1;
+				emitevery = emitevery * 255 / conf;
+				if ( 0 == ( rand() % emitevery ) )
+				{
+					ring.Emit( Worldspace.x, Worldspace.y, Worldspace.z, 1,
+						( pxo & 0xff ) / 255.0f, ( ( pxo >> 8 ) & 0xff ) / 255.0f, ( ( pxo >> 16 ) & 0xff ) / 255.0f, (float)( fTime + rand() * 10.0 / RAND_MAX ) );
+					iDots++;
+				}
+			}
+		}
+	}
+	return iDots;
+}
+
+int main( int argc, char ** argv )
+{
+	if ( argc < 2 )
+	{
+		fprintf( stderr, "Usage: %s <manifest> [passes] [--algorithm=N] [--every=N] [--importance=F]\n", argv[0] );
+		return 1;
+	}
+	int iPasses = 20;
+	int iAlgorithm = 0;
+	int iAntEvery = 5;
+	float fImportanceOfDist = 0;
+	for ( int i = 2; i < argc; i++ )
+	{
+		if ( strncmp( argv[i], "--algorithm=", 12 ) == 0 ) iAlgorithm = atoi( argv[i] + 12 );
+		else if ( strncmp( argv[i], "--every=", 8 ) == 0 ) iAntEvery = atoi( argv[i] + 8 );
+		else if ( strncmp( argv[i], "--importance=", 13 ) == 0 ) fImportanceOfDist = (float)atof( argv[i] + 13 );
+		else iPasses = atoi( argv[i] );
+	}
+	if ( iPasses < 1 ) iPasses = 1;
+
+	StereoRecordingSource source;
+	StereoCalibration calib;
+	if ( !source.Open( argv[1] ) || !source.GetCalibration( calib ) )
+	{
+		fprintf( stderr, "Could not read recording %s\n", argv[1] );
+		return 1;
+	}
+
+	StereoCore core;
+	core.SetAlgorithm( iAlgorithm );
+	if ( !core.Init( calib ) )
+	{
+		fprintf( stderr, "Could not set up the stereo pipeline for %ux%u frames\n", calib.frameWidth, calib.frameHeight );
+		return 1;
+	}
+
+	//Each frame's buffers, matched once.  Never moved, as their cv::Mats point into them.
+	std::vector< std::unique_ptr< StereoFrameBuffers > > frames;
+	StereoFrame frame;
+	while ( source.NextFrame( frame ) )
+	{
+		frames.push_back( std::unique_ptr< StereoFrameBuffers >( new StereoFrameBuffers ) );
+		StereoFrameBuffers & b = *frames.back();
+		core.InitBuffers( b );
+		core.RectifyDownsampleGray( frame, b );
+		core.Match( b );
+	}
+	if ( frames.empty() )
+	{
+		fprintf( stderr, "%s has no frames\n", argv[1] );
+		return 1;
+	}
+	printf( "%s: %u frames, %ux%u disparity, algorithm %d, every %d, importance %.2f\n", argv[1], (unsigned)frames.size(),
+		core.m_iFBAlgoWidth, core.m_iFBAlgoHeight, core.GetAlgorithm(), iAntEvery, fImportanceOfDist );
+
+	DotRing ring;
+	StereoDotEmitter emitter;
+	emitter.m_iAntEvery = iAntEvery;
+	emitter.m_fImportanceOfDist = fImportanceOfDist;
+	std::vector< StereoDot > dots;
+
+	//Interleaved, so both see the same machine load, and best of the passes.
+	double best[2] = { 1e30, 1e30 };
+	uint64_t counts[2] = { 0, 0 };
+	for ( int pass = 0; pass < iPasses; pass++ )
+	{
+		for ( int which = 0; which < 2; which++ )
+		{
+			uint64_t iDots = 0;
+			double start = Now();
+			for ( size_t i = 0; i < frames.size(); i++ )
+			{
+				if ( which == 0 )
+				{
+					iDots += EmitWithRand( core, *frames[i], iAntEvery, fImportanceOfDist, (float)i, ring );
+				}
+				else
+				{
+					emitter.Emit( core, *frames[i], (float)i, dots );
+					ring.Emit( dots.empty() ? 0 : &dots[0], (int)dots.size() );
+					iDots += dots.size();
+				}
+			}
+			double t = Now() - start;
+			if ( t < best[which] ) best[which] = t;
+			counts[which] += iDots;
+		}
+	}
+
+	static const char * names[2] = { "rand() loop", "StereoDotEmitter" };
+	double pointsPerMs[2];
+	printf( "\n%18s %12s %12s %14s\n", "emitter", "ms / frame", "dots / frame", "points / ms" );
+	for ( int which = 0; which < 2; which++ )
+	{
+		double perFrame = best[which] / frames.size() * 1000.0;
+		double dotsPerFrame = (double)counts[which] / iPasses / frames.size();
+		pointsPerMs[which] = dotsPerFrame / perFrame;
+		printf( "%18s %12.3f %12.1f %14.0f\n", names[which], perFrame, dotsPerFrame, pointsPerMs[which] );
+	}
+	printf( "\n%.2fx the points per millisecond\n", pointsPerMs[1] / pointsPerMs[0] );
+	return 0;
+}
@@ -0,0 +1,138 @@
+#include "stereo_dots.h"
+
+#if !defined( STEREO_SIMD_DISABLE ) && ( defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 ) )
+#define STEREO_DOTS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+StereoDotEmitter::StereoDotEmitter( uint32_t seed ) :
+	  m_iAntEvery( 5 )
+	, m_fImportanceOfDist( 0 )
+	, m_rng( seed ? seed : 1 ) //xorshift never leaves 0.
+	, m_iThresholdsEvery( 0 )
+	, m_fThresholdsImportance( 0 )
+{
+}
+
+void StereoDotEmitter::Emit( const StereoCore & core, const StereoFrameBuffers & b, float fTime, std::vector< StereoDot > & dots )
+{
+	if ( m_thresholds.empty() || m_iThresholdsEvery != m_iAntEvery || m_fThresholdsImportance != m_fImportanceOfDist )
+	{
+		//Disparity 0 would be infinitely far away, and 0xfff0 up is no disparity, so those never emit.
+		m_thresholds.assign( 0x10000, 0 );
+		for ( int d = 1; d < 0xfff0; d++ )
+		{
+			int emitevery = (int)( m_iAntEvery + m_fImportanceOfDist * 200 / d );
+			if ( emitevery < 1 ) emitevery = 1;
+			double threshold = 4294967296.0 / emitevery;
+			m_thresholds[d] = ( threshold < 4294967295.0 ) ? (uint32_t)threshold : 0xffffffff;
+		}
+		m_iThresholdsEvery = m_iAntEvery;
+		m_fThresholdsImportance = m_fImportanceOfDist;
+	}
+
+	size_t w = core.m_iFBAlgoWidth;
+	m_rayX.resize( w );
+	m_rayY.resize( w );
+	m_rayZ.resize( w );
+	m_depth.resize( w );
+	m_color.resize( w );
+
+	dots.clear();
+	for ( int y = 0; y < (int)core.m_iFBAlgoHeight; y++ )
+		EmitRow( core, b, y, fTime, dots );
+}
+
+void StereoDotEmitter::EmitRow( const StereoCore & core, const StereoFrameBuffers & b, int y, float fTime, std::vector< StereoDot > & dots )
+{
+	int w = (int)core.m_iFBAlgoWidth;
+	const uint16_t * pxin = &b.m_Disparity[y * w];
+	const uint8_t * confidence = b.m_Confidence.empty() ? 0 : &b.m_Confidence[y * w];
+	const uint32_t * color = &b.m_FBSidesColor[0][y * w];
+	const Vector3 * columns = &b.worldRayColumns[0];
+	const Vector3 & row = b.worldRayRows[y];
+	const Vector3 & stepX = b.worldRayStepX;
+	const Vector3 & stepY = b.worldRayStepY;
+
+	//Pick the pixels, and gather their rays and depths.
+	int n = 0;
+	for ( int x = IGNORE_EDGE_DATA_PIXELS; x < w - IGNORE_EDGE_DATA_PIXELS; x++ )
+	{
+		uint32_t threshold = m_thresholds[pxin[x]];
+		if ( threshold == 0 )
+			continue;
+		if ( confidence )
+		{
+			if ( confidence[x] < core.m_iMinConfidence )
+				continue;
+			threshold = (uint32_t)( ( (uint64_t)threshold * confidence[x] * 257 ) >> 16 ); //* confidence / 255
+		}
+		if ( Next() >= threshold )
+			continue;
+
+		float fx = NextUnit(), fy = NextUnit();
+		m_rayX[n] = row.x + columns[x].x + stepX.x * fx + stepY.x * fy;
+		m_rayY[n] = row.y + columns[x].y + stepX.y * fx + stepY.y * fy;
+		m_rayZ[n] = row.z + columns[x].z + stepX.z * fx + stepY.z * fy;
+		m_depth[n] = core.m_depthFromDisparity[pxin[x]];
+		m_color[n] = color[x];
+		n++;
+	}
+	if ( n == 0 )
+		return;
+
+	size_t base = dots.size();
+	dots.resize( base + n );
+	StereoDot * out = &dots[base];
+	Vector3 origin = b.worldFromRectified.getTranslation();
+	const float toUnit = 1.0f / 255.0f;
+	int i = 0;
+
+#if STEREO_DOTS_SSE2
+	const __m128 ox = _mm_set1_ps( origin.x ), oy = _mm_set1_ps( origin.y ), oz = _mm_set1_ps( origin.z );
+	const __m128 scale = _mm_set1_ps( toUnit );
+	const __m128i byte = _mm_set1_epi32( 0xff );
+	for ( ; i + 4 <= n; i += 4 )
+	{
+		__m128 depth = _mm_loadu_ps( &m_depth[i] );
+		__m128 px = _mm_add_ps( ox, _mm_mul_ps( depth, _mm_loadu_ps( &m_rayX[i] ) ) );
+		__m128 py = _mm_add_ps( oy, _mm_mul_ps( depth, _mm_loadu_ps( &m_rayY[i] ) ) );
+		__m128 pz = _mm_add_ps( oz, _mm_mul_ps( depth, _mm_loadu_ps( &m_rayZ[i] ) ) );
+		__m128 pw = _mm_set1_ps( 1.0f );
+
+		__m128i c = _mm_loadu_si128( (const __m128i *)&m_color[i] );
+		__m128 cr = _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( c, byte ) ), scale );
+		__m128 cg = _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( c, 8 ), byte ) ), scale );
+		__m128 cb = _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( c, 16 ), byte ) ), scale );
+		float a[4];
+		for ( int k = 0; k < 4; k++ )
+			a[k] = fTime + NextUnit() * 10.0f;
+		__m128 ca = _mm_loadu_ps( a );
+
+		//Four points' components to four whole records.
+		_MM_TRANSPOSE4_PS( px, py, pz, pw );
+		_MM_TRANSPOSE4_PS( cr, cg, cb, ca );
+		_mm_storeu_ps( &out[i + 0].x, px );
+		_mm_storeu_ps( &out[i + 0].r, cr );
+		_mm_storeu_ps( &out[i + 1].x, py );
+		_mm_storeu_ps( &out[i + 1].r, cg );
+		_mm_storeu_ps( &out[i + 2].x, pz );
+		_mm_storeu_ps( &out[i + 2].r, cb );
+		_mm_storeu_ps( &out[i + 3].x, pw );
+		_mm_storeu_ps( &out[i + 3].r, ca );
+	}
+#endif
+
+	for ( ; i < n; i++ )
+	{
+		StereoDot & d = out[i];
+		d.x = origin.x + m_depth[i] * m_rayX[i];
+		d.y = origin.y + m_depth[i] * m_rayY[i];
+		d.z = origin.z + m_depth[i] * m_rayZ[i];
+		d.w = 1.0f;
+		d.r = ( ( m_color[i] >> 0 ) & 0xff ) * toUnit;
+		d.g = ( ( m_color[i] >> 8 ) & 0xff ) * toUnit;
+		d.b = ( ( m_color[i] >> 16 ) & 0xff ) * toUnit;
+		d.a = fTime + NextUnit() * 10.0f;
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// Picks which of a frame's pixels become dots in the app's point cloud, and where they go.
+//
+// A pixel with a disparity d emits with probability 1 / ( m_iAntEvery + m_fImportanceOfDist * 200 / d ),
+// scaled by its confidence when the frame has a confidence map, at a random spot inside the
+// pixel.  The probability only depends on d, so it's a table of 32 bit thresholds, remade when the
+// settings change, and each pixel costs one random number and a compare.  The random numbers come
+// from a xorshift generator the emitter owns rather than rand(), which some C libraries lock, so
+// give each thread that emits its own emitter.
+//
+// The pixels a row accepts are put through StereoCore's ray tables together, four at a time with
+// SSE, and come out as whole dot records ready for StereoPointRing::Push.  Define
+// STEREO_SIMD_DISABLE to build only the scalar code.
+
+#include "stereo_core.h"
+#include "stereo_point_ring.h"
+#include <stdint.h>
+#include <vector>
+
+class StereoDotEmitter
+{
+public:
+	StereoDotEmitter( uint32_t seed = 0x9e3779b9 );
+
+	//Replaces dots with frame b's.  Each dot's a is fTime plus 0 .. 10 at random.
+	void Emit( const StereoCore & core, const StereoFrameBuffers & b, float fTime, std::vector< StereoDot > & dots );
+
+	int m_iAntEvery;
+	float m_fImportanceOfDist;
+
+private:
+	uint32_t Next()
+	{
+		m_rng ^= m_rng << 13;
+		m_rng ^= m_rng >> 17;
+		m_rng ^= m_rng << 5;
+		return m_rng;
+	}
+	float NextUnit() { return ( Next() >> 8 ) * ( 1.0f / 16777216.0f ); } //[0, 1)
+	void EmitRow( const StereoCore & core, const StereoFrameBuffers & b, int y, float fTime, std::vector< StereoDot > & dots );
+
+	uint32_t m_rng;
+	std::vector< uint32_t > m_thresholds;                   //Per disparity: emit if Next() < this.
+	int m_iThresholdsEvery;                                 //The settings m_thresholds was made for.
+	float m_fThresholdsImportance;
+
+	//The row's accepted pixels, one array per value so the batches can be loaded straight into registers.
+	std::vector< float > m_rayX, m_rayY, m_rayZ, m_depth;
+	std::vector< uint32_t > m_color;
+};
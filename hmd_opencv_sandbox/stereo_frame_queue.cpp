@@ -0,0 +1,107 @@
+#include "stereo_frame_queue.h"
+#include <chrono>
+#include <string.h>
+
+StereoFrameQueue::StereoFrameQueue( int iCapacity ) :
+	  m_slots( ( iCapacity < 1 ? 1 : iCapacity ) + 2 )
+	, m_iCapacity( iCapacity < 1 ? 1 : iCapacity )
+	, m_bClosed( false )
+{
+	memset( &m_stats, 0, sizeof( m_stats ) );
+	for ( size_t i = 0; i < m_slots.size(); i++ )
+		m_free.push_back( &m_slots[i] );
+}
+
+double StereoFrameQueue::Now()
+{
+	return std::chrono::duration< double >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+StereoFrameQueue::Slot * StereoFrameQueue::AcquireWrite()
+{
+	std::lock_guard< std::mutex > lock( m_mutex );
+	if ( m_bClosed )
+		return 0;
+	if ( m_free.empty() )
+	{
+		//Only happens when the queue is full, so the oldest frame makes room.
+		if ( m_queued.empty() )
+			return 0;
+		Slot * pOldest = m_queued.front();
+		m_queued.pop_front();
+		m_stats.dropped++;
+		return pOldest;
+	}
+	Slot * pSlot = m_free.back();
+	m_free.pop_back();
+	return pSlot;
+}
+
+void StereoFrameQueue::Push( Slot * pSlot )
+{
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		if ( m_bClosed )
+		{
+			m_free.push_back( pSlot );
+			return;
+		}
+		if ( (int)m_queued.size() >= m_iCapacity )
+		{
+			m_free.push_back( m_queued.front() );
+			m_queued.pop_front();
+			m_stats.dropped++;
+		}
+		pSlot->frame.pPixels = pSlot->pixels.empty() ? 0 : &pSlot->pixels[0];
+		pSlot->pushTime = Now();
+		m_queued.push_back( pSlot );
+		m_stats.pushed++;
+	}
+	m_ready.notify_one();
+}
+
+void StereoFrameQueue::Discard( Slot * pSlot )
+{
+	std::lock_guard< std::mutex > lock( m_mutex );
+	m_free.push_back( pSlot );
+}
+
+StereoFrameQueue::Slot * StereoFrameQueue::Pop()
+{
+	std::unique_lock< std::mutex > lock( m_mutex );
+	double start = Now();
+	m_ready.wait( lock, [this] { return m_bClosed || !m_queued.empty(); } );
+	if ( m_bClosed )
+		return 0;
+
+	Slot * pSlot = m_queued.front();
+	m_queued.pop_front();
+	double now = Now();
+	double latency = now - pSlot->pushTime;
+	m_stats.idleSeconds += now - start;
+	m_stats.latencySum += latency;
+	if ( latency > m_stats.latencyMax ) m_stats.latencyMax = latency;
+	m_stats.processed++;
+	return pSlot;
+}
+
+void StereoFrameQueue::Release( Slot * pSlot )
+{
+	std::lock_guard< std::mutex > lock( m_mutex );
+	m_free.push_back( pSlot );
+}
+
+void StereoFrameQueue::Close()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_bClosed = true;
+	}
+	m_ready.notify_all();
+}
+
+StereoFrameQueueStats StereoFrameQueue::GetStats()
+{
+	std::lock_guard< std::mutex > lock( m_mutex );
+	return m_stats;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// Hands camera frames from the GL thread to the processing thread.  Each frame lives in a slot
+// from a fixed pool, and a slot always has exactly one owner: the free list, the producer while it
+// fills it, the queue, or the consumer while it processes it.  The producer never waits; when the
+// queue is full the oldest queued frame is dropped and its slot reused.  The consumer sleeps on a
+// condition variable until a frame arrives or the queue is closed.
+
+#include "stereo_core.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+struct StereoFrameQueueStats
+{
+	uint64_t pushed;
+	uint64_t processed;
+	uint64_t dropped;     //Queued frames replaced by newer ones before the consumer got to them.
+	double idleSeconds;   //Total time the consumer spent waiting for a frame.
+	double latencySum;    //Total time processed frames sat in the queue.
+	double latencyMax;
+};
+
+class StereoFrameQueue
+{
+public:
+	struct Slot
+	{
+		StereoFrame frame;             //frame.pPixels points into pixels once the slot is pushed.
+		std::vector< uint8_t > pixels;
+		double pushTime;
+	};
+
+	//iCapacity frames can wait in the queue; two more slots cover the producer and the consumer.
+	StereoFrameQueue( int iCapacity = 2 );
+
+	//Producer.  Returns a slot to fill, or 0 if the queue is closed.  Never blocks.
+	Slot * AcquireWrite();
+	void Push( Slot * pSlot );
+	void Discard( Slot * pSlot ); //Give back a slot without queueing it, for a failed readback.
+
+	//Consumer.  Blocks until there is a frame and returns the oldest one, or returns 0 once
+	//the queue is closed.  Every slot from Pop goes back through Release.
+	Slot * Pop();
+	void Release( Slot * pSlot );
+
+	//Wakes the consumer and makes every later Pop and AcquireWrite return 0.
+	void Close();
+
+	StereoFrameQueueStats GetStats();
+	int GetCapacity() const { return m_iCapacity; }
+
+private:
+	static double Now();
+
+	std::mutex m_mutex;
+	std::condition_variable m_ready;
+	std::vector< Slot > m_slots;
+	std::vector< Slot * > m_free;
+	std::deque< Slot * > m_queued;
+	int m_iCapacity;
+	bool m_bClosed;
+	StereoFrameQueueStats m_stats;
+};
@@ -0,0 +1,235 @@
+#include "stereo_gray.h"
+
+#if !defined(STEREO_SIMD_DISABLE) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define STEREO_GRAY_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define STEREO_GRAY_AVX2_TARGET
+#else
+#define STEREO_GRAY_AVX2_TARGET __attribute__(( target( "avx2" ) ))
+#endif
+#elif !defined(STEREO_SIMD_DISABLE) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define STEREO_GRAY_ARM 1
+#include <arm_neon.h>
+#endif
+
+//gray = ( r * r + g * g + b * b + round ) >> shift.  Equal weighting uses 21846 / 65536, just over
+//a third, which floors to exactly ( r + g + b ) / 3 for every sum up to 765.
+struct StereoGrayCoefficients
+{
+	int16_t r, g, b;
+	int round, shift;
+};
+
+static const StereoGrayCoefficients g_grayCoefficients[STEREO_GRAY_WEIGHTINGS] =
+{
+	{ 21846, 21846, 21846, 0, 16 },
+	{ 9798, 19235, 3735, 1 << 14, 15 },
+	{ 6966, 23436, 2366, 1 << 14, 15 },
+};
+
+static void GrayRowScalar( const uint32_t * pIn, uint8_t * pOut, int w, const StereoGrayCoefficients & c )
+{
+	for ( int x = 0; x < w; x++ )
+	{
+		uint32_t inx = pIn[x];
+		int r = ( inx >> 0 ) & 0xff;
+		int g = ( inx >> 8 ) & 0xff;
+		int b = ( inx >> 16 ) & 0xff;
+		pOut[x] = (uint8_t)( ( r * c.r + g * c.g + b * c.b + c.round ) >> c.shift );
+	}
+}
+
+#if STEREO_GRAY_X86
+//Each 32 bit lane is one pixel.  Masking leaves r and b as 16 bit halves, shifting leaves g and a,
+//so two multiply-adds make the whole dot product with no shuffles.
+static inline __m128i GrayPixels4( __m128i px, __m128i rb, __m128i g, __m128i round, __m128i shift )
+{
+	__m128i lo = _mm_and_si128( px, _mm_set1_epi32( 0x00ff00ff ) );
+	__m128i hi = _mm_srli_epi16( px, 8 );
+	__m128i acc = _mm_add_epi32( _mm_madd_epi16( lo, rb ), _mm_madd_epi16( hi, g ) );
+	return _mm_srl_epi32( _mm_add_epi32( acc, round ), shift );
+}
+
+static void GrayRowSSE2( const uint32_t * pIn, uint8_t * pOut, int w, const StereoGrayCoefficients & c )
+{
+	const __m128i rb = _mm_set1_epi32( ( (int)c.b << 16 ) | (uint16_t)c.r );
+	const __m128i g = _mm_set1_epi32( c.g );
+	const __m128i round = _mm_set1_epi32( c.round );
+	const __m128i shift = _mm_cvtsi32_si128( c.shift );
+
+	int x = 0;
+	for ( ; x + 16 <= w; x += 16 )
+	{
+		const __m128i * p = (const __m128i *)( pIn + x );
+		__m128i a0 = GrayPixels4( _mm_loadu_si128( p + 0 ), rb, g, round, shift );
+		__m128i a1 = GrayPixels4( _mm_loadu_si128( p + 1 ), rb, g, round, shift );
+		__m128i a2 = GrayPixels4( _mm_loadu_si128( p + 2 ), rb, g, round, shift );
+		__m128i a3 = GrayPixels4( _mm_loadu_si128( p + 3 ), rb, g, round, shift );
+		__m128i out = _mm_packus_epi16( _mm_packs_epi32( a0, a1 ), _mm_packs_epi32( a2, a3 ) );
+		_mm_storeu_si128( (__m128i *)( pOut + x ), out );
+	}
+	GrayRowScalar( pIn + x, pOut + x, w - x, c );
+}
+
+STEREO_GRAY_AVX2_TARGET static inline __m256i GrayPixels8( __m256i px, __m256i rb, __m256i g, __m256i round, __m128i shift )
+{
+	__m256i lo = _mm256_and_si256( px, _mm256_set1_epi32( 0x00ff00ff ) );
+	__m256i hi = _mm256_srli_epi16( px, 8 );
+	__m256i acc = _mm256_add_epi32( _mm256_madd_epi16( lo, rb ), _mm256_madd_epi16( hi, g ) );
+	return _mm256_srl_epi32( _mm256_add_epi32( acc, round ), shift );
+}
+
+STEREO_GRAY_AVX2_TARGET static void GrayRowAVX2( const uint32_t * pIn, uint8_t * pOut, int w, const StereoGrayCoefficients & c )
+{
+	const __m256i rb = _mm256_set1_epi32( ( (int)c.b << 16 ) | (uint16_t)c.r );
+	const __m256i g = _mm256_set1_epi32( c.g );
+	const __m256i round = _mm256_set1_epi32( c.round );
+	const __m128i shift = _mm_cvtsi32_si128( c.shift );
+	//The packs work within each 128 bit half, this puts the 4 pixel groups back in order.
+	const __m256i order = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+
+	int x = 0;
+	for ( ; x + 32 <= w; x += 32 )
+	{
+		const __m256i * p = (const __m256i *)( pIn + x );
+		__m256i a0 = GrayPixels8( _mm256_loadu_si256( p + 0 ), rb, g, round, shift );
+		__m256i a1 = GrayPixels8( _mm256_loadu_si256( p + 1 ), rb, g, round, shift );
+		__m256i a2 = GrayPixels8( _mm256_loadu_si256( p + 2 ), rb, g, round, shift );
+		__m256i a3 = GrayPixels8( _mm256_loadu_si256( p + 3 ), rb, g, round, shift );
+		__m256i out = _mm256_packus_epi16( _mm256_packs_epi32( a0, a1 ), _mm256_packs_epi32( a2, a3 ) );
+		_mm256_storeu_si256( (__m256i *)( pOut + x ), _mm256_permutevar8x32_epi32( out, order ) );
+	}
+	GrayRowSSE2( pIn + x, pOut + x, w - x, c );
+}
+
+static bool CPUHasAVX2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid( info, 0 );
+	if ( info[0] < 7 )
+		return false;
+	__cpuid( info, 1 );
+	bool bOSXSave = ( info[2] & ( 1 << 27 ) ) != 0, bAVX = ( info[2] & ( 1 << 28 ) ) != 0;
+	if ( !bOSXSave || !bAVX || ( _xgetbv( 0 ) & 6 ) != 6 ) //The OS has to save the ymm registers.
+		return false;
+	__cpuidex( info, 7, 0 );
+	return ( info[1] & ( 1 << 5 ) ) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports( "avx2" ) != 0;
+#endif
+}
+#endif
+
+#if STEREO_GRAY_ARM
+static void GrayRowNEON( const uint32_t * pIn, uint8_t * pOut, int w, const StereoGrayCoefficients & c )
+{
+	const uint32x4_t round = vdupq_n_u32( c.round );
+	const int32x4_t shift = vdupq_n_s32( -c.shift );
+
+	int x = 0;
+	for ( ; x + 16 <= w; x += 16 )
+	{
+		//De-interleaves 16 pixels into r, g, b and a planes.
+		uint8x16x4_t px = vld4q_u8( (const uint8_t *)( pIn + x ) );
+		uint16x8_t r[2] = { vmovl_u8( vget_low_u8( px.val[0] ) ), vmovl_u8( vget_high_u8( px.val[0] ) ) };
+		uint16x8_t g[2] = { vmovl_u8( vget_low_u8( px.val[1] ) ), vmovl_u8( vget_high_u8( px.val[1] ) ) };
+		uint16x8_t b[2] = { vmovl_u8( vget_low_u8( px.val[2] ) ), vmovl_u8( vget_high_u8( px.val[2] ) ) };
+		uint16x4_t out16[4];
+		for ( int i = 0; i < 4; i++ )
+		{
+			uint16x4_t ri = ( i & 1 ) ? vget_high_u16( r[i >> 1] ) : vget_low_u16( r[i >> 1] );
+			uint16x4_t gi = ( i & 1 ) ? vget_high_u16( g[i >> 1] ) : vget_low_u16( g[i >> 1] );
+			uint16x4_t bi = ( i & 1 ) ? vget_high_u16( b[i >> 1] ) : vget_low_u16( b[i >> 1] );
+			uint32x4_t acc = vmlal_n_u16( vmlal_n_u16( vmlal_n_u16( round, ri, c.r ), gi, c.g ), bi, c.b );
+			out16[i] = vmovn_u32( vshlq_u32( acc, shift ) );
+		}
+		uint8x8_t lo = vqmovn_u16( vcombine_u16( out16[0], out16[1] ) );
+		uint8x8_t hi = vqmovn_u16( vcombine_u16( out16[2], out16[3] ) );
+		vst1q_u8( pOut + x, vcombine_u8( lo, hi ) );
+	}
+	GrayRowScalar( pIn + x, pOut + x, w - x, c );
+}
+#endif
+
+typedef void ( *GrayRowFn )( const uint32_t * pIn, uint8_t * pOut, int w, const StereoGrayCoefficients & c );
+
+static GrayRowFn GrayRowFor( StereoGrayKernel kernel )
+{
+	if ( !StereoGrayKernelSupported( kernel ) )
+		return 0;
+	switch ( kernel )
+	{
+	case STEREO_GRAY_SCALAR: return GrayRowScalar;
+#if STEREO_GRAY_X86
+	case STEREO_GRAY_SSE2: return GrayRowSSE2;
+	case STEREO_GRAY_AVX2: return GrayRowAVX2;
+#endif
+#if STEREO_GRAY_ARM
+	case STEREO_GRAY_NEON: return GrayRowNEON;
+#endif
+	default: return 0;
+	}
+}
+
+bool StereoGrayKernelSupported( StereoGrayKernel kernel )
+{
+	switch ( kernel )
+	{
+	case STEREO_GRAY_SCALAR: return true;
+#if STEREO_GRAY_X86
+	case STEREO_GRAY_SSE2: return true;
+	case STEREO_GRAY_AVX2:
+	{
+		static const bool bAVX2 = CPUHasAVX2();
+		return bAVX2;
+	}
+#endif
+#if STEREO_GRAY_ARM
+	case STEREO_GRAY_NEON: return true;
+#endif
+	default: return false;
+	}
+}
+
+StereoGrayKernel StereoGrayBestKernel()
+{
+	static const StereoGrayKernel best =
+		StereoGrayKernelSupported( STEREO_GRAY_AVX2 ) ? STEREO_GRAY_AVX2 :
+		StereoGrayKernelSupported( STEREO_GRAY_NEON ) ? STEREO_GRAY_NEON :
+		StereoGrayKernelSupported( STEREO_GRAY_SSE2 ) ? STEREO_GRAY_SSE2 : STEREO_GRAY_SCALAR;
+	return best;
+}
+
+void StereoGrayRow( const uint32_t * pIn, uint8_t * pOut, int w, StereoGrayWeighting weighting )
+{
+	static const GrayRowFn fn = GrayRowFor( StereoGrayBestKernel() );
+	if ( (unsigned)weighting >= STEREO_GRAY_WEIGHTINGS ) weighting = STEREO_GRAY_EQUAL;
+	fn( pIn, pOut, w, g_grayCoefficients[weighting] );
+}
+
+bool StereoGrayRowWith( StereoGrayKernel kernel, const uint32_t * pIn, uint8_t * pOut, int w, StereoGrayWeighting weighting )
+{
+	GrayRowFn fn = GrayRowFor( kernel );
+	if ( !fn )
+		return false;
+	if ( (unsigned)weighting >= STEREO_GRAY_WEIGHTINGS ) weighting = STEREO_GRAY_EQUAL;
+	fn( pIn, pOut, w, g_grayCoefficients[weighting] );
+	return true;
+}
+
+const char * StereoGrayKernelName( StereoGrayKernel kernel )
+{
+	static const char * names[STEREO_GRAY_KERNELS] = { "scalar", "sse2", "avx2", "neon" };
+	return ( (unsigned)kernel < STEREO_GRAY_KERNELS ) ? names[kernel] : "?";
+}
+
+const char * StereoGrayWeightingName( StereoGrayWeighting weighting )
+{
+	static const char * names[STEREO_GRAY_WEIGHTINGS] = { "equal", "rec601", "rec709" };
+	return ( (unsigned)weighting < STEREO_GRAY_WEIGHTINGS ) ? names[weighting] : "?";
+}
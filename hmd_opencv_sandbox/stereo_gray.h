@@ -0,0 +1,38 @@
+#pragma once
+
+// RGBA to gray for the stereo matcher.  Every weighting is a 16 bit fixed point dot product, so
+// the scalar, SSE2, AVX2 and NEON kernels all give exactly the same bytes; STEREO_GRAY_EQUAL is
+// bit for bit the ( r + g + b ) / 3 the pipeline has always used.
+//
+// The best kernel for the CPU is picked the first time StereoGrayRow is called.  Define
+// STEREO_SIMD_DISABLE to build only the scalar one.
+
+#include <stdint.h>
+
+enum StereoGrayWeighting
+{
+	STEREO_GRAY_EQUAL,  //( r + g + b ) / 3, rounded down.
+	STEREO_GRAY_REC601, //0.299 r + 0.587 g + 0.114 b, rounded.
+	STEREO_GRAY_REC709, //0.2126 r + 0.7152 g + 0.0722 b, rounded.
+	STEREO_GRAY_WEIGHTINGS
+};
+
+enum StereoGrayKernel
+{
+	STEREO_GRAY_SCALAR,
+	STEREO_GRAY_SSE2,
+	STEREO_GRAY_AVX2,
+	STEREO_GRAY_NEON,
+	STEREO_GRAY_KERNELS
+};
+
+//Converts w RGBA pixels (r in the low byte) to w gray bytes.  Neither pointer needs any alignment.
+void StereoGrayRow( const uint32_t * pIn, uint8_t * pOut, int w, StereoGrayWeighting weighting );
+
+//The same with a specific kernel, for the benchmark.  Returns false if this build or CPU can't run it.
+bool StereoGrayRowWith( StereoGrayKernel kernel, const uint32_t * pIn, uint8_t * pOut, int w, StereoGrayWeighting weighting );
+
+StereoGrayKernel StereoGrayBestKernel();
+bool StereoGrayKernelSupported( StereoGrayKernel kernel );
+const char * StereoGrayKernelName( StereoGrayKernel kernel );
+const char * StereoGrayWeightingName( StereoGrayWeighting weighting );
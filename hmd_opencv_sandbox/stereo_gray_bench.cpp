@@ -0,0 +1,145 @@
+// Checks and times the RGBA to gray kernels in stereo_gray.cpp.
+//
+// Every kernel this CPU can run is checked byte for byte against the scalar one for each
+// weighting, and the equal weighting against ( r + g + b ) / 3 for all 2^24 colors.  Then each is
+// timed on a buffer the size of one stereo frame's algorithm images (stays in cache) and on one far
+// bigger than the cache, next to memcpy of the same buffer.  Bandwidth counts bytes read plus bytes
+// written, so a kernel running at memory speed shows about the same GB/s as memcpy.
+//
+//   g++ -O2 -I.. -I. stereo_gray_bench.cpp stereo_gray.cpp -o stereo_gray_bench
+//
+// Usage: stereo_gray_bench [megapixels for the large buffer, default 16]
+
+#include "stereo_gray.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+static double Now()
+{
+	return std::chrono::duration< double >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static uint32_t g_rng = 0x12345678;
+static uint32_t Xorshift()
+{
+	g_rng ^= g_rng << 13;
+	g_rng ^= g_rng >> 17;
+	g_rng ^= g_rng << 5;
+	return g_rng;
+}
+
+//Best of a few runs of fn, in seconds.
+template< typename F > static double BestTime( int iRepeats, F fn )
+{
+	double best = 1e30;
+	for ( int r = 0; r < iRepeats; r++ )
+	{
+		double start = Now();
+		fn();
+		double t = Now() - start;
+		if ( t < best ) best = t;
+	}
+	return best;
+}
+
+static bool Validate()
+{
+	bool bOk = true;
+
+	//Every color once, for the exact ( r + g + b ) / 3 the pipeline started with.
+	std::vector< uint32_t > colors( 1 << 24 );
+	for ( uint32_t i = 0; i < colors.size(); i++ )
+		colors[i] = i | ( ( i * 7 ) << 24 );
+	std::vector< uint8_t > out( colors.size() );
+	for ( int k = 0; k < STEREO_GRAY_KERNELS; k++ )
+	{
+		if ( !StereoGrayRowWith( (StereoGrayKernel)k, &colors[0], &out[0], (int)colors.size(), STEREO_GRAY_EQUAL ) )
+			continue;
+		for ( uint32_t i = 0; i < colors.size(); i++ )
+		{
+			int expected = ( ( i & 0xff ) + ( ( i >> 8 ) & 0xff ) + ( ( i >> 16 ) & 0xff ) ) / 3;
+			if ( out[i] != expected )
+			{
+				printf( "%s: equal weighting of %06x gives %d, expected %d\n", StereoGrayKernelName( (StereoGrayKernel)k ), i, out[i], expected );
+				bOk = false;
+				break;
+			}
+		}
+	}
+
+	//Random rows of every width up to 100, so all the tail lengths get covered, against the scalar kernel.
+	std::vector< uint32_t > row( 100 );
+	uint8_t expected[100], got[100 + 1];
+	for ( int weighting = 0; weighting < STEREO_GRAY_WEIGHTINGS; weighting++ )
+	{
+		for ( int w = 0; w <= 100; w++ )
+		{
+			for ( int i = 0; i < 100; i++ ) row[i] = Xorshift();
+			StereoGrayRowWith( STEREO_GRAY_SCALAR, &row[0], expected, w, (StereoGrayWeighting)weighting );
+			for ( int k = 1; k < STEREO_GRAY_KERNELS; k++ )
+			{
+				got[w] = 0xa5;
+				if ( !StereoGrayRowWith( (StereoGrayKernel)k, &row[0], got, w, (StereoGrayWeighting)weighting ) )
+					continue;
+				if ( memcmp( got, expected, w ) != 0 || got[w] != 0xa5 )
+				{
+					printf( "%s: %s weighting differs from scalar at width %d\n", StereoGrayKernelName( (StereoGrayKernel)k ),
+						StereoGrayWeightingName( (StereoGrayWeighting)weighting ), w );
+					bOk = false;
+				}
+			}
+		}
+	}
+	return bOk;
+}
+
+static void TimeBuffer( const char * sLabel, size_t pixels, int iRepeats )
+{
+	std::vector< uint32_t > in( pixels );
+	std::vector< uint8_t > out( pixels );
+	std::vector< uint32_t > copy( pixels );
+	for ( size_t i = 0; i < pixels; i++ ) in[i] = Xorshift();
+
+	double tCopy = BestTime( iRepeats, [&] { memcpy( &copy[0], &in[0], pixels * 4 ); } );
+	printf( "\n%s: %.2f Mpixels, %.1f MB in\n", sLabel, pixels / 1e6, pixels * 4 / 1e6 );
+	printf( "%10s %8s %10s %10s %10s\n", "kernel", "weights", "ms", "Gpix/s", "GB/s" );
+	printf( "%10s %8s %10.3f %10s %10.2f\n", "memcpy", "", tCopy * 1000.0, "", pixels * 8 / tCopy / 1e9 );
+
+	for ( int k = 0; k < STEREO_GRAY_KERNELS; k++ )
+	{
+		if ( !StereoGrayKernelSupported( (StereoGrayKernel)k ) )
+			continue;
+		for ( int weighting = 0; weighting < STEREO_GRAY_WEIGHTINGS; weighting++ )
+		{
+			double t = BestTime( iRepeats, [&] { StereoGrayRowWith( (StereoGrayKernel)k, &in[0], &out[0], (int)pixels, (StereoGrayWeighting)weighting ); } );
+			printf( "%10s %8s %10.3f %10.2f %10.2f\n", StereoGrayKernelName( (StereoGrayKernel)k ), StereoGrayWeightingName( (StereoGrayWeighting)weighting ),
+				t * 1000.0, pixels / t / 1e9, pixels * 5 / t / 1e9 );
+		}
+	}
+}
+
+int main( int argc, char ** argv )
+{
+	double megapixels = ( argc > 1 ) ? atof( argv[1] ) : 16.0;
+	if ( megapixels <= 0 ) megapixels = 16.0;
+
+	printf( "kernels:" );
+	for ( int k = 0; k < STEREO_GRAY_KERNELS; k++ )
+	{
+		if ( StereoGrayKernelSupported( (StereoGrayKernel)k ) )
+			printf( " %s", StereoGrayKernelName( (StereoGrayKernel)k ) );
+	}
+	printf( ", StereoGrayRow uses %s\n", StereoGrayKernelName( StereoGrayBestKernel() ) );
+
+	if ( !Validate() )
+		return 2;
+	printf( "all kernels match the scalar one for every weighting\n" );
+
+	//Both eyes of a 1920x960 frame after the 4x4 downsample (MOGRIFY_X, MOGRIFY_Y).
+	TimeBuffer( "algorithm images", (size_t)2 * 240 * 240, 200 );
+	TimeBuffer( "large buffer", (size_t)( megapixels * 1e6 ), 10 );
+	return 0;
+}
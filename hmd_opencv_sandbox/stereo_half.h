@@ -0,0 +1,70 @@
+#pragma once
+
+// IEEE half floats, for vertex data that doesn't need all of a float.  FloatToHalf rounds to
+// nearest even, takes anything past the largest half to infinity and keeps NaNs as NaNs, so the
+// depth mesh's holes survive.
+//
+// When the compiler targets the F16C instructions FloatToHalf8 does eight at once and gives the
+// same bits, but for NaN payloads.  GCC and clang need -mf16c for that, -mavx2 doesn't imply it;
+// MSVC has no switch of its own for F16C and defines no macro for it, so there it comes with
+// /arch:AVX2.  A branchless SSE2 version was no faster than FloatToHalf, so without F16C the
+// callers convert one at a time.  Define STEREO_SIMD_DISABLE to build only the scalar code.
+
+#include <stdint.h>
+#include <string.h>
+
+#if !defined( STEREO_SIMD_DISABLE ) && ( defined( __F16C__ ) || ( defined( _MSC_VER ) && !defined( __clang__ ) && defined( __AVX2__ ) ) )
+#define STEREO_HALF_F16C 1
+#include <immintrin.h>
+#endif
+
+inline uint16_t FloatToHalf( float f )
+{
+	uint32_t x;
+	memcpy( &x, &f, 4 );
+	uint32_t sign = x & 0x80000000u;
+	x ^= sign;
+	uint32_t o;
+	if ( x >= 0x47800000u ) //65536 and up, infinity or NaN.
+	{
+		o = ( x > 0x7f800000u ) ? 0x7e00 : 0x7c00;
+	}
+	else if ( x < 0x38800000u ) //Subnormal or zero as a half.  Adding 0.5 lines the mantissa up and rounds it.
+	{
+		float r;
+		memcpy( &r, &x, 4 );
+		r += 0.5f;
+		memcpy( &o, &r, 4 );
+		o -= 0x3f000000u;
+	}
+	else
+	{
+		//Rebias the exponent and round, up on a tie only if that makes the mantissa even.
+		o = ( x + 0xc8000fffu + ( ( x >> 13 ) & 1 ) ) >> 13;
+	}
+	return (uint16_t)( ( sign >> 16 ) | o );
+}
+
+inline float HalfToFloat( uint16_t h )
+{
+	uint32_t sign = (uint32_t)( h & 0x8000 ) << 16;
+	uint32_t exponent = ( h >> 10 ) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+	float f;
+	if ( exponent == 0 )
+	{
+		f = mantissa * ( 1.0f / 16777216.0f );
+		return sign ? -f : f;
+	}
+	uint32_t x = sign | ( mantissa << 13 ) | ( ( exponent == 0x1f ) ? 0x7f800000u : ( exponent + 112 ) << 23 );
+	memcpy( &f, &x, 4 );
+	return f;
+}
+
+#if STEREO_HALF_F16C
+//lo's four then hi's, packed.
+inline __m128i FloatToHalf8( __m128 lo, __m128 hi )
+{
+	return _mm_unpacklo_epi64( _mm_cvtps_ph( lo, 0 ), _mm_cvtps_ph( hi, 0 ) );
+}
+#endif
@@ -0,0 +1,292 @@
+// Compares the matchers StereoCore can use (the SGBM presets and the census matcher, see
+// STEREO_ALGORITHM_CENSUS) on the same gray images, for speed and for what they produce.
+//
+// Every frame of a recording goes through the fused front end once, then through each matcher.
+// For each one this reports the mean match time and how many pixels got a disparity, and how
+// often the census matcher agrees with each SGBM preset to within a pixel where both have one.
+// A recording has no ground truth, so --synthetic replaces the gray images with random dot
+// stereograms of a known scene (a slanted background, a box in front of it moving a little
+// closer every frame, and a right camera exposing a little brighter), and reports each matcher's
+// error against that instead.
+//
+// --checks= turns on StereoCore's checks for every matcher (see STEREO_CHECK_LEFT_RIGHT), and the
+// pixels they reject, or rate below StereoCore::m_iMinConfidence, don't count as matched.
+//
+//   g++ -O2 -pthread -I.. -I. stereo_match_bench.cpp stereo_census.cpp stereo_core.cpp stereo_gray.cpp stereo_parallel.cpp
+//       stereo_recording.cpp ../shared/Matrices.cpp `pkg-config --cflags --libs opencv4` -o stereo_match_bench
+//
+// Usage: stereo_match_bench <manifest> [passes] [--synthetic] [--match-bands=N] [--search=full|pyramid|previous] [--window=N] [--checks=N]
+//   The recording is still needed with --synthetic, for the image sizes.
+//   --search=  how the census matcher narrows its search (StereoCensusSearch); anything but full
+//              also runs the full search and reports how far the narrowed one strays from it
+//   --window=  disparities searched per pixel when narrowed
+//   --checks=  STEREO_CHECK_ flags: 1 left-right consistency, 2 confidence, 3 both
+
+#include "stereo_core.h"
+#include "stereo_recording.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+static const char * g_algorithmNames[STEREO_ALGORITHMS] = { "sgbm 0", "sgbm 1", "sgbm 2", "census" };
+static const char * g_searchNames[STEREO_CENSUS_SEARCHES] = { "full", "pyramid", "previous" };
+
+static uint32_t g_rng = 0x12345678;
+static uint32_t Xorshift()
+{
+	g_rng ^= g_rng << 13;
+	g_rng ^= g_rng >> 17;
+	g_rng ^= g_rng << 5;
+	return g_rng;
+}
+
+static bool HasDisparity( uint16_t d )
+{
+	return d != 0 && d < NUM_DISP * 16;
+}
+
+//The synthetic scene's disparity at algorithm pixel x, y in the given frame, in 16ths of a pixel.
+static int SyntheticDisparity( int x, int y, int w, int h, int frame )
+{
+	int bx = w / 3 + frame * 2;
+	if ( x > bx && x < bx + w / 3 && y > h / 3 && y < h * 2 / 3 )
+		return ( 44 + frame ) * 16;
+	return 12 * 16 + x * 16 * 16 / w; //12 pixels on the left, 28 on the right.
+}
+
+//Random dots in 2x2 blocks, so the texture is about as fine as the downsampled camera's.  The
+//left image is the right one shifted by the scene's disparity, to the nearest pixel.
+static void MakeSynthetic( const StereoCore & core, StereoFrameBuffers & b, int frame, std::vector< uint16_t > & truth )
+{
+	int w = (int)core.m_iFBAlgoWidth, h = (int)core.m_iFBAlgoHeight, stride = w + NUM_DISP;
+	truth.resize( w * h );
+	std::vector< uint8_t > dots( stride * h );
+	for ( int y = 0; y < h; y += 2 )
+	{
+		for ( int x = 0; x < stride; x += 2 )
+		{
+			uint8_t v = (uint8_t)( 40 + Xorshift() % 160 );
+			for ( int i = 0; i < 4; i++ )
+			{
+				if ( y + ( i >> 1 ) < h && x + ( i & 1 ) < stride )
+					dots[( y + ( i >> 1 ) ) * stride + x + ( i & 1 )] = v;
+			}
+		}
+	}
+	for ( int y = 0; y < h; y++ )
+	{
+		for ( int x = 0; x < stride; x++ )
+		{
+			b.m_FBSides[1][y * stride + x] = (uint8_t)( dots[y * stride + x] * 9 / 8 + 10 );
+			int ax = x - NUM_DISP;
+			int d = SyntheticDisparity( ax < 0 ? 0 : ax, y, w, h, frame );
+			int sx = x - ( d + 8 ) / 16;
+			b.m_FBSides[0][y * stride + x] = dots[y * stride + ( sx < 0 ? 0 : sx )];
+			if ( ax >= 0 )
+				truth[y * w + ax] = (uint16_t)( ( d + 8 ) / 16 * 16 );
+		}
+	}
+}
+
+//The matchers compared: each algorithm with the census one searching every disparity, then the
+//census one narrowed the way --search= asks.
+#define NUM_MATCHERS ( STEREO_ALGORITHMS + 1 )
+#define NARROWED_CENSUS STEREO_ALGORITHMS
+
+struct MatchStats
+{
+	double time;
+	uint64_t matched, pixels;
+	uint64_t bad;        //Against the ground truth: more than a pixel out.
+	double absError;     //Pixels, summed over matched.
+};
+
+typedef std::vector< std::vector< uint16_t > > FrameDisparities;
+
+//Where both a and b have a disparity, how often they are within a pixel of each other.
+static void PrintAgreement( const char * name, const FrameDisparities & a, const FrameDisparities & b )
+{
+	uint64_t both = 0, agree = 0, pixels = 0;
+	double absDiff = 0;
+	for ( size_t i = 0; i < a.size(); i++ )
+	{
+		for ( size_t p = 0; p < a[i].size(); p++ )
+		{
+			if ( HasDisparity( a[i][p] ) && HasDisparity( b[i][p] ) )
+			{
+				int e = abs( (int)a[i][p] - (int)b[i][p] );
+				both++;
+				agree += e <= 16;
+				absDiff += e / 16.0;
+			}
+		}
+		pixels += a[i].size();
+	}
+	printf( "%16s  %.2f%% of pixels, %.2f%% of those within 1 px, mean difference %.3f px\n", name,
+		100.0 * both / pixels, both ? 100.0 * agree / both : 0.0, both ? absDiff / both : 0.0 );
+}
+
+int main( int argc, char ** argv )
+{
+	if ( argc < 2 )
+	{
+		fprintf( stderr, "Usage: %s <manifest> [passes] [--synthetic] [--match-bands=N] [--search=full|pyramid|previous] [--window=N] [--checks=N]\n", argv[0] );
+		return 1;
+	}
+	int iPasses = 3;
+	bool bSynthetic = false;
+	int iMatchBands = 0;
+	int iSearch = STEREO_CENSUS_FULL;
+	int iWindow = 0;
+	int iChecks = 0;
+	for ( int i = 2; i < argc; i++ )
+	{
+		if ( strcmp( argv[i], "--synthetic" ) == 0 ) bSynthetic = true;
+		else if ( strncmp( argv[i], "--match-bands=", 14 ) == 0 ) iMatchBands = atoi( argv[i] + 14 );
+		else if ( strncmp( argv[i], "--window=", 9 ) == 0 ) iWindow = atoi( argv[i] + 9 );
+		else if ( strncmp( argv[i], "--checks=", 9 ) == 0 ) iChecks = atoi( argv[i] + 9 );
+		else if ( strncmp( argv[i], "--search=", 9 ) == 0 )
+		{
+			for ( int s = 0; s < STEREO_CENSUS_SEARCHES; s++ )
+			{
+				if ( strcmp( argv[i] + 9, g_searchNames[s] ) == 0 )
+					iSearch = s;
+			}
+		}
+		else iPasses = atoi( argv[i] );
+	}
+	if ( iPasses < 1 ) iPasses = 1;
+
+	StereoRecordingSource source;
+	StereoCalibration calib;
+	if ( !source.Open( argv[1] ) || !source.GetCalibration( calib ) )
+	{
+		fprintf( stderr, "Could not read recording %s\n", argv[1] );
+		return 1;
+	}
+
+	StereoCore core;
+	if ( iMatchBands > 0 ) core.m_iMatchBands = iMatchBands;
+	if ( iWindow > 0 ) core.m_iCensusWindow = iWindow;
+	core.SetChecks( iChecks );
+	if ( !core.Init( calib ) )
+	{
+		fprintf( stderr, "Could not set up the stereo pipeline for %ux%u frames\n", calib.frameWidth, calib.frameHeight );
+		return 1;
+	}
+
+	//Gray images for every frame, made once, so every matcher sees exactly the same input.
+	StereoFrameBuffers b;
+	core.InitBuffers( b );
+	std::vector< std::vector< uint8_t > > grays[2];
+	std::vector< std::vector< uint16_t > > truths;
+	StereoFrame frame;
+	while ( source.NextFrame( frame ) )
+	{
+		if ( bSynthetic )
+		{
+			truths.push_back( std::vector< uint16_t >() );
+			MakeSynthetic( core, b, (int)truths.size() - 1, truths.back() );
+		}
+		else
+		{
+			core.RectifyDownsampleGray( frame, b );
+		}
+		grays[0].push_back( b.m_FBSides[0] );
+		grays[1].push_back( b.m_FBSides[1] );
+	}
+	size_t iFrames = grays[0].size();
+	if ( iFrames == 0 )
+	{
+		fprintf( stderr, "%s has no frames\n", argv[1] );
+		return 1;
+	}
+	printf( "%s: %u %s frames, %ux%u disparity, %d match bands, checks %d, census costs %s popcount instruction\n", argv[1],
+		(unsigned)iFrames, bSynthetic ? "synthetic" : "recorded", core.m_iFBAlgoWidth, core.m_iFBAlgoHeight, core.GetMatchBandCount(), core.GetChecks(),
+		StereoCensusMatcher::UsesPopcountInstruction() ? "with the" : "without the" );
+
+	size_t algoPixels = core.m_iFBAlgoWidth * core.m_iFBAlgoHeight;
+	FrameDisparities results[NUM_MATCHERS];
+	MatchStats stats[NUM_MATCHERS];
+	memset( stats, 0, sizeof( stats ) );
+	int iMatchers = ( iSearch == STEREO_CENSUS_FULL ) ? STEREO_ALGORITHMS : NUM_MATCHERS;
+
+	for ( int m = 0; m < iMatchers; m++ )
+	{
+		core.SetAlgorithm( m < STEREO_ALGORITHMS ? m : STEREO_ALGORITHM_CENSUS );
+		core.SetCensusSearch( m == NARROWED_CENSUS ? iSearch : STEREO_CENSUS_FULL );
+		results[m].resize( iFrames );
+		for ( int pass = 0; pass <= iPasses; pass++ )
+		{
+			for ( size_t i = 0; i < iFrames; i++ )
+			{
+				b.m_FBSides[0] = grays[0][i];
+				b.m_FBSides[1] = grays[1][i];
+				memset( &b.times, 0, sizeof( b.times ) );
+				core.Match( b );
+				//Pass 0 makes the matchers and warms them up, and isn't timed.
+				if ( pass == 0 )
+				{
+					results[m][i] = b.m_Disparity;
+					for ( size_t p = 0; p < b.m_Confidence.size(); p++ )
+					{
+						if ( b.m_Confidence[p] < core.m_iMinConfidence )
+							results[m][i][p] = 0xfff0;
+					}
+				}
+				else
+					stats[m].time += b.times.match;
+			}
+		}
+
+		MatchStats & s = stats[m];
+		for ( size_t i = 0; i < iFrames; i++ )
+		{
+			const std::vector< uint16_t > & d = results[m][i];
+			for ( size_t p = 0; p < algoPixels; p++ )
+			{
+				if ( !HasDisparity( d[p] ) )
+					continue;
+				s.matched++;
+				if ( bSynthetic )
+				{
+					int e = abs( (int)d[p] - (int)truths[i][p] );
+					s.absError += e / 16.0;
+					s.bad += e > 16;
+				}
+			}
+			s.pixels += algoPixels;
+		}
+	}
+
+	char narrowedName[64];
+	snprintf( narrowedName, sizeof( narrowedName ), "census %s %d", g_searchNames[iSearch], core.m_iCensusWindow );
+	double runs = (double)iFrames * iPasses;
+	printf( "\n%16s %10s %10s", "matcher", "mean ms", "matched %" );
+	if ( bSynthetic )
+		printf( " %10s %10s", "bad %", "mean err" );
+	printf( "\n" );
+	for ( int m = 0; m < iMatchers; m++ )
+	{
+		const MatchStats & s = stats[m];
+		printf( "%16s %10.3f %10.2f", m < STEREO_ALGORITHMS ? g_algorithmNames[m] : narrowedName, s.time / runs * 1000.0, 100.0 * s.matched / s.pixels );
+		if ( bSynthetic )
+			printf( " %10.2f %10.3f", s.matched ? 100.0 * s.bad / s.matched : 0.0, s.matched ? s.absError / s.matched : 0.0 );
+		printf( "\n" );
+	}
+
+	printf( "\ncensus against each preset, where both matched:\n" );
+	for ( int alg = 0; alg < STEREO_ALGORITHM_CENSUS; alg++ )
+		PrintAgreement( g_algorithmNames[alg], results[STEREO_ALGORITHM_CENSUS], results[alg] );
+	if ( iMatchers > NARROWED_CENSUS )
+	{
+		printf( "\n%s against the full search, where both matched:\n", narrowedName );
+		PrintAgreement( "census", results[STEREO_ALGORITHM_CENSUS], results[NARROWED_CENSUS] );
+	}
+
+	return 0;
+}
@@ -0,0 +1,90 @@
+#include "stereo_parallel.h"
+
+StereoParallel::StereoParallel( int iThreads ) :
+	  m_pJob( 0 )
+	, m_iCount( 0 )
+	, m_iBands( 0 )
+	, m_iNextBand( 0 )
+	, m_iBusy( 0 )
+	, m_iGeneration( 0 )
+	, m_bQuit( false )
+{
+	if ( iThreads < 0 )
+		iThreads = (int)std::thread::hardware_concurrency() - 1;
+	for ( int i = 0; i < iThreads; i++ )
+		m_threads.push_back( std::thread( &StereoParallel::Worker, this ) );
+}
+
+StereoParallel::~StereoParallel()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_bQuit = true;
+	}
+	m_wake.notify_all();
+	for ( size_t i = 0; i < m_threads.size(); i++ )
+		m_threads[i].join();
+}
+
+void StereoParallel::For( int count, const std::function< void( int, int ) > & fn )
+{
+	if ( count <= 0 )
+		return;
+	//One job at a time.  If another thread (another pipeline stage) has the pool, this caller
+	//just does the work itself rather than waiting.
+	std::unique_lock< std::mutex > job( m_jobMutex, std::try_to_lock );
+	if ( m_threads.empty() || count == 1 || !job.owns_lock() )
+	{
+		fn( 0, count );
+		return;
+	}
+
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_pJob = &fn;
+		m_iCount = count;
+		m_iBands = ( count < GetBandCount() ) ? count : GetBandCount();
+		m_iNextBand = 0;
+		m_iBusy = (int)m_threads.size();
+		m_iGeneration++;
+	}
+	m_wake.notify_all();
+
+	RunBands();
+
+	std::unique_lock< std::mutex > lock( m_mutex );
+	m_done.wait( lock, [this] { return m_iBusy == 0; } );
+	m_pJob = 0;
+}
+
+void StereoParallel::Worker()
+{
+	unsigned iSeen = 0;
+	for ( ;; )
+	{
+		{
+			std::unique_lock< std::mutex > lock( m_mutex );
+			m_wake.wait( lock, [&] { return m_bQuit || m_iGeneration != iSeen; } );
+			if ( m_bQuit )
+				return;
+			iSeen = m_iGeneration;
+		}
+
+		RunBands();
+
+		std::lock_guard< std::mutex > lock( m_mutex );
+		if ( --m_iBusy == 0 )
+			m_done.notify_one();
+	}
+}
+
+void StereoParallel::RunBands()
+{
+	int band;
+	while ( ( band = m_iNextBand++ ) < m_iBands )
+	{
+		int begin = (int)( (long long)m_iCount * band / m_iBands );
+		int end = (int)( (long long)m_iCount * ( band + 1 ) / m_iBands );
+		( *m_pJob )( begin, end );
+	}
+}
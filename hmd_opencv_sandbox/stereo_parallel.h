@@ -0,0 +1,43 @@
+#pragma once
+
+// A small persistent thread pool for splitting per-row image work into bands.  The calling
+// thread takes a band too, so a pool of N threads works on N+1 bands at once.
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class StereoParallel
+{
+public:
+	//iThreads extra worker threads; negative picks one less than the number of cores.
+	StereoParallel( int iThreads = -1 );
+	~StereoParallel();
+
+	int GetBandCount() const { return (int)m_threads.size() + 1; }
+
+	//Calls fn( begin, end ) over contiguous bands covering [0, count), and returns once all of them are done.
+	//Can be called from several threads; while one call has the pool, the others run on their caller alone.
+	void For( int count, const std::function< void( int, int ) > & fn );
+
+private:
+	void Worker();
+	void RunBands();
+
+	std::vector< std::thread > m_threads;
+	std::mutex m_jobMutex;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+
+	const std::function< void( int, int ) > * m_pJob;
+	int m_iCount;
+	int m_iBands;
+	std::atomic< int > m_iNextBand;
+	int m_iBusy;
+	unsigned m_iGeneration;
+	bool m_bQuit;
+};
@@ -0,0 +1,148 @@
+#include "stereo_pipeline.h"
+#include <chrono>
+#include <string.h>
+
+StereoPipeline::StereoPipeline( int iBuffers ) :
+	  m_buffers( iBuffers < 1 ? 1 : iBuffers )
+	, m_iInFlight( 0 )
+	, m_bRunning( false )
+	, m_bStopping( false )
+	, m_startTime( 0 )
+{
+	memset( &m_stats, 0, sizeof( m_stats ) );
+}
+
+StereoPipeline::~StereoPipeline()
+{
+	Stop();
+}
+
+double StereoPipeline::Now()
+{
+	return std::chrono::duration< double >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void StereoPipeline::Start( StereoCore & core, FrontEndFn frontEnd, StageFn match, StageFn output )
+{
+	Stop();
+
+	m_frontEnd = frontEnd;
+	m_stages[STEREO_STAGE_MATCH] = match;
+	m_stages[STEREO_STAGE_OUTPUT] = output;
+	m_free.clear();
+	for ( size_t i = 0; i < m_buffers.size(); i++ )
+	{
+		core.InitBuffers( m_buffers[i] );
+		m_free.push_back( &m_buffers[i] );
+	}
+	memset( &m_stats, 0, sizeof( m_stats ) );
+	m_iInFlight = 0;
+	m_startTime = Now();
+	m_bStopping = false;
+	m_bRunning = true;
+
+	m_threads.push_back( std::thread( &StereoPipeline::StageThread, this, (int)STEREO_STAGE_MATCH ) );
+	m_threads.push_back( std::thread( &StereoPipeline::StageThread, this, (int)STEREO_STAGE_OUTPUT ) );
+}
+
+void StereoPipeline::Submit( const StereoFrame & frame )
+{
+	if ( !m_bRunning )
+		return;
+
+	StereoFrameBuffers * b;
+	{
+		std::unique_lock< std::mutex > lock( m_mutex );
+		double start = Now();
+		m_freeReady.wait( lock, [this] { return !m_free.empty(); } );
+		m_stats.starved[STEREO_STAGE_FRONT_END] += Now() - start;
+		b = m_free.front();
+		m_free.pop_front();
+		m_iInFlight++;
+	}
+
+	memset( &b->times, 0, sizeof( b->times ) );
+	b->userFlags = 0;
+	double start = Now();
+	m_frontEnd( frame, *b );
+	double end = Now();
+
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_stats.busy[STEREO_STAGE_FRONT_END] += end - start;
+		m_queued[STEREO_STAGE_MATCH].push_back( b );
+	}
+	m_queueReady[STEREO_STAGE_MATCH].notify_one();
+}
+
+void StereoPipeline::StageThread( int stage )
+{
+	for ( ;; )
+	{
+		StereoFrameBuffers * b;
+		{
+			std::unique_lock< std::mutex > lock( m_mutex );
+			double start = Now();
+			m_queueReady[stage].wait( lock, [&] { return m_bStopping || !m_queued[stage].empty(); } );
+			if ( m_queued[stage].empty() )
+				return; //Stopping, and Stop has already flushed.
+			m_stats.starved[stage] += Now() - start;
+			b = m_queued[stage].front();
+			m_queued[stage].pop_front();
+		}
+
+		double start = Now();
+		m_stages[stage]( *b );
+		double end = Now();
+
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_stats.busy[stage] += end - start;
+		if ( stage + 1 < STEREO_STAGES )
+		{
+			m_queued[stage + 1].push_back( b );
+			m_queueReady[stage + 1].notify_one();
+		}
+		else
+		{
+			m_free.push_back( b );
+			m_iInFlight--;
+			m_stats.frames++;
+			m_freeReady.notify_one();
+			if ( m_iInFlight == 0 )
+				m_idle.notify_all();
+		}
+	}
+}
+
+void StereoPipeline::Flush()
+{
+	std::unique_lock< std::mutex > lock( m_mutex );
+	m_idle.wait( lock, [this] { return m_iInFlight == 0; } );
+}
+
+void StereoPipeline::Stop()
+{
+	if ( !m_bRunning )
+		return;
+
+	Flush();
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_bStopping = true;
+	}
+	for ( int stage = 0; stage < STEREO_STAGES; stage++ )
+		m_queueReady[stage].notify_all();
+	for ( size_t i = 0; i < m_threads.size(); i++ )
+		m_threads[i].join();
+	m_threads.clear();
+	m_bRunning = false;
+}
+
+StereoPipelineStats StereoPipeline::GetStats()
+{
+	std::lock_guard< std::mutex > lock( m_mutex );
+	StereoPipelineStats stats = m_stats;
+	stats.elapsed = m_bRunning ? Now() - m_startTime : 0;
+	stats.inFlight = m_iInFlight;
+	return stats;
+}
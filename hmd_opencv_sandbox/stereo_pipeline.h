@@ -0,0 +1,77 @@
+#pragma once
+
+// Runs consecutive frames through the depth stages at the same time.  While the output stage
+// (dots, blur, reprojection) works on frame N-1 and the matcher on frame N, the thread calling
+// Submit runs the front end of frame N+1.  Frames move between the stages in StereoFrameBuffers
+// from a fixed pool, so nothing is allocated per frame, and every stage sees the frames in order.
+
+#include "stereo_core.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum StereoPipelineStage
+{
+	STEREO_STAGE_FRONT_END, //On the thread calling Submit.
+	STEREO_STAGE_MATCH,
+	STEREO_STAGE_OUTPUT,
+	STEREO_STAGES
+};
+
+struct StereoPipelineStats
+{
+	uint64_t frames;                 //Frames through the output stage since Start.
+	double busy[STEREO_STAGES];      //Seconds each stage spent working; divide by elapsed for occupancy.
+	double starved[STEREO_STAGES];   //Seconds each stage waited for work.  For the front end, for a free buffer.
+	double elapsed;                  //Seconds since Start.
+	int inFlight;                    //Buffers somewhere between the front end and the end of the output stage.
+};
+
+class StereoPipeline
+{
+public:
+	typedef std::function< void( const StereoFrame &, StereoFrameBuffers & ) > FrontEndFn;
+	typedef std::function< void( StereoFrameBuffers & ) > StageFn;
+
+	//iBuffers frames can be in the pipeline at once; 3 keeps every stage busy.
+	StereoPipeline( int iBuffers = 3 );
+	~StereoPipeline();
+
+	//Sizes the buffers for core, and starts a thread each for match and output.
+	void Start( StereoCore & core, FrontEndFn frontEnd, StageFn match, StageFn output );
+	//Runs the front end on this thread, then hands the frame on.  Waits for a free buffer when all
+	//of them are in use, so the caller is held back when the later stages fall behind.  The frame's
+	//pixels are not used after Submit returns.
+	void Submit( const StereoFrame & frame );
+	//Waits until everything submitted has been through the output stage.
+	void Flush();
+	//Flushes, then stops the threads.
+	void Stop();
+
+	bool IsRunning() const { return m_bRunning; }
+	StereoPipelineStats GetStats();
+
+private:
+	static double Now();
+	void StageThread( int stage );
+
+	std::vector< StereoFrameBuffers > m_buffers;
+	std::vector< std::thread > m_threads;
+	FrontEndFn m_frontEnd;
+	StageFn m_stages[STEREO_STAGES];
+
+	std::mutex m_mutex;
+	std::deque< StereoFrameBuffers * > m_free;
+	std::deque< StereoFrameBuffers * > m_queued[STEREO_STAGES]; //Waiting for each stage.
+	std::condition_variable m_freeReady;
+	std::condition_variable m_queueReady[STEREO_STAGES];
+	std::condition_variable m_idle;
+	int m_iInFlight;
+	bool m_bRunning;
+	bool m_bStopping;
+	double m_startTime;
+	StereoPipelineStats m_stats;
+};
@@ -0,0 +1,85 @@
+#include "stereo_point_ring.h"
+#include "stereo_half.h"
+#include <string.h>
+#include <thread>
+
+void PackStereoDots( const StereoDot * pDots, int iCount, StereoDotVertex * pOut )
+{
+	for ( int i = 0; i < iCount; i++ )
+	{
+		const StereoDot & d = pDots[i];
+		StereoDotVertex & v = pOut[i];
+#if STEREO_HALF_F16C
+		__m128 xyzw = _mm_loadu_ps( &d.x );
+		__m128 color = _mm_loadu_ps( &d.r );
+		int frame = _mm_cvtsi128_si32( _mm_shuffle_epi32( _mm_cvttps_epi32( color ), 3 ) );
+		color = _mm_min_ps( _mm_max_ps( color, _mm_setzero_ps() ), _mm_set1_ps( 1.0f ) );
+		__m128i bytes = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( color, _mm_set1_ps( 255.0f ) ), _mm_set1_ps( 0.5f ) ) );
+		bytes = _mm_packus_epi16( _mm_packs_epi32( bytes, bytes ), bytes );
+		__m128i position = _mm_insert_epi16( FloatToHalf8( xyzw, xyzw ), frame, 3 );
+		_mm_storel_epi64( (__m128i*)&v, position );
+		uint32_t rgba = (uint32_t)_mm_cvtsi128_si32( bytes ) | 0xff000000;
+		memcpy( &v.r, &rgba, 4 );
+#else
+		v.x = FloatToHalf( d.x );
+		v.y = FloatToHalf( d.y );
+		v.z = FloatToHalf( d.z );
+		v.frame = (uint16_t)(int)d.a;
+		const float * c = &d.r;
+		uint8_t * o = &v.r;
+		for ( int k = 0; k < 3; k++ )
+		{
+			float f = ( c[k] < 0 ) ? 0 : ( c[k] > 1 ) ? 1 : c[k];
+			o[k] = (uint8_t)(int)( f * 255.0f + 0.5f );
+		}
+		v.a = 255;
+#endif
+	}
+}
+
+StereoPointRing::StereoPointRing() :
+	  m_iReserved( 0 )
+	, m_iPublished( 0 )
+	, m_iConsumed( 0 )
+	, m_iDropped( 0 )
+{
+}
+
+void StereoPointRing::Init( int iSlots )
+{
+	m_slots.assign( iSlots < 1 ? 1 : iSlots, StereoDotVertex() );
+	m_iReserved = 0;
+	m_iPublished = 0;
+	m_iConsumed = 0;
+	m_iDropped = 0;
+}
+
+void StereoPointRing::Push( const StereoDot * pDots, int iCount )
+{
+	if ( iCount <= 0 )
+		return;
+	uint64_t iSlots = m_slots.size();
+	uint64_t iStart = m_iReserved.fetch_add( iCount, std::memory_order_relaxed );
+	uint64_t iEnd = iStart + iCount;
+
+	//A batch bigger than the ring would only overwrite itself, so just its last ring's worth goes in.
+	uint64_t iFrom = ( iCount > (int)iSlots ) ? iEnd - iSlots : iStart;
+	//The consumer may be reading anything from where it started, so the slots a whole ring past that are off limits.
+	uint64_t iLimit = m_iConsumed.load( std::memory_order_acquire ) + iSlots;
+	uint64_t iTo = ( iEnd < iLimit ) ? iEnd : iLimit;
+	if ( iTo < iFrom ) iTo = iFrom;
+	m_iDropped.fetch_add( iCount - ( iTo - iFrom ), std::memory_order_relaxed );
+
+	while ( iFrom < iTo )
+	{
+		uint64_t iFirst = iFrom % iSlots;
+		uint64_t n = ( iTo - iFrom < iSlots - iFirst ) ? iTo - iFrom : iSlots - iFirst;
+		PackStereoDots( pDots + ( iFrom - iStart ), (int)n, &m_slots[iFirst] );
+		iFrom += n;
+	}
+
+	//Publish in reservation order.  The batches ahead of this one are already copying.
+	while ( m_iPublished.load( std::memory_order_acquire ) != iStart )
+		std::this_thread::yield();
+	m_iPublished.store( iEnd, std::memory_order_release );
+}
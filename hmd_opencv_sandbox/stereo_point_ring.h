@@ -0,0 +1,86 @@
+#pragma once
+
+// The app's point cloud: a fixed ring of dots that any number of threads push into and the GL
+// thread uploads from.  New dots overwrite the oldest.  The ring holds them as the point cloud's
+// vertices (StereoDotVertex), packed as they are pushed, so the upload is a straight copy.
+//
+// A push reserves its slots with one atomic add on a running count of dots, copies its dots in,
+// then publishes them.  Batches are published in the order they reserved, so everything before the
+// published count is complete; a producer whose batch reserved after another's waits for that one
+// to publish first, which only takes as long as its copy.  The consumer uploads the slots between
+// what it uploaded last time and the published count, as at most two spans where they wrap.
+//
+// Producers never write a slot the consumer might be reading.  That only happens when they get a
+// whole ring ahead of the last upload; those dots are dropped (counted in GetDropped) and the
+// slots they would have gone in keep their older dots.
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+//One dot as it is made: position and w, then color and the frame it was made on.
+struct StereoDot
+{
+	float x, y, z, w;
+	float r, g, b, a;
+};
+
+//One dot as the point cloud's VBO holds it, in 12 bytes rather than 32.  The position is half
+//floats, within a millimeter out to 4 m and two out to 8 m; w is always 1, which the shader gets
+//by default.  frame is StereoDot's a, a frame number, modulo 65536.  The color is RGBA8 with a
+//solid alpha.
+struct StereoDotVertex
+{
+	uint16_t x, y, z;
+	uint16_t frame;
+	uint8_t r, g, b, a;
+};
+
+//Packs a batch of dots.
+void PackStereoDots( const StereoDot * pDots, int iCount, StereoDotVertex * pOut );
+
+class StereoPointRing
+{
+public:
+	StereoPointRing();
+
+	//Sizes the ring, and forgets what was pushed.  Not while anything else is using it.
+	void Init( int iSlots );
+	int GetSlots() const { return (int)m_slots.size(); }
+
+	//Any thread.  Packs iCount dots into the next slots.
+	void Push( const StereoDot * pDots, int iCount );
+
+	//The consumer, one thread only.  Calls upload( iFirstSlot, pDots, iCount ) for each span of
+	//slots published since the last call, and returns the number of dots in them.  If more than
+	//the whole ring was published, that's every slot once.
+	template< typename F > int Consume( F upload )
+	{
+		uint64_t iPublished = m_iPublished.load( std::memory_order_acquire );
+		uint64_t iFrom = m_iConsumed.load( std::memory_order_relaxed );
+		uint64_t iSlots = m_slots.size();
+		if ( iPublished - iFrom > iSlots )
+			iFrom = iPublished - iSlots;
+		int iDots = (int)( iPublished - iFrom );
+		while ( iFrom < iPublished )
+		{
+			int iFirst = (int)( iFrom % iSlots );
+			int iCount = (int)( ( iPublished - iFrom < iSlots - iFirst ) ? iPublished - iFrom : iSlots - iFirst );
+			upload( iFirst, &m_slots[iFirst], iCount );
+			iFrom += iCount;
+		}
+		//Only now can producers write over what was just read.
+		m_iConsumed.store( iPublished, std::memory_order_release );
+		return iDots;
+	}
+
+	uint64_t GetPushed() const { return m_iReserved.load( std::memory_order_relaxed ); }
+	uint64_t GetDropped() const { return m_iDropped.load( std::memory_order_relaxed ); }
+
+private:
+	std::vector< StereoDotVertex > m_slots;
+	std::atomic< uint64_t > m_iReserved;  //Dots ever pushed; dot n goes in slot n % slots.
+	std::atomic< uint64_t > m_iPublished; //Dots before this are all written.
+	std::atomic< uint64_t > m_iConsumed;  //Where the consumer's next upload starts.
+	std::atomic< uint64_t > m_iDropped;
+};
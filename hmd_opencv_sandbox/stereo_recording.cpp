@@ -0,0 +1,239 @@
+#include "stereo_recording.h"
+#include <string.h>
+#include <fstream>
+#include <sstream>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+//The stb_image implementation is in geometry_object.cpp for the app, and stereo_bench.cpp for the bench.
+#include "stb_image.h"
+
+#define STEREO_RECORDING_VERSION 1
+
+static std::string DirectoryOf( const std::string & sPath )
+{
+	size_t slash = sPath.find_last_of( "/\\" );
+	return ( slash == std::string::npos ) ? std::string() : sPath.substr( 0, slash + 1 );
+}
+
+static void WriteMatrix34( FILE * f, const Matrix4 & m )
+{
+	const float * c = m.get(); //Column major.
+	for ( int row = 0; row < 3; row++ )
+		for ( int col = 0; col < 4; col++ )
+			fprintf( f, " %.9g", c[col * 4 + row] );
+}
+
+static bool ReadMatrix34( std::istream & in, Matrix4 & m )
+{
+	float rows[12];
+	for ( int i = 0; i < 12; i++ )
+	{
+		if ( !( in >> rows[i] ) )
+			return false;
+	}
+	m = Matrix3x4( rows ).toMatrix4();
+	return true;
+}
+
+StereoRecordingWriter::StereoRecordingWriter() :
+	  m_fManifest( 0 )
+	, m_iFrames( 0 )
+{
+}
+
+StereoRecordingWriter::~StereoRecordingWriter()
+{
+	Close();
+}
+
+bool StereoRecordingWriter::Open( const std::string & sManifest, const StereoCalibration & calib )
+{
+	Close();
+
+	m_fManifest = fopen( sManifest.c_str(), "w" );
+	if ( !m_fManifest )
+		return false;
+
+	m_sDirectory = DirectoryOf( sManifest );
+	m_sFramePrefix = sManifest.substr( m_sDirectory.size() );
+	size_t dot = m_sFramePrefix.find_last_of( '.' );
+	if ( dot != std::string::npos )
+		m_sFramePrefix.resize( dot );
+	m_iFrames = 0;
+
+	fprintf( m_fManifest, "stereo_recording %d\n", STEREO_RECORDING_VERSION );
+	fprintf( m_fManifest, "frame_size %u %u\n", calib.frameWidth, calib.frameHeight );
+	fprintf( m_fManifest, "fisheye %d\n", calib.fisheye ? 1 : 0 );
+	for ( int eye = 0; eye < 2; eye++ )
+	{
+		fprintf( m_fManifest, "intrinsics %d %.9g %.9g %.9g %.9g\n", eye,
+			calib.intrinsics[eye].fx, calib.intrinsics[eye].cx, calib.intrinsics[eye].fy, calib.intrinsics[eye].cy );
+		fprintf( m_fManifest, "distortion %d", eye );
+		for ( int i = 0; i < STEREO_MAX_DISTORTION_PARAMETERS; i++ )
+			fprintf( m_fManifest, " %.17g", calib.distortion[eye][i] );
+		fprintf( m_fManifest, "\nhead_from_camera %d", eye );
+		WriteMatrix34( m_fManifest, calib.headFromCamera[eye] );
+		fprintf( m_fManifest, "\n" );
+	}
+	fflush( m_fManifest );
+	return true;
+}
+
+bool StereoRecordingWriter::WriteFrame( const StereoFrame & frame )
+{
+	if ( !m_fManifest )
+		return false;
+
+	char name[32];
+	snprintf( name, sizeof( name ), "_%06u.png", m_iFrames );
+	std::string sFile = m_sFramePrefix + name;
+	if ( !stbi_write_png( ( m_sDirectory + sFile ).c_str(), frame.width, frame.height, 4, frame.pPixels, frame.width * 4 ) )
+		return false;
+
+	fprintf( m_fManifest, "frame %u %.17g %s", frame.sequence, frame.timestamp, sFile.c_str() );
+	WriteMatrix34( m_fManifest, frame.worldFromHead );
+	fprintf( m_fManifest, "\n" );
+	fflush( m_fManifest );
+	m_iFrames++;
+	return true;
+}
+
+void StereoRecordingWriter::Close()
+{
+	if ( m_fManifest )
+	{
+		fclose( m_fManifest );
+		m_fManifest = 0;
+	}
+}
+
+StereoRecordingSource::StereoRecordingSource() :
+	  m_calib()
+	, m_bHaveCalibration( false )
+	, m_iNextFrame( 0 )
+	, m_pPixels( 0 )
+{
+}
+
+StereoRecordingSource::~StereoRecordingSource()
+{
+	if ( m_pPixels )
+		stbi_image_free( m_pPixels );
+}
+
+bool StereoRecordingSource::Open( const std::string & sManifest )
+{
+	std::ifstream in( sManifest.c_str() );
+	if ( !in )
+		return false;
+
+	m_sDirectory = DirectoryOf( sManifest );
+	m_frames.clear();
+	m_iNextFrame = 0;
+	m_calib = StereoCalibration();
+
+	bool bHaveHeader = false, bHaveSize = false;
+	std::string sLine;
+	while ( std::getline( in, sLine ) )
+	{
+		std::istringstream line( sLine );
+		std::string sKey;
+		if ( !( line >> sKey ) || sKey[0] == '#' )
+			continue;
+
+		int eye = 0;
+		bool bOk = true;
+		if ( sKey == "stereo_recording" )
+		{
+			int version = 0;
+			bOk = ( line >> version ) && version == STEREO_RECORDING_VERSION;
+			bHaveHeader = bOk;
+		}
+		else if ( sKey == "frame_size" )
+		{
+			bOk = bHaveSize = !!( line >> m_calib.frameWidth >> m_calib.frameHeight );
+		}
+		else if ( sKey == "fisheye" )
+		{
+			int fisheye = 0;
+			bOk = !!( line >> fisheye );
+			m_calib.fisheye = fisheye != 0;
+		}
+		else if ( sKey == "intrinsics" || sKey == "distortion" || sKey == "head_from_camera" )
+		{
+			bOk = ( line >> eye ) && eye >= 0 && eye < 2;
+			if ( bOk && sKey == "intrinsics" )
+			{
+				bOk = !!( line >> m_calib.intrinsics[eye].fx >> m_calib.intrinsics[eye].cx >> m_calib.intrinsics[eye].fy >> m_calib.intrinsics[eye].cy );
+			}
+			else if ( bOk && sKey == "distortion" )
+			{
+				for ( int i = 0; i < STEREO_MAX_DISTORTION_PARAMETERS && bOk; i++ )
+					bOk = !!( line >> m_calib.distortion[eye][i] );
+			}
+			else if ( bOk )
+			{
+				bOk = ReadMatrix34( line, m_calib.headFromCamera[eye] );
+			}
+		}
+		else if ( sKey == "frame" )
+		{
+			FrameEntry e;
+			bOk = ( line >> e.sequence >> e.timestamp >> e.sFile ) && ReadMatrix34( line, e.worldFromHead );
+			if ( bOk )
+				m_frames.push_back( e );
+		}
+
+		if ( !bOk )
+		{
+			fprintf( stderr, "%s: bad line: %s\n", sManifest.c_str(), sLine.c_str() );
+			return false;
+		}
+	}
+
+	m_bHaveCalibration = bHaveHeader && bHaveSize;
+	return m_bHaveCalibration;
+}
+
+bool StereoRecordingSource::GetCalibration( StereoCalibration & calib )
+{
+	if ( !m_bHaveCalibration )
+		return false;
+	calib = m_calib;
+	return true;
+}
+
+bool StereoRecordingSource::NextFrame( StereoFrame & frame )
+{
+	if ( m_iNextFrame >= m_frames.size() )
+		return false;
+	const FrameEntry & e = m_frames[m_iNextFrame++];
+
+	if ( m_pPixels )
+	{
+		stbi_image_free( m_pPixels );
+		m_pPixels = 0;
+	}
+
+	int width, height, channels;
+	m_pPixels = stbi_load( ( m_sDirectory + e.sFile ).c_str(), &width, &height, &channels, 4 );
+	if ( !m_pPixels )
+	{
+		fprintf( stderr, "Could not load %s\n", ( m_sDirectory + e.sFile ).c_str() );
+		return false;
+	}
+	if ( (uint32_t)width != m_calib.frameWidth || (uint32_t)height != m_calib.frameHeight )
+	{
+		fprintf( stderr, "%s is %dx%d, expected %ux%u\n", e.sFile.c_str(), width, height, m_calib.frameWidth, m_calib.frameHeight );
+		return false;
+	}
+
+	frame.pPixels = m_pPixels;
+	frame.width = width;
+	frame.height = height;
+	frame.worldFromHead = e.worldFromHead;
+	frame.timestamp = e.timestamp;
+	frame.sequence = e.sequence;
+	return true;
+}
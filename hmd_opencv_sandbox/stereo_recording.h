@@ -0,0 +1,69 @@
+#pragma once
+
+// Stereo recordings: a text manifest with the calibration and one line per frame, next to one
+// lossless PNG per side-by-side frame.
+//
+//   stereo_recording 1
+//   frame_size <width> <height>
+//   fisheye <0|1>
+//   intrinsics <eye> <fx> <cx> <fy> <cy>
+//   distortion <eye> <8 coefficients>
+//   head_from_camera <eye> <3x4, row major>
+//   frame <sequence> <timestamp> <png, relative to the manifest> <world from head 3x4, row major>
+//
+// Lines starting with # are ignored.  The app writes these while recording ('c' toggles it),
+// and stereo_bench replays them.
+
+#include "stereo_core.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class StereoRecordingWriter
+{
+public:
+	StereoRecordingWriter();
+	~StereoRecordingWriter();
+
+	//Frames go next to the manifest, named after it.
+	bool Open( const std::string & sManifest, const StereoCalibration & calib );
+	bool WriteFrame( const StereoFrame & frame );
+	void Close();
+	bool IsOpen() const { return m_fManifest != 0; }
+	uint32_t GetFrameCount() const { return m_iFrames; }
+
+private:
+	FILE * m_fManifest;
+	std::string m_sDirectory;
+	std::string m_sFramePrefix;
+	uint32_t m_iFrames;
+};
+
+class StereoRecordingSource : public StereoFrameSource
+{
+public:
+	StereoRecordingSource();
+	virtual ~StereoRecordingSource();
+
+	bool Open( const std::string & sManifest );
+	virtual bool GetCalibration( StereoCalibration & calib );
+	virtual bool NextFrame( StereoFrame & frame );
+	void Rewind() { m_iNextFrame = 0; }
+	size_t GetFrameCount() const { return m_frames.size(); }
+
+private:
+	struct FrameEntry
+	{
+		uint32_t sequence;
+		double timestamp;
+		std::string sFile;
+		Matrix4 worldFromHead;
+	};
+
+	StereoCalibration m_calib;
+	bool m_bHaveCalibration;
+	std::string m_sDirectory;
+	std::vector< FrameEntry > m_frames;
+	size_t m_iNextFrame;
+	uint8_t * m_pPixels;
+};
@@ -0,0 +1,145 @@
+// Pushes dots into StereoPointRing from several threads while another consumes it the way the GL
+// thread does, and reports dots pushed per second, next to the old unsynchronized one dot at a time
+// ring for comparison.
+//
+// The consumer copies each span it gets into a buffer standing in for the VBO, and at the end every
+// vertex in it has to be whole: each dot's fields are made from its producer, batch and index, in
+// values that pack exactly, so a vertex copied while a producer was writing it shows.  Build with -fsanitize=thread to check the
+// synchronization as well.
+//
+//   g++ -O2 -pthread -I. stereo_ring_bench.cpp stereo_point_ring.cpp -o stereo_ring_bench
+//
+// Usage: stereo_ring_bench [producers, default 2] [dots per batch, default 10000] [seconds, default 2] [--upload-hz=N]
+//   --upload-hz=  how often the consumer uploads, default 90 as for the headset; 0 for as often as it can
+
+#include "stereo_point_ring.h"
+#include "stereo_half.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define RING_DOTS ( 65536 * 2 )
+
+static double Now()
+{
+	return std::chrono::duration< double >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+//Half floats hold whole numbers exactly up to 2048.
+static StereoDot MakeDot( int producer, uint32_t batch, int i )
+{
+	int x = producer, y = batch & 0x7ff, z = i & 0x7ff;
+	StereoDot d;
+	d.x = (float)x;
+	d.y = (float)y;
+	d.z = (float)z;
+	d.w = 1.0f;
+	d.r = ( ( y + z ) & 0xff ) / 255.0f;
+	d.g = ( ( x + z ) & 0xff ) / 255.0f;
+	d.b = ( ( x + y ) & 0xff ) / 255.0f;
+	d.a = (float)( x + y * 3 + z );
+	return d;
+}
+
+static bool IsWhole( const StereoDotVertex & v )
+{
+	if ( v.a == 0 )
+		return v.x == 0 && v.y == 0 && v.z == 0 && v.frame == 0 && v.r == 0 && v.g == 0 && v.b == 0; //Never written.
+	int x = (int)HalfToFloat( v.x ), y = (int)HalfToFloat( v.y ), z = (int)HalfToFloat( v.z );
+	return v.a == 255 && v.frame == x + y * 3 + z && v.r == ( ( y + z ) & 0xff ) && v.g == ( ( x + z ) & 0xff ) && v.b == ( ( x + y ) & 0xff );
+}
+
+int main( int argc, char ** argv )
+{
+	int iProducers = 2;
+	int iBatch = 10000;
+	double dSeconds = 2.0;
+	int iUploadHz = 90;
+	for ( int i = 1, iPositional = 0; i < argc; i++ )
+	{
+		if ( strncmp( argv[i], "--upload-hz=", 12 ) == 0 ) iUploadHz = atoi( argv[i] + 12 );
+		else if ( iPositional == 0 ) { iProducers = atoi( argv[i] ); iPositional++; }
+		else if ( iPositional == 1 ) { iBatch = atoi( argv[i] ); iPositional++; }
+		else dSeconds = atof( argv[i] );
+	}
+	if ( iProducers < 1 ) iProducers = 1;
+	if ( iBatch < 1 ) iBatch = 1;
+
+	//The old way: one thread, one dot at a time, nothing to say what's ready.
+	{
+		std::vector< float > data( RING_DOTS * 8 );
+		int place = 0;
+		uint64_t iDots = 0;
+		double start = Now();
+		while ( Now() - start < dSeconds / 4 )
+		{
+			for ( int i = 0; i < iBatch; i++ )
+			{
+				StereoDot d = MakeDot( 0, (uint32_t)iDots, i );
+				place++;
+				if ( place == RING_DOTS ) place = 0;
+				memcpy( &data[place * 8], &d, sizeof( d ) );
+			}
+			iDots += iBatch;
+		}
+		double elapsed = Now() - start;
+		printf( "EmitDot, 1 thread:            %8.1f M dots/s\n", iDots / elapsed / 1e6 );
+	}
+
+	StereoPointRing ring;
+	ring.Init( RING_DOTS );
+	std::vector< StereoDotVertex > vbo( RING_DOTS );
+	int iSpans = 0;
+	uint64_t iUploaded = 0;
+
+	bool bDone = false;
+	std::atomic< bool > bStop( false );
+	std::vector< std::thread > producers;
+	double start = Now();
+	for ( int p = 0; p < iProducers; p++ )
+	{
+		producers.push_back( std::thread( [&ring, &bStop, p, iBatch]()
+		{
+			std::vector< StereoDot > dots( iBatch );
+			for ( uint32_t batch = 1; !bStop.load( std::memory_order_relaxed ); batch++ )
+			{
+				for ( int i = 0; i < iBatch; i++ )
+					dots[i] = MakeDot( p + 1, batch, i );
+				ring.Push( &dots[0], iBatch );
+			}
+		} ) );
+	}
+
+	//The consumer runs here, as the GL thread would.
+	while ( !bDone )
+	{
+		bDone = Now() - start >= dSeconds;
+		if ( bDone )
+		{
+			bStop = true;
+			for ( size_t p = 0; p < producers.size(); p++ )
+				producers[p].join();
+		}
+		iUploaded += ring.Consume( [&]( int iFirst, const StereoDotVertex * pVerts, int iCount )
+		{
+			memcpy( &vbo[iFirst], pVerts, iCount * sizeof( StereoDotVertex ) );
+			iSpans++;
+		} );
+		if ( iUploadHz > 0 && !bDone )
+			std::this_thread::sleep_for( std::chrono::microseconds( 1000000 / iUploadHz ) );
+	}
+	double elapsed = Now() - start;
+
+	uint64_t iTorn = 0;
+	for ( int i = 0; i < RING_DOTS; i++ )
+		iTorn += !IsWhole( vbo[i] );
+
+	printf( "StereoPointRing, %d producer%s:%8.1f M dots/s pushed, %.1f M uploaded in %d spans, %.2f%% dropped\n", iProducers,
+		iProducers == 1 ? "" : "s", ring.GetPushed() / elapsed / 1e6, iUploaded / 1e6, iSpans, 100.0 * ring.GetDropped() / ring.GetPushed() );
+	printf( "%.1f MB uploaded, %.1f MB as whole StereoDots\n", iUploaded * sizeof( StereoDotVertex ) / 1e6, iUploaded * sizeof( StereoDot ) / 1e6 );
+	printf( "%llu torn vertices\n", (unsigned long long)iTorn );
+	return iTorn ? 1 : 0;
+}
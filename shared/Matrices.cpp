@@ -25,6 +25,71 @@ const float EPSILON = 0.00001f;
 
 
 
+#if defined(MATRICES_SSE)
+///////////////////////////////////////////////////////////////////////////////
+// SSE helpers
+///////////////////////////////////////////////////////////////////////////////
+#define MATRICES_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+
+// the batch transforms load arrays of vectors straight into registers
+static_assert(sizeof(Vector3) == 3 * sizeof(float) && sizeof(Vector4) == 4 * sizeof(float), "vectors must be tightly packed");
+
+// a x b in the first 3 lanes
+static inline __m128 crossSSE(__m128 a, __m128 b)
+{
+    const __m128 c = _mm_sub_ps(_mm_mul_ps(a, MATRICES_SHUFFLE(b, b, 1, 2, 0, 3)), _mm_mul_ps(MATRICES_SHUFFLE(a, a, 1, 2, 0, 3), b));
+    return MATRICES_SHUFFLE(c, c, 1, 2, 0, 3);
+}
+
+// a . b in every lane
+static inline __m128 dotSSE(__m128 a, __m128 b)
+{
+    __m128 p = _mm_mul_ps(a, b);
+    p = _mm_add_ps(p, MATRICES_SHUFFLE(p, p, 1, 0, 3, 2));
+    return _mm_add_ps(p, MATRICES_SHUFFLE(p, p, 2, 3, 0, 1));
+}
+
+// 2x2 matrices held as (m00, m01, m10, m11) in one register
+// A * B
+static inline __m128 mat2MulSSE(__m128 a, __m128 b)
+{
+    return _mm_add_ps(_mm_mul_ps(a, MATRICES_SHUFFLE(b, b, 0, 3, 0, 3)),
+                      _mm_mul_ps(MATRICES_SHUFFLE(a, a, 1, 0, 3, 2), MATRICES_SHUFFLE(b, b, 2, 1, 2, 1)));
+}
+
+// adj(A) * B
+static inline __m128 mat2AdjMulSSE(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(MATRICES_SHUFFLE(a, a, 3, 3, 0, 0), b),
+                      _mm_mul_ps(MATRICES_SHUFFLE(a, a, 1, 1, 2, 2), MATRICES_SHUFFLE(b, b, 2, 3, 0, 1)));
+}
+
+// A * adj(B)
+static inline __m128 mat2MulAdjSSE(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(a, MATRICES_SHUFFLE(b, b, 3, 0, 3, 0)),
+                      _mm_mul_ps(MATRICES_SHUFFLE(a, a, 1, 0, 3, 2), MATRICES_SHUFFLE(b, b, 2, 1, 2, 1)));
+}
+
+// Four points (twelve floats at p) split into x, y and z registers, and back
+static inline void loadPoints4SSE(const float* p, __m128& x, __m128& y, __m128& z)
+{
+    const __m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4), c = _mm_loadu_ps(p + 8);
+    x = MATRICES_SHUFFLE(a, MATRICES_SHUFFLE(b, c, 2, 0, 1, 0), 0, 3, 0, 2);
+    y = MATRICES_SHUFFLE(MATRICES_SHUFFLE(a, b, 1, 0, 0, 0), MATRICES_SHUFFLE(b, c, 3, 0, 2, 0), 0, 2, 0, 2);
+    z = MATRICES_SHUFFLE(MATRICES_SHUFFLE(a, b, 2, 0, 1, 0), c, 0, 2, 0, 3);
+}
+
+static inline void storePoints4SSE(__m128 x, __m128 y, __m128 z, float* p)
+{
+    _mm_storeu_ps(p,     MATRICES_SHUFFLE(MATRICES_SHUFFLE(x, y, 0, 0, 0, 0), MATRICES_SHUFFLE(z, x, 0, 0, 1, 0), 0, 2, 0, 2));
+    _mm_storeu_ps(p + 4, MATRICES_SHUFFLE(MATRICES_SHUFFLE(y, z, 1, 0, 1, 0), MATRICES_SHUFFLE(x, y, 2, 0, 2, 0), 0, 2, 0, 2));
+    _mm_storeu_ps(p + 8, MATRICES_SHUFFLE(MATRICES_SHUFFLE(z, x, 2, 0, 3, 0), MATRICES_SHUFFLE(y, z, 3, 0, 3, 0), 0, 2, 0, 2));
+}
+#endif
+
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // transpose 2x2 matrix
 ///////////////////////////////////////////////////////////////////////////////
@@ -249,6 +314,46 @@ Matrix4& Matrix4::invertEuclidean()
 ///////////////////////////////////////////////////////////////////////////////
 Matrix4& Matrix4::invertAffine()
 {
+#if defined(MATRICES_SSE)
+    // The rows of R^-1 are the cross products of pairs of R's columns over the determinant
+    const __m128 xyzMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    const __m128 c0 = _mm_and_ps(_mm_loadu_ps(m), xyzMask);
+    const __m128 c1 = _mm_and_ps(_mm_loadu_ps(m + 4), xyzMask);
+    const __m128 c2 = _mm_and_ps(_mm_loadu_ps(m + 8), xyzMask);
+
+    __m128 r0 = crossSSE(c1, c2);
+    __m128 r1 = crossSSE(c2, c0);
+    __m128 r2 = crossSSE(c0, c1);
+    __m128 r3 = _mm_setzero_ps();
+
+    const __m128 determinant = dotSSE(c0, r0);
+    if(fabs(_mm_cvtss_f32(determinant)) <= EPSILON)
+    {
+        // same as Matrix3::invert(), R^-1 becomes identity
+        r0 = _mm_setr_ps(1, 0, 0, 0);
+        r1 = _mm_setr_ps(0, 1, 0, 0);
+        r2 = _mm_setr_ps(0, 0, 1, 0);
+    }
+    else
+    {
+        const __m128 invDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+        r0 = _mm_mul_ps(r0, invDeterminant);
+        r1 = _mm_mul_ps(r1, invDeterminant);
+        r2 = _mm_mul_ps(r2, invDeterminant);
+    }
+
+    // into columns, then -R^-1 * T
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    const __m128 translation = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, _mm_set1_ps(m[12])), _mm_mul_ps(r1, _mm_set1_ps(m[13]))),
+                                          _mm_mul_ps(r2, _mm_set1_ps(m[14])));
+
+    _mm_storeu_ps(m,      r0);
+    _mm_storeu_ps(m + 4,  r1);
+    _mm_storeu_ps(m + 8,  r2);
+    _mm_storeu_ps(m + 12, _mm_sub_ps(_mm_setr_ps(0, 0, 0, 1), translation));
+
+    return *this;
+#else
     // R^-1
     Matrix3 r(m[0],m[1],m[2], m[4],m[5],m[6], m[8],m[9],m[10]);
     r.invert();
@@ -269,6 +374,7 @@ Matrix4& Matrix4::invertAffine()
     //m[15] = 1.0f;
 
     return * this;
+#endif
 }
 
 
@@ -348,6 +454,62 @@ Matrix4& Matrix4::invertProjective()
 ///////////////////////////////////////////////////////////////////////////////
 Matrix4& Matrix4::invertGeneral()
 {
+#if defined(MATRICES_SSE)
+    // Blockwise inverse on the four 2x2 sub matrices
+    // | A B |-1                  | adj(X) adj(Y) |
+    // | C D |     = 1 / det(M) * | adj(Z) adj(W) |
+    // with X = det(D) A - B adj(D) C, W = det(A) D - C adj(A) B, Y = det(B) C - D adj(adj(A) B),
+    // Z = det(C) B - A adj(adj(D) C) and det(M) = det(A) det(D) + det(B) det(C) - tr(adj(A) B adj(D) C).
+    // This works on the array as if it were row major: that inverts the transpose, and the transpose of the inverse read
+    // back as column major is the inverse.
+    const __m128 v0 = _mm_loadu_ps(m), v1 = _mm_loadu_ps(m + 4), v2 = _mm_loadu_ps(m + 8), v3 = _mm_loadu_ps(m + 12);
+
+    const __m128 a = _mm_movelh_ps(v0, v1);
+    const __m128 b = _mm_movehl_ps(v1, v0);
+    const __m128 c = _mm_movelh_ps(v2, v3);
+    const __m128 d = _mm_movehl_ps(v3, v2);
+
+    // (det(A), det(B), det(C), det(D))
+    const __m128 detSub = _mm_sub_ps(_mm_mul_ps(MATRICES_SHUFFLE(v0, v2, 0, 2, 0, 2), MATRICES_SHUFFLE(v1, v3, 1, 3, 1, 3)),
+                                     _mm_mul_ps(MATRICES_SHUFFLE(v0, v2, 1, 3, 1, 3), MATRICES_SHUFFLE(v1, v3, 0, 2, 0, 2)));
+    const __m128 detA = MATRICES_SHUFFLE(detSub, detSub, 0, 0, 0, 0);
+    const __m128 detB = MATRICES_SHUFFLE(detSub, detSub, 1, 1, 1, 1);
+    const __m128 detC = MATRICES_SHUFFLE(detSub, detSub, 2, 2, 2, 2);
+    const __m128 detD = MATRICES_SHUFFLE(detSub, detSub, 3, 3, 3, 3);
+
+    const __m128 adjDC = mat2AdjMulSSE(d, c);
+    const __m128 adjAB = mat2AdjMulSSE(a, b);
+
+    __m128 x = _mm_sub_ps(_mm_mul_ps(detD, a), mat2MulSSE(b, adjDC));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(detA, d), mat2MulSSE(c, adjAB));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(detB, c), mat2MulAdjSSE(d, adjAB));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(detC, b), mat2MulAdjSSE(a, adjDC));
+
+    __m128 trace = _mm_mul_ps(adjAB, MATRICES_SHUFFLE(adjDC, adjDC, 0, 2, 1, 3));
+    trace = _mm_add_ps(trace, MATRICES_SHUFFLE(trace, trace, 1, 0, 3, 2));
+    trace = _mm_add_ps(trace, MATRICES_SHUFFLE(trace, trace, 2, 3, 0, 1));
+
+    const __m128 determinant = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), trace);
+    if(fabs(_mm_cvtss_f32(determinant)) <= EPSILON)
+    {
+        return identity();
+    }
+
+    // the signs of the adjugate folded into the scale
+    const __m128 invDeterminant = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), determinant);
+    x = _mm_mul_ps(x, invDeterminant);
+    y = _mm_mul_ps(y, invDeterminant);
+    z = _mm_mul_ps(z, invDeterminant);
+    w = _mm_mul_ps(w, invDeterminant);
+
+    // adjugate of each block, shuffled into place
+    _mm_storeu_ps(m,      MATRICES_SHUFFLE(x, y, 3, 1, 3, 1));
+    _mm_storeu_ps(m + 4,  MATRICES_SHUFFLE(x, y, 2, 0, 2, 0));
+    _mm_storeu_ps(m + 8,  MATRICES_SHUFFLE(z, w, 3, 1, 3, 1));
+    _mm_storeu_ps(m + 12, MATRICES_SHUFFLE(z, w, 2, 0, 2, 0));
+
+    return *this;
+#else
     // get cofactors of minor matrices
     float cofactor0 = getCofactor(m[5],m[6],m[7], m[9],m[10],m[11], m[13],m[14],m[15]);
     float cofactor1 = getCofactor(m[4],m[6],m[7], m[8],m[10],m[11], m[12],m[14],m[15]);
@@ -401,6 +563,35 @@ Matrix4& Matrix4::invertGeneral()
     m[15]=  invDeterminant * cofactor15;
 
     return *this;
+#endif
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// transform count vectors: out[i] = M * in[i]
+///////////////////////////////////////////////////////////////////////////////
+void Matrix4::transform(const Vector4* in, Vector4* out, size_t count) const
+{
+    size_t i = 0;
+
+#if defined(MATRICES_AVX)
+    // two vectors per register, each half broadcasting its own x, y, z and w
+    const __m256 c0 = _mm256_broadcast_ps((const __m128*)m);
+    const __m256 c1 = _mm256_broadcast_ps((const __m128*)(m + 4));
+    const __m256 c2 = _mm256_broadcast_ps((const __m128*)(m + 8));
+    const __m256 c3 = _mm256_broadcast_ps((const __m128*)(m + 12));
+    for(; i + 2 <= count; i += 2)
+    {
+        const __m256 v = _mm256_loadu_ps(&in[i].x);
+        const __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c0, _mm256_permute_ps(v, 0x00)), _mm256_mul_ps(c1, _mm256_permute_ps(v, 0x55))),
+                                       _mm256_add_ps(_mm256_mul_ps(c2, _mm256_permute_ps(v, 0xaa)), _mm256_mul_ps(c3, _mm256_permute_ps(v, 0xff))));
+        _mm256_storeu_ps(&out[i].x, r);
+    }
+#endif
+
+    for(; i < count; ++i)
+        out[i] = *this * in[i];
 }
 
 
@@ -579,3 +770,99 @@ Matrix4& Matrix4::rotateZ(float angle)
 
     return *this;
 }
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// inverse 3x4 affine matrix
+///////////////////////////////////////////////////////////////////////////////
+Matrix3x4& Matrix3x4::invert()
+{
+    // L^-1
+    Matrix3 l(m[0],m[4],m[8], m[1],m[5],m[9], m[2],m[6],m[10]);
+    l.invert();
+
+    // -L^-1 * T
+    float x = m[3];
+    float y = m[7];
+    float z = m[11];
+    set(l[0], l[3], l[6], -(l[0] * x + l[3] * y + l[6] * z),
+        l[1], l[4], l[7], -(l[1] * x + l[4] * y + l[7] * z),
+        l[2], l[5], l[8], -(l[2] * x + l[5] * y + l[8] * z));
+
+    return *this;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// inverse of a rotation and translation
+// The rotation is orthonormal so its inverse is its transpose:
+// | R^T | -R^T * T |
+///////////////////////////////////////////////////////////////////////////////
+Matrix3x4& Matrix3x4::invertRigid()
+{
+#if defined(MATRICES_SSE)
+    // -R^T * T is the rows of R weighted by T. Transposing the rows with their translation cleared, and that as the fourth
+    // row, gives the inverse's rows.
+    const __m128 xyzMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    __m128 r0 = _mm_loadu_ps(m), r1 = _mm_loadu_ps(m + 4), r2 = _mm_loadu_ps(m + 8);
+
+    __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, _mm_set1_ps(m[3])), _mm_mul_ps(r1, _mm_set1_ps(m[7]))),
+                          _mm_mul_ps(r2, _mm_set1_ps(m[11])));
+    t = _mm_sub_ps(_mm_setzero_ps(), _mm_and_ps(t, xyzMask));
+
+    r0 = _mm_and_ps(r0, xyzMask);
+    r1 = _mm_and_ps(r1, xyzMask);
+    r2 = _mm_and_ps(r2, xyzMask);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, t);
+
+    _mm_storeu_ps(m,     r0);
+    _mm_storeu_ps(m + 4, r1);
+    _mm_storeu_ps(m + 8, r2);
+#else
+    std::swap(m[1], m[4]);
+    std::swap(m[2], m[8]);
+    std::swap(m[6], m[9]);
+
+    float x = m[3];
+    float y = m[7];
+    float z = m[11];
+    m[3] = -(m[0] * x + m[1] * y + m[2] * z);
+    m[7] = -(m[4] * x + m[5] * y + m[6] * z);
+    m[11]= -(m[8] * x + m[9] * y + m[10]* z);
+#endif
+
+    return *this;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// transform count points: out[i] = M * (in[i], 1)
+///////////////////////////////////////////////////////////////////////////////
+void Matrix3x4::transformPoints(const Vector3* in, Vector3* out, size_t count) const
+{
+    size_t i = 0;
+
+#if defined(MATRICES_SSE)
+    // four points at a time, split into x, y and z registers
+    const __m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2 = _mm_set1_ps(m[2]),  m3 = _mm_set1_ps(m[3]);
+    const __m128 m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]), m6 = _mm_set1_ps(m[6]),  m7 = _mm_set1_ps(m[7]);
+    const __m128 m8 = _mm_set1_ps(m[8]), m9 = _mm_set1_ps(m[9]), m10= _mm_set1_ps(m[10]), m11= _mm_set1_ps(m[11]);
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128 x, y, z;
+        loadPoints4SSE(&in[i].x, x, y, z);
+
+        const __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m1, y)), _mm_add_ps(_mm_mul_ps(m2,  z), m3));
+        const __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m4, x), _mm_mul_ps(m5, y)), _mm_add_ps(_mm_mul_ps(m6,  z), m7));
+        const __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m8, x), _mm_mul_ps(m9, y)), _mm_add_ps(_mm_mul_ps(m10, z), m11));
+
+        storePoints4SSE(rx, ry, rz, &out[i].x);
+    }
+#endif
+
+    for(; i < count; ++i)
+        out[i] = transformPoint(in[i]);
+}
@@ -19,10 +19,22 @@
 #ifndef MATH_MATRICES_H
 #define MATH_MATRICES_H
 
+#include <cstddef>
 #include <iostream>
 #include <iomanip>
 #include "Vectors.h"
 
+// Matrix4 products, inverses and the batch transforms use SSE wherever SSE2 is available (always on x64), and the
+// Matrix4 batch transform uses AVX when it is enabled. Define MATRICES_SIMD_DISABLE to get the plain C++ versions.
+#if !defined(MATRICES_SIMD_DISABLE) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MATRICES_SSE 1
+#include <emmintrin.h>
+#if defined(__AVX__)
+#define MATRICES_AVX 1
+#include <immintrin.h>
+#endif
+#endif
+
 ///////////////////////////////////////////////////////////////////////////
 // 2x2 matrix
 ///////////////////////////////////////////////////////////////////////////
@@ -194,6 +206,9 @@ public:
     float       operator[](int index) const;            // subscript operator v[0], v[1]
     float&      operator[](int index);                  // subscript operator v[0], v[1]
 
+    // batch: out[i] = M * in[i] for count vectors, in and out may be the same array
+    void        transform(const Vector4* in, Vector4* out, size_t count) const;
+
     friend Matrix4 operator-(const Matrix4& m);                     // unary operator (-)
     friend Matrix4 operator*(float scalar, const Matrix4& m);       // pre-multiplication
     friend Vector3 operator*(const Vector3& vec, const Matrix4& m); // pre-multiplication
@@ -214,6 +229,63 @@ private:
 
 
 
+///////////////////////////////////////////////////////////////////////////
+// 3x4 affine matrix: the top 3 rows of a 4x4 matrix whose last row is
+// (0,0,0,1), i.e. a 3x3 linear part and a translation.
+// Unlike the others it is stored in row major order, the same as
+// vr::HmdMatrix34_t, so a tracked pose can be copied straight in:
+// |  0  1  2  3 |
+// |  4  5  6  7 |
+// |  8  9 10 11 |
+///////////////////////////////////////////////////////////////////////////
+class Matrix3x4
+{
+public:
+    // constructors
+    Matrix3x4();  // init with identity
+    Matrix3x4(const float src[12]);
+    Matrix3x4(float m00, float m01, float m02, float m03, // 1st row
+              float m04, float m05, float m06, float m07, // 2nd row
+              float m08, float m09, float m10, float m11);// 3rd row
+    explicit Matrix3x4(const Matrix4& m);               // drops the last row of m
+
+    void        set(const float src[12]);
+    void        set(float m00, float m01, float m02, float m03, // 1st row
+                    float m04, float m05, float m06, float m07, // 2nd row
+                    float m08, float m09, float m10, float m11);// 3rd row
+
+    const float* get() const;
+    Vector3     getTranslation() const;
+    Matrix4     toMatrix4() const;
+
+    Matrix3x4&  identity();
+    Matrix3x4&  invert();                               // inverse of any affine matrix, identity 3x3 part if singular
+    Matrix3x4&  invertRigid();                          // inverse of rotation + translation only: R^T, -R^T * t
+
+    Vector3     transformPoint(const Vector3& v) const; // v' = M * (v, 1)
+    Vector3     transformVector(const Vector3& v) const;// v' = M * (v, 0), no translation
+
+    // batch: out[i] = M * (in[i], 1) for count points, in and out may be the same array
+    void        transformPoints(const Vector3* in, Vector3* out, size_t count) const;
+
+    // operators
+    Vector4     operator*(const Vector4& rhs) const;    // multiplication: v' = M * v, w is kept
+    Matrix3x4   operator*(const Matrix3x4& rhs) const;  // multiplication: M3 = M1 * M2
+    Matrix3x4&  operator*=(const Matrix3x4& rhs);       // multiplication: M1' = M1 * M2
+    bool        operator==(const Matrix3x4& rhs) const; // exact compare, no epsilon
+    bool        operator!=(const Matrix3x4& rhs) const; // exact compare, no epsilon
+    float       operator[](int index) const;            // subscript operator v[0], v[1]
+    float&      operator[](int index);                  // subscript operator v[0], v[1]
+
+    friend std::ostream& operator<<(std::ostream& os, const Matrix3x4& m);
+
+private:
+    float m[12];
+
+};
+
+
+
 ///////////////////////////////////////////////////////////////////////////
 // inline functions for Matrix2
 ///////////////////////////////////////////////////////////////////////////
@@ -796,12 +868,36 @@ inline Matrix4& Matrix4::operator-=(const Matrix4& rhs)
 
 
 
+#if defined(MATRICES_SSE)
+// column major 4x4 matrix times (x, y, z, w): the columns scaled and summed
+inline __m128 matrix4TransformSSE(const float* m, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m), x),     _mm_mul_ps(_mm_loadu_ps(m + 4), y)),
+                      _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m + 8), z), _mm_mul_ps(_mm_loadu_ps(m + 12), w)));
+}
+
+
+
+inline __m128 matrix4TransformSSE(const float* m, const float* v)
+{
+    return matrix4TransformSSE(m, _mm_set1_ps(v[0]), _mm_set1_ps(v[1]), _mm_set1_ps(v[2]), _mm_set1_ps(v[3]));
+}
+#endif
+
+
+
 inline Vector4 Matrix4::operator*(const Vector4& rhs) const
 {
+#if defined(MATRICES_SSE)
+    Vector4 result;
+    _mm_storeu_ps(&result.x, matrix4TransformSSE(m, &rhs.x));
+    return result;
+#else
     return Vector4(m[0]*rhs.x + m[4]*rhs.y + m[8]*rhs.z  + m[12]*rhs.w,
                    m[1]*rhs.x + m[5]*rhs.y + m[9]*rhs.z  + m[13]*rhs.w,
                    m[2]*rhs.x + m[6]*rhs.y + m[10]*rhs.z + m[14]*rhs.w,
                    m[3]*rhs.x + m[7]*rhs.y + m[11]*rhs.z + m[15]*rhs.w);
+#endif
 }
 
 
@@ -817,10 +913,20 @@ inline Vector3 Matrix4::operator*(const Vector3& rhs) const
 
 inline Matrix4 Matrix4::operator*(const Matrix4& n) const
 {
+#if defined(MATRICES_SSE)
+    // each column of the product is M times that column of n
+    Matrix4 result;
+    _mm_storeu_ps(result.m,      matrix4TransformSSE(m, n.m));
+    _mm_storeu_ps(result.m + 4,  matrix4TransformSSE(m, n.m + 4));
+    _mm_storeu_ps(result.m + 8,  matrix4TransformSSE(m, n.m + 8));
+    _mm_storeu_ps(result.m + 12, matrix4TransformSSE(m, n.m + 12));
+    return result;
+#else
     return Matrix4(m[0]*n[0]  + m[4]*n[1]  + m[8]*n[2]  + m[12]*n[3],   m[1]*n[0]  + m[5]*n[1]  + m[9]*n[2]  + m[13]*n[3],   m[2]*n[0]  + m[6]*n[1]  + m[10]*n[2]  + m[14]*n[3],   m[3]*n[0]  + m[7]*n[1]  + m[11]*n[2]  + m[15]*n[3],
                    m[0]*n[4]  + m[4]*n[5]  + m[8]*n[6]  + m[12]*n[7],   m[1]*n[4]  + m[5]*n[5]  + m[9]*n[6]  + m[13]*n[7],   m[2]*n[4]  + m[6]*n[5]  + m[10]*n[6]  + m[14]*n[7],   m[3]*n[4]  + m[7]*n[5]  + m[11]*n[6]  + m[15]*n[7],
                    m[0]*n[8]  + m[4]*n[9]  + m[8]*n[10] + m[12]*n[11],  m[1]*n[8]  + m[5]*n[9]  + m[9]*n[10] + m[13]*n[11],  m[2]*n[8]  + m[6]*n[9]  + m[10]*n[10] + m[14]*n[11],  m[3]*n[8]  + m[7]*n[9]  + m[11]*n[10] + m[15]*n[11],
                    m[0]*n[12] + m[4]*n[13] + m[8]*n[14] + m[12]*n[15],  m[1]*n[12] + m[5]*n[13] + m[9]*n[14] + m[13]*n[15],  m[2]*n[12] + m[6]*n[13] + m[10]*n[14] + m[14]*n[15],  m[3]*n[12] + m[7]*n[13] + m[11]*n[14] + m[15]*n[15]);
+#endif
 }
 
 
@@ -906,4 +1012,199 @@ inline std::ostream& operator<<(std::ostream& os, const Matrix4& m)
     return os;
 }
 // END OF MATRIX4 INLINE //////////////////////////////////////////////////////
+
+
+
+
+
+///////////////////////////////////////////////////////////////////////////
+// inline functions for Matrix3x4
+///////////////////////////////////////////////////////////////////////////
+inline Matrix3x4::Matrix3x4()
+{
+    // initially identity matrix
+    identity();
+}
+
+
+
+inline Matrix3x4::Matrix3x4(const float src[12])
+{
+    set(src);
+}
+
+
+
+inline Matrix3x4::Matrix3x4(float m00, float m01, float m02, float m03,
+                            float m04, float m05, float m06, float m07,
+                            float m08, float m09, float m10, float m11)
+{
+    set(m00, m01, m02, m03,  m04, m05, m06, m07,  m08, m09, m10, m11);
+}
+
+
+
+inline Matrix3x4::Matrix3x4(const Matrix4& n)
+{
+    set(n[0], n[4], n[8],  n[12],
+        n[1], n[5], n[9],  n[13],
+        n[2], n[6], n[10], n[14]);
+}
+
+
+
+inline void Matrix3x4::set(const float src[12])
+{
+    m[0] = src[0];  m[1] = src[1];  m[2] = src[2];  m[3] = src[3];
+    m[4] = src[4];  m[5] = src[5];  m[6] = src[6];  m[7] = src[7];
+    m[8] = src[8];  m[9] = src[9];  m[10]= src[10]; m[11]= src[11];
+}
+
+
+
+inline void Matrix3x4::set(float m00, float m01, float m02, float m03,
+                           float m04, float m05, float m06, float m07,
+                           float m08, float m09, float m10, float m11)
+{
+    m[0] = m00;  m[1] = m01;  m[2] = m02;  m[3] = m03;
+    m[4] = m04;  m[5] = m05;  m[6] = m06;  m[7] = m07;
+    m[8] = m08;  m[9] = m09;  m[10]= m10;  m[11]= m11;
+}
+
+
+
+inline const float* Matrix3x4::get() const
+{
+    return m;
+}
+
+
+
+inline Vector3 Matrix3x4::getTranslation() const
+{
+    return Vector3(m[3], m[7], m[11]);
+}
+
+
+
+inline Matrix4 Matrix3x4::toMatrix4() const
+{
+    return Matrix4(m[0], m[4], m[8],  0,
+                   m[1], m[5], m[9],  0,
+                   m[2], m[6], m[10], 0,
+                   m[3], m[7], m[11], 1);
+}
+
+
+
+inline Matrix3x4& Matrix3x4::identity()
+{
+    m[0] = m[5] = m[10] = 1.0f;
+    m[1] = m[2] = m[3] = m[4] = m[6] = m[7] = m[8] = m[9] = m[11] = 0.0f;
+    return *this;
+}
+
+
+
+inline Vector3 Matrix3x4::transformPoint(const Vector3& v) const
+{
+    return Vector3(m[0]*v.x + m[1]*v.y + m[2]*v.z  + m[3],
+                   m[4]*v.x + m[5]*v.y + m[6]*v.z  + m[7],
+                   m[8]*v.x + m[9]*v.y + m[10]*v.z + m[11]);
+}
+
+
+
+inline Vector3 Matrix3x4::transformVector(const Vector3& v) const
+{
+    return Vector3(m[0]*v.x + m[1]*v.y + m[2]*v.z,
+                   m[4]*v.x + m[5]*v.y + m[6]*v.z,
+                   m[8]*v.x + m[9]*v.y + m[10]*v.z);
+}
+
+
+
+inline Vector4 Matrix3x4::operator*(const Vector4& rhs) const
+{
+    return Vector4(m[0]*rhs.x + m[1]*rhs.y + m[2]*rhs.z  + m[3]*rhs.w,
+                   m[4]*rhs.x + m[5]*rhs.y + m[6]*rhs.z  + m[7]*rhs.w,
+                   m[8]*rhs.x + m[9]*rhs.y + m[10]*rhs.z + m[11]*rhs.w,
+                   rhs.w);
+}
+
+
+
+inline Matrix3x4 Matrix3x4::operator*(const Matrix3x4& n) const
+{
+#if defined(MATRICES_SSE)
+    // row i of the product is the rows of n weighted by row i of M, plus M's own translation
+    const __m128 translationMask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+    const __m128 n0 = _mm_loadu_ps(n.m), n1 = _mm_loadu_ps(n.m + 4), n2 = _mm_loadu_ps(n.m + 8);
+
+    Matrix3x4 result;
+    for(int row = 0; row < 3; ++row)
+    {
+        const float* r = m + row * 4;
+        const __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[0]), n0), _mm_mul_ps(_mm_set1_ps(r[1]), n1)),
+                                      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[2]), n2), _mm_and_ps(_mm_loadu_ps(r), translationMask)));
+        _mm_storeu_ps(result.m + row * 4, sum);
+    }
+    return result;
+#else
+    return Matrix3x4(m[0]*n[0] + m[1]*n[4] + m[2]*n[8],   m[0]*n[1] + m[1]*n[5] + m[2]*n[9],   m[0]*n[2] + m[1]*n[6] + m[2]*n[10],   m[0]*n[3] + m[1]*n[7] + m[2]*n[11] + m[3],
+                     m[4]*n[0] + m[5]*n[4] + m[6]*n[8],   m[4]*n[1] + m[5]*n[5] + m[6]*n[9],   m[4]*n[2] + m[5]*n[6] + m[6]*n[10],   m[4]*n[3] + m[5]*n[7] + m[6]*n[11] + m[7],
+                     m[8]*n[0] + m[9]*n[4] + m[10]*n[8],  m[8]*n[1] + m[9]*n[5] + m[10]*n[9],  m[8]*n[2] + m[9]*n[6] + m[10]*n[10],  m[8]*n[3] + m[9]*n[7] + m[10]*n[11] + m[11]);
+#endif
+}
+
+
+
+inline Matrix3x4& Matrix3x4::operator*=(const Matrix3x4& rhs)
+{
+    *this = *this * rhs;
+    return *this;
+}
+
+
+
+inline bool Matrix3x4::operator==(const Matrix3x4& n) const
+{
+    return (m[0] == n[0])  && (m[1] == n[1])  && (m[2] == n[2])  && (m[3] == n[3])  &&
+           (m[4] == n[4])  && (m[5] == n[5])  && (m[6] == n[6])  && (m[7] == n[7])  &&
+           (m[8] == n[8])  && (m[9] == n[9])  && (m[10]== n[10]) && (m[11]== n[11]);
+}
+
+
+
+inline bool Matrix3x4::operator!=(const Matrix3x4& n) const
+{
+    return !(*this == n);
+}
+
+
+
+inline float Matrix3x4::operator[](int index) const
+{
+    return m[index];
+}
+
+
+
+inline float& Matrix3x4::operator[](int index)
+{
+    return m[index];
+}
+
+
+
+inline std::ostream& operator<<(std::ostream& os, const Matrix3x4& m)
+{
+    os << std::fixed << std::setprecision(5);
+    os << "[" << std::setw(10) << m[0] << " " << std::setw(10) << m[1] << " " << std::setw(10) << m[2]  <<  " " << std::setw(10) << m[3]  << "]\n"
+       << "[" << std::setw(10) << m[4] << " " << std::setw(10) << m[5] << " " << std::setw(10) << m[6]  <<  " " << std::setw(10) << m[7]  << "]\n"
+       << "[" << std::setw(10) << m[8] << " " << std::setw(10) << m[9] << " " << std::setw(10) << m[10] <<  " " << std::setw(10) << m[11] << "]\n";
+    os << std::resetiosflags(std::ios_base::fixed | std::ios_base::floatfield);
+    return os;
+}
+// END OF MATRIX3x4 INLINE ////////////////////////////////////////////////////
 #endif